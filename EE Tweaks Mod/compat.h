@@ -0,0 +1,50 @@
+#ifndef COMPAT_H
+#define COMPAT_H
+
+// Minimal stand-ins for the Windows types and calls used by the portable
+// modules (memory, patches, config, logging), so they can be built on POSIX
+// for the offline tools in tools/. Never included in the Windows build.
+
+#ifndef _WIN32
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+#define WINAPI // Default calling convention; mocks in tools/ use it too
+
+typedef uint32_t DWORD;
+typedef int32_t HRESULT;
+typedef int BOOL;
+typedef void* HANDLE;
+typedef void* HMODULE;
+typedef void* LPVOID;
+typedef size_t SIZE_T;
+typedef int errno_t;
+
+struct MODULEINFO {
+    LPVOID lpBaseOfDll;
+    DWORD SizeOfImage;
+    LPVOID EntryPoint;
+};
+
+inline void OutputDebugStringA(const char* message) {
+    fputs(message, stderr);
+}
+
+const HRESULT S_OK = 0;
+#define SUCCEEDED(result) (static_cast<HRESULT>(result) >= 0)
+#define FAILED(result) (static_cast<HRESULT>(result) < 0)
+
+inline DWORD GetLastError() {
+    return static_cast<DWORD>(errno);
+}
+
+inline errno_t localtime_s(std::tm* result, const std::time_t* time) {
+    return localtime_r(time, result) ? 0 : errno;
+}
+#endif
+
+#endif // COMPAT_H
@@ -121,51 +121,152 @@ void CreateDefaultConfig(const std::string& configPath) {
         "512x512).\n";
     configFile << "; Default game value is 220.\n";
     configFile << "; 4GB Patch is recommended for big maps.\n";
-    configFile << "GiganticMapSize=512\n";
+    configFile << "GiganticMapSize=512\n\n";
+    configFile << "; Estimate the memory the map sizes above need and warn in "
+        "the log if\n";
+    configFile << "; they will not fit in the game's address space.\n";
+    configFile << "MapMemoryPlannerEnabled=true\n";
+    configFile << "; Lower sizes that will not fit instead of only warning.\n";
+    configFile << "MapMemoryPlannerClamp=false\n";
+    configFile << "; Record the address space each session takes in "
+        "tweaks_mapplan.csv to\n";
+    configFile << "; improve the estimates.\n";
+    configFile << "MapMemoryPlannerCalibrate=false\n\n";
+
+    configFile << "; --- Terrain Chunks ---\n";
+    configFile << "; Big maps need coarser terrain chunks. Maps above 220 use the "
+        "long-tested\n";
+    configFile << "; setting 31. With ChunkDimensionIntermediate=true the chunk size "
+        "is picked\n";
+    configFile << "; from the largest map size above so chunks are at most "
+        "ChunkDimensionTargetTiles\n";
+    configFile << "; tiles wide, which uses the less tested setting 15 for sizes up "
+        "to 448.\n";
+    configFile << "ChunkDimensionIntermediate=false\n";
+    configFile << "ChunkDimensionTargetTiles=28\n";
+    configFile << "; Try a different chunk setting each launch and record the "
+        "frame times\n";
+    configFile << "; in tweaks_chunkbench.csv. The log compares the settings.\n";
+    configFile << "ChunkDimensionBenchmark=false\n\n";
+
+    configFile << "; --- Experimental Performance Features ---\n";
+    configFile << "; Redirect the game's built-in memcpy/memset/strlen/memcmp to "
+        "SSE2 versions.\n";
+    configFile << "CrtSimdEnabled=false\n";
+    configFile << "; Log a speed comparison of the original and SSE2 routines "
+        "at startup.\n";
+    configFile << "CrtSimdBenchmark=false\n";
+    configFile << "; Sample the main thread's call stack every few milliseconds "
+        "and write\n";
+    configFile << "; tweaks_profile.folded on exit (input for flame graph "
+        "tools).\n";
+    configFile << "SamplingProfilerEnabled=false\n";
+    configFile << "SamplingProfilerIntervalMs=5\n";
+    configFile << "; Count lock acquisitions, contention and wait time per lock "
+        "and call site\n";
+    configFile << "; in the listed modules and write tweaks_locks.txt on exit.\n";
+    configFile << "LockProfilerEnabled=false\n";
+    configFile << "LockProfilerModules=GAME_EXECUTABLE,Miles Sound System "
+        "Mixer.dll\n";
+    configFile << "; Sample heap allocations in the listed modules (one sample "
+        "per SampleKB\n";
+    configFile << "; allocated bytes) and write live and peak bytes per call "
+        "site to\n";
+    configFile << "; tweaks_heap_NNN.csv every SnapshotSeconds and on exit. "
+        "StackDepth 2-4\n";
+    configFile << "; also records the callers' callers, to see past allocation "
+        "wrappers.\n";
+    configFile << "HeapProfilerEnabled=false\n";
+    configFile << "HeapProfilerModules=GAME_EXECUTABLE\n";
+    configFile << "HeapProfilerCrtModules=MSVCRT.dll\n";
+    configFile << "HeapProfilerSampleKB=256\n";
+    configFile << "HeapProfilerStackDepth=2\n";
+    configFile << "HeapProfilerSnapshotSeconds=300\n";
+    configFile << "; Record each thread's CPU use every IntervalMs in "
+        "tweaks_threads.csv and log\n";
+    configFile << "; the busiest threads on exit.\n";
+    configFile << "ThreadMonitorEnabled=false\n";
+    configFile << "ThreadMonitorIntervalMs=1000\n";
+    configFile << "; Touch the pages of large allocations (map grids) on a "
+        "background thread\n";
+    configFile << "; before the game does, and log the page faults and time of "
+        "each map\n";
+    configFile << "; generation. MeasureOnly logs without touching, for "
+        "comparison.\n";
+    configFile << "MapPrefaultEnabled=false\n";
+    configFile << "MapPrefaultThresholdKB=4096\n";
+    configFile << "MapPrefaultLargePages=false\n";
+    configFile << "MapPrefaultMeasureOnly=false\n";
+    configFile << "; Serve reads of the game's data archives from memory-mapped "
+        "views instead\n";
+    configFile << "; of one ReadFile call each (comma-separated extensions).\n";
+    configFile << "ArchiveReadCacheEnabled=false\n";
+    configFile << "ArchiveReadCacheExtensions=.ssa\n";
+    configFile << "ArchiveReadCacheViewSizeMB=2\n";
+    configFile << "; Record which game files are read during the first seconds "
+        "of a launch and\n";
+    configFile << "; read them ahead in the background on the next launch.\n";
+    configFile << "StartupPrefetchEnabled=false\n";
+    configFile << "StartupPrefetchSeconds=30\n";
+    configFile << "; Collect the many small writes of saved and recorded games "
+        "into large ones\n";
+    configFile << "; (files whose path contains one of the comma-separated "
+        "fragments).\n";
+    configFile << "WriteCoalescingEnabled=false\n";
+    configFile << "WriteCoalescingPaths=saved games\n";
+    configFile << "; Store new saved games LZ4-compressed. Saves written this way "
+        "need the mod\n";
+    configFile << "; with this option on to load; plain saves still load.\n";
+    configFile << "SaveCompressionEnabled=false\n";
+    configFile << "SaveCompressionPaths=saved games\n";
+    configFile << "; Diagnostic: save the game modules the patches search "
+        "(tweaks_dump_*.eemd)\n";
+    configFile << "; so scan failures can be reproduced offline.\n";
+    configFile << "ModuleDumpEnabled=false\n";
+    configFile << "; Publish live counters (patch status, timings, cache hits) "
+        "in shared memory\n";
+    configFile << "; for tools/counterreader.cpp.\n";
+    configFile << "SharedCountersEnabled=false\n";
+    configFile << "HighResolutionTimersEnabled=false\n";
+    configFile << "D3DStateFilterEnabled=false\n";
+    configFile << "ManagedVertexBuffersEnabled=false\n";
+    configFile << "TextureDedupEnabled=false\n";
+    configFile << "; Merge runs of small draws with the same state into one draw "
+        "call. Works\n";
+    configFile << "; best together with D3DStateFilterEnabled.\n";
+    configFile << "DrawBatchingEnabled=false\n";
+    configFile << "; Do plain blits between system-memory surfaces with SSE2.\n";
+    configFile << "SoftwareBlitEnabled=false\n";
+    configFile << "JobSchedulerEnabled=false\n";
+    configFile << "; Slow the main loop down while the game is in the background "
+        "or minimized.\n";
+    configFile << "PowerModeEnabled=false\n";
+    configFile << "; Also slow it down during a multiplayer session.\n";
+    configFile << "PowerModeInMultiplayer=false\n";
+    configFile << "; Experiment mode: each launch applies the next "
+        "ExperimentVariantN (Key=Value\n";
+    configFile << "; pairs separated by ';', empty for the baseline) and records "
+        "frame times\n";
+    configFile << "; in tweaks_experiment.csv. Compare with "
+        "tools/experimentreport.cpp.\n";
+    configFile << "ExperimentEnabled=false\n";
+    configFile << "ExperimentVariant1=\n";
+    configFile << "ExperimentVariant2=SetSleepToZeroEnabled=false\n";
 
     configFile.close();
     OutputDebugStringA(
         ("tweaks.dll: Default configuration file created successfully.\n"));
 }
 
-// Load configuration from tweaks.config
-void LoadConfig() {
-    std::string configPath = g_dllDir + "\\" + CONFIG_FILE;
+// Parse key=value lines from a config file into g_config. Returns false if
+// the file cannot be opened (g_config is then left empty).
+bool ReadConfigFile(const std::string& configPath) {
+    g_config.clear(); // Clear previous config
     std::ifstream configFile(configPath);
-
-    std::error_code ec;
-    if (!std::filesystem::exists(configPath, ec) || ec) {
-        if (ec) {
-            OutputDebugStringA(
-                ("tweaks.dll: Warning: Filesystem error checking config "
-                    "existence: " +
-                    ec.message() + "\n")
-                .c_str());
-        }
-        OutputDebugStringA(
-            ("tweaks.dll: Warning: " + std::string(CONFIG_FILE) +
-                " not found in DLL directory (" + g_dllDir + ").\n")
-            .c_str());
-        configFile.close();
-        CreateDefaultConfig(configPath);
-        configFile.open(configPath); // Try opening again
-    }
-
-    OutputDebugStringA(
-        ("tweaks.dll: Loading configuration from " + configPath + "...\n")
-        .c_str());
-
     if (!configFile.is_open()) {
-        OutputDebugStringA(
-            ("tweaks.dll: Error: Could not open " + configPath +
-                ". Using default settings.\n")
-            .c_str());
-        g_config.clear();
-        // Keep g_loggingEnabled = true (default) if config fails to load
-        return;
+        return false;
     }
 
-    g_config.clear(); // Clear previous config
     std::string line;
     int lineNumber = 0;
     while (getline(configFile, line)) {
@@ -199,6 +300,41 @@ void LoadConfig() {
     }
 
     configFile.close();
+    return true;
+}
+
+// Load configuration from tweaks.config
+void LoadConfig() {
+    std::string configPath = g_dllDir + "\\" + CONFIG_FILE;
+
+    std::error_code ec;
+    if (!std::filesystem::exists(configPath, ec) || ec) {
+        if (ec) {
+            OutputDebugStringA(
+                ("tweaks.dll: Warning: Filesystem error checking config "
+                    "existence: " +
+                    ec.message() + "\n")
+                .c_str());
+        }
+        OutputDebugStringA(
+            ("tweaks.dll: Warning: " + std::string(CONFIG_FILE) +
+                " not found in DLL directory (" + g_dllDir + ").\n")
+            .c_str());
+        CreateDefaultConfig(configPath);
+    }
+
+    OutputDebugStringA(
+        ("tweaks.dll: Loading configuration from " + configPath + "...\n")
+        .c_str());
+
+    if (!ReadConfigFile(configPath)) {
+        OutputDebugStringA(
+            ("tweaks.dll: Error: Could not open " + configPath +
+                ". Using default settings.\n")
+            .c_str());
+        // Keep g_loggingEnabled = true (default) if config fails to load
+        return;
+    }
 
     // Read Logging Enable Flag *after* parsing the whole file
     g_loggingEnabled = GetConfigBool("EnableLogging", true);
@@ -13,6 +13,7 @@ std::string GetConfigString(const std::string& key,
     const std::string& defaultValue = "");
 int GetConfigInt(const std::string& key, int defaultValue = 0); // Helper for ints
 void CreateDefaultConfig(const std::string& configPath);
+bool ReadConfigFile(const std::string& configPath);
 void LoadConfig();
 bool ParseIntList(const std::string& str, std::vector<int>& result);
 
@@ -0,0 +1,260 @@
+#include "pch.h"
+#include "counters.h"
+
+#ifndef COUNTERS_READER
+#include "logging.h" // Access Log()
+#include "config.h"  // Access config functions
+#endif
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// --- Counter Names ---
+
+static const char* const COUNTER_NAMES[COUNTER_COUNT] = {
+    "pipeline_us",
+    "scan_us",
+    "patches_applied",
+    "frames",
+    "frame_last_us",
+    "frame_max_us",
+    "frame_total_us",
+    "allocations",
+    "allocated_bytes",
+    "frees",
+    "io_reads_served",
+    "io_bytes_served",
+    "io_reads_passed",
+    "io_bytes_passed",
+    "prefetch_bytes",
+    "prefetch_reads",
+    "prefetch_hits",
+    "profiler_samples",
+    "d3d_calls_filtered",
+    "d3d_calls_forwarded",
+    "d3d_frame_filtered",
+    "d3d_frame_forwarded",
+    "vb_ring_wraps",
+    "vb_ring_stalls",
+    "vb_ring_bytes",
+    "texture_dedup_saved_bytes",
+    "texture_dedup_unique",
+    "frame_work_us",
+    "jobs_executed",
+    "jobs_stolen",
+    "jobs_spilled",
+    "writes_buffered",
+    "write_calls",
+    "write_calls_avoided",
+    "save_bytes",
+    "save_stored_bytes",
+    "d3d_draws_in",
+    "d3d_draws_out",
+    "d3d_frame_draws_in",
+    "d3d_frame_draws_out",
+    "software_blits",
+    "software_blit_bytes",
+    "main_thread_cpu_percent",
+    "process_cpu_percent",
+    "prefaulted_pages",
+    "map_generation_ms",
+};
+
+const char* GetCounterName(size_t id) {
+    return id < COUNTER_COUNT ? COUNTER_NAMES[id] : nullptr;
+}
+
+const char* GetPatchStateName(uint32_t state) {
+    switch (state) {
+    case PATCH_STATE_DISABLED: return "disabled";
+    case PATCH_STATE_NOT_FOUND: return "not found";
+    case PATCH_STATE_APPLIED: return "applied";
+    case PATCH_STATE_NOT_APPLIED: return "not applied";
+    default: return "unknown";
+    }
+}
+
+// --- Shared Mapping ---
+
+std::string SharedCounterMapping::NameFor(uint32_t processId) {
+#ifdef _WIN32
+    return "Local\\EETweaksCounters-" + std::to_string(processId);
+#else
+    return "/EETweaksCounters-" + std::to_string(processId);
+#endif
+}
+
+bool SharedCounterMapping::Create(uint32_t processId) {
+    Close();
+    std::string name = NameFor(processId);
+#ifdef _WIN32
+    m_mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0,
+        sizeof(SharedCounterBlock), name.c_str());
+    if (m_mapping == NULL) {
+        return false;
+    }
+    m_block = static_cast<SharedCounterBlock*>(MapViewOfFile(m_mapping,
+        FILE_MAP_ALL_ACCESS, 0, 0, sizeof(SharedCounterBlock)));
+#else
+    m_fd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0600);
+    if (m_fd < 0) {
+        return false;
+    }
+    if (ftruncate(m_fd, sizeof(SharedCounterBlock)) != 0) {
+        Close();
+        return false;
+    }
+    void* view = mmap(nullptr, sizeof(SharedCounterBlock),
+        PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    m_block = view == MAP_FAILED ? nullptr :
+        static_cast<SharedCounterBlock*>(view);
+#endif
+    if (m_block == nullptr) {
+        Close();
+        return false;
+    }
+    m_owner = true;
+    m_processId = processId;
+    memset(static_cast<void*>(m_block), 0, sizeof(SharedCounterBlock));
+    return true;
+}
+
+// Readers map the block writable too: 64-bit atomic loads on 32-bit x86 may
+// be implemented with cmpxchg8b, which faults on a read-only page
+bool SharedCounterMapping::Open(uint32_t processId) {
+    Close();
+    std::string name = NameFor(processId);
+#ifdef _WIN32
+    m_mapping = OpenFileMappingA(FILE_MAP_READ | FILE_MAP_WRITE, FALSE,
+        name.c_str());
+    if (m_mapping == NULL) {
+        return false;
+    }
+    m_block = static_cast<SharedCounterBlock*>(MapViewOfFile(m_mapping,
+        FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, sizeof(SharedCounterBlock)));
+#else
+    m_fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (m_fd < 0) {
+        return false;
+    }
+    void* view = mmap(nullptr, sizeof(SharedCounterBlock),
+        PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    m_block = view == MAP_FAILED ? nullptr :
+        static_cast<SharedCounterBlock*>(view);
+#endif
+    if (m_block == nullptr) {
+        Close();
+        return false;
+    }
+    m_processId = processId;
+    return true;
+}
+
+void SharedCounterMapping::Close() {
+#ifdef _WIN32
+    if (m_block != nullptr) UnmapViewOfFile(m_block);
+    if (m_mapping != NULL) CloseHandle(m_mapping);
+    m_mapping = NULL;
+#else
+    if (m_block != nullptr) munmap(m_block, sizeof(SharedCounterBlock));
+    if (m_fd >= 0) close(m_fd);
+    if (m_owner) shm_unlink(NameFor(m_processId).c_str());
+    m_fd = -1;
+#endif
+    m_block = nullptr;
+    m_owner = false;
+}
+
+// --- Mod Side ---
+
+#ifndef COUNTERS_READER
+static SharedCounterMapping g_counterMapping;
+static SharedCounterBlock* g_counterBlock = nullptr;
+
+// Create this process's counter block if enabled in config. It is never
+// unmapped: game threads may still be counting in the hooks while the
+// ExitProcess hook runs, so it goes away with the process. Readers see the
+// final values until then.
+bool InitializeSharedCounters() {
+    if (!GetConfigBool("SharedCountersEnabled", false)) {
+        return false;
+    }
+
+#ifdef _WIN32
+    uint32_t processId = GetCurrentProcessId();
+#else
+    uint32_t processId = static_cast<uint32_t>(getpid());
+#endif
+    if (!g_counterMapping.Create(processId)) {
+        Log("Error: Could not create shared counters " +
+            SharedCounterMapping::NameFor(processId) + ". Error code: " +
+            std::to_string(GetLastError()));
+        return false;
+    }
+
+    SharedCounterBlock* block = g_counterMapping.Block();
+    block->version = COUNTER_BLOCK_VERSION;
+    block->blockSize = sizeof(SharedCounterBlock);
+    block->counterCount = COUNTER_COUNT;
+    block->processId = processId;
+    block->startTime = static_cast<uint64_t>(std::time(nullptr));
+    block->magic.store(COUNTER_BLOCK_MAGIC, std::memory_order_release);
+    g_counterBlock = block;
+
+    Log("Shared counters published as " +
+        SharedCounterMapping::NameFor(processId) + ".");
+    return true;
+}
+
+void CounterAdd(CounterId id, uint64_t value) {
+    if (g_counterBlock != nullptr) {
+        g_counterBlock->counters[id].fetch_add(value, std::memory_order_relaxed);
+    }
+}
+
+void CounterSet(CounterId id, uint64_t value) {
+    if (g_counterBlock != nullptr) {
+        g_counterBlock->counters[id].store(value, std::memory_order_relaxed);
+    }
+}
+
+void CounterMax(CounterId id, uint64_t value) {
+    if (g_counterBlock == nullptr) {
+        return;
+    }
+    std::atomic<uint64_t>& counter = g_counterBlock->counters[id];
+    uint64_t current = counter.load(std::memory_order_relaxed);
+    while (value > current &&
+        !counter.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
+
+// Publish a patch's state. Only called from the patch pipeline (one thread).
+void SetPatchState(const std::string& patchName, PatchState state) {
+    if (g_counterBlock == nullptr) {
+        return;
+    }
+    uint32_t count = g_counterBlock->patchCount.load(std::memory_order_relaxed);
+    for (uint32_t i = 0; i < count; ++i) {
+        CounterPatchEntry& entry = g_counterBlock->patches[i];
+        if (patchName.compare(0, COUNTER_PATCH_NAME_SIZE - 1, entry.name) == 0) {
+            entry.state.store(state, std::memory_order_relaxed);
+            return;
+        }
+    }
+    if (count >= COUNTER_PATCH_SLOTS) {
+        return;
+    }
+
+    CounterPatchEntry& entry = g_counterBlock->patches[count];
+    size_t length = patchName.size();
+    if (length > COUNTER_PATCH_NAME_SIZE - 1) length = COUNTER_PATCH_NAME_SIZE - 1;
+    memcpy(entry.name, patchName.data(), length);
+    entry.name[length] = '\0';
+    entry.state.store(state, std::memory_order_relaxed);
+    // Readers see the name once the count includes it
+    g_counterBlock->patchCount.store(count + 1, std::memory_order_release);
+}
+#endif
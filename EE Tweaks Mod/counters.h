@@ -0,0 +1,135 @@
+#ifndef COUNTERS_H
+#define COUNTERS_H
+
+#include "pch.h"
+
+// Live counters published in a named shared-memory block so external tools
+// (tools/counterreader.cpp) can watch the mod while the game runs. The
+// layout is a fixed contract: append new counters at the end and bump
+// COUNTER_BLOCK_VERSION only for incompatible changes.
+
+const uint32_t COUNTER_BLOCK_MAGIC = 0x43544545; // "EETC"
+const uint32_t COUNTER_BLOCK_VERSION = 1;
+const size_t COUNTER_SLOTS = 64;
+const size_t COUNTER_PATCH_SLOTS = 32;
+const size_t COUNTER_PATCH_NAME_SIZE = 40;
+
+enum CounterId {
+    COUNTER_PIPELINE_US = 0,   // Time taken by the patch pipeline
+    COUNTER_SCAN_US,           // Time taken by the standard pattern scan
+    COUNTER_PATCHES_APPLIED,
+    COUNTER_FRAMES,            // Frame counters are filled by frame hooks
+    COUNTER_FRAME_LAST_US,
+    COUNTER_FRAME_MAX_US,
+    COUNTER_FRAME_TOTAL_US,
+    COUNTER_ALLOCATIONS,       // Allocation counters are filled by heap hooks
+    COUNTER_ALLOCATED_BYTES,
+    COUNTER_FREES,
+    COUNTER_IO_READS_SERVED,   // Archive read cache
+    COUNTER_IO_BYTES_SERVED,
+    COUNTER_IO_READS_PASSED,
+    COUNTER_IO_BYTES_PASSED,
+    COUNTER_PREFETCH_BYTES,    // Startup prefetch
+    COUNTER_PREFETCH_READS,
+    COUNTER_PREFETCH_HITS,
+    COUNTER_PROFILER_SAMPLES,
+    COUNTER_D3D_CALLS_FILTERED,  // Direct3D state filter
+    COUNTER_D3D_CALLS_FORWARDED,
+    COUNTER_D3D_FRAME_FILTERED,  // Counts of the last frame
+    COUNTER_D3D_FRAME_FORWARDED,
+    COUNTER_VB_RING_WRAPS,       // Managed vertex buffers
+    COUNTER_VB_RING_STALLS,
+    COUNTER_VB_RING_BYTES,
+    COUNTER_TEXTURE_DEDUP_SAVED_BYTES, // Texture dedup
+    COUNTER_TEXTURE_DEDUP_UNIQUE,
+    COUNTER_FRAME_WORK_US,       // Job scheduler; main thread time of the last frame
+    COUNTER_JOBS_EXECUTED,
+    COUNTER_JOBS_STOLEN,
+    COUNTER_JOBS_SPILLED,
+    COUNTER_WRITES_BUFFERED,     // Write coalescing
+    COUNTER_WRITE_CALLS,
+    COUNTER_WRITE_CALLS_AVOIDED,
+    COUNTER_SAVE_BYTES,          // Save compression; files written
+    COUNTER_SAVE_STORED_BYTES,
+    COUNTER_D3D_DRAWS_IN,        // Draw batching; calls from the game
+    COUNTER_D3D_DRAWS_OUT,       // Calls that reached the device
+    COUNTER_D3D_FRAME_DRAWS_IN,  // Counts of the last frame
+    COUNTER_D3D_FRAME_DRAWS_OUT,
+    COUNTER_SOFTWARE_BLITS,      // Blits done by the SSE2 kernels
+    COUNTER_SOFTWARE_BLIT_BYTES,
+    COUNTER_MAIN_THREAD_CPU_PERCENT, // Thread monitor; last interval
+    COUNTER_PROCESS_CPU_PERCENT,     // All threads; 100 = one core
+    COUNTER_PREFAULTED_PAGES,        // Map prefault; touched in the background
+    COUNTER_MAP_GENERATION_MS,       // Last map generation
+    COUNTER_COUNT
+};
+
+enum PatchState : uint32_t {
+    PATCH_STATE_UNKNOWN = 0,
+    PATCH_STATE_DISABLED,
+    PATCH_STATE_NOT_FOUND,
+    PATCH_STATE_APPLIED,
+    PATCH_STATE_NOT_APPLIED, // Skipped, not needed or failed; see the log
+};
+
+struct CounterPatchEntry {
+    char name[COUNTER_PATCH_NAME_SIZE]; // Zero-terminated
+    std::atomic<uint32_t> state;
+    uint32_t reserved;
+};
+
+struct SharedCounterBlock {
+    std::atomic<uint32_t> magic; // Stored last: the block is ready once set
+    uint32_t version;
+    uint32_t blockSize;
+    uint32_t counterCount;       // Slots in use, <= COUNTER_SLOTS
+    uint32_t processId;
+    std::atomic<uint32_t> patchCount;
+    uint64_t startTime;          // Unix time the block was created
+    uint8_t reserved[32];
+    std::atomic<uint64_t> counters[COUNTER_SLOTS];
+    CounterPatchEntry patches[COUNTER_PATCH_SLOTS];
+};
+
+static_assert(sizeof(std::atomic<uint64_t>) == 8 &&
+    sizeof(std::atomic<uint32_t>) == 4, "Counter atomics must be plain words");
+static_assert(sizeof(CounterPatchEntry) == 48, "Counter layout changed");
+static_assert(sizeof(SharedCounterBlock) == 64 + COUNTER_SLOTS * 8 +
+    COUNTER_PATCH_SLOTS * 48, "Counter layout changed");
+static_assert(COUNTER_COUNT <= COUNTER_SLOTS, "Too many counters");
+
+const char* GetCounterName(size_t id); // nullptr for ids this build does not know
+const char* GetPatchStateName(uint32_t state);
+
+// A mapping of the shared block of one process: the mod creates it, readers
+// open it
+class SharedCounterMapping {
+public:
+    ~SharedCounterMapping() { Close(); }
+    bool Create(uint32_t processId); // Zeroed, magic not yet set
+    bool Open(uint32_t processId);
+    void Close();
+    SharedCounterBlock* Block() const { return m_block; }
+    static std::string NameFor(uint32_t processId);
+
+private:
+    SharedCounterBlock* m_block = nullptr;
+    bool m_owner = false;
+    uint32_t m_processId = 0;
+#ifdef _WIN32
+    HANDLE m_mapping = NULL;
+#else
+    int m_fd = -1;
+#endif
+};
+
+// Function declarations (mod side; no-ops until InitializeSharedCounters)
+#ifndef COUNTERS_READER
+bool InitializeSharedCounters();
+void CounterAdd(CounterId id, uint64_t value);
+void CounterSet(CounterId id, uint64_t value);
+void CounterMax(CounterId id, uint64_t value);
+void SetPatchState(const std::string& patchName, PatchState state);
+#endif
+
+#endif // COUNTERS_H
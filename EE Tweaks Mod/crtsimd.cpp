@@ -0,0 +1,385 @@
+#include "pch.h"
+#include "globals.h" // Access g_executableName
+#include "logging.h" // Access Log()
+#include "config.h"  // Access config functions
+#include "memory.h"  // Access pattern scanning
+#include "patches.h" // Access GetModuleInfoByName
+#include "detour.h"
+#include "crtsimd.h"
+
+#include <emmintrin.h> // SSE2
+#ifdef _MSC_VER
+#include <intrin.h>    // _BitScanForward
+#endif
+
+// --- SSE2 CRT Replacements ---
+
+static inline unsigned int CountTrailingZeros(unsigned int mask) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return static_cast<unsigned int>(index);
+#else
+    return static_cast<unsigned int>(__builtin_ctz(mask));
+#endif
+}
+
+// The game's memcpy is the old overlap-safe assembly version (it shares its
+// body with memmove), so the replacement keeps memmove semantics.
+void* __cdecl SimdMemmove(void* dst, const void* src, size_t count) {
+    unsigned char* d = static_cast<unsigned char*>(dst);
+    const unsigned char* s = static_cast<const unsigned char*>(src);
+    if (d == s || count == 0) {
+        return dst;
+    }
+
+    if (d < s || d >= s + count) {
+        // Forward copy; every block is loaded before it is stored
+        while (count >= 64) {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 16));
+            __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 32));
+            __m128i e = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 48));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(d), a);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(d + 16), b);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(d + 32), c);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(d + 48), e);
+            d += 64;
+            s += 64;
+            count -= 64;
+        }
+        while (count >= 16) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(d),
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(s)));
+            d += 16;
+            s += 16;
+            count -= 16;
+        }
+        while (count--) {
+            *d++ = *s++;
+        }
+    }
+    else {
+        // Destination overlaps the end of the source: copy backwards
+        d += count;
+        s += count;
+        while (count >= 64) {
+            d -= 64;
+            s -= 64;
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 16));
+            __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 32));
+            __m128i e = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 48));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(d), a);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(d + 16), b);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(d + 32), c);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(d + 48), e);
+            count -= 64;
+        }
+        while (count >= 16) {
+            d -= 16;
+            s -= 16;
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(d),
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(s)));
+            count -= 16;
+        }
+        while (count--) {
+            *--d = *--s;
+        }
+    }
+    return dst;
+}
+
+void* __cdecl SimdMemset(void* dst, int value, size_t count) {
+    unsigned char* d = static_cast<unsigned char*>(dst);
+    unsigned char byteValue = static_cast<unsigned char>(value);
+
+    // Align the destination so the bulk uses aligned stores
+    while (count != 0 && (reinterpret_cast<uintptr_t>(d) & 15) != 0) {
+        *d++ = byteValue;
+        --count;
+    }
+    __m128i fill = _mm_set1_epi8(static_cast<char>(byteValue));
+    while (count >= 64) {
+        _mm_store_si128(reinterpret_cast<__m128i*>(d), fill);
+        _mm_store_si128(reinterpret_cast<__m128i*>(d + 16), fill);
+        _mm_store_si128(reinterpret_cast<__m128i*>(d + 32), fill);
+        _mm_store_si128(reinterpret_cast<__m128i*>(d + 48), fill);
+        d += 64;
+        count -= 64;
+    }
+    while (count >= 16) {
+        _mm_store_si128(reinterpret_cast<__m128i*>(d), fill);
+        d += 16;
+        count -= 16;
+    }
+    while (count--) {
+        *d++ = byteValue;
+    }
+    return dst;
+}
+
+// Only aligned 16-byte loads are used, which never cross a page boundary,
+// so reading a little before or past the string is safe.
+size_t __cdecl SimdStrlen(const char* str) {
+    const __m128i zero = _mm_setzero_si128();
+    uintptr_t misalignment = reinterpret_cast<uintptr_t>(str) & 15;
+    const __m128i* block = reinterpret_cast<const __m128i*>(str - misalignment);
+
+    unsigned int mask = static_cast<unsigned int>(
+        _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128(block), zero)));
+    mask >>= misalignment; // Ignore bytes before the string
+    if (mask != 0) {
+        return CountTrailingZeros(mask);
+    }
+
+    for (;;) {
+        ++block;
+        mask = static_cast<unsigned int>(
+            _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128(block), zero)));
+        if (mask != 0) {
+            return static_cast<size_t>(
+                reinterpret_cast<const char*>(block) - str) +
+                CountTrailingZeros(mask);
+        }
+    }
+}
+
+int __cdecl SimdMemcmp(const void* buf1, const void* buf2, size_t count) {
+    const unsigned char* a = static_cast<const unsigned char*>(buf1);
+    const unsigned char* b = static_cast<const unsigned char*>(buf2);
+
+    while (count >= 16) {
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b));
+        unsigned int equal =
+            static_cast<unsigned int>(_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)));
+        if (equal != 0xFFFF) {
+            unsigned int index = CountTrailingZeros(~equal & 0xFFFF);
+            return static_cast<int>(a[index]) - static_cast<int>(b[index]);
+        }
+        a += 16;
+        b += 16;
+        count -= 16;
+    }
+    while (count--) {
+        if (*a != *b) {
+            return static_cast<int>(*a) - static_cast<int>(*b);
+        }
+        ++a;
+        ++b;
+    }
+    return 0;
+}
+
+// --- Game CRT Routines ---
+// Signatures of the statically linked Visual C++ 6 runtime routines. A build
+// with a different CRT can supply its own pattern through the config key
+// CrtSimdSignature<Name>; a pattern must match at a function boundary.
+
+typedef void* (__cdecl* MemmoveFn)(void*, const void*, size_t);
+typedef void* (__cdecl* MemsetFn)(void*, int, size_t);
+typedef size_t(__cdecl* StrlenFn)(const char*);
+typedef int(__cdecl* MemcmpFn)(const void*, const void*, size_t);
+
+struct CrtRoutine {
+    const char* name;
+    const char* defaultSignature;
+    const void* replacement;
+    void* original; // Trampoline to the first detoured match
+};
+
+static CrtRoutine g_crtRoutines[] = {
+    // memcpy.asm / memmove.asm: push ebp; mov ebp,esp; push edi; push esi;
+    // load dst/src/count, compute src+count and compare for overlap
+    {"memcpy",
+        "55 8B EC 57 56 8B 75 0C 8B 4D 10 8B 7D 08 8B C1 8B D1 03 C6 3B FE",
+        reinterpret_cast<const void*>(&SimdMemmove), nullptr},
+    // memset.asm: load count and dst, bail out on zero, widen the fill byte
+    {"memset",
+        "8B 54 24 0C 8B 4C 24 04 85 D2 74 ?? 33 C0 8A 44 24 08",
+        reinterpret_cast<const void*>(&SimdMemset), nullptr},
+    // strlen.asm: test alignment, then a byte loop until aligned
+    {"strlen",
+        "8B 4C 24 04 F7 C1 03 00 00 00 74 ?? 8A 01 41 84 C0 74",
+        reinterpret_cast<const void*>(&SimdStrlen), nullptr},
+    // memcmp.c: count check, then a byte-at-a-time compare loop
+    {"memcmp",
+        "8B 4C 24 0C 85 C9 74 ?? 8B 44 24 04 8B 54 24 08 49 74 ?? 8A 10 3A 11",
+        reinterpret_cast<const void*>(&SimdMemcmp), nullptr},
+};
+
+// Matches must start a function: preceded by alignment padding or a return
+static bool IsFunctionBoundary(uintptr_t address, uintptr_t moduleBase) {
+    if (address == moduleBase) {
+        return false;
+    }
+    unsigned char previous = *reinterpret_cast<const unsigned char*>(address - 1);
+    return previous == 0xCC || previous == 0x90 || previous == 0xC3;
+}
+
+// --- Benchmark ---
+
+static double SecondsBetween(const LARGE_INTEGER& start,
+    const LARGE_INTEGER& end, const LARGE_INTEGER& frequency) {
+    return static_cast<double>(end.QuadPart - start.QuadPart) /
+        static_cast<double>(frequency.QuadPart);
+}
+
+// Time the original routine (through its trampoline) against the SSE2 one
+// for a range of buffer sizes and log throughput for both.
+static void RunCrtSimdBenchmark() {
+    const size_t sizes[] = { 16, 256, 4096, 65536, 1024 * 1024 };
+    const size_t bytesPerRun = 64 * 1024 * 1024;
+    const size_t bufferSize = 1024 * 1024 + 64;
+
+    std::vector<unsigned char> bufferA(bufferSize, 'a');
+    std::vector<unsigned char> bufferB(bufferSize, 'a');
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+
+    Log("CRT SIMD benchmark (" + std::to_string(bytesPerRun >> 20) +
+        " MB per measurement):");
+    for (const CrtRoutine& routine : g_crtRoutines) {
+        if (routine.original == nullptr) {
+            continue;
+        }
+        std::string name = routine.name;
+
+        for (size_t size : sizes) {
+            if (name == "memcmp") {
+                // Equal buffers so both versions compare every byte
+                memcpy(bufferB.data() + 1, bufferA.data(), size);
+            }
+            size_t iterations = bytesPerRun / size;
+            volatile size_t sink = 0;
+            double seconds[2] = { 0.0, 0.0 };
+            size_t results[2] = { 0, 0 };
+
+            for (int variant = 0; variant < 2; ++variant) {
+                const void* fn = variant == 0 ? routine.original :
+                    routine.replacement;
+                // Terminate the string for strlen, refreshed for each variant
+                bufferA[size] = 0;
+                LARGE_INTEGER start, end;
+                QueryPerformanceCounter(&start);
+                for (size_t i = 0; i < iterations; ++i) {
+                    if (name == "memcpy") {
+                        reinterpret_cast<MemmoveFn>(fn)(bufferB.data() + 1,
+                            bufferA.data(), size);
+                    }
+                    else if (name == "memset") {
+                        reinterpret_cast<MemsetFn>(fn)(bufferB.data() + 1,
+                            static_cast<int>(i & 0x7F), size);
+                    }
+                    else if (name == "strlen") {
+                        sink = sink + reinterpret_cast<StrlenFn>(fn)(
+                            reinterpret_cast<const char*>(bufferA.data()));
+                    }
+                    else if (name == "memcmp") {
+                        sink = sink + static_cast<size_t>(
+                            reinterpret_cast<MemcmpFn>(fn)(bufferA.data(),
+                                bufferB.data() + 1, size) != 0);
+                    }
+                }
+                QueryPerformanceCounter(&end);
+                seconds[variant] = SecondsBetween(start, end, frequency);
+                results[variant] = sink;
+                sink = 0;
+                bufferA[size] = 'a';
+            }
+
+            double originalRate = seconds[0] > 0.0 ?
+                (bytesPerRun / 1048576.0) / seconds[0] : 0.0;
+            double simdRate = seconds[1] > 0.0 ?
+                (bytesPerRun / 1048576.0) / seconds[1] : 0.0;
+            std::stringstream ss;
+            ss << std::fixed << std::setprecision(0) << "  " << name << " "
+                << size << " B: original " << originalRate << " MB/s, SSE2 "
+                << simdRate << " MB/s";
+            if (originalRate > 0.0) {
+                ss << std::setprecision(2) << " (" << simdRate / originalRate
+                    << "x)";
+            }
+            if (results[0] != results[1]) {
+                ss << " RESULT MISMATCH";
+            }
+            Log(ss.str());
+        }
+    }
+}
+
+// Redirect the game's CRT memcpy/memset/strlen/memcmp to the SSE2 versions
+bool ApplyCrtSimdPatch() {
+    Log("Checking CRT SIMD patch...");
+    if (!GetConfigBool("CrtSimdEnabled", false)) {
+        Log("CRT SIMD patch is disabled in config.");
+        return false;
+    }
+    if (!IsProcessorFeaturePresent(PF_XMMI64_INSTRUCTIONS_AVAILABLE)) {
+        Log("Warning: CPU does not support SSE2. CRT SIMD patch skipped.");
+        return false;
+    }
+
+    MODULEINFO moduleInfo = { 0 };
+    uintptr_t baseAddress = 0;
+    size_t moduleSize = 0;
+    if (!GetModuleInfoByName(g_executableName, moduleInfo, baseAddress,
+        moduleSize)) {
+        Log("Aborting CRT SIMD patch.");
+        return false;
+    }
+
+    int detoured = 0;
+    for (CrtRoutine& routine : g_crtRoutines) {
+        std::string name = routine.name;
+        std::string signature = GetConfigString(
+            "CrtSimdSignature" + name, routine.defaultSignature);
+
+        std::vector<unsigned char> pattern, mask;
+        if (!HexToMaskedBytes(signature, pattern, mask) || pattern.empty()) {
+            Log("Error: Invalid signature for CRT routine '" + name +
+                "'. Skipping.");
+            continue;
+        }
+
+        // memcpy and memmove share one body, so several matches are expected
+        std::vector<uintptr_t> matches =
+            FindAllPatternMatches(baseAddress, moduleSize, pattern, mask, 4);
+        if (matches.empty()) {
+            Log("CRT routine '" + name + "' not found in '" + g_executableName +
+                "'.");
+            continue;
+        }
+
+        for (uintptr_t address : matches) {
+            std::stringstream addrHex;
+            addrHex << "0x" << std::hex << address;
+            if (!IsFunctionBoundary(address, baseAddress)) {
+                Log("Warning: Match for CRT routine '" + name + "' at " +
+                    addrHex.str() + " is not at a function start. Skipping.");
+                continue;
+            }
+
+            void* trampoline = nullptr;
+            if (InstallDetour(name, address, routine.replacement, &trampoline)) {
+                if (routine.original == nullptr) {
+                    routine.original = trampoline;
+                }
+                detoured++;
+            }
+        }
+    }
+
+    if (detoured == 0) {
+        Log("No CRT routines were redirected.");
+        return false;
+    }
+    Log("Successfully applied CRT SIMD patch (" + std::to_string(detoured) +
+        " routines redirected).");
+
+    if (GetConfigBool("CrtSimdBenchmark", false)) {
+        RunCrtSimdBenchmark();
+    }
+    return true;
+}
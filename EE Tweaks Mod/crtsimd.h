@@ -0,0 +1,15 @@
+#ifndef CRTSIMD_H
+#define CRTSIMD_H
+
+#include "pch.h"
+
+// SSE2 versions of the CRT routines, same contracts as the C library ones
+void* __cdecl SimdMemmove(void* dst, const void* src, size_t count);
+void* __cdecl SimdMemset(void* dst, int value, size_t count);
+size_t __cdecl SimdStrlen(const char* str);
+int __cdecl SimdMemcmp(const void* buf1, const void* buf2, size_t count);
+
+// Function declarations
+bool ApplyCrtSimdPatch();
+
+#endif // CRTSIMD_H
@@ -0,0 +1,580 @@
+#include "pch.h"
+#include "d3dhooks.h"
+
+#include "hooks.h"   // Access HookImport(), HookVtableEntry()
+
+#ifdef _WIN32
+#include "logging.h" // Access Log()
+#include "config.h"  // Access config functions
+#include "counters.h"
+#include "vbring.h"   // Managed vertex buffers share the hook chain
+#include "texdedup.h" // So does texture dedup
+#include "drawbatch.h" // And draw batching
+#include "softblit.h" // And the software blits
+#include "experiment.h" // Experiment mode measures frames
+#endif
+
+// --- Device State Shadow ---
+
+bool DeviceStateShadow::Filter(uint32_t& slot, uint8_t& known, uint32_t value) {
+    if (!m_recording && known && slot == value) {
+        m_filtered++;
+        m_frameFiltered++;
+        return false;
+    }
+    if (!m_recording) {
+        slot = value;
+        known = 1;
+    }
+    m_forwarded++;
+    m_frameForwarded++;
+    return true;
+}
+
+bool DeviceStateShadow::FilterRenderState(uint32_t state, uint32_t value) {
+    if (state >= SHADOW_RENDER_STATES) {
+        m_forwarded++;
+        m_frameForwarded++;
+        return true;
+    }
+    return Filter(m_renderStates[state], m_renderStateKnown[state], value);
+}
+
+bool DeviceStateShadow::FilterTextureStageState(uint32_t stage, uint32_t type,
+    uint32_t value) {
+    if (stage >= SHADOW_TEXTURE_STAGES || type >= SHADOW_STAGE_STATES) {
+        m_forwarded++;
+        m_frameForwarded++;
+        return true;
+    }
+    return Filter(m_stageStates[stage][type], m_stageStateKnown[stage][type],
+        value);
+}
+
+bool DeviceStateShadow::FilterTexture(uint32_t stage, uintptr_t texture) {
+    if (stage >= SHADOW_TEXTURE_STAGES) {
+        m_forwarded++;
+        m_frameForwarded++;
+        return true;
+    }
+    // The device holds a reference to the bound texture, so its address
+    // cannot be reused by another texture while it is bound
+    if (!m_recording && m_textureKnown[stage] && m_textures[stage] == texture) {
+        m_filtered++;
+        m_frameFiltered++;
+        return false;
+    }
+    if (!m_recording) {
+        m_textures[stage] = texture;
+        m_textureKnown[stage] = 1;
+    }
+    m_forwarded++;
+    m_frameForwarded++;
+    return true;
+}
+
+void DeviceStateShadow::ForgetRenderState(uint32_t state) {
+    if (state < SHADOW_RENDER_STATES) m_renderStateKnown[state] = 0;
+}
+
+void DeviceStateShadow::ForgetTextureStageState(uint32_t stage, uint32_t type) {
+    if (stage < SHADOW_TEXTURE_STAGES && type < SHADOW_STAGE_STATES) {
+        m_stageStateKnown[stage][type] = 0;
+    }
+}
+
+void DeviceStateShadow::ForgetTexture(uint32_t stage) {
+    if (stage < SHADOW_TEXTURE_STAGES) m_textureKnown[stage] = 0;
+}
+
+void DeviceStateShadow::Invalidate() {
+    memset(m_renderStateKnown, 0, sizeof(m_renderStateKnown));
+    memset(m_stageStateKnown, 0, sizeof(m_stageStateKnown));
+    memset(m_textureKnown, 0, sizeof(m_textureKnown));
+}
+
+void DeviceStateShadow::SetRecording(bool recording) {
+    m_recording = recording;
+    Invalidate(); // A recorded or applied block changes state behind our back
+}
+
+void DeviceStateShadow::EndFrame() {
+    m_lastFrameFiltered = m_frameFiltered;
+    m_lastFrameForwarded = m_frameForwarded;
+    m_frameFiltered = 0;
+    m_frameForwarded = 0;
+}
+
+// --- Frame Time Histogram ---
+
+void FrameTimeHistogram::Add(uint64_t micros) {
+    uint64_t bucket = micros / 1000;
+    if (bucket >= FRAME_HISTOGRAM_BUCKETS) bucket = FRAME_HISTOGRAM_BUCKETS - 1;
+    m_buckets[bucket]++;
+    m_frames++;
+    m_totalMicros += micros;
+    if (micros > m_maxMicros) m_maxMicros = micros;
+}
+
+void FrameTimeHistogram::Clear() {
+    memset(m_buckets, 0, sizeof(m_buckets));
+    m_frames = 0;
+    m_totalMicros = 0;
+    m_maxMicros = 0;
+}
+
+uint64_t FrameTimeHistogram::Percentile(double fraction) const {
+    if (m_frames == 0) {
+        return 0;
+    }
+    uint64_t wanted = static_cast<uint64_t>(fraction * m_frames);
+    if (wanted < 1) wanted = 1;
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < FRAME_HISTOGRAM_BUCKETS - 1; ++i) {
+        seen += m_buckets[i];
+        if (seen >= wanted) {
+            return (i + 1) * 1000ull;
+        }
+    }
+    return m_maxMicros;
+}
+
+// --- State Filter Hooks ---
+
+// Vtable slots, in the method order of ddraw.h and d3d.h
+const size_t DEVICE_SLOT_SET_RENDER_STATE = 20;
+const size_t DEVICE_SLOT_BEGIN_STATE_BLOCK = 22;
+const size_t DEVICE_SLOT_END_STATE_BLOCK = 23;
+const size_t DEVICE_SLOT_SET_TEXTURE = 35;
+const size_t DEVICE_SLOT_SET_TEXTURE_STAGE_STATE = 37;
+const size_t DEVICE_SLOT_APPLY_STATE_BLOCK = 39;
+const size_t DIRECTDRAW7_SLOT_RESTORE_ALL_SURFACES = 25;
+const size_t DIRECTDRAW7_SLOT_TEST_COOPERATIVE_LEVEL = 26;
+const size_t SURFACE7_SLOT_RESTORE = 27;
+
+const HRESULT DDERR_SURFACE_LOST = static_cast<HRESULT>(0x887601C2);
+
+typedef HRESULT(WINAPI* SetRenderStateFn)(void* self, DWORD state, DWORD value);
+typedef HRESULT(WINAPI* SetTextureFn)(void* self, DWORD stage, void* texture);
+typedef HRESULT(WINAPI* SetTextureStageStateFn)(void* self, DWORD stage,
+    DWORD type, DWORD value);
+typedef HRESULT(WINAPI* BeginStateBlockFn)(void* self);
+typedef HRESULT(WINAPI* EndStateBlockFn)(void* self, DWORD* block);
+typedef HRESULT(WINAPI* ApplyStateBlockFn)(void* self, DWORD block);
+typedef HRESULT(WINAPI* RestoreFn)(void* self); // Also TestCooperativeLevel
+
+static SetRenderStateFn g_originalSetRenderState = nullptr;
+static SetTextureFn g_originalSetTexture = nullptr;
+static SetTextureStageStateFn g_originalSetTextureStageState = nullptr;
+static BeginStateBlockFn g_originalBeginStateBlock = nullptr;
+static EndStateBlockFn g_originalEndStateBlock = nullptr;
+static ApplyStateBlockFn g_originalApplyStateBlock = nullptr;
+static RestoreFn g_originalRestoreAllSurfaces = nullptr;
+static RestoreFn g_originalTestCooperativeLevel = nullptr;
+static RestoreFn g_originalSurfaceRestore = nullptr;
+
+static void* g_filterDevice = nullptr; // The device being shadowed, if any
+static DeviceStateShadow g_shadow;
+static uint64_t g_deviceLosses = 0;
+
+static HRESULT WINAPI HookedSetRenderState(void* self, DWORD state, DWORD value) {
+    if (self != g_filterDevice) {
+        return g_originalSetRenderState(self, state, value);
+    }
+    if (!g_shadow.FilterRenderState(state, value)) {
+        return S_OK;
+    }
+    HRESULT result = g_originalSetRenderState(self, state, value);
+    if (FAILED(result)) {
+        g_shadow.ForgetRenderState(state);
+    }
+    return result;
+}
+
+static HRESULT WINAPI HookedSetTexture(void* self, DWORD stage, void* texture) {
+    if (self != g_filterDevice) {
+        return g_originalSetTexture(self, stage, texture);
+    }
+    if (!g_shadow.FilterTexture(stage, reinterpret_cast<uintptr_t>(texture))) {
+        return S_OK;
+    }
+    HRESULT result = g_originalSetTexture(self, stage, texture);
+    if (FAILED(result)) {
+        g_shadow.ForgetTexture(stage);
+    }
+    return result;
+}
+
+static HRESULT WINAPI HookedSetTextureStageState(void* self, DWORD stage,
+    DWORD type, DWORD value) {
+    if (self != g_filterDevice) {
+        return g_originalSetTextureStageState(self, stage, type, value);
+    }
+    if (!g_shadow.FilterTextureStageState(stage, type, value)) {
+        return S_OK;
+    }
+    HRESULT result = g_originalSetTextureStageState(self, stage, type, value);
+    if (FAILED(result)) {
+        g_shadow.ForgetTextureStageState(stage, type);
+    }
+    return result;
+}
+
+static HRESULT WINAPI HookedBeginStateBlock(void* self) {
+    if (self == g_filterDevice) {
+        g_shadow.SetRecording(true);
+    }
+    return g_originalBeginStateBlock(self);
+}
+
+static HRESULT WINAPI HookedEndStateBlock(void* self, DWORD* block) {
+    if (self == g_filterDevice) {
+        g_shadow.SetRecording(false);
+    }
+    return g_originalEndStateBlock(self, block);
+}
+
+static HRESULT WINAPI HookedApplyStateBlock(void* self, DWORD block) {
+    if (self == g_filterDevice) {
+        g_shadow.Invalidate();
+    }
+    return g_originalApplyStateBlock(self, block);
+}
+
+// A lost device may come back with any state, so whatever restores it, or
+// finds it lost, makes the shadow forget everything. Restore is hooked on
+// every surface of the driver; one that is not the render target only costs
+// a few forwarded calls.
+static void OnDeviceLoss() {
+    if (g_filterDevice != nullptr) {
+        g_shadow.Invalidate();
+        g_deviceLosses++;
+    }
+}
+
+static HRESULT WINAPI HookedRestoreAllSurfaces(void* self) {
+    HRESULT result = g_originalRestoreAllSurfaces(self);
+    OnDeviceLoss();
+    return result;
+}
+
+static HRESULT WINAPI HookedTestCooperativeLevel(void* self) {
+    HRESULT result = g_originalTestCooperativeLevel(self);
+    if (result != S_OK) {
+        OnDeviceLoss();
+    }
+    return result;
+}
+
+static HRESULT WINAPI HookedSurfaceRestore(void* self) {
+    HRESULT result = g_originalSurfaceRestore(self);
+    OnDeviceLoss();
+    return result;
+}
+
+// Start filtering the state calls of this device (nullptr: stop). All
+// devices of one driver share a vtable, so it is only patched once.
+bool AttachStateFilter(void* device) {
+    g_filterDevice = nullptr;
+    g_shadow.Invalidate();
+    if (device == nullptr) {
+        return true;
+    }
+    if (g_originalSetRenderState == nullptr) {
+        bool hooked =
+            HookVtableEntry(device, DEVICE_SLOT_SET_RENDER_STATE,
+                reinterpret_cast<const void*>(HookedSetRenderState),
+                reinterpret_cast<void**>(&g_originalSetRenderState)) &&
+            HookVtableEntry(device, DEVICE_SLOT_SET_TEXTURE,
+                reinterpret_cast<const void*>(HookedSetTexture),
+                reinterpret_cast<void**>(&g_originalSetTexture)) &&
+            HookVtableEntry(device, DEVICE_SLOT_SET_TEXTURE_STAGE_STATE,
+                reinterpret_cast<const void*>(HookedSetTextureStageState),
+                reinterpret_cast<void**>(&g_originalSetTextureStageState)) &&
+            HookVtableEntry(device, DEVICE_SLOT_BEGIN_STATE_BLOCK,
+                reinterpret_cast<const void*>(HookedBeginStateBlock),
+                reinterpret_cast<void**>(&g_originalBeginStateBlock)) &&
+            HookVtableEntry(device, DEVICE_SLOT_END_STATE_BLOCK,
+                reinterpret_cast<const void*>(HookedEndStateBlock),
+                reinterpret_cast<void**>(&g_originalEndStateBlock)) &&
+            HookVtableEntry(device, DEVICE_SLOT_APPLY_STATE_BLOCK,
+                reinterpret_cast<const void*>(HookedApplyStateBlock),
+                reinterpret_cast<void**>(&g_originalApplyStateBlock));
+        if (!hooked) {
+            // Some slots may already point at us; they pass calls through
+            return false;
+        }
+    }
+    g_filterDevice = device;
+    return true;
+}
+
+// Watch for device loss through the DirectDraw object and the surfaces of
+// the device's driver. Each vtable is patched once.
+bool AttachLossDetection(void* directDraw, void* surface) {
+    bool hooked = true;
+    if (directDraw != nullptr && g_originalTestCooperativeLevel == nullptr) {
+        hooked = HookVtableEntry(directDraw, DIRECTDRAW7_SLOT_RESTORE_ALL_SURFACES,
+                reinterpret_cast<const void*>(HookedRestoreAllSurfaces),
+                reinterpret_cast<void**>(&g_originalRestoreAllSurfaces)) &&
+            HookVtableEntry(directDraw, DIRECTDRAW7_SLOT_TEST_COOPERATIVE_LEVEL,
+                reinterpret_cast<const void*>(HookedTestCooperativeLevel),
+                reinterpret_cast<void**>(&g_originalTestCooperativeLevel));
+    }
+    if (surface != nullptr && g_originalSurfaceRestore == nullptr) {
+        hooked = HookVtableEntry(surface, SURFACE7_SLOT_RESTORE,
+            reinterpret_cast<const void*>(HookedSurfaceRestore),
+            reinterpret_cast<void**>(&g_originalSurfaceRestore)) && hooked;
+    }
+    return hooked;
+}
+
+const DeviceStateShadow& GetStateShadow() {
+    return g_shadow;
+}
+
+uint64_t GetDeviceLosses() {
+    return g_deviceLosses;
+}
+
+// --- Direct3D 7 Device Hooks ---
+// DX7HRTnLDisplay.dll creates its device through DirectDraw: the hook chain
+// follows DirectDrawCreateEx -> IDirectDraw7::QueryInterface(IDirect3D7) ->
+// IDirect3D7::CreateDevice and then patches the device's vtable.
+
+#ifdef _WIN32
+const size_t SLOT_QUERY_INTERFACE = 0;
+const size_t D3D7_SLOT_CREATE_DEVICE = 4;
+const size_t DEVICE_SLOT_BEGIN_SCENE = 5;
+const size_t DEVICE_SLOT_END_SCENE = 6;
+
+static const GUID GUID_DIRECT3D7 = { 0xf5049e77, 0x4861, 0x11d2,
+    { 0xa4, 0x07, 0x00, 0xa0, 0xc9, 0x06, 0x29, 0xa8 } };
+
+typedef HRESULT(WINAPI* DirectDrawCreateExFn)(GUID* driver, void** directDraw,
+    const GUID& iid, void* outer);
+typedef HRESULT(WINAPI* QueryInterfaceFn)(void* self, const GUID& iid,
+    void** object);
+typedef HRESULT(WINAPI* CreateDeviceFn)(void* self, const GUID& deviceType,
+    void* renderTarget, void** device);
+typedef HRESULT(WINAPI* SceneFn)(void* self);
+
+static DirectDrawCreateExFn g_originalDirectDrawCreateEx = nullptr;
+static QueryInterfaceFn g_originalDirectDrawQueryInterface = nullptr;
+static CreateDeviceFn g_originalCreateDevice = nullptr;
+static SceneFn g_originalBeginScene = nullptr;
+static SceneFn g_originalEndScene = nullptr;
+
+static void* g_device = nullptr; // The device being timed
+static bool g_stateFilterEnabled = false;
+static LARGE_INTEGER g_counterFrequency = { 0 };
+static LONGLONG g_lastFrameCounter = 0;
+static uint64_t g_frames = 0;
+static FrameTimeHistogram g_frameTimes;
+static bool g_frameTimingRequested = false;
+
+static HRESULT WINAPI HookedBeginScene(void* self) {
+    HRESULT result = g_originalBeginScene(self);
+    if (self == g_filterDevice) {
+        g_shadow.Invalidate();
+    }
+    return result;
+}
+
+// Publish the frame time and the filter counts of the frame just drawn
+static HRESULT WINAPI HookedEndScene(void* self) {
+    HRESULT heldResult = DrawBatchingOnEndScene(self);
+    HRESULT result = g_originalEndScene(self);
+    // Merged draws are made after the game's draw calls returned, so a
+    // failed one reports its error here
+    if (SUCCEEDED(result) && FAILED(heldResult)) {
+        result = heldResult;
+    }
+    if (self != g_device) {
+        return result;
+    }
+    if (result == DDERR_SURFACE_LOST) {
+        OnDeviceLoss();
+    }
+
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    if (g_lastFrameCounter != 0) {
+        uint64_t micros = static_cast<uint64_t>(
+            (now.QuadPart - g_lastFrameCounter) * 1000000 /
+            g_counterFrequency.QuadPart);
+        CounterSet(COUNTER_FRAME_LAST_US, micros);
+        CounterMax(COUNTER_FRAME_MAX_US, micros);
+        CounterAdd(COUNTER_FRAME_TOTAL_US, micros);
+        g_frameTimes.Add(micros);
+        ExperimentOnFrame(micros);
+    }
+    g_lastFrameCounter = now.QuadPart;
+    g_frames++;
+    CounterAdd(COUNTER_FRAMES, 1);
+
+    if (g_filterDevice != nullptr) {
+        g_shadow.EndFrame();
+        CounterSet(COUNTER_D3D_FRAME_FILTERED, g_shadow.LastFrameFiltered());
+        CounterSet(COUNTER_D3D_FRAME_FORWARDED, g_shadow.LastFrameForwarded());
+        CounterSet(COUNTER_D3D_CALLS_FILTERED, g_shadow.Filtered());
+        CounterSet(COUNTER_D3D_CALLS_FORWARDED, g_shadow.Forwarded());
+    }
+    return result;
+}
+
+// Start shadowing a new device. All devices of one driver share a vtable, so
+// it is only patched once.
+static void AttachDevice(void* device, void* renderTarget) {
+    g_device = device;
+    g_lastFrameCounter = 0;
+    ManagedVertexBuffersOnDevice(device);
+    DrawBatchingOnDevice(device, renderTarget); // Before the state filter
+
+    if (g_originalEndScene == nullptr) {
+        bool hooked =
+            HookVtableEntry(device, DEVICE_SLOT_BEGIN_SCENE,
+                reinterpret_cast<const void*>(HookedBeginScene),
+                reinterpret_cast<void**>(&g_originalBeginScene)) &&
+            HookVtableEntry(device, DEVICE_SLOT_END_SCENE,
+                reinterpret_cast<const void*>(HookedEndScene),
+                reinterpret_cast<void**>(&g_originalEndScene));
+        if (!hooked) {
+            Log("Warning: Could not hook the Direct3D device. Error code: " +
+                std::to_string(GetLastError()));
+            return;
+        }
+    }
+    if (g_stateFilterEnabled) {
+        if (!AttachStateFilter(device)) {
+            g_stateFilterEnabled = false;
+            Log("Warning: Could not hook the Direct3D device state calls. "
+                "Error code: " + std::to_string(GetLastError()));
+            return;
+        }
+        if (!AttachLossDetection(nullptr, renderTarget)) {
+            Log("Warning: Could not hook IDirectDrawSurface7::Restore.");
+        }
+    }
+    std::stringstream ss;
+    ss << "0x" << std::hex << reinterpret_cast<uintptr_t>(device);
+    Log("Hooked Direct3D device at " + ss.str() +
+        (g_stateFilterEnabled ? " (state filter on)." : "."));
+}
+
+static HRESULT WINAPI HookedCreateDevice(void* self, const GUID& deviceType,
+    void* renderTarget, void** device) {
+    HRESULT result = g_originalCreateDevice(self, deviceType, renderTarget,
+        device);
+    if (SUCCEEDED(result) && device != nullptr && *device != nullptr) {
+        AttachDevice(*device, renderTarget);
+        TextureDedupOnDevice(*device);
+    }
+    return result;
+}
+
+static HRESULT WINAPI HookedDirectDrawQueryInterface(void* self,
+    const GUID& iid, void** object) {
+    HRESULT result = g_originalDirectDrawQueryInterface(self, iid, object);
+    if (FAILED(result) || object == nullptr || *object == nullptr ||
+        memcmp(&iid, &GUID_DIRECT3D7, sizeof(GUID)) != 0) {
+        return result;
+    }
+    if (g_originalCreateDevice == nullptr &&
+        !HookVtableEntry(*object, D3D7_SLOT_CREATE_DEVICE,
+            reinterpret_cast<const void*>(HookedCreateDevice),
+            reinterpret_cast<void**>(&g_originalCreateDevice))) {
+        Log("Warning: Could not hook IDirect3D7::CreateDevice.");
+    }
+    ManagedVertexBuffersOnDirect3D(*object);
+    return result;
+}
+
+static HRESULT WINAPI HookedDirectDrawCreateEx(GUID* driver, void** directDraw,
+    const GUID& iid, void* outer) {
+    HRESULT result = g_originalDirectDrawCreateEx(driver, directDraw, iid,
+        outer);
+    if (FAILED(result) || directDraw == nullptr || *directDraw == nullptr) {
+        return result;
+    }
+    if (g_originalDirectDrawQueryInterface == nullptr &&
+        !HookVtableEntry(*directDraw, SLOT_QUERY_INTERFACE,
+            reinterpret_cast<const void*>(HookedDirectDrawQueryInterface),
+            reinterpret_cast<void**>(&g_originalDirectDrawQueryInterface))) {
+        Log("Warning: Could not hook IDirectDraw7::QueryInterface.");
+    }
+    if (g_stateFilterEnabled && !AttachLossDetection(*directDraw, nullptr)) {
+        Log("Warning: Could not hook IDirectDraw7::TestCooperativeLevel.");
+    }
+    SoftwareBlitOnDirectDraw(*directDraw); // Before texture dedup
+    TextureDedupOnDirectDraw(*directDraw);
+    return result;
+}
+
+// Called by features that only need frame times, before InstallDirect3DHooks
+void RequestFrameTiming() {
+    g_frameTimingRequested = true;
+}
+
+// Hook the TnL renderer's device creation if a feature needs the device.
+// Frame times are then published as well.
+bool InstallDirect3DHooks() {
+    Log("Checking Direct3D State Filter...");
+    g_stateFilterEnabled = GetConfigBool("D3DStateFilterEnabled", false);
+    if (!g_stateFilterEnabled) {
+        Log("Direct3D State Filter is disabled in config.");
+    }
+    bool managedVertexBuffers = InitializeManagedVertexBuffers();
+    bool textureDedup = InitializeTextureDedup();
+    bool drawBatching = InitializeDrawBatching();
+    bool softwareBlit = InitializeSoftwareBlit();
+    if (!g_stateFilterEnabled && !managedVertexBuffers && !textureDedup &&
+        !drawBatching && !softwareBlit && !g_frameTimingRequested) {
+        return false;
+    }
+    QueryPerformanceFrequency(&g_counterFrequency);
+
+    // Both DirectX 7 renderers create their device the same way
+    const char* renderers[] = { "DX7HRTnLDisplay.dll", "DX7HRDisplay.dll" };
+    int hookedRenderers = 0;
+    for (const char* rendererName : renderers) {
+        HMODULE renderer = GetModuleHandleA(rendererName);
+        if (renderer == NULL) {
+            continue;
+        }
+        if (HookImport(renderer, "DDRAW.dll", "DirectDrawCreateEx",
+            reinterpret_cast<const void*>(HookedDirectDrawCreateEx),
+            reinterpret_cast<void**>(&g_originalDirectDrawCreateEx))) {
+            Log("Direct3D hooks will attach when " + std::string(rendererName) +
+                " creates its device.");
+            hookedRenderers++;
+        }
+        else {
+            Log("Warning: " + std::string(rendererName) + " does not import "
+                "DirectDrawCreateEx.");
+        }
+    }
+    if (hookedRenderers == 0) {
+        Log("Warning: No DirectX 7 renderer found. Direct3D hooks not "
+            "installed.");
+        return false;
+    }
+    return true;
+}
+
+const FrameTimeHistogram& GetFrameTimes() {
+    return g_frameTimes;
+}
+
+// Log the totals. Called at shutdown.
+void ShutdownDirect3DHooks() {
+    if (g_frames == 0 || !g_stateFilterEnabled) {
+        return;
+    }
+    uint64_t total = g_shadow.Filtered() + g_shadow.Forwarded();
+    Log("Direct3D State Filter: " + std::to_string(g_frames) + " frames, " +
+        std::to_string(g_shadow.Filtered()) + " of " + std::to_string(total) +
+        " state calls filtered, " + std::to_string(g_deviceLosses) +
+        " device losses.");
+}
+#endif
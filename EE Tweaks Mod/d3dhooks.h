@@ -0,0 +1,97 @@
+#ifndef D3DHOOKS_H
+#define D3DHOOKS_H
+
+#include "pch.h"
+
+// Sizes of the shadowed state tables. Larger ids are always forwarded.
+const uint32_t SHADOW_RENDER_STATES = 256;  // D3DRENDERSTATETYPE
+const uint32_t SHADOW_TEXTURE_STAGES = 8;
+const uint32_t SHADOW_STAGE_STATES = 32;    // D3DTEXTURESTAGESTATETYPE
+
+// The render states, texture stage states and textures last set on a
+// Direct3D 7 device. Each Filter call returns true if the call has to reach
+// the device (the value is then remembered) and false if it would set the
+// value the device already has. Not thread-safe: device calls come from the
+// game's render thread only.
+class DeviceStateShadow {
+public:
+    DeviceStateShadow() { Invalidate(); }
+
+    bool FilterRenderState(uint32_t state, uint32_t value);
+    bool FilterTextureStageState(uint32_t stage, uint32_t type, uint32_t value);
+    bool FilterTexture(uint32_t stage, uintptr_t texture);
+
+    // The device rejected a forwarded call; its value is unknown now
+    void ForgetRenderState(uint32_t state);
+    void ForgetTextureStageState(uint32_t stage, uint32_t type);
+    void ForgetTexture(uint32_t stage);
+
+    void Invalidate(); // Forget everything (new scene, lost device)
+    // While a state block is recorded, calls are forwarded and not remembered
+    void SetRecording(bool recording);
+    void EndFrame(); // Move the per-frame counts to the LastFrame values
+
+    uint64_t Filtered() const { return m_filtered; }
+    uint64_t Forwarded() const { return m_forwarded; }
+    uint32_t LastFrameFiltered() const { return m_lastFrameFiltered; }
+    uint32_t LastFrameForwarded() const { return m_lastFrameForwarded; }
+
+private:
+    bool Filter(uint32_t& slot, uint8_t& known, uint32_t value);
+
+    uint32_t m_renderStates[SHADOW_RENDER_STATES];
+    uint8_t m_renderStateKnown[SHADOW_RENDER_STATES];
+    uint32_t m_stageStates[SHADOW_TEXTURE_STAGES][SHADOW_STAGE_STATES];
+    uint8_t m_stageStateKnown[SHADOW_TEXTURE_STAGES][SHADOW_STAGE_STATES];
+    uintptr_t m_textures[SHADOW_TEXTURE_STAGES];
+    uint8_t m_textureKnown[SHADOW_TEXTURE_STAGES];
+    bool m_recording = false;
+
+    uint64_t m_filtered = 0;
+    uint64_t m_forwarded = 0;
+    uint32_t m_frameFiltered = 0;
+    uint32_t m_frameForwarded = 0;
+    uint32_t m_lastFrameFiltered = 0;
+    uint32_t m_lastFrameForwarded = 0;
+};
+
+const uint32_t FRAME_HISTOGRAM_BUCKETS = 500; // 1 ms each; the last collects the rest
+
+// Distribution of frame times, for percentiles without keeping every frame
+class FrameTimeHistogram {
+public:
+    void Add(uint64_t micros);
+    void Clear();
+    // Upper edge of the bucket holding the given fraction of frames, in
+    // microseconds; 0 if no frames were added
+    uint64_t Percentile(double fraction) const;
+
+    uint64_t Frames() const { return m_frames; }
+    uint64_t TotalMicros() const { return m_totalMicros; }
+    uint64_t MaxMicros() const { return m_maxMicros; }
+
+private:
+    uint32_t m_buckets[FRAME_HISTOGRAM_BUCKETS] = { 0 };
+    uint64_t m_frames = 0;
+    uint64_t m_totalMicros = 0;
+    uint64_t m_maxMicros = 0;
+};
+
+// The state filter's device hooks. They build on POSIX as well, so
+// tools/d3dhooktest.cpp can drive them through mock vtables.
+bool AttachStateFilter(void* device); // nullptr stops filtering
+// Forget the shadowed state whenever the device may have been lost:
+// TestCooperativeLevel failing, RestoreAllSurfaces or a surface's Restore
+bool AttachLossDetection(void* directDraw, void* surface);
+const DeviceStateShadow& GetStateShadow();
+uint64_t GetDeviceLosses();
+
+// Function declarations
+#ifdef _WIN32
+void RequestFrameTiming(); // Hook the device for frame times alone
+bool InstallDirect3DHooks();
+void ShutdownDirect3DHooks();
+const FrameTimeHistogram& GetFrameTimes();
+#endif
+
+#endif // D3DHOOKS_H
@@ -0,0 +1,425 @@
+#include "pch.h"
+#include "detour.h"
+
+#ifdef _WIN32
+#include "globals.h"
+#include "logging.h" // Access Log()
+#endif
+
+// --- x86 Instruction Length Decoder ---
+// Covers the 32-bit general purpose, x87, MMX and SSE/SSE2 encodings found in
+// compiler generated prologues. Anything unknown decodes to length 0 and the
+// caller refuses to detour that function.
+
+// Flags for one-byte opcodes
+enum OpcodeFlags : unsigned char {
+    OP_NONE = 0x00,
+    OP_MODRM = 0x01,   // Has a ModRM byte
+    OP_IMM8 = 0x02,    // 8-bit immediate
+    OP_IMM16 = 0x04,   // 16-bit immediate
+    OP_IMMZ = 0x08,    // 16/32-bit immediate depending on operand size
+    OP_REL8 = 0x10,    // 8-bit relative branch
+    OP_RELZ = 0x20,    // 16/32-bit relative branch
+    OP_MOFFS = 0x40,   // Memory offset sized by address size
+    OP_INVALID = 0x80
+};
+
+static const unsigned char ONE_BYTE_FLAGS[256] = {
+    // 00-0F: ALU ops, push/pop seg, 0F escape handled separately
+    OP_MODRM, OP_MODRM, OP_MODRM, OP_MODRM, OP_IMM8, OP_IMMZ, OP_NONE, OP_NONE,
+    OP_MODRM, OP_MODRM, OP_MODRM, OP_MODRM, OP_IMM8, OP_IMMZ, OP_NONE, OP_INVALID,
+    // 10-1F
+    OP_MODRM, OP_MODRM, OP_MODRM, OP_MODRM, OP_IMM8, OP_IMMZ, OP_NONE, OP_NONE,
+    OP_MODRM, OP_MODRM, OP_MODRM, OP_MODRM, OP_IMM8, OP_IMMZ, OP_NONE, OP_NONE,
+    // 20-2F (26/2E are prefixes, handled before lookup)
+    OP_MODRM, OP_MODRM, OP_MODRM, OP_MODRM, OP_IMM8, OP_IMMZ, OP_INVALID, OP_NONE,
+    OP_MODRM, OP_MODRM, OP_MODRM, OP_MODRM, OP_IMM8, OP_IMMZ, OP_INVALID, OP_NONE,
+    // 30-3F (36/3E are prefixes)
+    OP_MODRM, OP_MODRM, OP_MODRM, OP_MODRM, OP_IMM8, OP_IMMZ, OP_INVALID, OP_NONE,
+    OP_MODRM, OP_MODRM, OP_MODRM, OP_MODRM, OP_IMM8, OP_IMMZ, OP_INVALID, OP_NONE,
+    // 40-4F: inc/dec reg
+    OP_NONE, OP_NONE, OP_NONE, OP_NONE, OP_NONE, OP_NONE, OP_NONE, OP_NONE,
+    OP_NONE, OP_NONE, OP_NONE, OP_NONE, OP_NONE, OP_NONE, OP_NONE, OP_NONE,
+    // 50-5F: push/pop reg
+    OP_NONE, OP_NONE, OP_NONE, OP_NONE, OP_NONE, OP_NONE, OP_NONE, OP_NONE,
+    OP_NONE, OP_NONE, OP_NONE, OP_NONE, OP_NONE, OP_NONE, OP_NONE, OP_NONE,
+    // 60-6F (64/65/66/67 are prefixes)
+    OP_NONE, OP_NONE, OP_MODRM, OP_MODRM, OP_INVALID, OP_INVALID, OP_INVALID, OP_INVALID,
+    OP_IMMZ, OP_MODRM | OP_IMMZ, OP_IMM8, OP_MODRM | OP_IMM8, OP_NONE, OP_NONE, OP_NONE, OP_NONE,
+    // 70-7F: jcc rel8
+    OP_REL8, OP_REL8, OP_REL8, OP_REL8, OP_REL8, OP_REL8, OP_REL8, OP_REL8,
+    OP_REL8, OP_REL8, OP_REL8, OP_REL8, OP_REL8, OP_REL8, OP_REL8, OP_REL8,
+    // 80-8F: group 1, test, xchg, mov, lea, pop r/m
+    OP_MODRM | OP_IMM8, OP_MODRM | OP_IMMZ, OP_MODRM | OP_IMM8, OP_MODRM | OP_IMM8,
+    OP_MODRM, OP_MODRM, OP_MODRM, OP_MODRM,
+    OP_MODRM, OP_MODRM, OP_MODRM, OP_MODRM, OP_MODRM, OP_MODRM, OP_MODRM, OP_MODRM,
+    // 90-9F: xchg, cbw, cwd, callf, wait, pushf, popf, sahf, lahf
+    OP_NONE, OP_NONE, OP_NONE, OP_NONE, OP_NONE, OP_NONE, OP_NONE, OP_NONE,
+    OP_NONE, OP_NONE, OP_IMMZ | OP_IMM16, OP_NONE, OP_NONE, OP_NONE, OP_NONE, OP_NONE,
+    // A0-AF: mov moffs, string ops, test imm
+    OP_MOFFS, OP_MOFFS, OP_MOFFS, OP_MOFFS, OP_NONE, OP_NONE, OP_NONE, OP_NONE,
+    OP_IMM8, OP_IMMZ, OP_NONE, OP_NONE, OP_NONE, OP_NONE, OP_NONE, OP_NONE,
+    // B0-BF: mov reg, imm
+    OP_IMM8, OP_IMM8, OP_IMM8, OP_IMM8, OP_IMM8, OP_IMM8, OP_IMM8, OP_IMM8,
+    OP_IMMZ, OP_IMMZ, OP_IMMZ, OP_IMMZ, OP_IMMZ, OP_IMMZ, OP_IMMZ, OP_IMMZ,
+    // C0-CF: shifts, ret, les/lds, mov r/m imm, enter/leave, int
+    OP_MODRM | OP_IMM8, OP_MODRM | OP_IMM8, OP_IMM16, OP_NONE,
+    OP_MODRM, OP_MODRM, OP_MODRM | OP_IMM8, OP_MODRM | OP_IMMZ,
+    OP_IMM16 | OP_IMM8, OP_NONE, OP_IMM16, OP_NONE, OP_NONE, OP_IMM8, OP_NONE, OP_NONE,
+    // D0-DF: shifts, aam/aad, xlat, x87
+    OP_MODRM, OP_MODRM, OP_MODRM, OP_MODRM, OP_IMM8, OP_IMM8, OP_INVALID, OP_NONE,
+    OP_MODRM, OP_MODRM, OP_MODRM, OP_MODRM, OP_MODRM, OP_MODRM, OP_MODRM, OP_MODRM,
+    // E0-EF: loop/jcxz, in/out, call/jmp
+    OP_REL8, OP_REL8, OP_REL8, OP_REL8, OP_IMM8, OP_IMM8, OP_IMM8, OP_IMM8,
+    OP_RELZ, OP_RELZ, OP_IMMZ | OP_IMM16, OP_REL8, OP_NONE, OP_NONE, OP_NONE, OP_NONE,
+    // F0-FF (F0/F2/F3 are prefixes); F6/F7 immediates handled separately
+    OP_INVALID, OP_NONE, OP_INVALID, OP_INVALID, OP_NONE, OP_NONE, OP_MODRM, OP_MODRM,
+    OP_NONE, OP_NONE, OP_NONE, OP_NONE, OP_NONE, OP_NONE, OP_MODRM, OP_MODRM
+};
+
+// Does a 0F xx opcode take a ModRM byte?
+static bool TwoByteHasModRM(unsigned char op) {
+    if (op >= 0x80 && op <= 0x8F) return false; // jcc rel32
+    if (op >= 0xC8 && op <= 0xCF) return false; // bswap
+    switch (op) {
+    case 0x05: case 0x06: case 0x07: case 0x08: case 0x09: case 0x0B:
+    case 0x30: case 0x31: case 0x32: case 0x33: case 0x34: case 0x35:
+    case 0x37: case 0x77: case 0xA0: case 0xA1: case 0xA2: case 0xA8:
+    case 0xA9: case 0xAA:
+        return false;
+    default:
+        return true;
+    }
+}
+
+// Does a 0F xx opcode take an 8-bit immediate?
+static bool TwoByteHasImm8(unsigned char op) {
+    switch (op) {
+    case 0x0F: // 3DNow! suffix byte
+    case 0x70: case 0x71: case 0x72: case 0x73:
+    case 0xA4: case 0xAC: case 0xBA:
+    case 0xC2: case 0xC4: case 0xC5: case 0xC6:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Length of the ModRM byte plus SIB and displacement
+static size_t ModRMLength(const unsigned char* p, bool addressSize16) {
+    unsigned char modrm = p[0];
+    unsigned char mod = modrm >> 6;
+    unsigned char rm = modrm & 7;
+    size_t length = 1;
+
+    if (mod == 3) {
+        return length;
+    }
+    if (addressSize16) {
+        if (mod == 0 && rm == 6) return length + 2;
+        return length + (mod == 1 ? 1 : (mod == 2 ? 2 : 0));
+    }
+    if (rm == 4) {
+        unsigned char sibBase = p[1] & 7;
+        length += 1;
+        if (mod == 0 && sibBase == 5) return length + 4;
+    }
+    else if (mod == 0 && rm == 5) {
+        return length + 4; // disp32 absolute
+    }
+    return length + (mod == 1 ? 1 : (mod == 2 ? 4 : 0));
+}
+
+// Decode one instruction; returns its length (0 if unsupported)
+size_t DecodeInstruction(const unsigned char* code, InstructionInfo& info) {
+    info = InstructionInfo{ 0, 0, 0, 0, false, false };
+    const unsigned char* p = code;
+    bool operandSize16 = false;
+    bool addressSize16 = false;
+
+    // Legacy prefixes (at most 4 are meaningful, x86 allows up to 15 bytes)
+    for (int i = 0; i < 14; ++i, ++p) {
+        unsigned char b = *p;
+        if (b == 0x66) operandSize16 = true;
+        else if (b == 0x67) addressSize16 = true;
+        else if (b == 0xF0 || b == 0xF2 || b == 0xF3 || b == 0x2E ||
+            b == 0x36 || b == 0x3E || b == 0x26 || b == 0x64 || b == 0x65) {
+        }
+        else break;
+    }
+    info.opcodeOffset = static_cast<size_t>(p - code);
+    size_t immZ = operandSize16 ? 2 : 4;
+    unsigned char op = *p++;
+
+    if (op == 0x0F) {
+        unsigned char op2 = *p++;
+        if (op2 >= 0x80 && op2 <= 0x8F) { // jcc rel32
+            info.relativeOffset = static_cast<size_t>(p - code);
+            info.relativeSize = immZ;
+            p += immZ;
+        }
+        else if (op2 == 0x38 || op2 == 0x3A) { // Three-byte opcode maps
+            ++p;
+            p += ModRMLength(p, addressSize16);
+            if (op2 == 0x3A) ++p;
+        }
+        else {
+            if (op2 == 0x0B || op2 == 0xFF) return 0; // ud2/ud0
+            if (TwoByteHasModRM(op2)) p += ModRMLength(p, addressSize16);
+            if (TwoByteHasImm8(op2)) ++p;
+        }
+        info.length = static_cast<size_t>(p - code);
+        return info.length;
+    }
+
+    unsigned char flags = ONE_BYTE_FLAGS[op];
+    if (flags & OP_INVALID) {
+        return 0;
+    }
+    if (flags & OP_MODRM) {
+        unsigned char reg = (p[0] >> 3) & 7;
+        p += ModRMLength(p, addressSize16);
+        // test r/m, imm lives in group 3 (/0 and /1 only)
+        if ((op == 0xF6 || op == 0xF7) && reg <= 1) {
+            p += (op == 0xF6) ? 1 : immZ;
+        }
+        // jmp r/m is /4 and /5 of group 5
+        if (op == 0xFF && (reg == 4 || reg == 5)) {
+            info.isUnconditionalJump = true;
+        }
+    }
+    if (flags & OP_REL8) {
+        info.relativeOffset = static_cast<size_t>(p - code);
+        info.relativeSize = 1;
+        p += 1;
+    }
+    if (flags & OP_RELZ) {
+        info.relativeOffset = static_cast<size_t>(p - code);
+        info.relativeSize = immZ;
+        p += immZ;
+    }
+    if (flags & OP_MOFFS) p += addressSize16 ? 2 : 4;
+    if (flags & OP_IMMZ) p += immZ;
+    if (flags & OP_IMM16) p += 2;
+    if (flags & OP_IMM8) p += 1;
+
+    info.isReturn = (op == 0xC2 || op == 0xC3 || op == 0xCA || op == 0xCB);
+    info.isUnconditionalJump = info.isUnconditionalJump || op == 0xE9 ||
+        op == 0xEB || op == 0xEA;
+    info.length = static_cast<size_t>(p - code);
+    return info.length;
+}
+
+// --- Trampoline Builder ---
+
+static void AppendRel32(std::vector<unsigned char>& out, int32_t value) {
+    for (int i = 0; i < 4; ++i) {
+        out.push_back(static_cast<unsigned char>((value >> (i * 8)) & 0xFF));
+    }
+}
+
+// Copy whole instructions covering at least minLength bytes from code into a
+// trampoline placed at trampolineAddress, fixing up relative branches, and
+// finish with a jump back to the rest of the original function.
+// Works purely on byte buffers so it does not depend on the live process.
+bool BuildTrampoline(const unsigned char* code, uintptr_t codeAddress,
+    uintptr_t trampolineAddress, size_t minLength,
+    std::vector<unsigned char>& trampoline, size_t& stolenLength) {
+    trampoline.clear();
+    stolenLength = 0;
+
+    while (stolenLength < minLength) {
+        const unsigned char* instruction = code + stolenLength;
+        InstructionInfo info;
+        if (DecodeInstruction(instruction, info) == 0) {
+            return false;
+        }
+        if (info.relativeSize == 2) {
+            return false; // rel16 branches truncate EIP, never in real code
+        }
+
+        uintptr_t instructionAddress = codeAddress + stolenLength;
+        uintptr_t outAddress = trampolineAddress + trampoline.size();
+
+        if (info.relativeSize != 0) {
+            int32_t displacement = 0;
+            if (info.relativeSize == 1) {
+                displacement = static_cast<int8_t>(instruction[info.relativeOffset]);
+            }
+            else {
+                memcpy(&displacement, instruction + info.relativeOffset, 4);
+            }
+            uintptr_t branchTarget =
+                instructionAddress + info.length + displacement;
+
+            // A branch back into the bytes we overwrite cannot be relocated
+            if (branchTarget > codeAddress &&
+                branchTarget < codeAddress + minLength) {
+                return false;
+            }
+
+            unsigned char op = instruction[info.opcodeOffset];
+            if (info.relativeSize == 4) {
+                // Same encoding, displacement re-based to the trampoline
+                trampoline.insert(trampoline.end(), instruction,
+                    instruction + info.relativeOffset);
+                uintptr_t end = outAddress + info.length;
+                AppendRel32(trampoline, static_cast<int32_t>(branchTarget - end));
+            }
+            else if (op == 0xEB) { // jmp rel8 -> jmp rel32
+                trampoline.push_back(0xE9);
+                AppendRel32(trampoline,
+                    static_cast<int32_t>(branchTarget - (outAddress + 5)));
+            }
+            else if (op >= 0x70 && op <= 0x7F) { // jcc rel8 -> jcc rel32
+                trampoline.push_back(0x0F);
+                trampoline.push_back(static_cast<unsigned char>(0x80 + (op - 0x70)));
+                AppendRel32(trampoline,
+                    static_cast<int32_t>(branchTarget - (outAddress + 6)));
+            }
+            else {
+                return false; // loop/jcxz have no rel32 form
+            }
+        }
+        else {
+            trampoline.insert(trampoline.end(), instruction,
+                instruction + info.length);
+        }
+        stolenLength += info.length;
+
+        // The function ends inside the bytes we need; too short to detour
+        if ((info.isReturn || info.isUnconditionalJump) &&
+            stolenLength < minLength) {
+            return false;
+        }
+    }
+
+    uintptr_t jumpAddress = trampolineAddress + trampoline.size();
+    trampoline.push_back(0xE9);
+    AppendRel32(trampoline, static_cast<int32_t>(
+        (codeAddress + stolenLength) - (jumpAddress + 5)));
+    return true;
+}
+
+// --- Jump Writer ---
+
+#ifdef _WIN32
+// Write a jmp rel32 at address. When the five bytes sit inside one aligned
+// qword they are swapped in with a single cmpxchg8b, so a thread executing
+// the function sees either the old or the new code, never a mix. Otherwise
+// a plain write is only done if the caller says no other thread can run it.
+bool WriteJumpAtomic(uintptr_t address, uintptr_t target, bool allowNonAtomic) {
+    unsigned char jump[DETOUR_JUMP_SIZE];
+    int32_t relative =
+        static_cast<int32_t>(target - (address + DETOUR_JUMP_SIZE));
+    jump[0] = 0xE9;
+    memcpy(&jump[1], &relative, sizeof(relative));
+
+    uintptr_t aligned = address & ~static_cast<uintptr_t>(7);
+    size_t offset = address - aligned;
+    bool atomic = offset + DETOUR_JUMP_SIZE <= 8;
+    if (!atomic && !allowNonAtomic) {
+        return false;
+    }
+
+    void* protectStart = reinterpret_cast<void*>(aligned);
+    DWORD oldProtect;
+    if (!VirtualProtect(protectStart, 16, PAGE_EXECUTE_READWRITE, &oldProtect)) {
+        return false;
+    }
+
+    if (atomic) {
+        volatile LONGLONG* qword = reinterpret_cast<volatile LONGLONG*>(aligned);
+        LONGLONG current, desired;
+        do {
+            current = *qword;
+            desired = current;
+            memcpy(reinterpret_cast<unsigned char*>(&desired) + offset, jump,
+                DETOUR_JUMP_SIZE);
+        } while (InterlockedCompareExchange64(qword, desired, current) != current);
+    }
+    else {
+        memcpy(reinterpret_cast<void*>(address), jump, DETOUR_JUMP_SIZE);
+    }
+
+    FlushInstructionCache(GetCurrentProcess(), protectStart, 16);
+    DWORD tempProtect;
+    VirtualProtect(protectStart, 16, oldProtect, &tempProtect);
+    return true;
+}
+
+// --- Detour Installation ---
+
+// Trampolines are small, so they share one executable page
+static unsigned char* g_trampolinePool = nullptr;
+static size_t g_trampolinePoolUsed = 0;
+static const size_t TRAMPOLINE_POOL_SIZE = 4096;
+static const size_t TRAMPOLINE_SLOT_SIZE = 64;
+
+// Redirect the function at target to replacement. If trampoline is non-null
+// it receives a callable pointer to the original function.
+bool InstallDetour(const std::string& name, uintptr_t target,
+    const void* replacement, void** trampoline) {
+    std::stringstream addrHex;
+    addrHex << "0x" << std::hex << target;
+
+#ifdef _WIN64
+    (void)replacement;
+    (void)trampoline;
+    Log("Error: Cannot detour '" + name + "' at " + addrHex.str() +
+        ", inline detours are only supported in 32-bit builds.");
+    return false;
+#else
+    if (g_trampolinePool == nullptr) {
+        g_trampolinePool = static_cast<unsigned char*>(VirtualAlloc(NULL,
+            TRAMPOLINE_POOL_SIZE, MEM_COMMIT | MEM_RESERVE,
+            PAGE_EXECUTE_READWRITE));
+        if (g_trampolinePool == nullptr) {
+            Log("Error: Failed to allocate trampoline memory. Error code: " +
+                std::to_string(GetLastError()));
+            return false;
+        }
+    }
+    if (g_trampolinePoolUsed + TRAMPOLINE_SLOT_SIZE > TRAMPOLINE_POOL_SIZE) {
+        Log("Error: Trampoline pool exhausted, cannot detour '" + name + "'.");
+        return false;
+    }
+
+    unsigned char* slot = g_trampolinePool + g_trampolinePoolUsed;
+    std::vector<unsigned char> trampolineBytes;
+    size_t stolenLength = 0;
+    if (!BuildTrampoline(reinterpret_cast<const unsigned char*>(target), target,
+        reinterpret_cast<uintptr_t>(slot), DETOUR_JUMP_SIZE, trampolineBytes,
+        stolenLength) ||
+        trampolineBytes.size() > TRAMPOLINE_SLOT_SIZE) {
+        Log("Error: Could not relocate the prologue of '" + name + "' at " +
+            addrHex.str() + ". Detour aborted.");
+        return false;
+    }
+
+    memcpy(slot, trampolineBytes.data(), trampolineBytes.size());
+    FlushInstructionCache(GetCurrentProcess(), slot, trampolineBytes.size());
+    g_trampolinePoolUsed += TRAMPOLINE_SLOT_SIZE;
+
+    if (trampoline != nullptr) {
+        *trampoline = slot;
+    }
+
+    // Before WinMain only the main thread runs game code, so a non-atomic
+    // write is acceptable there
+    if (!WriteJumpAtomic(target, reinterpret_cast<uintptr_t>(replacement),
+        g_initFromEntryPoint)) {
+        Log("Error: Could not safely write the jump for '" + name + "' at " +
+            addrHex.str() + ". Detour aborted.");
+        if (trampoline != nullptr) {
+            *trampoline = nullptr;
+        }
+        return false;
+    }
+
+    Log("Installed detour for '" + name + "' at " + addrHex.str() + " (" +
+        std::to_string(stolenLength) + " bytes relocated).");
+    return true;
+#endif
+}
+#endif
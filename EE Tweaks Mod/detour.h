@@ -0,0 +1,30 @@
+#ifndef DETOUR_H
+#define DETOUR_H
+
+#include "pch.h"
+
+// Size of the jmp rel32 written over a detoured function
+const size_t DETOUR_JUMP_SIZE = 5;
+
+// Decoded details of a single x86 (32-bit mode) instruction
+struct InstructionInfo {
+    size_t length;          // Total length in bytes, 0 if not decodable
+    size_t opcodeOffset;    // Offset of the opcode byte (after prefixes)
+    size_t relativeOffset;  // Offset of the relative displacement, if any
+    size_t relativeSize;    // 1 or 4 for relative branches/calls, else 0
+    bool isReturn;          // ret/retf, the function may end here
+    bool isUnconditionalJump;
+};
+
+// Function declarations
+size_t DecodeInstruction(const unsigned char* code, InstructionInfo& info);
+bool BuildTrampoline(const unsigned char* code, uintptr_t codeAddress,
+    uintptr_t trampolineAddress, size_t minLength,
+    std::vector<unsigned char>& trampoline, size_t& stolenLength);
+#ifdef _WIN32
+bool WriteJumpAtomic(uintptr_t address, uintptr_t target, bool allowNonAtomic);
+bool InstallDetour(const std::string& name, uintptr_t target,
+    const void* replacement, void** trampoline);
+#endif
+
+#endif // DETOUR_H
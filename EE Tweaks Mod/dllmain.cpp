@@ -3,13 +3,67 @@
 #include "globals.h"
 #include "logging.h"
 #include "config.h"
-#include "memory.h"
-#include "patches.h"
+#include "pipeline.h"
+#include "hooks.h"
+#include "profiler.h"
+#include "iocache.h"
+#include "fileio.h"
+#include "prefetch.h"
+#include "counters.h"
+#include "timesource.h"
+#include "d3dhooks.h"
+#include "vbring.h"
+#include "texdedup.h"
+#include "mapplanner.h"
+#include "scheduler.h"
+#include "experiment.h"
+#include "writebuffer.h"
+#include "savecompress.h"
+#include "lockprof.h"
+#include "heapprof.h"
+#include "drawbatch.h"
+#include "powermode.h"
+#include "softblit.h"
+#include "threadmon.h"
+#include "mapprefault.h"
 
 // --- Helper Functions --- (Moved to respective files)
 
+// Write the reports and close the log. Runs once: from the game's
+// ExitProcess call while its threads are still alive, or on FreeLibrary.
+static volatile LONG g_shutdownDone = 0;
+
+static void ShutdownTweaks() {
+    if (InterlockedExchange(&g_shutdownDone, 1) != 0) {
+        return;
+    }
+    ShutdownSamplingProfiler(); // Writes the profile; logs, so goes first
+    ShutdownLockProfiler(); // Writes the lock report
+    ShutdownHeapProfiler(); // Writes the final heap snapshot
+    ShutdownThreadMonitor(); // Logs the busiest threads
+    ShutdownMapPrefault(); // Logs the pages touched ahead of the game
+    ShutdownJobScheduler(); // Logs the job totals
+    ShutdownPowerMode(); // Logs the time in each mode
+    ShutdownSaveCompression(); // Finishes files left open
+    ShutdownWriteCoalescing(); // Writes out files left open
+    ShutdownArchiveReadCache(); // Logs the bytes served
+    ShutdownPrefetch(); // Saves the trace if the window is still open
+    ShutdownHighResolutionTimers(); // Logs the largest drift
+    ShutdownDirect3DHooks(); // Logs the filter totals
+    ShutdownManagedVertexBuffers(); // Logs the ring statistics
+    ShutdownDrawBatching(); // Logs the draw calls saved
+    ShutdownTextureDedup(); // Logs the memory saved
+    ShutdownSoftwareBlit(); // Logs the blits done
+    ShutdownMapPlanner(); // Records the calibration sample
+    ShutdownExperiment(); // Logs an unfinished measurement
+    ShutdownLogging(); // Close the log file properly
+}
+
 // --- Main Mod Logic ---
 void ApplyTweaks() {
+    auto pipelineStart = std::chrono::steady_clock::now();
+    g_mainThreadId = GetCurrentThreadId();
+
     // 0. Get DLL directory and Executable Name/Path FIRST
     char dllPath[MAX_PATH] = { 0 };
     char exePath[MAX_PATH] = { 0 };
@@ -77,7 +131,11 @@ void ApplyTweaks() {
     Log("DLL Directory: " + g_dllDir);
     Log("Game Executable Path: " + g_executablePath);
     Log("Game Executable Name: " + g_executableName);
+    Log(std::string("Initialization stage: ") +
+        (g_initFromEntryPoint ? "game entry point (outside loader lock)" :
+            "DllMain"));
     // Logging status is logged within InitializeLogging()
+    InitializeSharedCounters(); // Live counters for external monitors
 
     if (g_executableName != "EE-AOC.exe" &&
         g_executableName != "Empire Earth.exe" &&
@@ -91,128 +149,57 @@ void ApplyTweaks() {
             "the main executable might fail.");
     }
 
-    // 4. Update standard patch enabled status from config
-    for (auto& patch : g_patches) {
-        patch.enabled = GetConfigBool(patch.name + "Enabled", false);
-        if (!patch.enabled && patch.name != "BypassMapSizeAssertion") {
-            Log("Config: Patch '" + patch.name + "' disabled.");
-        }
-    }
-
-    // Force enable the assertion bypass patch
-    bool assertionPatchFound = false;
-    for (auto& patch : g_patches) {
-        if (patch.name == "BypassMapSizeAssertion") {
-            if (!patch.enabled) {
-                Log("Info: Forcing 'BypassMapSizeAssertion' patch to enabled state.");
-                patch.enabled = true;
-            }
-            assertionPatchFound = true;
-            break;
-        }
-    }
-    if (!assertionPatchFound) {
-        Log("Error: 'BypassMapSizeAssertion' patch definition not found internally.");
-    }
-
-    // 5. Find Standard Patch Locations
-    Log("Scanning for standard patch locations...");
-    for (auto& patch : g_patches) {
-        if (!patch.enabled) {
-            continue;
-        }
-
-        std::string moduleToScan = patch.moduleIdentifier;
-        if (moduleToScan == "GAME_EXECUTABLE") {
-            if (g_executableName == "UNKNOWN_EXE") {
-                Log("Skipping scan for patch '" + patch.name +
-                    "' because game executable name is unknown.");
-                continue;
-            }
-            moduleToScan = g_executableName;
-        }
-
-        MODULEINFO moduleInfo = { 0 };
-        uintptr_t baseAddress = 0;
-        size_t moduleSize = 0;
-        if (!GetModuleInfoByName(moduleToScan, moduleInfo, baseAddress,
-            moduleSize)) {
-            Log("Warning: Could not get module info for '" + moduleToScan +
-                "' needed by patch '" + patch.name +
-                "'. Patch will be skipped.");
-            continue;
-        }
+    // Experiment mode overrides config values, so it goes before any use
+    ApplyExperimentVariant();
 
-        std::vector<unsigned char> originalBytes;
-        if (!HexToBytes(patch.originalHex, originalBytes)) {
-            Log("Error: Cannot scan for patch '" + patch.name +
-                "' due to invalid original hex pattern. Skipping patch.");
-            continue;
-        }
+    // 4. to 7. Find and apply the standard and custom patches
+    PatchPipelineReport patchReport;
+    RunPatchPipeline(false, patchReport);
 
-        patch.patchAddress =
-            FindPattern(baseAddress, moduleSize, originalBytes);
-
-        if (patch.patchAddress != 0) {
-            std::stringstream ss;
-            ss << "0x" << std::hex << patch.patchAddress;
-            Log("Found pattern for patch '" + patch.name + "' in module '" +
-                moduleToScan + "' at address " + ss.str());
-        }
-        else {
-            Log("Warning: Pattern for patch '" + patch.name + "' not found in '" +
-                moduleToScan + "'. Patch will be skipped.");
-        }
+    // 8. Start optional background features
+    if (!InstallProcessExitHook(ShutdownTweaks)) {
+        Log("Warning: Could not hook ExitProcess; the reports are not written "
+            "on exit.");
     }
-
-    // 6. Apply Standard Patches
-    Log("Applying enabled standard patches...");
-    int patchesApplied = 0;
-    for (auto& patch : g_patches) {
-        if (ApplyStandardPatch(patch)) { // ApplyStandardPatch now uses ApplyDataPatch
-            patchesApplied++;
-        }
-    }
-    Log("Applied " + std::to_string(patchesApplied) + " standard patches.");
-
-    // 7. Apply Custom Patches
-    Log("Applying custom patches...");
-    int customPatchesApplied = 0;
-
-    if (ApplyAudioSampleRatePatch()) {
-        customPatchesApplied++;
+    StartJobScheduler(); // First, so the features below can use it
+    StartPowerMode();
+    StartSamplingProfiler();
+    StartLockProfiler();
+    StartMapPrefault(); // Before the heap profiler, which then calls through it
+    StartHeapProfiler();
+    StartThreadMonitor();
+    ApplyHighResolutionTimers();
+    InstallDirect3DHooks();
+    bool archiveCache = InitializeArchiveReadCache();
+    bool startupPrefetch = StartPrefetch();
+    bool writeCoalescing = InitializeWriteCoalescing();
+    bool saveCompression = InitializeSaveCompression();
+    if (archiveCache || startupPrefetch || writeCoalescing ||
+        saveCompression) {
+        InstallFileHooks();
     }
 
-    if (g_executableName != "UNKNOWN_EXE") {
-        if (ApplyCustomFlatWorldSizesPatch()) {
-            customPatchesApplied++;
-        }
-        if (ApplyGiganticMapSizePatch()) {
-            customPatchesApplied++;
-        }
-        if (ApplyMapGridLimitPatch()) { // Depends on GiganticMapSize
-            customPatchesApplied++;
-        }
-        // *** APPLY NEW PATCH HERE ***
-        if (ApplyChunkDimensionPatch()) { // Depends on Gigantic/Custom sizes > 220
-            customPatchesApplied++;
-        }
-    }
-    else {
-        Log("Skipping game executable specific patches (FlatWorldSizes, "
-            "GiganticMapSize, MapGridLimit, ChunkDimension) because game "
-            "executable name is unknown.");
-    }
-
-    Log("Applied " + std::to_string(customPatchesApplied) + " custom patches.");
-
-    Log("Patching process finished.");
+    auto pipelineMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - pipelineStart).count();
+    Log("Patching process finished in " + std::to_string(pipelineMs) + " ms.");
+    CounterSet(COUNTER_PIPELINE_US, static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - pipelineStart).count()));
+    CounterSet(COUNTER_PATCHES_APPLIED,
+        static_cast<uint64_t>(patchReport.standardApplied +
+            patchReport.customApplied));
     Log("--------------------");
 
-    // 8. Close Log File (handled by ShutdownLogging)
+    // 9. Close Log File (handled by ShutdownLogging)
     // ShutdownLogging(); // Call this in DLL_PROCESS_DETACH instead
 }
 
+// Runs from the entry point hook on the main thread, before WinMain
+void ApplyTweaksFromEntryPoint() {
+    g_initFromEntryPoint = true; // Loader lock is free: threads are safe now
+    ApplyTweaks();
+}
+
 // --- DLL Entry Point ---
 BOOL APIENTRY DllMain(HMODULE hModule, DWORD ul_reason_for_call,
     LPVOID lpReserved) {
@@ -220,14 +207,27 @@ BOOL APIENTRY DllMain(HMODULE hModule, DWORD ul_reason_for_call,
     case DLL_PROCESS_ATTACH:
         g_hModule = hModule; // Store module handle *early*
         DisableThreadLibraryCalls(hModule);
-        ApplyTweaks(); // Run main logic
+        // lpReserved is non-NULL for static loads, i.e. before the game's
+        // entry point has run. Defer all work until then so nothing heavy
+        // happens under the loader lock. Dynamic loads (LoadLibrary) happen
+        // after startup, so there the work has to be done right away.
+        if (lpReserved == NULL ||
+            !InstallEntryPointHook(ApplyTweaksFromEntryPoint)) {
+            ApplyTweaks(); // Run main logic
+        }
         break;
     case DLL_THREAD_ATTACH:
     case DLL_THREAD_DETACH:
         break; // Do nothing
     case DLL_PROCESS_DETACH:
         OutputDebugStringA("tweaks.dll: Unloading.\n");
-        ShutdownLogging(); // Close the log file properly on unload
+        // lpReserved is non-NULL when the process is exiting. The other
+        // threads are gone by now and may have died holding our locks, so
+        // nothing may lock or write files here; the reports were written from
+        // the ExitProcess hook. On FreeLibrary the threads are still alive.
+        if (lpReserved == NULL) {
+            ShutdownTweaks();
+        }
         break;
     }
     return TRUE;
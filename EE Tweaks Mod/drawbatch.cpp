@@ -0,0 +1,498 @@
+#include "pch.h"
+#include "drawbatch.h"
+#include "vbring.h" // GetFvfVertexSize()
+
+#ifdef _WIN32
+#include "logging.h" // Access Log()
+#include "config.h"  // Access config functions
+#include "hooks.h"   // Access HookVtableEntry()
+#include "counters.h"
+#endif
+
+// --- Draw Batcher ---
+
+// The list a primitive type is merged into; 0 if it is not merged
+static uint32_t ListTypeOf(uint32_t primitiveType) {
+    switch (primitiveType) {
+    case PRIMITIVE_POINT_LIST: return PRIMITIVE_POINT_LIST;
+    case PRIMITIVE_LINE_LIST:
+    case PRIMITIVE_LINE_STRIP: return PRIMITIVE_LINE_LIST;
+    case PRIMITIVE_TRIANGLE_LIST:
+    case PRIMITIVE_TRIANGLE_STRIP: return PRIMITIVE_TRIANGLE_LIST;
+    }
+    return 0;
+}
+
+static uint32_t VerticesPerPrimitive(uint32_t listType) {
+    return listType == PRIMITIVE_TRIANGLE_LIST ? 3 :
+        listType == PRIMITIVE_LINE_LIST ? 2 : 1;
+}
+
+// Indices a draw of count vertices (or indices) needs as a list
+static uint32_t ListIndexCount(uint32_t primitiveType, uint32_t count) {
+    switch (primitiveType) {
+    case PRIMITIVE_LINE_STRIP: return count >= 2 ? (count - 1) * 2 : 0;
+    case PRIMITIVE_TRIANGLE_STRIP: return count >= 3 ? (count - 2) * 3 : 0;
+    }
+    return count - count % VerticesPerPrimitive(primitiveType);
+}
+
+DrawBatcher::DrawBatcher(uint32_t maxBytes) : m_maxBytes(maxBytes) {
+    m_vertices.reserve(maxBytes);
+}
+
+BatchResult DrawBatcher::Add(uint32_t primitiveType, uint32_t fvf,
+    const void* vertices, uint32_t vertexCount, const uint16_t* indices,
+    uint32_t indexCount, uint32_t flags) {
+    uint32_t listType = ListTypeOf(primitiveType);
+    uint32_t stride = GetFvfVertexSize(fvf);
+    if (listType == 0 || stride == 0 || vertices == nullptr || vertexCount == 0 ||
+        (indices != nullptr && primitiveType == PRIMITIVE_POINT_LIST)) {
+        return BATCH_NOT_BATCHABLE;
+    }
+    // Vertices past the last whole primitive of a list are never drawn
+    if (primitiveType == listType) {
+        uint32_t per = VerticesPerPrimitive(listType);
+        if (indices != nullptr) indexCount -= indexCount % per;
+        else vertexCount -= vertexCount % per;
+    }
+    uint32_t listIndices = ListIndexCount(primitiveType,
+        indices != nullptr ? indexCount : vertexCount);
+    size_t bytes = static_cast<size_t>(vertexCount) * stride;
+    if (listIndices == 0 || vertexCount > BATCH_MAX_VERTICES ||
+        listIndices > BATCH_MAX_INDICES || bytes > m_maxBytes) {
+        return BATCH_NOT_BATCHABLE;
+    }
+    const uint8_t* source = static_cast<const uint8_t*>(vertices);
+
+    if (m_draws == 0) {
+        m_firstType = primitiveType;
+        m_firstIndexed = indices != nullptr;
+        m_asItCame = true;
+        m_listType = listType;
+        m_fvf = fvf;
+        m_flags = flags;
+        m_vertices.assign(source, source + bytes);
+        if (indices != nullptr) m_indices.assign(indices, indices + indexCount);
+        m_vertexCount = vertexCount;
+        m_listIndexCount = listIndices;
+        m_draws = 1;
+        return BATCH_ADDED;
+    }
+
+    if (listType != m_listType || fvf != m_fvf || flags != m_flags) {
+        return BATCH_FLUSH_FIRST;
+    }
+    bool indexed = m_indexed || indices != nullptr || primitiveType != listType ||
+        (m_asItCame && (m_firstIndexed || m_firstType != m_listType));
+    if (m_vertexCount + vertexCount > BATCH_MAX_VERTICES ||
+        m_vertices.size() + bytes > m_maxBytes ||
+        (indexed && m_listIndexCount + listIndices > BATCH_MAX_INDICES)) {
+        return BATCH_FLUSH_FIRST;
+    }
+    ConvertToList(indexed);
+
+    uint32_t base = m_vertexCount;
+    m_vertices.insert(m_vertices.end(), source, source + bytes);
+    if (m_indexed) {
+        AppendListIndices(primitiveType, indices,
+            indices != nullptr ? indexCount : vertexCount, base);
+    }
+    m_vertexCount += vertexCount;
+    m_listIndexCount += listIndices;
+    m_draws++;
+    return BATCH_ADDED;
+}
+
+// Turn the batch into the list it is merged as, indexed if a draw needs it
+void DrawBatcher::ConvertToList(bool indexed) {
+    if (m_asItCame) {
+        m_asItCame = false;
+        if (!indexed) {
+            return; // A plain list stays as it is
+        }
+        m_scratch.swap(m_indices);
+        m_indices.clear();
+        AppendListIndices(m_firstType, m_firstIndexed ? m_scratch.data() : nullptr,
+            m_firstIndexed ? static_cast<uint32_t>(m_scratch.size()) :
+            m_vertexCount, 0);
+        m_indexed = true;
+    }
+    else if (indexed && !m_indexed) {
+        for (uint32_t i = 0; i < m_vertexCount; ++i) {
+            m_indices.push_back(static_cast<uint16_t>(i));
+        }
+        m_indexed = true;
+    }
+}
+
+// Strip triangle i is (i, i+1, i+2) when i is even and (i, i+2, i+1) when it
+// is odd, as Direct3D draws it: same winding, same first vertex
+void DrawBatcher::AppendListIndices(uint32_t primitiveType,
+    const uint16_t* indices, uint32_t count, uint32_t base) {
+    auto at = [indices, base](uint32_t i) {
+        return static_cast<uint16_t>(base + (indices != nullptr ? indices[i] : i));
+    };
+    switch (primitiveType) {
+    case PRIMITIVE_LINE_STRIP:
+        for (uint32_t i = 0; i + 1 < count; ++i) {
+            m_indices.push_back(at(i));
+            m_indices.push_back(at(i + 1));
+        }
+        break;
+    case PRIMITIVE_TRIANGLE_STRIP:
+        for (uint32_t i = 0; i + 2 < count; ++i) {
+            m_indices.push_back(at(i));
+            m_indices.push_back(at(i + 1 + (i & 1)));
+            m_indices.push_back(at(i + 2 - (i & 1)));
+        }
+        break;
+    default:
+        for (uint32_t i = 0; i < count; ++i) {
+            m_indices.push_back(at(i));
+        }
+        break;
+    }
+}
+
+MergedDraw DrawBatcher::Merged() const {
+    MergedDraw draw;
+    bool indexed = m_asItCame ? m_firstIndexed : m_indexed;
+    draw.primitiveType = m_asItCame ? m_firstType : m_listType;
+    draw.fvf = m_fvf;
+    draw.flags = m_flags;
+    draw.vertices = m_vertices.data();
+    draw.vertexCount = m_vertexCount;
+    draw.indices = indexed ? m_indices.data() : nullptr;
+    draw.indexCount = indexed ? static_cast<uint32_t>(m_indices.size()) : 0;
+    draw.draws = m_draws;
+    return draw;
+}
+
+void DrawBatcher::Clear() {
+    m_draws = 0;
+    m_asItCame = false;
+    m_indexed = false;
+    m_vertexCount = 0;
+    m_listIndexCount = 0;
+    m_vertices.clear();
+    m_indices.clear();
+}
+
+// --- Direct3D 7 Draw Hooks ---
+// DrawPrimitive and DrawIndexedPrimitive are held back while they can be
+// merged. Everything that could change how a held draw looks flushes it
+// first: device state calls, other draws, reading the clip status, and
+// writes to any surface (a texture may be updated between two draws).
+// Surface calls can come from any thread, so the batch state is guarded by
+// g_batchMutex. It is recursive because a flush calls into the device,
+// which can reach the surface hooks again on the same thread.
+
+#ifdef _WIN32
+// Vtable slots, in the method order of d3d.h and ddraw.h
+const size_t DEVICE_SLOT_DRAW_PRIMITIVE = 25;
+const size_t DEVICE_SLOT_DRAW_INDEXED_PRIMITIVE = 26;
+const size_t DEVICE_SLOTS = 49;
+const size_t SURFACE_SLOTS = 49;
+
+typedef HRESULT(WINAPI* DrawPrimitiveFn)(void* self, DWORD primitiveType,
+    DWORD fvf, void* vertices, DWORD vertexCount, DWORD flags);
+typedef HRESULT(WINAPI* DrawIndexedPrimitiveFn)(void* self,
+    DWORD primitiveType, DWORD fvf, void* vertices, DWORD vertexCount,
+    WORD* indices, DWORD indexCount, DWORD flags);
+
+static DrawPrimitiveFn g_originalDrawPrimitive = nullptr;
+static DrawIndexedPrimitiveFn g_originalDrawIndexedPrimitive = nullptr;
+static void* g_deviceOriginals[DEVICE_SLOTS] = { nullptr };
+static void* g_surfaceOriginals[SURFACE_SLOTS] = { nullptr };
+
+static bool g_batchingEnabled = false;
+static std::recursive_mutex g_batchMutex;
+static DrawBatcher* g_batcher = nullptr;
+static void* g_device = nullptr;
+static DWORD g_batchThread = 0; // Thread that added the held draws
+static bool g_flushing = false;
+// The first failed merged draw since the last EndScene, which returns it
+static HRESULT g_heldDrawError = S_OK;
+
+static uint64_t g_drawsIn = 0;
+static uint64_t g_drawsOut = 0;
+static uint32_t g_frameDrawsIn = 0;
+static uint32_t g_frameDrawsOut = 0;
+static uint64_t g_failedFlushes = 0;
+
+// Hand the held draws to the device as one call. The game's calls have
+// already returned, so an error is kept for EndScene; the first one is
+// logged. Called with g_batchMutex held.
+static void FlushPendingDraws() {
+    if (!g_batcher->Pending() || g_flushing) {
+        return;
+    }
+    g_flushing = true;
+    MergedDraw draw = g_batcher->Merged();
+    HRESULT result;
+    if (draw.indices != nullptr) {
+        result = g_originalDrawIndexedPrimitive(g_device, draw.primitiveType,
+            draw.fvf, const_cast<void*>(draw.vertices), draw.vertexCount,
+            const_cast<WORD*>(draw.indices), draw.indexCount, draw.flags);
+    }
+    else {
+        result = g_originalDrawPrimitive(g_device, draw.primitiveType, draw.fvf,
+            const_cast<void*>(draw.vertices), draw.vertexCount, draw.flags);
+    }
+    g_drawsOut++;
+    g_frameDrawsOut++;
+    if (FAILED(result) && SUCCEEDED(g_heldDrawError)) {
+        g_heldDrawError = result;
+    }
+    if (FAILED(result) && g_failedFlushes++ == 0) {
+        Log("Warning: Draw Batching: a merged draw of " +
+            std::to_string(draw.draws) + " calls failed. Error code: " +
+            std::to_string(static_cast<uint32_t>(result)));
+    }
+    g_batcher->Clear();
+    g_flushing = false;
+}
+
+// Hold the draw if it can be merged, otherwise flush and pass it on
+static HRESULT AddDraw(void* self, DWORD primitiveType, DWORD fvf,
+    void* vertices, DWORD vertexCount, WORD* indices, DWORD indexCount,
+    DWORD flags) {
+    std::lock_guard<std::recursive_mutex> lock(g_batchMutex);
+    g_drawsIn++;
+    g_frameDrawsIn++;
+    BatchResult added = g_batcher->Add(primitiveType, fvf, vertices,
+        vertexCount, indices, indexCount, flags);
+    if (added == BATCH_FLUSH_FIRST) {
+        FlushPendingDraws();
+        added = g_batcher->Add(primitiveType, fvf, vertices, vertexCount,
+            indices, indexCount, flags);
+    }
+    if (added == BATCH_ADDED) {
+        g_batchThread = GetCurrentThreadId();
+        return S_OK;
+    }
+    FlushPendingDraws();
+    g_drawsOut++;
+    g_frameDrawsOut++;
+    if (indices != NULL) {
+        return g_originalDrawIndexedPrimitive(self, primitiveType, fvf,
+            vertices, vertexCount, indices, indexCount, flags);
+    }
+    return g_originalDrawPrimitive(self, primitiveType, fvf, vertices,
+        vertexCount, flags);
+}
+
+static HRESULT WINAPI HookedDrawPrimitive(void* self, DWORD primitiveType,
+    DWORD fvf, void* vertices, DWORD vertexCount, DWORD flags) {
+    if (self != g_device || !g_batchingEnabled) {
+        return g_originalDrawPrimitive(self, primitiveType, fvf, vertices,
+            vertexCount, flags);
+    }
+    return AddDraw(self, primitiveType, fvf, vertices, vertexCount, NULL, 0,
+        flags);
+}
+
+static HRESULT WINAPI HookedDrawIndexedPrimitive(void* self,
+    DWORD primitiveType, DWORD fvf, void* vertices, DWORD vertexCount,
+    WORD* indices, DWORD indexCount, DWORD flags) {
+    if (self != g_device || !g_batchingEnabled) {
+        return g_originalDrawIndexedPrimitive(self, primitiveType, fvf,
+            vertices, vertexCount, indices, indexCount, flags);
+    }
+    if (indices == NULL) {
+        std::lock_guard<std::recursive_mutex> lock(g_batchMutex);
+        FlushPendingDraws(); // Invalid; the device reports it
+        return g_originalDrawIndexedPrimitive(self, primitiveType, fvf,
+            vertices, vertexCount, indices, indexCount, flags);
+    }
+    return AddDraw(self, primitiveType, fvf, vertices, vertexCount, indices,
+        indexCount, flags);
+}
+
+// On x86 every argument of these methods, floats included, takes one 4-byte
+// stack slot, so one template forwards them all
+template <size_t Slot, typename... Args>
+static HRESULT WINAPI FlushBeforeDeviceCall(void* self, Args... args) {
+    if (self == g_device) {
+        std::lock_guard<std::recursive_mutex> lock(g_batchMutex);
+        FlushPendingDraws();
+    }
+    typedef HRESULT(WINAPI* MethodFn)(void*, Args...);
+    return reinterpret_cast<MethodFn>(g_deviceOriginals[Slot])(self, args...);
+}
+
+// Surface calls may come from other threads; only the thread that holds the
+// draws may flush them
+template <size_t Slot, typename... Args>
+static HRESULT WINAPI FlushBeforeSurfaceCall(void* self, Args... args) {
+    {
+        std::lock_guard<std::recursive_mutex> lock(g_batchMutex);
+        if (g_batcher->Pending() && GetCurrentThreadId() == g_batchThread) {
+            FlushPendingDraws();
+        }
+    }
+    typedef HRESULT(WINAPI* MethodFn)(void*, Args...);
+    return reinterpret_cast<MethodFn>(g_surfaceOriginals[Slot])(self, args...);
+}
+
+struct FlushHook {
+    size_t slot;
+    const void* replacement;
+};
+
+static const FlushHook DEVICE_FLUSH_HOOKS[] = {
+    { 8, reinterpret_cast<const void*>( // SetRenderTarget
+        FlushBeforeDeviceCall<8, DWORD, DWORD>) },
+    { 10, reinterpret_cast<const void*>( // Clear
+        FlushBeforeDeviceCall<10, DWORD, DWORD, DWORD, DWORD, DWORD, DWORD>) },
+    { 11, reinterpret_cast<const void*>( // SetTransform
+        FlushBeforeDeviceCall<11, DWORD, DWORD>) },
+    { 13, reinterpret_cast<const void*>( // SetViewport
+        FlushBeforeDeviceCall<13, DWORD>) },
+    { 14, reinterpret_cast<const void*>( // MultiplyTransform
+        FlushBeforeDeviceCall<14, DWORD, DWORD>) },
+    { 16, reinterpret_cast<const void*>( // SetMaterial
+        FlushBeforeDeviceCall<16, DWORD>) },
+    { 18, reinterpret_cast<const void*>( // SetLight
+        FlushBeforeDeviceCall<18, DWORD, DWORD>) },
+    { 20, reinterpret_cast<const void*>( // SetRenderState
+        FlushBeforeDeviceCall<20, DWORD, DWORD>) },
+    { 22, reinterpret_cast<const void*>( // BeginStateBlock
+        FlushBeforeDeviceCall<22>) },
+    { 23, reinterpret_cast<const void*>( // EndStateBlock
+        FlushBeforeDeviceCall<23, DWORD>) },
+    { 24, reinterpret_cast<const void*>( // PreLoad
+        FlushBeforeDeviceCall<24, DWORD>) },
+    { 27, reinterpret_cast<const void*>( // SetClipStatus
+        FlushBeforeDeviceCall<27, DWORD>) },
+    { 28, reinterpret_cast<const void*>( // GetClipStatus
+        FlushBeforeDeviceCall<28, DWORD>) },
+    { 29, reinterpret_cast<const void*>( // DrawPrimitiveStrided
+        FlushBeforeDeviceCall<29, DWORD, DWORD, DWORD, DWORD, DWORD>) },
+    { 30, reinterpret_cast<const void*>( // DrawIndexedPrimitiveStrided
+        FlushBeforeDeviceCall<30, DWORD, DWORD, DWORD, DWORD, DWORD, DWORD, DWORD>) },
+    { 31, reinterpret_cast<const void*>( // DrawPrimitiveVB
+        FlushBeforeDeviceCall<31, DWORD, DWORD, DWORD, DWORD, DWORD>) },
+    { 32, reinterpret_cast<const void*>( // DrawIndexedPrimitiveVB
+        FlushBeforeDeviceCall<32, DWORD, DWORD, DWORD, DWORD, DWORD, DWORD, DWORD>) },
+    { 35, reinterpret_cast<const void*>( // SetTexture
+        FlushBeforeDeviceCall<35, DWORD, DWORD>) },
+    { 37, reinterpret_cast<const void*>( // SetTextureStageState
+        FlushBeforeDeviceCall<37, DWORD, DWORD, DWORD>) },
+    { 39, reinterpret_cast<const void*>( // ApplyStateBlock
+        FlushBeforeDeviceCall<39, DWORD>) },
+    { 40, reinterpret_cast<const void*>( // CaptureStateBlock
+        FlushBeforeDeviceCall<40, DWORD>) },
+    { 43, reinterpret_cast<const void*>( // Load
+        FlushBeforeDeviceCall<43, DWORD, DWORD, DWORD, DWORD, DWORD>) },
+    { 44, reinterpret_cast<const void*>( // LightEnable
+        FlushBeforeDeviceCall<44, DWORD, DWORD>) },
+    { 46, reinterpret_cast<const void*>( // SetClipPlane
+        FlushBeforeDeviceCall<46, DWORD, DWORD>) },
+};
+
+static const FlushHook SURFACE_FLUSH_HOOKS[] = {
+    { 5, reinterpret_cast<const void*>( // Blt
+        FlushBeforeSurfaceCall<5, DWORD, DWORD, DWORD, DWORD, DWORD>) },
+    { 7, reinterpret_cast<const void*>( // BltFast
+        FlushBeforeSurfaceCall<7, DWORD, DWORD, DWORD, DWORD, DWORD>) },
+    { 11, reinterpret_cast<const void*>( // Flip
+        FlushBeforeSurfaceCall<11, DWORD, DWORD>) },
+    { 17, reinterpret_cast<const void*>( // GetDC
+        FlushBeforeSurfaceCall<17, DWORD>) },
+    { 25, reinterpret_cast<const void*>( // Lock
+        FlushBeforeSurfaceCall<25, DWORD, DWORD, DWORD, DWORD>) },
+    { 29, reinterpret_cast<const void*>( // SetColorKey
+        FlushBeforeSurfaceCall<29, DWORD, DWORD>) },
+    { 31, reinterpret_cast<const void*>( // SetPalette
+        FlushBeforeSurfaceCall<31, DWORD>) },
+};
+
+// Read config. Returns true if the Direct3D hooks are needed.
+bool InitializeDrawBatching() {
+    Log("Checking Draw Batching...");
+    if (!GetConfigBool("DrawBatchingEnabled", false)) {
+        Log("Draw Batching is disabled in config.");
+        return false;
+    }
+    int bufferKB = GetConfigInt("DrawBatchingBufferKB", 256);
+    if (bufferKB < 16) bufferKB = 16;
+    if (bufferKB > 4096) bufferKB = 4096;
+    g_batcher = new DrawBatcher(static_cast<uint32_t>(bufferKB) * 1024);
+    g_batchingEnabled = true;
+    return true;
+}
+
+// Start batching the draws of a new device. Installed before the state
+// filter, so only the state calls the filter lets through flush. All
+// surfaces share one vtable; the render target is the first one at hand.
+void DrawBatchingOnDevice(void* device, void* renderTarget) {
+    if (!g_batchingEnabled) {
+        return;
+    }
+    std::lock_guard<std::recursive_mutex> lock(g_batchMutex);
+    g_batcher->Clear();
+    g_heldDrawError = S_OK;
+
+    if (g_originalDrawPrimitive == nullptr) {
+        bool hooked =
+            HookVtableEntry(device, DEVICE_SLOT_DRAW_PRIMITIVE,
+                reinterpret_cast<const void*>(HookedDrawPrimitive),
+                reinterpret_cast<void**>(&g_originalDrawPrimitive)) &&
+            HookVtableEntry(device, DEVICE_SLOT_DRAW_INDEXED_PRIMITIVE,
+                reinterpret_cast<const void*>(HookedDrawIndexedPrimitive),
+                reinterpret_cast<void**>(&g_originalDrawIndexedPrimitive));
+        for (const FlushHook& hook : DEVICE_FLUSH_HOOKS) {
+            hooked = hooked && HookVtableEntry(device, hook.slot,
+                hook.replacement, &g_deviceOriginals[hook.slot]);
+        }
+        for (const FlushHook& hook : SURFACE_FLUSH_HOOKS) {
+            hooked = hooked && renderTarget != nullptr &&
+                HookVtableEntry(renderTarget, hook.slot, hook.replacement,
+                    &g_surfaceOriginals[hook.slot]);
+        }
+        if (!hooked) {
+            // Slots already hooked keep forwarding; nothing is held back
+            Log("Warning: Could not hook the Direct3D draw and state calls. "
+                "Draw Batching not applied.");
+            g_batchingEnabled = false;
+            return;
+        }
+    }
+    g_device = device;
+    Log("Draw Batching attached (" + std::to_string(sizeof(DEVICE_FLUSH_HOOKS) /
+        sizeof(FlushHook) + sizeof(SURFACE_FLUSH_HOOKS) / sizeof(FlushHook)) +
+        " flush points).");
+}
+
+// Draw what is held and publish the frame's call counts. Returns the first
+// merged draw of the frame that failed, or S_OK.
+HRESULT DrawBatchingOnEndScene(void* device) {
+    if (!g_batchingEnabled || device != g_device) {
+        return S_OK;
+    }
+    std::lock_guard<std::recursive_mutex> lock(g_batchMutex);
+    FlushPendingDraws();
+    HRESULT heldResult = g_heldDrawError;
+    g_heldDrawError = S_OK;
+    CounterSet(COUNTER_D3D_FRAME_DRAWS_IN, g_frameDrawsIn);
+    CounterSet(COUNTER_D3D_FRAME_DRAWS_OUT, g_frameDrawsOut);
+    CounterSet(COUNTER_D3D_DRAWS_IN, g_drawsIn);
+    CounterSet(COUNTER_D3D_DRAWS_OUT, g_drawsOut);
+    g_frameDrawsIn = 0;
+    g_frameDrawsOut = 0;
+    return heldResult;
+}
+
+// Log the totals. Called at shutdown.
+void ShutdownDrawBatching() {
+    if (g_drawsIn == 0) {
+        return;
+    }
+    Log("Draw Batching: " + std::to_string(g_drawsIn) + " draw calls in, " +
+        std::to_string(g_drawsOut) + " out (" +
+        std::to_string(100 - g_drawsOut * 100 / g_drawsIn) + "% fewer), " +
+        std::to_string(g_failedFlushes) + " failed merged draws.");
+}
+#endif
@@ -0,0 +1,90 @@
+#ifndef DRAWBATCH_H
+#define DRAWBATCH_H
+
+#include "pch.h"
+
+// D3DPRIMITIVETYPE values
+const uint32_t PRIMITIVE_POINT_LIST = 1;
+const uint32_t PRIMITIVE_LINE_LIST = 2;
+const uint32_t PRIMITIVE_LINE_STRIP = 3;
+const uint32_t PRIMITIVE_TRIANGLE_LIST = 4;
+const uint32_t PRIMITIVE_TRIANGLE_STRIP = 5;
+const uint32_t PRIMITIVE_TRIANGLE_FAN = 6;
+
+// Limits of one Direct3D 7 draw call with WORD indices
+const uint32_t BATCH_MAX_VERTICES = 0xFFFF;
+const uint32_t BATCH_MAX_INDICES = 0xFFFF;
+
+// A draw as handed to the device
+struct MergedDraw {
+    uint32_t primitiveType;
+    uint32_t fvf;
+    uint32_t flags; // D3DDP_*
+    const void* vertices;
+    uint32_t vertexCount;
+    const uint16_t* indices; // nullptr for DrawPrimitive
+    uint32_t indexCount;
+    uint32_t draws; // Calls merged into it
+};
+
+enum BatchResult {
+    BATCH_ADDED = 0,
+    BATCH_FLUSH_FIRST = 1,   // Does not fit the pending batch; flush and retry
+    BATCH_NOT_BATCHABLE = 2, // Flush and draw it as it came
+};
+
+// Merges consecutive user-pointer draws with the same vertex format, flags
+// and kind of primitive into one draw. Vertices are copied, so the caller's
+// memory may change after Add. Strips become indexed lists with the
+// triangles in Direct3D's order and winding, which keeps flat shading too
+// (it uses each triangle's first vertex); fans are not merged, as they flat
+// shade from a different vertex. A batch of one draw is handed back exactly
+// as it came.
+class DrawBatcher {
+public:
+    explicit DrawBatcher(uint32_t maxBytes); // Vertex bytes per batch
+
+    // indices is nullptr for DrawPrimitive. The caller must flush the
+    // pending batch first on anything but BATCH_ADDED.
+    BatchResult Add(uint32_t primitiveType, uint32_t fvf, const void* vertices,
+        uint32_t vertexCount, const uint16_t* indices, uint32_t indexCount,
+        uint32_t flags);
+    bool Pending() const { return m_draws > 0; }
+    MergedDraw Merged() const; // Valid until the next Add or Clear
+    void Clear();
+
+private:
+    void ConvertToList(bool indexed);
+    void AppendListIndices(uint32_t primitiveType, const uint16_t* indices,
+        uint32_t count, uint32_t base);
+
+    uint32_t m_maxBytes;
+    uint32_t m_draws = 0;
+    // The first draw as it came, kept that way while it is the only one
+    uint32_t m_firstType = 0;
+    bool m_firstIndexed = false;
+    bool m_asItCame = false;
+    uint32_t m_listType = 0;
+    uint32_t m_fvf = 0;
+    uint32_t m_flags = 0;
+    uint32_t m_vertexCount = 0;
+    uint32_t m_listIndexCount = 0; // Indices the batch needs as an indexed list
+    bool m_indexed = false; // Once merged: drawn as an indexed list
+    std::vector<uint8_t> m_vertices;
+    std::vector<uint16_t> m_indices;
+    std::vector<uint16_t> m_scratch;
+};
+
+// Function declarations
+#ifdef _WIN32
+bool InitializeDrawBatching(); // Reads config
+void ShutdownDrawBatching();
+
+// Called from the Direct3D hook chain (d3dhooks.cpp)
+void DrawBatchingOnDevice(void* device, void* renderTarget);
+// Before the real EndScene. Returns the error of a held draw that failed
+// since the last call, or S_OK.
+HRESULT DrawBatchingOnEndScene(void* device);
+#endif
+
+#endif // DRAWBATCH_H
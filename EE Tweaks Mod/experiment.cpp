@@ -0,0 +1,379 @@
+#include "pch.h"
+#include "experiment.h"
+
+#include <cmath>
+
+#ifdef _WIN32
+#include "globals.h"   // Access g_dllDir, EXPERIMENT_FILE
+#include "logging.h"   // Access Log()
+#include "config.h"    // Access config functions and g_config
+#include "d3dhooks.h"  // Access RequestFrameTiming(), FrameTimeHistogram
+#include "scheduler.h" // Access SubmitJob()
+#endif
+
+// --- Variants ---
+
+static std::string TrimSpaces(const std::string& text) {
+    size_t first = text.find_first_not_of(" \t");
+    if (first == std::string::npos) {
+        return "";
+    }
+    size_t last = text.find_last_not_of(" \t");
+    return text.substr(first, last - first + 1);
+}
+
+bool ParseVariant(const std::string& text,
+    std::vector<ConfigOverride>& overrides) {
+    overrides.clear();
+    std::stringstream ss(text);
+    std::string item;
+    while (std::getline(ss, item, ';')) {
+        item = TrimSpaces(item);
+        if (item.empty()) {
+            continue;
+        }
+        size_t equalsPos = item.find('=');
+        if (equalsPos == std::string::npos || equalsPos == 0) {
+            return false;
+        }
+        ConfigOverride setting;
+        setting.key = TrimSpaces(item.substr(0, equalsPos));
+        setting.value = TrimSpaces(item.substr(equalsPos + 1));
+        overrides.push_back(setting);
+    }
+    return true;
+}
+
+int NextExperimentVariant(int variantCount,
+    const std::vector<ExperimentRun>& runs) {
+    int best = 1;
+    size_t bestRuns = SIZE_MAX;
+    for (int variant = 1; variant <= variantCount; ++variant) {
+        size_t count = 0;
+        for (const ExperimentRun& run : runs) {
+            if (run.variant == variant) count++;
+        }
+        if (count < bestRuns) {
+            best = variant;
+            bestRuns = count;
+        }
+    }
+    return best;
+}
+
+// --- Results File ---
+
+// One line per run; the settings come last so they may contain commas:
+// variant,frames,windowMs,meanMs,p50Ms,p95Ms,p99Ms,maxMs,cpuPercent,settings
+bool ReadExperimentRuns(std::istream& in, std::vector<ExperimentRun>& runs) {
+    std::string line;
+    while (std::getline(in, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        std::stringstream ss(line);
+        std::string fields[9];
+        for (std::string& field : fields) {
+            if (!std::getline(ss, field, ',')) {
+                return false;
+            }
+        }
+        ExperimentRun run;
+        std::getline(ss, run.settings);
+        try {
+            run.variant = std::stoi(fields[0]);
+            run.frames = std::stoull(fields[1]);
+            run.windowMs = std::stoull(fields[2]);
+            run.meanFrameMs = std::stod(fields[3]);
+            run.p50FrameMs = std::stod(fields[4]);
+            run.p95FrameMs = std::stod(fields[5]);
+            run.p99FrameMs = std::stod(fields[6]);
+            run.maxFrameMs = std::stod(fields[7]);
+            run.cpuPercent = std::stod(fields[8]);
+        }
+        catch (const std::exception&) {
+            return false;
+        }
+        if (run.variant < 1) {
+            return false;
+        }
+        runs.push_back(run);
+    }
+    return true;
+}
+
+void WriteExperimentRun(std::ostream& out, const ExperimentRun& run) {
+    std::string settings = run.settings;
+    std::replace(settings.begin(), settings.end(), '\n', ' ');
+    out << run.variant << ',' << run.frames << ',' << run.windowMs << ','
+        << std::fixed << std::setprecision(3) << run.meanFrameMs << ','
+        << run.p50FrameMs << ',' << run.p95FrameMs << ',' << run.p99FrameMs
+        << ',' << run.maxFrameMs << ',' << std::setprecision(1)
+        << run.cpuPercent << ',' << settings << '\n';
+}
+
+// --- Statistics ---
+
+double GetMetric(const ExperimentRun& run, ExperimentMetric metric) {
+    switch (metric) {
+    case METRIC_MEAN_FRAME: return run.meanFrameMs;
+    case METRIC_P95_FRAME: return run.p95FrameMs;
+    case METRIC_P99_FRAME: return run.p99FrameMs;
+    case METRIC_CPU: return run.cpuPercent;
+    default: return 0;
+    }
+}
+
+const char* GetMetricName(ExperimentMetric metric) {
+    switch (metric) {
+    case METRIC_MEAN_FRAME: return "mean frame ms";
+    case METRIC_P95_FRAME: return "p95 frame ms";
+    case METRIC_P99_FRAME: return "p99 frame ms";
+    case METRIC_CPU: return "CPU %";
+    default: return "?";
+    }
+}
+
+// Between table rows, uses the row below (fewer degrees of freedom), whose
+// larger value widens the interval slightly
+double StudentT95(double degreesOfFreedom) {
+    static const double table[30] = {
+        12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+        2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+        2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042 };
+    if (degreesOfFreedom < 1) {
+        return table[0];
+    }
+    size_t df = static_cast<size_t>(degreesOfFreedom);
+    if (df < 40) return table[std::min<size_t>(df, 30) - 1];
+    if (df < 60) return 2.021;
+    if (df < 120) return 2.000;
+    return 1.980;
+}
+
+MetricSummary SummarizeMetric(const std::vector<ExperimentRun>& runs,
+    int variant, ExperimentMetric metric) {
+    MetricSummary summary = { 0, 0, 0, 0, 0 };
+    double sum = 0;
+    for (const ExperimentRun& run : runs) {
+        if (run.variant == variant) {
+            sum += GetMetric(run, metric);
+            summary.runs++;
+        }
+    }
+    if (summary.runs == 0) {
+        return summary;
+    }
+    summary.mean = sum / summary.runs;
+    double squares = 0;
+    for (const ExperimentRun& run : runs) {
+        if (run.variant == variant) {
+            double delta = GetMetric(run, metric) - summary.mean;
+            squares += delta * delta;
+        }
+    }
+    summary.ciLow = summary.ciHigh = summary.mean;
+    if (summary.runs > 1) {
+        summary.stdDev = std::sqrt(squares / (summary.runs - 1));
+        double halfWidth = StudentT95(static_cast<double>(summary.runs - 1)) *
+            summary.stdDev / std::sqrt(static_cast<double>(summary.runs));
+        summary.ciLow = summary.mean - halfWidth;
+        summary.ciHigh = summary.mean + halfWidth;
+    }
+    return summary;
+}
+
+bool CompareMetric(const std::vector<ExperimentRun>& runs, int baseline,
+    int variant, ExperimentMetric metric, MetricComparison& comparison) {
+    MetricSummary a = SummarizeMetric(runs, baseline, metric);
+    MetricSummary b = SummarizeMetric(runs, variant, metric);
+    if (a.runs < 2 || b.runs < 2) {
+        return false;
+    }
+    double va = a.stdDev * a.stdDev / a.runs;
+    double vb = b.stdDev * b.stdDev / b.runs;
+    double standardError = std::sqrt(va + vb);
+    // Welch-Satterthwaite degrees of freedom
+    double df = 1;
+    if (va + vb > 0) {
+        df = (va + vb) * (va + vb) /
+            (va * va / (a.runs - 1) + vb * vb / (b.runs - 1));
+    }
+    double halfWidth = StudentT95(df) * standardError;
+    comparison.difference = b.mean - a.mean;
+    comparison.ciLow = comparison.difference - halfWidth;
+    comparison.ciHigh = comparison.difference + halfWidth;
+    comparison.significant = comparison.ciLow > 0 || comparison.ciHigh < 0;
+    return true;
+}
+
+// --- Experiment Mode ---
+
+#ifdef _WIN32
+enum ExperimentPhase { PHASE_OFF, PHASE_WARMUP, PHASE_WINDOW, PHASE_DONE };
+
+static ExperimentPhase g_phase = PHASE_OFF;
+static ExperimentRun g_run;
+static FrameTimeHistogram g_windowFrames;
+static ULONGLONG g_warmupMs = 60000;
+static ULONGLONG g_windowMs = 120000;
+static ULONGLONG g_phaseStart = 0;
+static ULONGLONG g_cpuStart = 0; // 100 ns units
+
+static ULONGLONG GetProcessCpuTime() {
+    FILETIME creation, exit, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel,
+        &user)) {
+        return 0;
+    }
+    ULARGE_INTEGER k, u;
+    k.LowPart = kernel.dwLowDateTime;
+    k.HighPart = kernel.dwHighDateTime;
+    u.LowPart = user.dwLowDateTime;
+    u.HighPart = user.dwHighDateTime;
+    return k.QuadPart + u.QuadPart;
+}
+
+static void SaveRun(ExperimentRun run) {
+    std::string path = g_dllDir + "\\" + EXPERIMENT_FILE;
+    std::ofstream out(path, std::ios::app);
+    if (!out.is_open()) {
+        Log("Error: Could not write the experiment result to " + path + ".");
+        return;
+    }
+    WriteExperimentRun(out, run);
+    Log("Experiment: variant " + std::to_string(run.variant) + " recorded (" +
+        std::to_string(run.frames) + " frames).");
+}
+
+// Pick this launch's variant and apply its settings on top of tweaks.config.
+// Runs before anything reads the overridden settings.
+bool ApplyExperimentVariant() {
+    if (!GetConfigBool("ExperimentEnabled", false)) {
+        return false;
+    }
+    Log("Experiment mode is enabled.");
+
+    std::vector<std::string> variants;
+    for (int i = 1; i <= MAX_EXPERIMENT_VARIANTS; ++i) {
+        std::string key = "ExperimentVariant" + std::to_string(i);
+        if (g_config.find(key) == g_config.end()) {
+            break;
+        }
+        variants.push_back(g_config[key]);
+    }
+    if (variants.empty()) {
+        Log("Warning: Experiment mode needs ExperimentVariant1, "
+            "ExperimentVariant2, ... in the config. Experiment disabled.");
+        return false;
+    }
+
+    std::vector<ExperimentRun> runs;
+    std::ifstream in(g_dllDir + "\\" + EXPERIMENT_FILE);
+    if (in.is_open() && !ReadExperimentRuns(in, runs)) {
+        Log("Warning: " + std::string(EXPERIMENT_FILE) + " is damaged. Earlier "
+            "runs are ignored when picking the variant.");
+        runs.clear();
+    }
+    int variant = NextExperimentVariant(static_cast<int>(variants.size()), runs);
+
+    std::vector<ConfigOverride> overrides;
+    if (!ParseVariant(variants[variant - 1], overrides)) {
+        Log("Error: Could not parse ExperimentVariant" + std::to_string(variant) +
+            ". Use Key=Value pairs separated by ';'. Experiment disabled.");
+        return false;
+    }
+    for (const ConfigOverride& setting : overrides) {
+        if (g_config.find(setting.key) == g_config.end()) {
+            Log("Warning: Experiment setting '" + setting.key + "' is not in "
+                "the config. Check the spelling.");
+        }
+        g_config[setting.key] = setting.value;
+    }
+
+    int warmup = GetConfigInt("ExperimentWarmupSeconds", 60);
+    int window = GetConfigInt("ExperimentWindowSeconds", 120);
+    g_warmupMs = static_cast<ULONGLONG>(warmup < 0 ? 0 : warmup) * 1000;
+    g_windowMs = static_cast<ULONGLONG>(window < 10 ? 10 : window) * 1000;
+    g_run = ExperimentRun();
+    g_run.variant = variant;
+    g_run.settings = variants[variant - 1];
+    g_phase = PHASE_WARMUP;
+    RequestFrameTiming();
+
+    Log("Experiment: this launch runs variant " + std::to_string(variant) +
+        " of " + std::to_string(variants.size()) + " (" +
+        (overrides.empty() ? std::string("no changes") : g_run.settings) +
+        "). Measuring " + std::to_string(g_windowMs / 1000) + " s of frames after " +
+        std::to_string(g_warmupMs / 1000) + " s; start a match now.");
+    if (!runs.empty()) {
+        for (int i = 1; i <= static_cast<int>(variants.size()); ++i) {
+            MetricSummary summary = SummarizeMetric(runs, i, METRIC_MEAN_FRAME);
+            if (summary.runs == 0) {
+                continue;
+            }
+            std::stringstream ss;
+            ss << std::fixed << std::setprecision(2) << "  Variant " << i << ": "
+                << summary.runs << " runs, mean frame " << summary.mean
+                << " ms (95% CI " << summary.ciLow << " - " << summary.ciHigh
+                << ")";
+            Log(ss.str());
+        }
+    }
+    return true;
+}
+
+// Warm up, then measure a fixed window of frames. Called once per frame.
+void ExperimentOnFrame(uint64_t micros) {
+    if (g_phase == PHASE_OFF || g_phase == PHASE_DONE) {
+        return;
+    }
+    ULONGLONG now = GetTickCount64();
+    if (g_phaseStart == 0) {
+        g_phaseStart = now; // First frame: the warmup starts
+        return;
+    }
+    if (g_phase == PHASE_WARMUP) {
+        if (now - g_phaseStart >= g_warmupMs) {
+            g_phase = PHASE_WINDOW;
+            g_phaseStart = now;
+            g_cpuStart = GetProcessCpuTime();
+            g_windowFrames.Clear();
+        }
+        return;
+    }
+
+    g_windowFrames.Add(micros);
+    ULONGLONG elapsed = now - g_phaseStart;
+    if (elapsed < g_windowMs) {
+        return;
+    }
+    g_phase = PHASE_DONE;
+    g_run.frames = g_windowFrames.Frames();
+    g_run.windowMs = elapsed;
+    g_run.meanFrameMs = g_windowFrames.Frames() == 0 ? 0 :
+        g_windowFrames.TotalMicros() / 1000.0 / g_windowFrames.Frames();
+    g_run.p50FrameMs = g_windowFrames.Percentile(0.50) / 1000.0;
+    g_run.p95FrameMs = g_windowFrames.Percentile(0.95) / 1000.0;
+    g_run.p99FrameMs = g_windowFrames.Percentile(0.99) / 1000.0;
+    g_run.maxFrameMs = g_windowFrames.MaxMicros() / 1000.0;
+    // 100 ns CPU units over ms of wall time
+    g_run.cpuPercent = (GetProcessCpuTime() - g_cpuStart) / 100.0 / elapsed;
+
+    // Keep file writes off the render thread when workers are available
+    ExperimentRun run = g_run;
+    if (!SubmitJob([run]() { SaveRun(run); })) {
+        SaveRun(run);
+    }
+}
+
+// Called at shutdown
+void ShutdownExperiment() {
+    if (g_phase == PHASE_WARMUP || g_phase == PHASE_WINDOW) {
+        Log("Experiment: the game closed before the measuring window ended. "
+            "Variant " + std::to_string(g_run.variant) + " will run again.");
+    }
+    g_phase = PHASE_OFF;
+}
+#endif
@@ -0,0 +1,82 @@
+#ifndef EXPERIMENT_H
+#define EXPERIMENT_H
+
+#include "pch.h"
+
+const int MAX_EXPERIMENT_VARIANTS = 16; // ExperimentVariant1..16
+
+// One "Key=Value" setting of a variant
+struct ConfigOverride {
+    std::string key;
+    std::string value;
+};
+
+// Statistics of the measured window of one launch
+struct ExperimentRun {
+    int variant;          // 1-based, as in ExperimentVariantN
+    uint64_t frames;
+    uint64_t windowMs;
+    double meanFrameMs;
+    double p50FrameMs;
+    double p95FrameMs;
+    double p99FrameMs;
+    double maxFrameMs;
+    double cpuPercent;    // Process CPU time over wall time; 100 = one core
+    std::string settings; // The variant's overrides when it ran
+};
+
+// Metrics the report compares
+enum ExperimentMetric {
+    METRIC_MEAN_FRAME,
+    METRIC_P95_FRAME,
+    METRIC_P99_FRAME,
+    METRIC_CPU,
+    METRIC_COUNT
+};
+
+// Mean of one metric over the runs of a variant, with a 95% confidence
+// interval (Student's t)
+struct MetricSummary {
+    size_t runs;
+    double mean;
+    double stdDev;
+    double ciLow;
+    double ciHigh;
+};
+
+// Difference of a variant from the baseline (Welch's t interval)
+struct MetricComparison {
+    double difference; // Variant minus baseline
+    double ciLow;
+    double ciHigh;
+    bool significant;  // The interval excludes zero
+};
+
+// Parse "Key=Value; Key=Value". An empty text is a valid variant with no
+// overrides (the baseline).
+bool ParseVariant(const std::string& text, std::vector<ConfigOverride>& overrides);
+// The variant with the fewest recorded runs (the lowest on a tie)
+int NextExperimentVariant(int variantCount, const std::vector<ExperimentRun>& runs);
+
+bool ReadExperimentRuns(std::istream& in, std::vector<ExperimentRun>& runs);
+void WriteExperimentRun(std::ostream& out, const ExperimentRun& run);
+
+double GetMetric(const ExperimentRun& run, ExperimentMetric metric);
+const char* GetMetricName(ExperimentMetric metric);
+double StudentT95(double degreesOfFreedom); // Two-sided critical value
+MetricSummary SummarizeMetric(const std::vector<ExperimentRun>& runs,
+    int variant, ExperimentMetric metric);
+// Needs at least two runs of each variant; returns false otherwise
+bool CompareMetric(const std::vector<ExperimentRun>& runs, int baseline,
+    int variant, ExperimentMetric metric, MetricComparison& comparison);
+
+// Function declarations
+#ifdef _WIN32
+bool ApplyExperimentVariant(); // After LoadConfig, before patches read config
+void ShutdownExperiment();
+
+// Called from the frame hook (d3dhooks.cpp)
+void ExperimentOnFrame(uint64_t micros);
+#endif
+
+#endif // EXPERIMENT_H
@@ -0,0 +1,351 @@
+#include "pch.h"
+#include "logging.h" // Access Log()
+#include "hooks.h"   // Access HookImport()
+#include "iocache.h"
+#include "prefetch.h"
+#include "writebuffer.h"
+#include "savecompress.h"
+#include "fileio.h"
+
+// The game opens, reads, writes and seeks its files through these imports
+// (directly and via its static CRT). Features that want to see or serve
+// file I/O plug in here.
+
+typedef HANDLE(WINAPI* CreateFileAFn)(LPCSTR, DWORD, DWORD,
+    LPSECURITY_ATTRIBUTES, DWORD, DWORD, HANDLE);
+typedef BOOL(WINAPI* ReadFileFn)(HANDLE, LPVOID, DWORD, LPDWORD, LPOVERLAPPED);
+typedef DWORD(WINAPI* SetFilePointerFn)(HANDLE, LONG, PLONG, DWORD);
+typedef BOOL(WINAPI* SetFilePointerExFn)(HANDLE, LARGE_INTEGER, PLARGE_INTEGER,
+    DWORD);
+typedef BOOL(WINAPI* CloseHandleFn)(HANDLE);
+typedef BOOL(WINAPI* WriteFileFn)(HANDLE, LPCVOID, DWORD, LPDWORD, LPOVERLAPPED);
+typedef BOOL(WINAPI* FlushFileBuffersFn)(HANDLE);
+typedef BOOL(WINAPI* SetEndOfFileFn)(HANDLE);
+typedef DWORD(WINAPI* GetFileSizeFn)(HANDLE, LPDWORD);
+typedef BOOL(WINAPI* GetFileSizeExFn)(HANDLE, PLARGE_INTEGER);
+
+static CreateFileAFn g_originalCreateFileA = CreateFileA;
+static ReadFileFn g_originalReadFile = ReadFile;
+static SetFilePointerFn g_originalSetFilePointer = SetFilePointer;
+static SetFilePointerExFn g_originalSetFilePointerEx = SetFilePointerEx;
+static CloseHandleFn g_originalCloseHandle = CloseHandle;
+static WriteFileFn g_originalWriteFile = WriteFile;
+static FlushFileBuffersFn g_originalFlushFileBuffers = FlushFileBuffers;
+static SetEndOfFileFn g_originalSetEndOfFile = SetEndOfFile;
+static GetFileSizeFn g_originalGetFileSize = GetFileSize;
+static GetFileSizeExFn g_originalGetFileSizeEx = GetFileSizeEx;
+
+static HANDLE WINAPI HookedCreateFileA(LPCSTR fileName, DWORD access,
+    DWORD shareMode, LPSECURITY_ATTRIBUTES security, DWORD creation,
+    DWORD flags, HANDLE templateFile) {
+    DWORD openAccess = SaveCompressionAccess(fileName, access, flags);
+    HANDLE file = g_originalCreateFileA(fileName, openAccess, shareMode,
+        security, creation, flags, templateFile);
+    if (file == INVALID_HANDLE_VALUE && openAccess != access) {
+        openAccess = access; // Read access denied: open as asked
+        file = g_originalCreateFileA(fileName, access, shareMode, security,
+            creation, flags, templateFile);
+    }
+    if (file != INVALID_HANDLE_VALUE) {
+        DWORD lastError = GetLastError(); // ERROR_ALREADY_EXISTS etc.
+        // Compressed files are served entirely by save compression
+        if (!SaveCompressionOnOpen(file, fileName, openAccess, flags)) {
+            ArchiveCacheOnOpen(file, fileName, access, creation, flags);
+            PrefetchOnOpen(file, fileName, access);
+            WriteCoalescingOnOpen(file, fileName, access, flags);
+        }
+        SetLastError(lastError);
+    }
+    return file;
+}
+
+// Where the next synchronous read of file starts
+static bool GetReadOffset(HANDLE file, uint64_t& offset) {
+    if (ArchiveCacheGetPosition(file, offset)) {
+        return true;
+    }
+    LARGE_INTEGER zero = { 0 };
+    LARGE_INTEGER position;
+    if (!SetFilePointerEx(file, zero, &position, FILE_CURRENT)) {
+        return false;
+    }
+    offset = static_cast<uint64_t>(position.QuadPart);
+    return true;
+}
+
+static BOOL WINAPI HookedReadFile(HANDLE file, LPVOID buffer, DWORD bytesToRead,
+    LPDWORD bytesRead, LPOVERLAPPED overlapped) {
+    BOOL result = FALSE;
+    if (SaveCompressionOnRead(file, buffer, bytesToRead, bytesRead, overlapped,
+        result)) {
+        return result;
+    }
+    if (!WriteCoalescingFlush(file)) {
+        return FALSE; // The read would miss buffered data
+    }
+    // Note the offset before the read moves it
+    uint64_t traceOffset = 0;
+    bool traced = overlapped == NULL && bytesRead != NULL &&
+        PrefetchTracesHandle(file) && GetReadOffset(file, traceOffset);
+    auto readStart = std::chrono::steady_clock::now();
+
+    if (!ArchiveCacheOnRead(file, buffer, bytesToRead, bytesRead, overlapped,
+        result)) {
+        result = g_originalReadFile(file, buffer, bytesToRead, bytesRead,
+            overlapped);
+        if (result && overlapped == NULL && bytesRead != NULL) {
+            ArchiveCacheOnPassThrough(*bytesRead);
+        }
+    }
+
+    if (traced && result) {
+        auto micros = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - readStart).count();
+        PrefetchOnRead(file, traceOffset, *bytesRead,
+            static_cast<uint64_t>(micros));
+    }
+    return result;
+}
+
+static BOOL WINAPI HookedWriteFile(HANDLE file, LPCVOID buffer,
+    DWORD bytesToWrite, LPDWORD bytesWritten, LPOVERLAPPED overlapped) {
+    BOOL result = FALSE;
+    if (SaveCompressionOnWrite(file, buffer, bytesToWrite, bytesWritten,
+        overlapped, result)) {
+        return result;
+    }
+    if (WriteCoalescingOnWrite(file, buffer, bytesToWrite, bytesWritten,
+        overlapped, result)) {
+        return result;
+    }
+    return g_originalWriteFile(file, buffer, bytesToWrite, bytesWritten,
+        overlapped);
+}
+
+static DWORD WINAPI HookedSetFilePointer(HANDLE file, LONG distanceLow,
+    PLONG distanceHigh, DWORD moveMethod) {
+    LONGLONG distance = distanceHigh != NULL ?
+        (static_cast<LONGLONG>(*distanceHigh) << 32) |
+        static_cast<DWORD>(distanceLow) :
+        static_cast<LONGLONG>(distanceLow);
+    LONGLONG newPosition = 0;
+    bool success = false;
+    if (SaveCompressionOnSeek(file, distance, moveMethod, newPosition,
+        success)) {
+        if (!success) {
+            return INVALID_SET_FILE_POINTER;
+        }
+        if (distanceHigh != NULL) {
+            *distanceHigh = static_cast<LONG>(newPosition >> 32);
+        }
+        return static_cast<DWORD>(newPosition & 0xFFFFFFFF);
+    }
+    uint64_t position = 0;
+    if (distance == 0 && moveMethod == FILE_CURRENT &&
+        WriteCoalescingGetPosition(file, position)) {
+        // Position query: answer without writing out the buffer
+        if (distanceHigh != NULL) {
+            *distanceHigh = static_cast<LONG>(position >> 32);
+        }
+        SetLastError(NO_ERROR);
+        return static_cast<DWORD>(position & 0xFFFFFFFF);
+    }
+    if (!WriteCoalescingFlush(file)) {
+        return INVALID_SET_FILE_POINTER;
+    }
+    if (ArchiveCacheOnSeek(file, distance, moveMethod, newPosition, success)) {
+        if (!success) {
+            return INVALID_SET_FILE_POINTER;
+        }
+        if (distanceHigh != NULL) {
+            *distanceHigh = static_cast<LONG>(newPosition >> 32);
+        }
+        return static_cast<DWORD>(newPosition & 0xFFFFFFFF);
+    }
+    DWORD result = g_originalSetFilePointer(file, distanceLow, distanceHigh,
+        moveMethod);
+    WriteCoalescingOnSeek(file);
+    return result;
+}
+
+static BOOL WINAPI HookedSetFilePointerEx(HANDLE file, LARGE_INTEGER distance,
+    PLARGE_INTEGER newPointer, DWORD moveMethod) {
+    LONGLONG newPosition = 0;
+    bool success = false;
+    if (SaveCompressionOnSeek(file, distance.QuadPart, moveMethod, newPosition,
+        success)) {
+        if (success && newPointer != NULL) {
+            newPointer->QuadPart = newPosition;
+        }
+        return success ? TRUE : FALSE;
+    }
+    uint64_t position = 0;
+    if (distance.QuadPart == 0 && moveMethod == FILE_CURRENT &&
+        WriteCoalescingGetPosition(file, position)) {
+        if (newPointer != NULL) {
+            newPointer->QuadPart = static_cast<LONGLONG>(position);
+        }
+        return TRUE;
+    }
+    if (!WriteCoalescingFlush(file)) {
+        return FALSE;
+    }
+    if (ArchiveCacheOnSeek(file, distance.QuadPart, moveMethod, newPosition,
+        success)) {
+        if (success && newPointer != NULL) {
+            newPointer->QuadPart = newPosition;
+        }
+        return success ? TRUE : FALSE;
+    }
+    BOOL result = g_originalSetFilePointerEx(file, distance, newPointer,
+        moveMethod);
+    WriteCoalescingOnSeek(file);
+    return result;
+}
+
+// These see the file as a whole: compressed files answer with their
+// uncompressed view, and buffered writes go out first
+static BOOL WINAPI HookedFlushFileBuffers(HANDLE file) {
+    BOOL result = FALSE;
+    if (SaveCompressionOnFlush(file, result)) {
+        return result;
+    }
+    if (!WriteCoalescingFlush(file)) {
+        return FALSE;
+    }
+    return g_originalFlushFileBuffers(file);
+}
+
+static BOOL WINAPI HookedSetEndOfFile(HANDLE file) {
+    BOOL result = FALSE;
+    if (SaveCompressionOnSetEndOfFile(file, result)) {
+        return result;
+    }
+    if (!WriteCoalescingFlush(file)) {
+        return FALSE;
+    }
+    return g_originalSetEndOfFile(file);
+}
+
+static DWORD WINAPI HookedGetFileSize(HANDLE file, LPDWORD sizeHigh) {
+    uint64_t size = 0;
+    if (SaveCompressionGetSize(file, size)) {
+        if (sizeHigh != NULL) {
+            *sizeHigh = static_cast<DWORD>(size >> 32);
+        }
+        return static_cast<DWORD>(size & 0xFFFFFFFF);
+    }
+    if (!WriteCoalescingFlush(file)) {
+        return INVALID_FILE_SIZE;
+    }
+    return g_originalGetFileSize(file, sizeHigh);
+}
+
+static BOOL WINAPI HookedGetFileSizeEx(HANDLE file, PLARGE_INTEGER size) {
+    uint64_t uncompressedSize = 0;
+    if (size != NULL && SaveCompressionGetSize(file, uncompressedSize)) {
+        size->QuadPart = static_cast<LONGLONG>(uncompressedSize);
+        return TRUE;
+    }
+    if (!WriteCoalescingFlush(file)) {
+        return FALSE;
+    }
+    return g_originalGetFileSizeEx(file, size);
+}
+
+static BOOL WINAPI HookedCloseHandle(HANDLE handle) {
+    // Write the block index, or what is still buffered (a handle has at most
+    // one of them). The handle is closed either way, but the game learns its
+    // data did not all reach the file.
+    std::string compactPath;
+    bool flushed = SaveCompressionOnClose(handle, compactPath) &&
+        WriteCoalescingOnClose(handle);
+    DWORD error = GetLastError();
+    ArchiveCacheOnClose(handle); // Before the handle value can be reused
+    PrefetchOnClose(handle);
+    BOOL closed = g_originalCloseHandle(handle);
+    if (closed && !flushed) {
+        SetLastError(error);
+        return FALSE;
+    }
+    // The copy can only replace the save once no handle holds it
+    if (closed && !compactPath.empty()) {
+        SaveCompressionCompact(compactPath);
+        SetLastError(NO_ERROR);
+    }
+    return closed;
+}
+
+// Install the file API hooks into the game executable. Safe to call more
+// than once.
+bool InstallFileHooks() {
+    static bool installed = false;
+    if (installed) {
+        return true;
+    }
+
+    HMODULE exe = GetModuleHandleA(NULL);
+    struct ImportHook {
+        const char* name;
+        const void* replacement;
+        void** original;
+        bool required;
+    };
+    const ImportHook hooks[] = {
+        { "CreateFileA", reinterpret_cast<const void*>(HookedCreateFileA),
+            reinterpret_cast<void**>(&g_originalCreateFileA), true },
+        { "ReadFile", reinterpret_cast<const void*>(HookedReadFile),
+            reinterpret_cast<void**>(&g_originalReadFile), true },
+        { "SetFilePointer", reinterpret_cast<const void*>(HookedSetFilePointer),
+            reinterpret_cast<void**>(&g_originalSetFilePointer), true },
+        { "SetFilePointerEx",
+            reinterpret_cast<const void*>(HookedSetFilePointerEx),
+            reinterpret_cast<void**>(&g_originalSetFilePointerEx), false },
+        { "CloseHandle", reinterpret_cast<const void*>(HookedCloseHandle),
+            reinterpret_cast<void**>(&g_originalCloseHandle), true },
+        { "WriteFile", reinterpret_cast<const void*>(HookedWriteFile),
+            reinterpret_cast<void**>(&g_originalWriteFile), true },
+        { "FlushFileBuffers",
+            reinterpret_cast<const void*>(HookedFlushFileBuffers),
+            reinterpret_cast<void**>(&g_originalFlushFileBuffers), false },
+        { "SetEndOfFile", reinterpret_cast<const void*>(HookedSetEndOfFile),
+            reinterpret_cast<void**>(&g_originalSetEndOfFile), false },
+        { "GetFileSize", reinterpret_cast<const void*>(HookedGetFileSize),
+            reinterpret_cast<void**>(&g_originalGetFileSize), false },
+        { "GetFileSizeEx", reinterpret_cast<const void*>(HookedGetFileSizeEx),
+            reinterpret_cast<void**>(&g_originalGetFileSizeEx), false },
+    };
+
+    // A cached handle must never reach an unhooked seek or close, so either
+    // all required imports are hooked or none are
+    for (const ImportHook& hook : hooks) {
+        void* probe = nullptr;
+        if (hook.required && !HookImport(exe, "KERNEL32.dll", hook.name,
+            hook.replacement, &probe)) {
+            Log("Error: Could not hook " + std::string(hook.name) +
+                " in the game executable. File hooks not installed.");
+            // Undo the hooks installed so far
+            for (const ImportHook& undo : hooks) {
+                if (&undo == &hook) break;
+                if (undo.required) {
+                    HookImport(exe, "KERNEL32.dll", undo.name, *undo.original,
+                        nullptr);
+                }
+            }
+            return false;
+        }
+        if (probe != nullptr) {
+            *hook.original = probe;
+        }
+    }
+    for (const ImportHook& hook : hooks) {
+        if (!hook.required) {
+            HookImport(exe, "KERNEL32.dll", hook.name, hook.replacement,
+                hook.original); // Not imported by every build: optional
+        }
+    }
+
+    installed = true;
+    Log("File API hooks installed in the game executable.");
+    return true;
+}
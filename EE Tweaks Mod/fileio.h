@@ -0,0 +1,9 @@
+#ifndef FILEIO_H
+#define FILEIO_H
+
+#include "pch.h"
+
+// Function declarations
+bool InstallFileHooks(); // Hook the game executable's file API imports
+
+#endif // FILEIO_H
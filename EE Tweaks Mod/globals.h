@@ -10,12 +10,23 @@ extern const char* MOD_AUTHOR;
 // --- Configuration File Names ---
 extern const char* CONFIG_FILE;
 extern const char* LOG_FILE;
+extern const char* PROFILE_FILE;
+extern const char* PREFETCH_TRACE_FILE;
+extern const char* MODULE_DUMP_PREFIX;
+extern const char* MAP_PLAN_FILE;
+extern const char* CHUNK_BENCH_FILE;
+extern const char* EXPERIMENT_FILE;
+extern const char* LOCK_PROFILE_FILE;
+extern const char* HEAP_SNAPSHOT_PREFIX;
+extern const char* THREAD_MONITOR_FILE;
 
 // --- Game/System Globals ---
 extern std::string g_executableName; // Detected name of the game executable
 extern std::string g_executablePath; // Full path of the game executable
 extern std::string g_dllDir;         // Directory where this DLL resides
 extern HMODULE g_hModule;            // Handle to this DLL instance
+extern bool g_initFromEntryPoint;    // True when running from the entry point hook (no loader lock)
+extern DWORD g_mainThreadId;         // Thread that ran the patch pipeline (the game's main thread)
 
 // --- Constants ---
 extern const int NUM_FLAT_MAP_SIZES;
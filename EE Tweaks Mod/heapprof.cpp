@@ -0,0 +1,675 @@
+#include "pch.h"
+#include "heapprof.h"
+
+#include <cmath>
+
+#ifdef _WIN32
+#include <intrin.h> // _ReturnAddress
+#include "globals.h" // Access g_dllDir, HEAP_SNAPSHOT_PREFIX
+#include "logging.h" // Access Log()
+#include "config.h"  // Access config functions
+#include "counters.h"
+#include "hooks.h"   // Access HookImport()
+#include "modulemap.h"
+#endif
+
+// --- Sampling ---
+
+struct SampleCountdown {
+    const HeapProfiler* owner;
+    int64_t bytesUntilSample;
+    uint64_t random;
+};
+static thread_local SampleCountdown t_countdown = { nullptr, 0, 0 };
+static std::atomic<uint64_t> g_countdownSeed{ 0x9E3779B97F4A7C15ull };
+
+static uint64_t NextRandom(uint64_t& state) {
+    // xorshift64*
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 0x2545F4914F6CDD1Dull;
+}
+
+// Exponentially distributed gaps between samples make the sampled bytes a
+// Poisson process, which is what the weights in RecordAllocation assume
+static int64_t NextSampleGap(uint64_t& state, double sampleBytes) {
+    double uniform = ((NextRandom(state) >> 11) + 1) * (1.0 / 9007199254740992.0);
+    double gap = -std::log(uniform) * sampleBytes;
+    if (gap < 1) gap = 1;
+    return static_cast<int64_t>(gap);
+}
+
+static size_t SizeClass(size_t size) {
+    size_t sizeClass = 0;
+    size_t limit = 16;
+    while (size > limit && sizeClass + 1 < HEAP_SIZE_CLASSES) {
+        limit <<= 1;
+        sizeClass++;
+    }
+    return sizeClass;
+}
+
+HeapProfiler::HeapProfiler(uint64_t sampleBytes, size_t maxSites,
+    size_t maxLiveSamples)
+    : m_sampleBytes(sampleBytes < 1 ? 1.0 : static_cast<double>(sampleBytes)),
+    m_maxSites(maxSites), m_maxLiveSamples(maxLiveSamples),
+    m_filter(new std::atomic<uint16_t>[size_t(1) << FILTER_BITS]) {
+    for (size_t i = 0; i < (size_t(1) << FILTER_BITS); ++i) {
+        m_filter[i].store(0, std::memory_order_relaxed);
+    }
+    memset(&m_total, 0, sizeof(m_total));
+}
+
+bool HeapProfiler::ShouldSample(size_t size) {
+    SampleCountdown& countdown = t_countdown;
+    if (countdown.owner != this) {
+        countdown.owner = this;
+        countdown.random = g_countdownSeed.fetch_add(0x9E3779B97F4A7C15ull,
+            std::memory_order_relaxed) | 1;
+        countdown.bytesUntilSample = NextSampleGap(countdown.random,
+            m_sampleBytes);
+    }
+    countdown.bytesUntilSample -= static_cast<int64_t>(size);
+    if (countdown.bytesUntilSample > 0) {
+        return false;
+    }
+    countdown.bytesUntilSample = NextSampleGap(countdown.random, m_sampleBytes);
+    return true;
+}
+
+// An allocation of size bytes is sampled with probability
+// 1 - exp(-size / sampleBytes), so each sample stands for the inverse of that
+void HeapProfiler::RecordAllocation(const void* pointer, size_t size,
+    const uintptr_t* frames, size_t depth) {
+    double sampledSize = size > 0 ? static_cast<double>(size) : 1.0;
+    double bytes = sampledSize / -std::expm1(-sampledSize / m_sampleBytes);
+    double allocations = bytes / sampledSize;
+    size_t sizeClass = SizeClass(size);
+
+    SiteKey key;
+    memset(&key, 0, sizeof(key));
+    if (depth > HEAP_PROFILER_MAX_DEPTH) depth = HEAP_PROFILER_MAX_DEPTH;
+    memcpy(key.frames, frames, depth * sizeof(uintptr_t));
+    uintptr_t address = reinterpret_cast<uintptr_t>(pointer);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_total.samples++;
+    m_total.allocations += allocations;
+    m_total.allocatedBytes += bytes;
+    m_total.sizeClasses[sizeClass] += allocations;
+
+    size_t siteIndex;
+    auto found = m_siteIndex.find(key);
+    if (found != m_siteIndex.end()) {
+        siteIndex = found->second;
+    }
+    else if (m_sites.size() < m_maxSites) {
+        HeapSiteStats site;
+        memset(&site, 0, sizeof(site));
+        memcpy(site.frames, key.frames, sizeof(site.frames));
+        site.depth = static_cast<uint32_t>(depth);
+        siteIndex = m_sites.size();
+        m_sites.push_back(site);
+        m_siteIndex.emplace(key, siteIndex);
+    }
+    else {
+        m_dropped++;
+        return;
+    }
+    HeapSiteStats& site = m_sites[siteIndex];
+    site.samples++;
+    site.allocations += allocations;
+    site.allocatedBytes += bytes;
+    site.sizeClasses[sizeClass] += allocations;
+
+    // A pointer still in the table was freed through a path that is not
+    // hooked; retire the old sample before reusing the address
+    auto live = m_live.find(address);
+    bool reused = live != m_live.end();
+    if (reused) {
+        m_sites[live->second.site].liveBytes -= live->second.bytes;
+        m_total.liveBytes -= live->second.bytes;
+        m_live.erase(live);
+    }
+    else if (m_live.size() >= m_maxLiveSamples) {
+        m_dropped++;
+        return; // Counted, but its free cannot be matched
+    }
+    uint32_t filterIndex = FilterIndex(pointer);
+    m_live.emplace(address, LiveSample{ siteIndex, bytes, filterIndex });
+    if (!reused &&
+        m_filter[filterIndex].load(std::memory_order_relaxed) != 0xFFFF) {
+        m_filter[filterIndex].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    site.liveBytes += bytes;
+    site.peakLiveBytes = std::max(site.peakLiveBytes, site.liveBytes);
+    m_total.liveBytes += bytes;
+    m_total.peakLiveBytes = std::max(m_total.peakLiveBytes, m_total.liveBytes);
+}
+
+void HeapProfiler::RecordFree(const void* pointer) {
+    if (!MaybeSampled(pointer)) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto live = m_live.find(reinterpret_cast<uintptr_t>(pointer));
+    if (live == m_live.end()) {
+        return; // Another pointer with the same hash
+    }
+    m_sites[live->second.site].liveBytes -= live->second.bytes;
+    m_total.liveBytes -= live->second.bytes;
+    // A saturated counter stays set for good
+    std::atomic<uint16_t>& counter = m_filter[live->second.filterIndex];
+    if (counter.load(std::memory_order_relaxed) != 0xFFFF) {
+        counter.fetch_sub(1, std::memory_order_relaxed);
+    }
+    m_live.erase(live);
+}
+
+std::vector<HeapSiteStats> HeapProfiler::Snapshot() {
+    std::vector<HeapSiteStats> sites;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        sites.reserve(m_sites.size() + 1);
+        sites.push_back(m_total);
+        sites.insert(sites.end(), m_sites.begin(), m_sites.end());
+    }
+    std::sort(sites.begin() + 1, sites.end(),
+        [](const HeapSiteStats& a, const HeapSiteStats& b) {
+            if (a.liveBytes != b.liveBytes) return a.liveBytes > b.liveBytes;
+            return a.allocatedBytes > b.allocatedBytes;
+        });
+    return sites;
+}
+
+uint64_t HeapProfiler::Samples() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_total.samples;
+}
+
+uint64_t HeapProfiler::Dropped() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_dropped;
+}
+
+// --- Snapshot Files ---
+
+static const char* const HEAP_SNAPSHOT_HEADER =
+    "site,live_bytes,peak_live_bytes,allocated_bytes,allocations,samples";
+
+static std::string SizeClassLabel(size_t sizeClass) {
+    if (sizeClass + 1 == HEAP_SIZE_CLASSES) {
+        return ">" + SizeClassLabel(sizeClass - 1).substr(2);
+    }
+    size_t limit = size_t(16) << sizeClass;
+    if (limit >= (1 << 20)) return "<=" + std::to_string(limit >> 20) + "M";
+    if (limit >= (1 << 10)) return "<=" + std::to_string(limit >> 10) + "K";
+    return "<=" + std::to_string(limit);
+}
+
+static std::string QuoteCsv(const std::string& text) {
+    if (text.find_first_of(",\"") == std::string::npos) {
+        return text;
+    }
+    std::string quoted = "\"";
+    for (char c : text) {
+        if (c == '"') quoted += '"';
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+void WriteHeapSnapshot(std::ostream& out, const std::vector<HeapSiteStats>& sites,
+    const std::function<std::string(uintptr_t)>& describe) {
+    out << HEAP_SNAPSHOT_HEADER;
+    for (size_t i = 0; i < HEAP_SIZE_CLASSES; ++i) {
+        out << ',' << SizeClassLabel(i);
+    }
+    out << '\n' << std::fixed << std::setprecision(0);
+
+    for (const HeapSiteStats& site : sites) {
+        std::string name;
+        for (uint32_t i = 0; i < site.depth; ++i) {
+            name += (i > 0 ? " < " : "") + describe(site.frames[i]);
+        }
+        out << QuoteCsv(site.depth == 0 ? "(all)" : name) << ','
+            << std::max(site.liveBytes, 0.0) << ',' << site.peakLiveBytes << ','
+            << site.allocatedBytes << ',' << site.allocations << ','
+            << site.samples;
+        for (size_t i = 0; i < HEAP_SIZE_CLASSES; ++i) {
+            out << ',' << site.sizeClasses[i];
+        }
+        out << '\n';
+    }
+}
+
+bool ReadHeapSnapshot(std::istream& in, std::vector<HeapSnapshotRow>& rows) {
+    std::string line;
+    if (!std::getline(in, line) || line.compare(0, strlen(HEAP_SNAPSHOT_HEADER),
+        HEAP_SNAPSHOT_HEADER) != 0) {
+        return false;
+    }
+    while (std::getline(in, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty()) {
+            continue;
+        }
+
+        HeapSnapshotRow row;
+        size_t pos = 0;
+        if (line[0] == '"') {
+            for (pos = 1; pos < line.size(); ++pos) {
+                if (line[pos] == '"') {
+                    if (pos + 1 < line.size() && line[pos + 1] == '"') {
+                        row.site += '"';
+                        pos++;
+                        continue;
+                    }
+                    pos++;
+                    break;
+                }
+                row.site += line[pos];
+            }
+        }
+        else {
+            pos = line.find(',');
+            row.site = line.substr(0, pos);
+        }
+        if (pos >= line.size() || line[pos] != ',') {
+            return false;
+        }
+
+        std::stringstream fields(line.substr(pos + 1));
+        double* values[] = { &row.liveBytes, &row.peakLiveBytes,
+            &row.allocatedBytes, &row.allocations };
+        std::string field;
+        for (double* value : values) {
+            if (!std::getline(fields, field, ',')) {
+                return false;
+            }
+            try {
+                *value = std::stod(field);
+            }
+            catch (const std::exception&) {
+                return false;
+            }
+        }
+        rows.push_back(row);
+    }
+    return true;
+}
+
+// --- Import Hooks ---
+
+#ifdef _WIN32
+typedef LPVOID(WINAPI* HeapAllocFn)(HANDLE, DWORD, SIZE_T);
+typedef LPVOID(WINAPI* HeapReAllocFn)(HANDLE, DWORD, LPVOID, SIZE_T);
+typedef BOOL(WINAPI* HeapFreeFn)(HANDLE, DWORD, LPVOID);
+typedef void* (__cdecl* MallocFn)(size_t);
+typedef void* (__cdecl* CallocFn)(size_t, size_t);
+typedef void* (__cdecl* ReallocFn)(void*, size_t);
+typedef void(__cdecl* FreeFn)(void*);
+
+// Bound to what the first hooked module called, so hooks installed earlier
+// (Map Prefault's) stay in the chain; until then the DLL's own imports
+static HeapAllocFn g_originalHeapAlloc = HeapAlloc;
+static HeapReAllocFn g_originalHeapReAlloc = HeapReAlloc;
+static HeapFreeFn g_originalHeapFree = HeapFree;
+// Bound to the CRT DLL the game imports them from, if any
+static MallocFn g_originalMalloc = nullptr;
+static CallocFn g_originalCalloc = nullptr;
+static ReallocFn g_originalRealloc = nullptr;
+static FreeFn g_originalFree = nullptr;
+static MallocFn g_originalNew = nullptr;
+static MallocFn g_originalNewArray = nullptr;
+static FreeFn g_originalDelete = nullptr;
+static FreeFn g_originalDeleteArray = nullptr;
+
+static HeapProfiler* g_heapProfiler = nullptr;
+static size_t g_heapStackDepth = 2;
+static HANDLE g_snapshotThread = NULL;
+static volatile bool g_snapshotStop = false;
+static DWORD g_snapshotSeconds = 300;
+static int g_snapshotCount = 0;
+
+// Exact call counts, published to the shared counters in batches so the
+// hooks do not all write the same cache line
+struct HeapCallCounts {
+    uint32_t allocations;
+    uint32_t frees;
+    uint64_t bytes;
+};
+static thread_local HeapCallCounts t_heapCalls = { 0, 0, 0 };
+
+static void FlushHeapCallCounts() {
+    CounterAdd(COUNTER_ALLOCATIONS, t_heapCalls.allocations);
+    CounterAdd(COUNTER_ALLOCATED_BYTES, t_heapCalls.bytes);
+    CounterAdd(COUNTER_FREES, t_heapCalls.frees);
+    t_heapCalls = { 0, 0, 0 };
+}
+
+// Not inlined, so the stack below it is always hook, then the caller.
+// RtlCaptureStackBackTrace's first frame is in this function, so skipping
+// three starts at the caller's caller.
+__declspec(noinline) static void OnAllocation(void* pointer, size_t size,
+    uintptr_t caller) {
+    if (pointer == NULL) {
+        return;
+    }
+    t_heapCalls.allocations++;
+    t_heapCalls.bytes += size;
+    if (t_heapCalls.allocations + t_heapCalls.frees >= 256) {
+        FlushHeapCallCounts();
+    }
+    if (!g_heapProfiler->ShouldSample(size)) {
+        return;
+    }
+    uintptr_t frames[HEAP_PROFILER_MAX_DEPTH];
+    frames[0] = caller;
+    size_t depth = 1;
+    if (g_heapStackDepth > 1) {
+        depth += RtlCaptureStackBackTrace(3,
+            static_cast<DWORD>(g_heapStackDepth - 1),
+            reinterpret_cast<PVOID*>(&frames[1]), NULL);
+    }
+    g_heapProfiler->RecordAllocation(pointer, size, frames, depth);
+}
+
+// Called before the real free, so the address cannot be handed out again
+// before its sample is retired
+static void OnFree(void* pointer) {
+    if (pointer == NULL) {
+        return;
+    }
+    t_heapCalls.frees++;
+    if (t_heapCalls.allocations + t_heapCalls.frees >= 256) {
+        FlushHeapCallCounts();
+    }
+    if (g_heapProfiler->MaybeSampled(pointer)) {
+        g_heapProfiler->RecordFree(pointer);
+    }
+}
+
+static LPVOID WINAPI HookedHeapAlloc(HANDLE heap, DWORD flags, SIZE_T size) {
+    LPVOID pointer = g_originalHeapAlloc(heap, flags, size);
+    OnAllocation(pointer, size, reinterpret_cast<uintptr_t>(_ReturnAddress()));
+    return pointer;
+}
+
+// The old block's sample is retired only once the reallocation succeeded: a
+// failed one leaves the block allocated. A block that moved is free before
+// its sample is retired, so a sample another thread takes at that address in
+// the meantime can be lost.
+static LPVOID WINAPI HookedHeapReAlloc(HANDLE heap, DWORD flags, LPVOID old,
+    SIZE_T size) {
+    LPVOID pointer = g_originalHeapReAlloc(heap, flags, old, size);
+    if (pointer != NULL) {
+        OnFree(old);
+        OnAllocation(pointer, size, reinterpret_cast<uintptr_t>(_ReturnAddress()));
+    }
+    return pointer;
+}
+
+static BOOL WINAPI HookedHeapFree(HANDLE heap, DWORD flags, LPVOID pointer) {
+    OnFree(pointer);
+    return g_originalHeapFree(heap, flags, pointer);
+}
+
+static void* __cdecl HookedMalloc(size_t size) {
+    void* pointer = g_originalMalloc(size);
+    OnAllocation(pointer, size, reinterpret_cast<uintptr_t>(_ReturnAddress()));
+    return pointer;
+}
+
+static void* __cdecl HookedCalloc(size_t count, size_t size) {
+    void* pointer = g_originalCalloc(count, size);
+    OnAllocation(pointer, count * size,
+        reinterpret_cast<uintptr_t>(_ReturnAddress()));
+    return pointer;
+}
+
+// As HookedHeapReAlloc. A size of 0 frees the block and returns NULL.
+static void* __cdecl HookedRealloc(void* old, size_t size) {
+    void* pointer = g_originalRealloc(old, size);
+    if (pointer != NULL || size == 0) {
+        OnFree(old);
+        OnAllocation(pointer, size, reinterpret_cast<uintptr_t>(_ReturnAddress()));
+    }
+    return pointer;
+}
+
+static void __cdecl HookedFree(void* pointer) {
+    OnFree(pointer);
+    g_originalFree(pointer);
+}
+
+static void* __cdecl HookedNew(size_t size) {
+    void* pointer = g_originalNew(size);
+    OnAllocation(pointer, size, reinterpret_cast<uintptr_t>(_ReturnAddress()));
+    return pointer;
+}
+
+static void* __cdecl HookedNewArray(size_t size) {
+    void* pointer = g_originalNewArray(size);
+    OnAllocation(pointer, size, reinterpret_cast<uintptr_t>(_ReturnAddress()));
+    return pointer;
+}
+
+static void __cdecl HookedDelete(void* pointer) {
+    OnFree(pointer);
+    g_originalDelete(pointer);
+}
+
+static void __cdecl HookedDeleteArray(void* pointer) {
+    OnFree(pointer);
+    g_originalDeleteArray(pointer);
+}
+
+// Write tweaks_heap_NNN.csv. Numbered so that any two can be compared with
+// tools/heapdiff.cpp.
+static void WriteHeapSnapshotFile() {
+    std::vector<HeapSiteStats> sites = g_heapProfiler->Snapshot();
+    ModuleMap modules;
+    modules.Refresh();
+
+    char number[16];
+    snprintf(number, sizeof(number), "%03d", ++g_snapshotCount);
+    std::string snapshotPath = g_dllDir + "\\" + HEAP_SNAPSHOT_PREFIX + number +
+        ".csv";
+    std::ofstream snapshot(snapshotPath, std::ios::trunc);
+    if (!snapshot.is_open()) {
+        Log("Error: Could not write heap snapshot to " + snapshotPath + ".");
+        return;
+    }
+    WriteHeapSnapshot(snapshot, sites,
+        [&modules](uintptr_t address) { return modules.Describe(address); });
+    snapshot.close();
+
+    Log("Heap profiler wrote snapshot " + std::to_string(g_snapshotCount) +
+        " (" + std::to_string(sites.size() - 1) + " sites, about " +
+        std::to_string(static_cast<uint64_t>(sites[0].liveBytes / 1024)) +
+        " KB live, peak " +
+        std::to_string(static_cast<uint64_t>(sites[0].peakLiveBytes / 1024)) +
+        " KB) to " + snapshotPath + ".");
+}
+
+static DWORD WINAPI HeapSnapshotThreadProc(LPVOID) {
+    DWORD elapsed = 0;
+    while (!g_snapshotStop) {
+        Sleep(1000);
+        if (++elapsed >= g_snapshotSeconds) {
+            elapsed = 0;
+            WriteHeapSnapshotFile();
+        }
+    }
+    return 0;
+}
+
+// Hook the heap and CRT allocation imports of the modules in
+// HeapProfilerModules if enabled
+bool StartHeapProfiler() {
+    if (!GetConfigBool("HeapProfilerEnabled", false)) {
+        return false;
+    }
+
+    int sampleKB = GetConfigInt("HeapProfilerSampleKB", 256);
+    if (sampleKB < 1) sampleKB = 1;
+    int stackDepth = GetConfigInt("HeapProfilerStackDepth", 2);
+    if (stackDepth < 1) stackDepth = 1;
+    if (stackDepth > static_cast<int>(HEAP_PROFILER_MAX_DEPTH)) {
+        stackDepth = static_cast<int>(HEAP_PROFILER_MAX_DEPTH);
+    }
+    int maxSites = GetConfigInt("HeapProfilerMaxSites", 8192);
+    if (maxSites < 64) maxSites = 64;
+    int maxLiveSamples = GetConfigInt("HeapProfilerMaxLiveSamples", 65536);
+    if (maxLiveSamples < 1024) maxLiveSamples = 1024;
+    int snapshotSeconds = GetConfigInt("HeapProfilerSnapshotSeconds", 300);
+    if (snapshotSeconds < 0) snapshotSeconds = 0;
+
+    g_heapStackDepth = static_cast<size_t>(stackDepth);
+    g_heapProfiler = new HeapProfiler(static_cast<uint64_t>(sampleKB) * 1024,
+        static_cast<size_t>(maxSites), static_cast<size_t>(maxLiveSamples));
+
+    struct ImportHook {
+        const char* name;
+        const void* replacement;
+        void** original;
+    };
+    const ImportHook heapHooks[] = {
+        { "HeapAlloc", reinterpret_cast<const void*>(HookedHeapAlloc),
+            reinterpret_cast<void**>(&g_originalHeapAlloc) },
+        { "HeapReAlloc", reinterpret_cast<const void*>(HookedHeapReAlloc),
+            reinterpret_cast<void**>(&g_originalHeapReAlloc) },
+        { "HeapFree", reinterpret_cast<const void*>(HookedHeapFree),
+            reinterpret_cast<void**>(&g_originalHeapFree) },
+    };
+    const ImportHook crtHooks[] = {
+        { "malloc", reinterpret_cast<const void*>(HookedMalloc),
+            reinterpret_cast<void**>(&g_originalMalloc) },
+        { "calloc", reinterpret_cast<const void*>(HookedCalloc),
+            reinterpret_cast<void**>(&g_originalCalloc) },
+        { "realloc", reinterpret_cast<const void*>(HookedRealloc),
+            reinterpret_cast<void**>(&g_originalRealloc) },
+        { "free", reinterpret_cast<const void*>(HookedFree),
+            reinterpret_cast<void**>(&g_originalFree) },
+        { "??2@YAPAXI@Z", reinterpret_cast<const void*>(HookedNew),
+            reinterpret_cast<void**>(&g_originalNew) },
+        { "??_U@YAPAXI@Z", reinterpret_cast<const void*>(HookedNewArray),
+            reinterpret_cast<void**>(&g_originalNewArray) },
+        { "??3@YAXPAX@Z", reinterpret_cast<const void*>(HookedDelete),
+            reinterpret_cast<void**>(&g_originalDelete) },
+        { "??_V@YAXPAX@Z", reinterpret_cast<const void*>(HookedDeleteArray),
+            reinterpret_cast<void**>(&g_originalDeleteArray) },
+    };
+
+    std::vector<std::string> crtModules;
+    std::stringstream crtList(GetConfigString("HeapProfilerCrtModules",
+        "MSVCRT.dll"));
+    std::string crtName;
+    while (std::getline(crtList, crtName, ',')) {
+        crtName = Trim(crtName);
+        if (!crtName.empty()) crtModules.push_back(crtName);
+    }
+
+    // The CRT hooks can only forward to one CRT: the first one found. Memory
+    // from another CRT must not be freed by it.
+    std::string boundCrt;
+    // The heap functions likewise forward to what the first module called,
+    // so a block is always freed through the hooks that allocated it
+    bool heapBound = false;
+    std::stringstream modules(GetConfigString("HeapProfilerModules",
+        "GAME_EXECUTABLE"));
+    std::string moduleName;
+    int hooked = 0;
+    while (std::getline(modules, moduleName, ',')) {
+        moduleName = Trim(moduleName);
+        if (moduleName.empty()) {
+            continue;
+        }
+        HMODULE module = moduleName == "GAME_EXECUTABLE" ?
+            GetModuleHandleA(NULL) : GetModuleHandleA(moduleName.c_str());
+        if (module == NULL) {
+            Log("Warning: Heap profiler: module '" + moduleName +
+                "' is not loaded.");
+            continue;
+        }
+        std::string names;
+        bool heapHooked = false;
+        for (const ImportHook& hook : heapHooks) {
+            void* previous = *hook.original;
+            if (HookImport(module, "KERNEL32.dll", hook.name, hook.replacement,
+                heapBound ? &previous : hook.original)) {
+                if (heapBound && previous != *hook.original) {
+                    Log("Warning: Heap profiler: " + moduleName + "'s " +
+                        hook.name + " was hooked by another feature and now "
+                        "skips it.");
+                }
+                names += (names.empty() ? "" : ", ") + std::string(hook.name);
+                heapHooked = true;
+                hooked++;
+            }
+        }
+        heapBound = heapBound || heapHooked;
+        for (const std::string& crt : crtModules) {
+            if (!boundCrt.empty() && crt != boundCrt) {
+                continue;
+            }
+            for (const ImportHook& hook : crtHooks) {
+                // Functions already bound come from the same CRT
+                void** original = *hook.original == nullptr ? hook.original :
+                    nullptr;
+                if (HookImport(module, crt.c_str(), hook.name, hook.replacement,
+                    original)) {
+                    names += (names.empty() ? "" : ", ") + crt + "!" + hook.name;
+                    boundCrt = crt;
+                    hooked++;
+                }
+            }
+        }
+        Log("Heap profiler: hooked " + (names.empty() ? std::string("nothing") :
+            names) + " in " + moduleName + ".");
+    }
+    if (hooked == 0) {
+        Log("Warning: Heap profiler found no allocation imports to hook.");
+        return false;
+    }
+
+    g_snapshotSeconds = static_cast<DWORD>(snapshotSeconds);
+    if (g_snapshotSeconds > 0) {
+        g_snapshotStop = false;
+        g_snapshotThread = CreateThread(NULL, 0, HeapSnapshotThreadProc, NULL, 0,
+            NULL);
+        if (g_snapshotThread == NULL) {
+            Log("Warning: Could not start the heap snapshot thread. Error code: " +
+                std::to_string(GetLastError()) + ". Only the final snapshot "
+                "will be written.");
+        }
+    }
+    Log("Heap profiler started (one sample per " + std::to_string(sampleKB) +
+        " KB, stack depth " + std::to_string(stackDepth) + ", snapshots every " +
+        std::to_string(snapshotSeconds) + " s).");
+    return true;
+}
+
+// Write the final snapshot. Called at shutdown; the snapshot thread is
+// stopped first so it does not write at the same time. The hooks stay in
+// place.
+void ShutdownHeapProfiler() {
+    if (g_heapProfiler == nullptr) {
+        return;
+    }
+    if (g_snapshotThread != NULL) {
+        g_snapshotStop = true;
+        WaitForSingleObject(g_snapshotThread, 2000); // It wakes once a second
+        CloseHandle(g_snapshotThread);
+        g_snapshotThread = NULL;
+    }
+    FlushHeapCallCounts();
+    WriteHeapSnapshotFile();
+    Log("Heap profiler took " + std::to_string(g_heapProfiler->Samples()) +
+        " samples (" + std::to_string(g_heapProfiler->Dropped()) +
+        " dropped).");
+}
+#endif
@@ -0,0 +1,106 @@
+#ifndef HEAPPROF_H
+#define HEAPPROF_H
+
+#include "pch.h"
+
+const size_t HEAP_PROFILER_MAX_DEPTH = 4;
+// Allocation sizes are counted in power-of-two classes: up to 16 bytes, up
+// to 32, ..., up to 4 MB, and larger
+const size_t HEAP_SIZE_CLASSES = 20;
+
+// Estimated totals of the allocations made from one call stack. Values are
+// scaled up from the sampled allocations, so they are not exact.
+struct HeapSiteStats {
+    uintptr_t frames[HEAP_PROFILER_MAX_DEPTH]; // Return addresses, caller first
+    uint32_t depth;
+    uint64_t samples;
+    double allocations;
+    double allocatedBytes;
+    double liveBytes;     // Allocated and not freed yet
+    double peakLiveBytes;
+    double sizeClasses[HEAP_SIZE_CLASSES]; // Allocations per size class
+};
+
+// One row of a written snapshot, as read back by ReadHeapSnapshot
+struct HeapSnapshotRow {
+    std::string site;
+    double liveBytes;
+    double peakLiveBytes;
+    double allocatedBytes;
+    double allocations;
+};
+
+// Samples heap allocations by bytes: on average one sample every sampleBytes
+// allocated bytes, with random spacing so periodic allocation patterns are
+// not missed or over-counted. Each sample stands for the bytes and
+// allocations it statistically represents. Allocations that were not sampled
+// cost one thread-local subtraction, frees of them one table lookup.
+class HeapProfiler {
+public:
+    HeapProfiler(uint64_t sampleBytes, size_t maxSites, size_t maxLiveSamples);
+
+    // Count size bytes against the calling thread's countdown. True if this
+    // allocation is to be sampled with RecordAllocation.
+    bool ShouldSample(size_t size);
+    void RecordAllocation(const void* pointer, size_t size,
+        const uintptr_t* frames, size_t depth);
+    // Cheap check whether pointer may be a sampled allocation; false
+    // positives are possible, false negatives are not
+    bool MaybeSampled(const void* pointer) const {
+        return m_filter[FilterIndex(pointer)].load(std::memory_order_relaxed) != 0;
+    }
+    void RecordFree(const void* pointer);
+
+    // Sites with the most live bytes first, preceded by a row for all sites
+    // (depth 0)
+    std::vector<HeapSiteStats> Snapshot();
+    uint64_t Samples();
+    uint64_t Dropped(); // Samples not attributed: site or live table full
+
+private:
+    struct SiteKey {
+        uintptr_t frames[HEAP_PROFILER_MAX_DEPTH];
+        bool operator<(const SiteKey& other) const {
+            return memcmp(frames, other.frames, sizeof(frames)) < 0;
+        }
+    };
+    struct LiveSample {
+        size_t site;
+        double bytes;
+        uint32_t filterIndex;
+    };
+
+    static const uint32_t FILTER_BITS = 16;
+    static uint32_t FilterIndex(const void* pointer) {
+        uint32_t value = static_cast<uint32_t>(
+            reinterpret_cast<uintptr_t>(pointer) >> 3);
+        return (value * 2654435761u) >> (32 - FILTER_BITS);
+    }
+
+    double m_sampleBytes;
+    size_t m_maxSites;
+    size_t m_maxLiveSamples;
+    // Number of live samples per pointer hash
+    std::unique_ptr<std::atomic<uint16_t>[]> m_filter;
+
+    std::mutex m_mutex; // Taken for samples and possibly sampled frees only
+    std::map<SiteKey, size_t> m_siteIndex;
+    std::vector<HeapSiteStats> m_sites;
+    std::unordered_map<uintptr_t, LiveSample> m_live;
+    HeapSiteStats m_total;
+    uint64_t m_dropped = 0;
+};
+
+// Write a snapshot as CSV, one row per site. describe turns a return address
+// into text; frames are joined with " < ".
+void WriteHeapSnapshot(std::ostream& out, const std::vector<HeapSiteStats>& sites,
+    const std::function<std::string(uintptr_t)>& describe);
+bool ReadHeapSnapshot(std::istream& in, std::vector<HeapSnapshotRow>& rows);
+
+// Function declarations
+#ifdef _WIN32
+bool StartHeapProfiler();
+void ShutdownHeapProfiler();
+#endif
+
+#endif // HEAPPROF_H
@@ -0,0 +1,270 @@
+#include "pch.h"
+#include "hooks.h"
+
+// --- Entry Point Hook ---
+// The executable's entry point is overwritten with a jump to our detour while
+// we are still inside DllMain. The detour restores the original bytes, runs
+// the callback on the main thread (outside the loader lock) and then calls
+// the real entry point, so the game never executes code before we patch it.
+
+#ifdef _WIN64
+// jmp qword ptr [rip+0] followed by the absolute target
+static const size_t ENTRY_JUMP_SIZE = 14;
+#else
+// jmp rel32
+static const size_t ENTRY_JUMP_SIZE = 5;
+#endif
+
+typedef DWORD(WINAPI* EntryPointFn)(LPVOID);
+
+static EntryPointCallback g_entryCallback = nullptr;
+static uintptr_t g_entryAddress = 0;
+static unsigned char g_entryOriginalBytes[ENTRY_JUMP_SIZE] = { 0 };
+
+// Write raw bytes over code, adjusting protection around the write
+static bool WriteCodeBytes(uintptr_t address, const unsigned char* bytes,
+    size_t size) {
+    void* target = reinterpret_cast<void*>(address);
+    DWORD oldProtect;
+    if (!VirtualProtect(target, size, PAGE_EXECUTE_READWRITE, &oldProtect)) {
+        return false;
+    }
+    memcpy(target, bytes, size);
+    FlushInstructionCache(GetCurrentProcess(), target, size);
+    DWORD tempProtect;
+    VirtualProtect(target, size, oldProtect, &tempProtect);
+    return true;
+}
+
+// Runs in place of the game's entry point
+static DWORD WINAPI EntryPointDetour(LPVOID param) {
+    // Put the original entry point back before anything else runs
+    if (!WriteCodeBytes(g_entryAddress, g_entryOriginalBytes,
+        ENTRY_JUMP_SIZE)) {
+        // Without the original bytes the game cannot start; nothing sane left
+        OutputDebugStringA(
+            ("tweaks.dll: FATAL ERROR - Could not restore entry point. Error: " +
+                std::to_string(GetLastError()) + "\n")
+            .c_str());
+        ExitProcess(1);
+    }
+
+    if (g_entryCallback) {
+        g_entryCallback();
+    }
+
+    // The CRT startup routine never returns (it calls ExitProcess), so calling
+    // it from here instead of jumping is fine regardless of its convention.
+    return reinterpret_cast<EntryPointFn>(g_entryAddress)(param);
+}
+
+// Get the address of the executable's entry point from its PE header
+uintptr_t GetExecutableEntryPoint() {
+    uintptr_t base = reinterpret_cast<uintptr_t>(GetModuleHandleA(NULL));
+    if (base == 0) {
+        return 0;
+    }
+
+    const IMAGE_DOS_HEADER* dosHeader =
+        reinterpret_cast<const IMAGE_DOS_HEADER*>(base);
+    if (dosHeader->e_magic != IMAGE_DOS_SIGNATURE) {
+        return 0;
+    }
+    const IMAGE_NT_HEADERS* ntHeaders =
+        reinterpret_cast<const IMAGE_NT_HEADERS*>(base + dosHeader->e_lfanew);
+    if (ntHeaders->Signature != IMAGE_NT_SIGNATURE ||
+        ntHeaders->OptionalHeader.AddressOfEntryPoint == 0) {
+        return 0;
+    }
+    return base + ntHeaders->OptionalHeader.AddressOfEntryPoint;
+}
+
+// Redirect the executable's entry point to run the callback first.
+// Called from DllMain, so this only touches the PE header and a few code bytes.
+bool InstallEntryPointHook(EntryPointCallback callback) {
+    if (g_entryAddress != 0) {
+        return false; // Already installed
+    }
+
+    uintptr_t entryAddress = GetExecutableEntryPoint();
+    if (entryAddress == 0) {
+        OutputDebugStringA(
+            "tweaks.dll: Warning: Could not locate the executable entry point.\n");
+        return false;
+    }
+
+    unsigned char jumpBytes[ENTRY_JUMP_SIZE] = { 0 };
+    uintptr_t detourAddress = reinterpret_cast<uintptr_t>(&EntryPointDetour);
+#ifdef _WIN64
+    jumpBytes[0] = 0xFF;
+    jumpBytes[1] = 0x25; // jmp [rip+0], displacement left as zero
+    memcpy(&jumpBytes[6], &detourAddress, sizeof(detourAddress));
+#else
+    int32_t relative = static_cast<int32_t>(
+        detourAddress - (entryAddress + ENTRY_JUMP_SIZE));
+    jumpBytes[0] = 0xE9;
+    memcpy(&jumpBytes[1], &relative, sizeof(relative));
+#endif
+
+    memcpy(g_entryOriginalBytes, reinterpret_cast<const void*>(entryAddress),
+        ENTRY_JUMP_SIZE);
+    g_entryCallback = callback;
+    g_entryAddress = entryAddress;
+
+    if (!WriteCodeBytes(entryAddress, jumpBytes, ENTRY_JUMP_SIZE)) {
+        OutputDebugStringA(
+            ("tweaks.dll: Warning: Could not write entry point hook. Error: " +
+                std::to_string(GetLastError()) + "\n")
+            .c_str());
+        g_entryCallback = nullptr;
+        g_entryAddress = 0;
+        return false;
+    }
+    return true;
+}
+
+// --- Process Exit Hook ---
+// The game ends by calling ExitProcess from its CRT. Hooking the executable's
+// import runs the callback first, while the game's other threads are still
+// alive and no loader lock is held. DllMain only sees process detach after
+// the system has killed those threads, possibly while they held our locks.
+
+typedef VOID(WINAPI* ExitProcessFn)(UINT);
+
+static ExitProcessFn g_originalExitProcess = ExitProcess;
+static ProcessExitCallback g_exitCallback = nullptr;
+
+static VOID WINAPI HookedExitProcess(UINT exitCode) {
+    // Only the first thread to exit runs the callback
+    ProcessExitCallback callback = reinterpret_cast<ProcessExitCallback>(
+        InterlockedExchangePointer(reinterpret_cast<PVOID*>(&g_exitCallback),
+            NULL));
+    if (callback) {
+        callback();
+    }
+    g_originalExitProcess(exitCode);
+}
+
+// --- Import Address Table Hooks ---
+
+// Find the IAT slot through which module calls importDll!functionName
+static void** FindImportSlot(HMODULE module, const char* importDll,
+    const char* functionName) {
+    uintptr_t base = reinterpret_cast<uintptr_t>(module);
+    const IMAGE_DOS_HEADER* dosHeader =
+        reinterpret_cast<const IMAGE_DOS_HEADER*>(base);
+    if (dosHeader->e_magic != IMAGE_DOS_SIGNATURE) {
+        return nullptr;
+    }
+    const IMAGE_NT_HEADERS* ntHeaders =
+        reinterpret_cast<const IMAGE_NT_HEADERS*>(base + dosHeader->e_lfanew);
+    if (ntHeaders->Signature != IMAGE_NT_SIGNATURE) {
+        return nullptr;
+    }
+    const IMAGE_DATA_DIRECTORY& importDirectory =
+        ntHeaders->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_IMPORT];
+    if (importDirectory.VirtualAddress == 0) {
+        return nullptr;
+    }
+
+    // Bound or name-less thunks are matched by the resolved address instead
+    HMODULE exporter = GetModuleHandleA(importDll);
+    void* resolved = exporter ?
+        reinterpret_cast<void*>(GetProcAddress(exporter, functionName)) :
+        nullptr;
+
+    const IMAGE_IMPORT_DESCRIPTOR* descriptor =
+        reinterpret_cast<const IMAGE_IMPORT_DESCRIPTOR*>(
+            base + importDirectory.VirtualAddress);
+    for (; descriptor->Name != 0; ++descriptor) {
+        const char* dllName = reinterpret_cast<const char*>(base + descriptor->Name);
+        if (_stricmp(dllName, importDll) != 0) {
+            continue;
+        }
+
+        IMAGE_THUNK_DATA* addressThunk =
+            reinterpret_cast<IMAGE_THUNK_DATA*>(base + descriptor->FirstThunk);
+        const IMAGE_THUNK_DATA* nameThunk = descriptor->OriginalFirstThunk ?
+            reinterpret_cast<const IMAGE_THUNK_DATA*>(
+                base + descriptor->OriginalFirstThunk) :
+            nullptr;
+
+        for (; addressThunk->u1.Function != 0; ++addressThunk) {
+            if (nameThunk != nullptr) {
+                if (!IMAGE_SNAP_BY_ORDINAL(nameThunk->u1.Ordinal)) {
+                    const IMAGE_IMPORT_BY_NAME* importByName =
+                        reinterpret_cast<const IMAGE_IMPORT_BY_NAME*>(
+                            base + nameThunk->u1.AddressOfData);
+                    if (strcmp(importByName->Name, functionName) == 0) {
+                        return reinterpret_cast<void**>(&addressThunk->u1.Function);
+                    }
+                }
+                ++nameThunk;
+            }
+            else if (resolved != nullptr &&
+                reinterpret_cast<void*>(addressThunk->u1.Function) == resolved) {
+                return reinterpret_cast<void**>(&addressThunk->u1.Function);
+            }
+        }
+    }
+    return nullptr;
+}
+
+// Swap a function pointer in read-only data. The previous target is stored
+// in original unless it already was replacement.
+static bool ExchangeFunctionSlot(void** slot, const void* replacement,
+    void** original) {
+    DWORD oldProtect;
+    if (!VirtualProtect(slot, sizeof(void*), PAGE_READWRITE, &oldProtect)) {
+        return false;
+    }
+    void* previous = InterlockedExchangePointer(slot,
+        const_cast<void*>(replacement));
+    DWORD tempProtect;
+    VirtualProtect(slot, sizeof(void*), oldProtect, &tempProtect);
+
+    if (original != nullptr && previous != replacement) {
+        *original = previous;
+    }
+    return true;
+}
+
+// Point module's import of importDll!functionName at replacement. The
+// previous target is stored in original (left untouched on failure).
+bool HookImport(HMODULE module, const char* importDll, const char* functionName,
+    const void* replacement, void** original) {
+    if (module == NULL) {
+        return false;
+    }
+    void** slot = FindImportSlot(module, importDll, functionName);
+    if (slot == nullptr) {
+        return false;
+    }
+    return ExchangeFunctionSlot(slot, replacement, original);
+}
+
+// Run the callback when the game calls ExitProcess
+bool InstallProcessExitHook(ProcessExitCallback callback) {
+    g_exitCallback = callback;
+    if (!HookImport(GetModuleHandleA(NULL), "KERNEL32.dll", "ExitProcess",
+        reinterpret_cast<const void*>(HookedExitProcess),
+        reinterpret_cast<void**>(&g_originalExitProcess))) {
+        g_exitCallback = nullptr;
+        return false;
+    }
+    return true;
+}
+
+// --- COM Vtable Hooks ---
+
+// Replace method index of a COM object's vtable. The vtable is shared by
+// every object of the same class, so hooks must check which object they are
+// called on.
+bool HookVtableEntry(void* object, size_t index, const void* replacement,
+    void** original) {
+    if (object == nullptr) {
+        return false;
+    }
+    void** vtable = *reinterpret_cast<void***>(object);
+    return ExchangeFunctionSlot(&vtable[index], replacement, original);
+}
@@ -0,0 +1,20 @@
+#ifndef HOOKS_H
+#define HOOKS_H
+
+#include "pch.h"
+
+// Callback run on the game's main thread right before its entry point
+typedef void (*EntryPointCallback)();
+// Callback run when the game calls ExitProcess, before the process ends
+typedef void (*ProcessExitCallback)();
+
+// Function declarations
+uintptr_t GetExecutableEntryPoint();
+bool InstallEntryPointHook(EntryPointCallback callback);
+bool InstallProcessExitHook(ProcessExitCallback callback);
+bool HookImport(HMODULE module, const char* importDll, const char* functionName,
+    const void* replacement, void** original);
+bool HookVtableEntry(void* object, size_t index, const void* replacement,
+    void** original);
+
+#endif // HOOKS_H
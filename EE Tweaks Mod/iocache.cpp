@@ -0,0 +1,420 @@
+#include "pch.h"
+#include "iocache.h"
+
+#ifdef _WIN32
+#include "globals.h"
+#include "logging.h" // Access Log()
+#include "config.h"  // Access config functions
+#include "counters.h"
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#include <cstring>
+#endif
+
+// --- Platform View Mapping ---
+
+#ifdef _WIN32
+static size_t GetMappingGranularity() {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwAllocationGranularity;
+}
+#else
+static size_t GetMappingGranularity() {
+    return static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+#endif
+
+// --- Archive Read Cache ---
+
+ArchiveReadCache::ArchiveReadCache(size_t viewSize, size_t maxViewsPerFile)
+    : m_maxViewsPerFile(maxViewsPerFile ? maxViewsPerFile : 1) {
+    // Views must start on the OS mapping granularity
+    size_t granularity = GetMappingGranularity();
+    if (viewSize < granularity) viewSize = granularity;
+    m_viewSize = (viewSize / granularity) * granularity;
+}
+
+ArchiveReadCache::~ArchiveReadCache() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto& entry : m_files) {
+        UnmapAll(entry.second);
+    }
+    m_files.clear();
+}
+
+// Start serving reads for an open file. The file must stay open until Detach.
+bool ArchiveReadCache::Attach(NativeFile file, uint64_t fileSize) {
+    if (fileSize == 0) {
+        return false; // Empty files cannot be mapped
+    }
+
+    CachedFile cached;
+    cached.file = file;
+    cached.size = fileSize;
+    cached.position = 0;
+#ifdef _WIN32
+    cached.mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (cached.mapping == NULL) {
+        return false;
+    }
+#endif
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto existing = m_files.find(file);
+    if (existing != m_files.end()) {
+        UnmapAll(existing->second); // Stale entry from a reused handle
+        m_files.erase(existing);
+    }
+    m_files[file] = cached;
+    return true;
+}
+
+void ArchiveReadCache::Detach(NativeFile file) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_files.find(file);
+    if (it == m_files.end()) {
+        return;
+    }
+    UnmapAll(it->second);
+    m_files.erase(it);
+}
+
+bool ArchiveReadCache::IsAttached(NativeFile file) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_files.find(file) != m_files.end();
+}
+
+void ArchiveReadCache::UnmapAll(CachedFile& cached) {
+    for (View& view : cached.views) {
+#ifdef _WIN32
+        UnmapViewOfFile(view.data);
+#else
+        munmap(const_cast<unsigned char*>(view.data), view.size);
+#endif
+    }
+    cached.views.clear();
+#ifdef _WIN32
+    if (cached.mapping != NULL) {
+        CloseHandle(cached.mapping);
+        cached.mapping = NULL;
+    }
+#endif
+}
+
+// Return the view containing offset, mapping it (and evicting the least
+// recently used view) if needed
+const ArchiveReadCache::View* ArchiveReadCache::GetView(CachedFile& cached,
+    uint64_t offset) {
+    for (View& view : cached.views) {
+        if (offset >= view.offset && offset - view.offset < view.size) {
+            view.lastUse = ++m_useCounter;
+            return &view;
+        }
+    }
+
+    if (cached.views.size() >= m_maxViewsPerFile) {
+        auto oldest = std::min_element(cached.views.begin(), cached.views.end(),
+            [](const View& a, const View& b) { return a.lastUse < b.lastUse; });
+#ifdef _WIN32
+        UnmapViewOfFile(oldest->data);
+#else
+        munmap(const_cast<unsigned char*>(oldest->data), oldest->size);
+#endif
+        cached.views.erase(oldest);
+    }
+
+    View view;
+    view.offset = offset - (offset % m_viewSize);
+    uint64_t remaining = cached.size - view.offset;
+    view.size = remaining < m_viewSize ? static_cast<size_t>(remaining) :
+        m_viewSize;
+    view.lastUse = ++m_useCounter;
+#ifdef _WIN32
+    view.data = static_cast<const unsigned char*>(MapViewOfFile(cached.mapping,
+        FILE_MAP_READ, static_cast<DWORD>(view.offset >> 32),
+        static_cast<DWORD>(view.offset & 0xFFFFFFFF), view.size));
+    if (view.data == nullptr) {
+        return nullptr;
+    }
+#else
+    void* data = mmap(nullptr, view.size, PROT_READ, MAP_PRIVATE, cached.file,
+        static_cast<off_t>(view.offset));
+    if (data == MAP_FAILED) {
+        return nullptr;
+    }
+    view.data = static_cast<const unsigned char*>(data);
+#endif
+    cached.views.push_back(view);
+    return &cached.views.back();
+}
+
+bool ArchiveReadCache::Read(NativeFile file, void* buffer, uint32_t bytesToRead,
+    uint32_t& bytesRead) {
+    bytesRead = 0;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_files.find(file);
+    if (it == m_files.end()) {
+        return false;
+    }
+    CachedFile& cached = it->second;
+
+    uint64_t available = cached.position < cached.size ?
+        cached.size - cached.position : 0;
+    uint32_t toCopy = available < bytesToRead ?
+        static_cast<uint32_t>(available) : bytesToRead;
+
+    unsigned char* out = static_cast<unsigned char*>(buffer);
+    uint32_t copied = 0;
+    while (copied < toCopy) {
+        uint64_t offset = cached.position + copied;
+        const View* view = GetView(cached, offset);
+        if (view == nullptr) {
+            return false; // Position untouched, caller falls back to the OS
+        }
+        size_t offsetInView = static_cast<size_t>(offset - view->offset);
+        size_t chunk = view->size - offsetInView;
+        if (chunk > toCopy - copied) chunk = toCopy - copied;
+        memcpy(out + copied, view->data + offsetInView, chunk);
+        copied += static_cast<uint32_t>(chunk);
+    }
+
+    cached.position += toCopy;
+    bytesRead = toCopy;
+    return true;
+}
+
+bool ArchiveReadCache::Seek(NativeFile file, int64_t distance,
+    SeekOrigin origin, uint64_t& newPosition) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_files.find(file);
+    if (it == m_files.end()) {
+        return false;
+    }
+    CachedFile& cached = it->second;
+
+    int64_t base = 0;
+    if (origin == SEEK_FROM_CURRENT) base = static_cast<int64_t>(cached.position);
+    else if (origin == SEEK_FROM_END) base = static_cast<int64_t>(cached.size);
+    int64_t target = base + distance;
+    if (target < 0) {
+        return false;
+    }
+    cached.position = static_cast<uint64_t>(target); // Past EOF is allowed
+    newPosition = cached.position;
+    return true;
+}
+
+bool ArchiveReadCache::GetPosition(NativeFile file, uint64_t& position) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_files.find(file);
+    if (it == m_files.end()) {
+        return false;
+    }
+    position = it->second.position;
+    return true;
+}
+
+size_t ArchiveReadCache::AttachedFiles() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_files.size();
+}
+
+size_t ArchiveReadCache::MappedViews() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    size_t views = 0;
+    for (auto& entry : m_files) {
+        views += entry.second.views.size();
+    }
+    return views;
+}
+
+// --- Game Integration ---
+
+#ifdef _WIN32
+static ArchiveReadCache* g_archiveCache = nullptr;
+static std::vector<std::string> g_archiveExtensions; // Lowercase, with dot
+static std::atomic<uint64_t> g_bytesServed(0);
+static std::atomic<uint64_t> g_bytesPassedThrough(0);
+static std::atomic<uint64_t> g_readsServed(0);
+static std::atomic<uint64_t> g_readsPassedThrough(0);
+static std::atomic<uint32_t> g_filesAttached(0);
+
+static bool HasArchiveExtension(const char* path) {
+    std::string lowerPath(path);
+    std::transform(lowerPath.begin(), lowerPath.end(), lowerPath.begin(),
+        [](unsigned char c) { return static_cast<char>(tolower(c)); });
+    for (const std::string& extension : g_archiveExtensions) {
+        if (lowerPath.size() >= extension.size() &&
+            lowerPath.compare(lowerPath.size() - extension.size(),
+                extension.size(), extension) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Read the cache settings from config. Returns true if the file hooks are
+// needed.
+bool InitializeArchiveReadCache() {
+    if (!GetConfigBool("ArchiveReadCacheEnabled", false)) {
+        return false;
+    }
+
+    std::stringstream extensions(GetConfigString("ArchiveReadCacheExtensions",
+        ".ssa"));
+    std::string extension;
+    while (std::getline(extensions, extension, ',')) {
+        extension = Trim(extension);
+        if (extension.empty()) {
+            continue;
+        }
+        if (extension[0] != '.') extension = "." + extension;
+        std::transform(extension.begin(), extension.end(), extension.begin(),
+            [](unsigned char c) { return static_cast<char>(tolower(c)); });
+        g_archiveExtensions.push_back(extension);
+    }
+    if (g_archiveExtensions.empty()) {
+        Log("Warning: ArchiveReadCacheExtensions is empty. Archive read cache "
+            "disabled.");
+        return false;
+    }
+
+    int viewSizeMB = GetConfigInt("ArchiveReadCacheViewSizeMB", 2);
+    if (viewSizeMB < 1) viewSizeMB = 1;
+    if (viewSizeMB > 64) viewSizeMB = 64;
+    int maxViews = GetConfigInt("ArchiveReadCacheMaxViews", 4);
+    if (maxViews < 1) maxViews = 1;
+
+    g_archiveCache = new ArchiveReadCache(
+        static_cast<size_t>(viewSizeMB) * 1024 * 1024,
+        static_cast<size_t>(maxViews));
+    Log("Archive read cache enabled (" + std::to_string(viewSizeMB) +
+        " MB views, up to " + std::to_string(maxViews) + " per file).");
+    return true;
+}
+
+// Attach read-only, synchronous opens of archive files to the cache
+void ArchiveCacheOnOpen(HANDLE file, const char* path, DWORD access,
+    DWORD creation, DWORD flags) {
+    if (g_archiveCache == nullptr || file == INVALID_HANDLE_VALUE ||
+        path == nullptr) {
+        return;
+    }
+    if (access != GENERIC_READ || creation != OPEN_EXISTING ||
+        (flags & FILE_FLAG_OVERLAPPED) != 0 || !HasArchiveExtension(path)) {
+        return;
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize)) {
+        return;
+    }
+    if (g_archiveCache->Attach(file, static_cast<uint64_t>(fileSize.QuadPart))) {
+        g_filesAttached++;
+        Log("Archive read cache: serving reads of " + std::string(path) +
+            " from memory.");
+    }
+}
+
+// Serve a ReadFile call. Returns false if the handle is not cached, in which
+// case the caller forwards to the real ReadFile.
+bool ArchiveCacheOnRead(HANDLE file, LPVOID buffer, DWORD bytesToRead,
+    LPDWORD bytesRead, LPOVERLAPPED overlapped, BOOL& result) {
+    if (g_archiveCache == nullptr || overlapped != NULL) {
+        return false;
+    }
+
+    uint32_t served = 0;
+    if (g_archiveCache->Read(file, buffer, bytesToRead, served)) {
+        if (bytesRead != NULL) *bytesRead = served;
+        g_bytesServed += served;
+        g_readsServed++;
+        CounterAdd(COUNTER_IO_BYTES_SERVED, served);
+        CounterAdd(COUNTER_IO_READS_SERVED, 1);
+        SetLastError(NO_ERROR);
+        result = TRUE;
+        return true;
+    }
+
+    uint64_t position = 0;
+    if (!g_archiveCache->GetPosition(file, position)) {
+        return false; // Not an archive handle
+    }
+
+    // Mapping failed (address space exhausted?): read from the OS at the
+    // cached position and keep both positions in step
+    LARGE_INTEGER distance;
+    distance.QuadPart = static_cast<LONGLONG>(position);
+    DWORD osRead = 0;
+    result = SetFilePointerEx(file, distance, NULL, FILE_BEGIN) &&
+        ReadFile(file, buffer, bytesToRead, &osRead, NULL);
+    if (bytesRead != NULL) *bytesRead = osRead;
+    if (result) {
+        uint64_t newPosition;
+        g_archiveCache->Seek(file, osRead, SEEK_FROM_CURRENT, newPosition);
+        g_bytesPassedThrough += osRead;
+        g_readsPassedThrough++;
+        CounterAdd(COUNTER_IO_BYTES_PASSED, osRead);
+        CounterAdd(COUNTER_IO_READS_PASSED, 1);
+    }
+    return true;
+}
+
+// Count a read that went to the OS
+void ArchiveCacheOnPassThrough(DWORD bytesRead) {
+    if (g_archiveCache == nullptr) {
+        return;
+    }
+    g_bytesPassedThrough += bytesRead;
+    g_readsPassedThrough++;
+    CounterAdd(COUNTER_IO_BYTES_PASSED, bytesRead);
+    CounterAdd(COUNTER_IO_READS_PASSED, 1);
+}
+
+// Move a cached file's position. Returns false if the handle is not cached.
+bool ArchiveCacheOnSeek(HANDLE file, LONGLONG distance, DWORD moveMethod,
+    LONGLONG& newPosition, bool& success) {
+    if (g_archiveCache == nullptr || moveMethod > FILE_END) {
+        return false;
+    }
+    uint64_t position = 0;
+    if (!g_archiveCache->GetPosition(file, position)) {
+        return false;
+    }
+    success = g_archiveCache->Seek(file, distance,
+        static_cast<SeekOrigin>(moveMethod), position);
+    newPosition = static_cast<LONGLONG>(position);
+    SetLastError(success ? NO_ERROR : ERROR_NEGATIVE_SEEK);
+    return true;
+}
+
+void ArchiveCacheOnClose(HANDLE file) {
+    if (g_archiveCache != nullptr) {
+        g_archiveCache->Detach(file);
+    }
+}
+
+// The position of a cached file, which the OS handle does not track
+bool ArchiveCacheGetPosition(HANDLE file, uint64_t& position) {
+    return g_archiveCache != nullptr &&
+        g_archiveCache->GetPosition(file, position);
+}
+
+// Log how many bytes the cache served. Called at shutdown.
+void ShutdownArchiveReadCache() {
+    if (g_archiveCache == nullptr) {
+        return;
+    }
+    uint64_t served = g_bytesServed;
+    uint64_t passed = g_bytesPassedThrough;
+    Log("Archive read cache: " + std::to_string(served) + " bytes in " +
+        std::to_string(g_readsServed.load()) + " reads served from memory, " +
+        std::to_string(passed) + " bytes in " +
+        std::to_string(g_readsPassedThrough.load()) + " reads passed through (" +
+        std::to_string(g_filesAttached.load()) + " archive opens).");
+    // Views are left for the system to release; other DLLs may still read
+    // through the hooks while the process is shutting down.
+}
+#endif
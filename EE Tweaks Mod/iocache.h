@@ -0,0 +1,84 @@
+#ifndef IOCACHE_H
+#define IOCACHE_H
+
+#include "pch.h"
+
+#ifdef _WIN32
+typedef HANDLE NativeFile;
+#else
+typedef int NativeFile;
+#endif
+
+// Seek origins, same values as FILE_BEGIN/FILE_CURRENT/FILE_END and SEEK_*
+enum SeekOrigin { SEEK_FROM_BEGIN = 0, SEEK_FROM_CURRENT = 1, SEEK_FROM_END = 2 };
+
+// Serves reads of whole read-only files from memory-mapped views. Each
+// attached file keeps its own virtual file position; views are mapped in
+// fixed-size windows on demand so large archives do not eat address space.
+class ArchiveReadCache {
+public:
+    ArchiveReadCache(size_t viewSize, size_t maxViewsPerFile);
+    ~ArchiveReadCache();
+
+    bool Attach(NativeFile file, uint64_t fileSize);
+    void Detach(NativeFile file);
+    bool IsAttached(NativeFile file);
+
+    // Copy up to bytesToRead from the file position. Returns false if the
+    // file is not attached or the view could not be mapped.
+    bool Read(NativeFile file, void* buffer, uint32_t bytesToRead,
+        uint32_t& bytesRead);
+    // Move the file position. Returns false (and leaves it) on a negative
+    // result, matching ERROR_NEGATIVE_SEEK.
+    bool Seek(NativeFile file, int64_t distance, SeekOrigin origin,
+        uint64_t& newPosition);
+    bool GetPosition(NativeFile file, uint64_t& position);
+
+    size_t AttachedFiles();
+    size_t MappedViews();
+
+private:
+    struct View {
+        uint64_t offset;
+        size_t size;
+        const unsigned char* data;
+        uint64_t lastUse;
+    };
+    struct CachedFile {
+        NativeFile file;
+#ifdef _WIN32
+        HANDLE mapping;
+#endif
+        uint64_t size;
+        uint64_t position;
+        std::vector<View> views;
+    };
+
+    const View* GetView(CachedFile& cached, uint64_t offset);
+    void UnmapAll(CachedFile& cached);
+
+    size_t m_viewSize;
+    size_t m_maxViewsPerFile;
+    uint64_t m_useCounter = 0;
+    std::mutex m_mutex;
+    std::map<NativeFile, CachedFile> m_files;
+};
+
+// Function declarations
+#ifdef _WIN32
+bool InitializeArchiveReadCache();
+void ShutdownArchiveReadCache();
+
+// Called from the file API hooks (fileio.cpp)
+void ArchiveCacheOnOpen(HANDLE file, const char* path, DWORD access,
+    DWORD creation, DWORD flags);
+bool ArchiveCacheOnRead(HANDLE file, LPVOID buffer, DWORD bytesToRead,
+    LPDWORD bytesRead, LPOVERLAPPED overlapped, BOOL& result);
+void ArchiveCacheOnPassThrough(DWORD bytesRead);
+bool ArchiveCacheOnSeek(HANDLE file, LONGLONG distance, DWORD moveMethod,
+    LONGLONG& newPosition, bool& success);
+void ArchiveCacheOnClose(HANDLE file);
+bool ArchiveCacheGetPosition(HANDLE file, uint64_t& position);
+#endif
+
+#endif // IOCACHE_H
@@ -0,0 +1,421 @@
+#include "pch.h"
+#include "lockprof.h"
+
+#ifdef _WIN32
+#include <intrin.h> // _ReturnAddress
+#include "globals.h" // Access g_dllDir, LOCK_PROFILE_FILE
+#include "logging.h" // Access Log()
+#include "config.h"  // Access config functions
+#include "hooks.h"   // Access HookImport()
+#include "modulemap.h"
+#endif
+
+// --- Per-Thread Tables ---
+
+static size_t HashSite(uintptr_t lock, uintptr_t caller) {
+    uint64_t hash = (static_cast<uint64_t>(lock) * 0x9E3779B97F4A7C15ull) ^
+        (static_cast<uint64_t>(caller) * 0xC2B2AE3D27D4EB4Full);
+    return static_cast<size_t>(hash ^ (hash >> 29));
+}
+
+LockSiteTable::LockSiteTable(size_t capacity) {
+    size_t size = 1;
+    while (size < capacity) size <<= 1;
+    m_slots.reset(new Slot[size]);
+    m_mask = size - 1;
+}
+
+// Count one acquisition. Uses linear probing and refuses new sites once the
+// table is 3/4 full so probe chains stay short.
+void LockSiteTable::Record(uintptr_t lock, uintptr_t caller, LockKind kind,
+    bool contended, uint64_t waitTicks) {
+    size_t index = HashSite(lock, caller) & m_mask;
+    for (size_t probe = 0; probe <= m_mask; ++probe) {
+        Slot& slot = m_slots[index];
+        uint64_t acquisitions = slot.acquisitions.load(std::memory_order_relaxed);
+        if (acquisitions == 0) {
+            if (m_used + 1 > ((m_mask + 1) / 4) * 3) {
+                break; // Table full
+            }
+            m_used++;
+            slot.lock.store(lock, std::memory_order_relaxed);
+            slot.caller.store(caller, std::memory_order_relaxed);
+            slot.kind.store(static_cast<uint32_t>(kind), std::memory_order_relaxed);
+        }
+        else if (slot.lock.load(std::memory_order_relaxed) != lock ||
+            slot.caller.load(std::memory_order_relaxed) != caller) {
+            index = (index + 1) & m_mask;
+            continue;
+        }
+        if (contended) {
+            slot.contended.store(slot.contended.load(std::memory_order_relaxed) + 1,
+                std::memory_order_relaxed);
+            slot.waitTicks.store(slot.waitTicks.load(std::memory_order_relaxed) +
+                waitTicks, std::memory_order_relaxed);
+            if (waitTicks > slot.maxWaitTicks.load(std::memory_order_relaxed)) {
+                slot.maxWaitTicks.store(waitTicks, std::memory_order_relaxed);
+            }
+        }
+        // Published last: a reader that sees the count sees the key
+        slot.acquisitions.store(acquisitions + 1, std::memory_order_release);
+        return;
+    }
+    m_dropped.store(m_dropped.load(std::memory_order_relaxed) + 1,
+        std::memory_order_relaxed);
+}
+
+void LockSiteTable::AppendTo(std::vector<LockSiteStats>& sites) const {
+    for (size_t i = 0; i <= m_mask; ++i) {
+        const Slot& slot = m_slots[i];
+        uint64_t acquisitions = slot.acquisitions.load(std::memory_order_acquire);
+        if (acquisitions == 0) {
+            continue;
+        }
+        LockSiteStats site;
+        site.lock = slot.lock.load(std::memory_order_relaxed);
+        site.caller = slot.caller.load(std::memory_order_relaxed);
+        site.kind = static_cast<LockKind>(slot.kind.load(std::memory_order_relaxed));
+        site.acquisitions = acquisitions;
+        site.contended = slot.contended.load(std::memory_order_relaxed);
+        site.waitTicks = slot.waitTicks.load(std::memory_order_relaxed);
+        site.maxWaitTicks = slot.maxWaitTicks.load(std::memory_order_relaxed);
+        sites.push_back(site);
+    }
+}
+
+// --- Profiler ---
+
+struct ThreadTableRef {
+    const LockProfiler* owner;
+    LockSiteTable* table;
+};
+static thread_local ThreadTableRef t_lockTable = { nullptr, nullptr };
+
+LockProfiler::LockProfiler(size_t sitesPerThread)
+    : m_sitesPerThread(sitesPerThread < 64 ? 64 : sitesPerThread) {
+}
+
+LockSiteTable* LockProfiler::ThreadTable() {
+    if (t_lockTable.owner == this) {
+        return t_lockTable.table;
+    }
+    LockSiteTable* table = nullptr;
+    try {
+        std::unique_ptr<LockSiteTable> created(
+            new LockSiteTable(m_sitesPerThread));
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_tables.push_back(std::move(created));
+        table = m_tables.back().get();
+    }
+    catch (const std::bad_alloc&) {
+        table = nullptr; // Not retried: this thread goes unrecorded
+    }
+    t_lockTable.owner = this;
+    t_lockTable.table = table;
+    return table;
+}
+
+std::vector<LockSiteStats> LockProfiler::Collect() {
+    std::vector<LockSiteStats> all;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (const auto& table : m_tables) {
+            table->AppendTo(all);
+        }
+    }
+
+    // Merge the threads' entries for the same site
+    std::map<std::pair<uintptr_t, uintptr_t>, LockSiteStats> merged;
+    for (const LockSiteStats& site : all) {
+        auto key = std::make_pair(site.lock, site.caller);
+        auto it = merged.find(key);
+        if (it == merged.end()) {
+            merged.emplace(key, site);
+            continue;
+        }
+        LockSiteStats& total = it->second;
+        total.acquisitions += site.acquisitions;
+        total.contended += site.contended;
+        total.waitTicks += site.waitTicks;
+        total.maxWaitTicks = std::max(total.maxWaitTicks, site.maxWaitTicks);
+    }
+
+    std::vector<LockSiteStats> sites;
+    sites.reserve(merged.size());
+    for (const auto& entry : merged) {
+        sites.push_back(entry.second);
+    }
+    std::sort(sites.begin(), sites.end(),
+        [](const LockSiteStats& a, const LockSiteStats& b) {
+            if (a.waitTicks != b.waitTicks) return a.waitTicks > b.waitTicks;
+            return a.contended > b.contended;
+        });
+    return sites;
+}
+
+size_t LockProfiler::Threads() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_tables.size();
+}
+
+uint64_t LockProfiler::Dropped() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    uint64_t dropped = 0;
+    for (const auto& table : m_tables) {
+        dropped += table->Dropped();
+    }
+    return dropped;
+}
+
+// --- Report ---
+
+static const char* LockKindName(LockKind kind) {
+    switch (kind) {
+    case LOCK_CRITICAL_SECTION: return "cs";
+    case LOCK_WAIT: return "wait";
+    case LOCK_WAIT_MULTIPLE: return "waitmulti";
+    }
+    return "?";
+}
+
+static void WriteReportRow(std::ostream& out, const LockSiteStats& site,
+    double ticksPerMicrosecond) {
+    double percent = site.acquisitions > 0 ?
+        100.0 * site.contended / site.acquisitions : 0;
+    out << std::setw(12) << site.waitTicks / ticksPerMicrosecond / 1000.0
+        << std::setw(11) << site.contended
+        << std::setw(13) << site.acquisitions
+        << std::setw(7) << percent << '%'
+        << std::setw(11) << site.maxWaitTicks / ticksPerMicrosecond / 1000.0
+        << "  " << std::left << std::setw(10) << LockKindName(site.kind)
+        << std::right;
+}
+
+void WriteLockReport(std::ostream& out, const std::vector<LockSiteStats>& sites,
+    double ticksPerMicrosecond,
+    const std::function<std::string(uintptr_t)>& describe, size_t maxRows) {
+    if (ticksPerMicrosecond <= 0) ticksPerMicrosecond = 1;
+    out << std::fixed << std::setprecision(2);
+
+    out << "Lock sites by total wait time (" << sites.size() << " sites)\n\n";
+    out << "     wait ms  contended acquisitions    cont.     max ms  kind      "
+        "lock  caller\n";
+    for (size_t i = 0; i < sites.size() && i < maxRows; ++i) {
+        WriteReportRow(out, sites[i], ticksPerMicrosecond);
+        out << "0x" << std::hex << sites[i].lock << std::dec << "  "
+            << describe(sites[i].caller) << '\n';
+    }
+
+    // The same lock is often taken from many places
+    std::map<uintptr_t, LockSiteStats> locks;
+    std::map<uintptr_t, size_t> callers;
+    for (const LockSiteStats& site : sites) {
+        auto it = locks.find(site.lock);
+        if (it == locks.end()) {
+            locks.emplace(site.lock, site);
+        }
+        else {
+            it->second.acquisitions += site.acquisitions;
+            it->second.contended += site.contended;
+            it->second.waitTicks += site.waitTicks;
+            it->second.maxWaitTicks = std::max(it->second.maxWaitTicks,
+                site.maxWaitTicks);
+        }
+        callers[site.lock]++;
+    }
+    std::vector<LockSiteStats> ranked;
+    for (const auto& entry : locks) {
+        ranked.push_back(entry.second);
+    }
+    std::sort(ranked.begin(), ranked.end(),
+        [](const LockSiteStats& a, const LockSiteStats& b) {
+            return a.waitTicks > b.waitTicks;
+        });
+
+    out << "\nLocks by total wait time (" << ranked.size() << " locks)\n\n";
+    out << "     wait ms  contended acquisitions    cont.     max ms  kind      "
+        "lock  call sites\n";
+    for (size_t i = 0; i < ranked.size() && i < maxRows; ++i) {
+        WriteReportRow(out, ranked[i], ticksPerMicrosecond);
+        out << "0x" << std::hex << ranked[i].lock << std::dec << "  "
+            << callers[ranked[i].lock] << '\n';
+    }
+}
+
+// --- Import Hooks ---
+
+#ifdef _WIN32
+typedef void(WINAPI* EnterCriticalSectionFn)(LPCRITICAL_SECTION);
+typedef DWORD(WINAPI* WaitForSingleObjectFn)(HANDLE, DWORD);
+typedef DWORD(WINAPI* WaitForMultipleObjectsFn)(DWORD, const HANDLE*, BOOL,
+    DWORD);
+
+// The DLL's own imports are the real functions
+static EnterCriticalSectionFn g_originalEnterCriticalSection =
+    EnterCriticalSection;
+static WaitForSingleObjectFn g_originalWaitForSingleObject =
+    WaitForSingleObject;
+static WaitForMultipleObjectsFn g_originalWaitForMultipleObjects =
+    WaitForMultipleObjects;
+static LockProfiler* g_lockProfiler = nullptr;
+static double g_ticksPerMicrosecond = 1;
+
+static uint64_t ReadTicks() {
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return static_cast<uint64_t>(now.QuadPart);
+}
+
+static void RecordLock(uintptr_t lock, uintptr_t caller, LockKind kind,
+    bool contended, uint64_t waitTicks) {
+    LockSiteTable* table = g_lockProfiler->ThreadTable();
+    if (table != nullptr) {
+        table->Record(lock, caller, kind, contended, waitTicks);
+    }
+}
+
+// Try first: only a failed try means the thread has to wait. Recursive
+// entry by the owner succeeds and counts as uncontended.
+static void WINAPI HookedEnterCriticalSection(LPCRITICAL_SECTION section) {
+    uintptr_t caller = reinterpret_cast<uintptr_t>(_ReturnAddress());
+    if (TryEnterCriticalSection(section)) {
+        RecordLock(reinterpret_cast<uintptr_t>(section), caller,
+            LOCK_CRITICAL_SECTION, false, 0);
+        return;
+    }
+    uint64_t start = ReadTicks();
+    g_originalEnterCriticalSection(section);
+    RecordLock(reinterpret_cast<uintptr_t>(section), caller,
+        LOCK_CRITICAL_SECTION, true, ReadTicks() - start);
+}
+
+// A zero-timeout wait first, so waits that are satisfied at once are not
+// counted as contended. It consumes the signal just as the real wait would.
+static DWORD WINAPI HookedWaitForSingleObject(HANDLE handle, DWORD timeout) {
+    uintptr_t caller = reinterpret_cast<uintptr_t>(_ReturnAddress());
+    DWORD result = g_originalWaitForSingleObject(handle, 0);
+    if (result != WAIT_TIMEOUT || timeout == 0) {
+        RecordLock(reinterpret_cast<uintptr_t>(handle), caller, LOCK_WAIT,
+            result == WAIT_TIMEOUT, 0);
+        return result;
+    }
+    uint64_t start = ReadTicks();
+    result = g_originalWaitForSingleObject(handle, timeout);
+    RecordLock(reinterpret_cast<uintptr_t>(handle), caller, LOCK_WAIT, true,
+        ReadTicks() - start);
+    return result;
+}
+
+static DWORD WINAPI HookedWaitForMultipleObjects(DWORD count,
+    const HANDLE* handles, BOOL waitAll, DWORD timeout) {
+    uintptr_t caller = reinterpret_cast<uintptr_t>(_ReturnAddress());
+    uintptr_t lock = count > 0 && handles != NULL ?
+        reinterpret_cast<uintptr_t>(handles[0]) : 0;
+    DWORD result = g_originalWaitForMultipleObjects(count, handles, waitAll, 0);
+    if (result != WAIT_TIMEOUT || timeout == 0) {
+        RecordLock(lock, caller, LOCK_WAIT_MULTIPLE, result == WAIT_TIMEOUT, 0);
+        return result;
+    }
+    uint64_t start = ReadTicks();
+    result = g_originalWaitForMultipleObjects(count, handles, waitAll, timeout);
+    RecordLock(lock, caller, LOCK_WAIT_MULTIPLE, true, ReadTicks() - start);
+    return result;
+}
+
+// Hook the lock imports of the modules in LockProfilerModules if enabled
+bool StartLockProfiler() {
+    if (!GetConfigBool("LockProfilerEnabled", false)) {
+        return false;
+    }
+
+    int sitesPerThread = GetConfigInt("LockProfilerSitesPerThread", 4096);
+    if (sitesPerThread < 256) sitesPerThread = 256;
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    g_ticksPerMicrosecond = frequency.QuadPart / 1000000.0;
+    g_lockProfiler = new LockProfiler(static_cast<size_t>(sitesPerThread));
+
+    struct ImportHook {
+        const char* name;
+        const void* replacement;
+    };
+    const ImportHook hooks[] = {
+        { "EnterCriticalSection",
+            reinterpret_cast<const void*>(HookedEnterCriticalSection) },
+        { "WaitForSingleObject",
+            reinterpret_cast<const void*>(HookedWaitForSingleObject) },
+        { "WaitForMultipleObjects",
+            reinterpret_cast<const void*>(HookedWaitForMultipleObjects) },
+    };
+
+    std::stringstream modules(GetConfigString("LockProfilerModules",
+        "GAME_EXECUTABLE"));
+    std::string moduleName;
+    int hooked = 0;
+    while (std::getline(modules, moduleName, ',')) {
+        moduleName = Trim(moduleName);
+        if (moduleName.empty()) {
+            continue;
+        }
+        HMODULE module = moduleName == "GAME_EXECUTABLE" ?
+            GetModuleHandleA(NULL) : GetModuleHandleA(moduleName.c_str());
+        if (module == NULL) {
+            Log("Warning: Lock profiler: module '" + moduleName +
+                "' is not loaded.");
+            continue;
+        }
+        std::string names;
+        for (const ImportHook& hook : hooks) {
+            if (HookImport(module, "KERNEL32.dll", hook.name, hook.replacement,
+                nullptr)) {
+                names += (names.empty() ? "" : ", ") + std::string(hook.name);
+                hooked++;
+            }
+        }
+        Log("Lock profiler: hooked " + (names.empty() ? std::string("nothing") :
+            names) + " in " + moduleName + ".");
+    }
+    if (hooked == 0) {
+        Log("Warning: Lock profiler found no lock imports to hook.");
+        return false;
+    }
+    return true;
+}
+
+// Write the ranked report. Called at shutdown; the hooks stay in place and
+// keep recording harmlessly.
+void ShutdownLockProfiler() {
+    if (g_lockProfiler == nullptr) {
+        return;
+    }
+    std::vector<LockSiteStats> sites = g_lockProfiler->Collect();
+
+    ModuleMap modules;
+    modules.Refresh();
+    std::string reportPath = g_dllDir + "\\" + LOCK_PROFILE_FILE;
+    std::ofstream report(reportPath, std::ios::trunc);
+    if (!report.is_open()) {
+        Log("Error: Could not write lock report to " + reportPath + ".");
+        return;
+    }
+    int rows = GetConfigInt("LockProfilerReportRows", 40);
+    if (rows < 1) rows = 1;
+    WriteLockReport(report, sites, g_ticksPerMicrosecond,
+        [&modules](uintptr_t address) { return modules.Describe(address); },
+        static_cast<size_t>(rows));
+    report.close();
+
+    uint64_t contended = 0;
+    uint64_t waitTicks = 0;
+    for (const LockSiteStats& site : sites) {
+        contended += site.contended;
+        waitTicks += site.waitTicks;
+    }
+    Log("Lock profiler wrote " + std::to_string(sites.size()) + " lock sites (" +
+        std::to_string(g_lockProfiler->Threads()) + " threads, " +
+        std::to_string(contended) + " contended acquisitions, " +
+        std::to_string(static_cast<uint64_t>(waitTicks / g_ticksPerMicrosecond /
+            1000)) + " ms waiting, " + std::to_string(g_lockProfiler->Dropped()) +
+        " dropped) to " + reportPath + ".");
+}
+#endif
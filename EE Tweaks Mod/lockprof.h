@@ -0,0 +1,82 @@
+#ifndef LOCKPROF_H
+#define LOCKPROF_H
+
+#include "pch.h"
+
+enum LockKind {
+    LOCK_CRITICAL_SECTION = 0,
+    LOCK_WAIT = 1,          // WaitForSingleObject on a handle
+    LOCK_WAIT_MULTIPLE = 2, // WaitForMultipleObjects; lock = first handle
+};
+
+// Totals of one lock taken from one call site
+struct LockSiteStats {
+    uintptr_t lock;   // Critical section address or waited handle
+    uintptr_t caller; // Return address in the calling module
+    LockKind kind;
+    uint64_t acquisitions;
+    uint64_t contended;    // Had to wait
+    uint64_t waitTicks;    // Total time spent waiting
+    uint64_t maxWaitTicks;
+};
+
+// Lock statistics of one thread. Only its own thread records into it, so
+// there are no locks and no read-modify-write instructions; the report reads
+// it from another thread through the atomics. Memory is allocated up front.
+class LockSiteTable {
+public:
+    explicit LockSiteTable(size_t capacity); // Rounded up to a power of two
+
+    void Record(uintptr_t lock, uintptr_t caller, LockKind kind, bool contended,
+        uint64_t waitTicks);
+    void AppendTo(std::vector<LockSiteStats>& sites) const;
+    uint64_t Dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+private:
+    struct Slot {
+        std::atomic<uintptr_t> lock{ 0 };
+        std::atomic<uintptr_t> caller{ 0 };
+        std::atomic<uint32_t> kind{ 0 };
+        std::atomic<uint64_t> acquisitions{ 0 }; // 0 = empty slot
+        std::atomic<uint64_t> contended{ 0 };
+        std::atomic<uint64_t> waitTicks{ 0 };
+        std::atomic<uint64_t> maxWaitTicks{ 0 };
+    };
+
+    std::unique_ptr<Slot[]> m_slots;
+    size_t m_mask;
+    size_t m_used = 0;
+    std::atomic<uint64_t> m_dropped{ 0 };
+};
+
+// Hands each thread its own table and merges them for the report
+class LockProfiler {
+public:
+    explicit LockProfiler(size_t sitesPerThread);
+
+    // The calling thread's table, created on its first call. nullptr if it
+    // could not be allocated.
+    LockSiteTable* ThreadTable();
+    // Sites merged over all threads, most total wait time first
+    std::vector<LockSiteStats> Collect();
+    size_t Threads();
+    uint64_t Dropped();
+
+private:
+    size_t m_sitesPerThread;
+    std::mutex m_mutex; // Only taken when a thread registers
+    std::vector<std::unique_ptr<LockSiteTable>> m_tables;
+};
+
+// Write the ranked report: the top sites, then the totals per lock
+void WriteLockReport(std::ostream& out, const std::vector<LockSiteStats>& sites,
+    double ticksPerMicrosecond,
+    const std::function<std::string(uintptr_t)>& describe, size_t maxRows);
+
+// Function declarations
+#ifdef _WIN32
+bool StartLockProfiler();
+void ShutdownLockProfiler();
+#endif
+
+#endif // LOCKPROF_H
@@ -5,6 +5,7 @@
 // Define logging globals
 std::ofstream g_logFile;
 bool g_loggingEnabled = true; // Enable logging by default
+static std::mutex g_logMutex; // Log() may be called from worker threads
 
 // Get current timestamp for logging
 std::string GetTimestamp() {
@@ -24,7 +25,12 @@ void Log(const std::string& message) {
     // Always output to debugger first for critical setup messages
     OutputDebugStringA(("tweaks.dll: " + message + "\n").c_str());
 
-    // Only write to file if logging is enabled and file is open
+    // Only write to file if logging is enabled and file is open. Checked
+    // before locking too: after shutdown a dead thread may own the lock.
+    if (!g_loggingEnabled) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(g_logMutex);
     if (!g_loggingEnabled || !g_logFile.is_open()) {
         return;
     }
@@ -55,6 +61,8 @@ void InitializeLogging() {
 void ShutdownLogging() {
     if (g_logFile.is_open()) {
         Log("Closing log file.");
+        std::lock_guard<std::mutex> lock(g_logMutex);
+        g_loggingEnabled = false; // Later calls return before locking
         g_logFile.close();
     }
 }
@@ -0,0 +1,185 @@
+#include "pch.h"
+#include "lz4block.h"
+
+#ifndef _WIN32
+#include <cstring>
+#endif
+
+static const size_t LZ4_MIN_MATCH = 4;
+static const size_t LZ4_LAST_LITERALS = 5; // Block must end with literals
+static const size_t LZ4_MATCH_FIND_LIMIT = 12; // Last match starts before this
+static const size_t LZ4_MAX_OFFSET = 65535;
+static const int LZ4_HASH_BITS = 12;
+
+static uint32_t Read32(const unsigned char* p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static uint32_t HashSequence(uint32_t sequence) {
+    return (sequence * 2654435761u) >> (32 - LZ4_HASH_BITS);
+}
+
+size_t Lz4CompressBound(size_t srcSize) {
+    return srcSize + srcSize / 255 + 16;
+}
+
+// Write a length continuation (the part above 15) as 255-bytes plus rest
+static bool WriteLength(size_t length, unsigned char*& op,
+    const unsigned char* end) {
+    while (length >= 255) {
+        if (op >= end) return false;
+        *op++ = 255;
+        length -= 255;
+    }
+    if (op >= end) return false;
+    *op++ = static_cast<unsigned char>(length);
+    return true;
+}
+
+// Emit literals [literals, literals + literalLength) followed by a match
+// (matchLength 0 = last sequence, literals only)
+static bool WriteSequence(const unsigned char* literals, size_t literalLength,
+    size_t offset, size_t matchLength, unsigned char*& op,
+    const unsigned char* end) {
+    if (op >= end) return false;
+    unsigned char* token = op++;
+    *token = static_cast<unsigned char>(
+        (literalLength >= 15 ? 15 : literalLength) << 4);
+    if (literalLength >= 15 && !WriteLength(literalLength - 15, op, end)) {
+        return false;
+    }
+    if (static_cast<size_t>(end - op) < literalLength) return false;
+    if (literalLength > 0) {
+        memcpy(op, literals, literalLength);
+        op += literalLength;
+    }
+
+    if (matchLength == 0) {
+        return true;
+    }
+    if (end - op < 2) return false;
+    *op++ = static_cast<unsigned char>(offset & 0xFF);
+    *op++ = static_cast<unsigned char>(offset >> 8);
+    size_t code = matchLength - LZ4_MIN_MATCH;
+    *token |= static_cast<unsigned char>(code >= 15 ? 15 : code);
+    if (code >= 15 && !WriteLength(code - 15, op, end)) {
+        return false;
+    }
+    return true;
+}
+
+size_t Lz4CompressBlock(const unsigned char* src, size_t srcSize,
+    unsigned char* dst, size_t dstCapacity) {
+    unsigned char* op = dst;
+    const unsigned char* end = dst + dstCapacity;
+    size_t anchor = 0;
+
+    if (srcSize > LZ4_MATCH_FIND_LIMIT) {
+        std::vector<int64_t> table(static_cast<size_t>(1) << LZ4_HASH_BITS, -1);
+        size_t matchFindLimit = srcSize - LZ4_MATCH_FIND_LIMIT;
+        size_t matchEndLimit = srcSize - LZ4_LAST_LITERALS;
+        size_t ip = 0;
+
+        while (ip < matchFindLimit) {
+            uint32_t sequence = Read32(src + ip);
+            uint32_t hash = HashSequence(sequence);
+            int64_t candidate = table[hash];
+            table[hash] = static_cast<int64_t>(ip);
+
+            if (candidate < 0 || ip - static_cast<size_t>(candidate) > LZ4_MAX_OFFSET ||
+                Read32(src + candidate) != sequence) {
+                ip++;
+                continue;
+            }
+
+            size_t ref = static_cast<size_t>(candidate);
+            while (ip > anchor && ref > 0 && src[ip - 1] == src[ref - 1]) {
+                ip--; // Extend backwards over pending literals
+                ref--;
+            }
+            size_t length = LZ4_MIN_MATCH;
+            while (ip + length < matchEndLimit && src[ip + length] == src[ref + length]) {
+                length++;
+            }
+
+            if (!WriteSequence(src + anchor, ip - anchor, ip - ref, length, op,
+                end)) {
+                return 0;
+            }
+            ip += length;
+            anchor = ip;
+            if (ip - 2 < matchFindLimit) {
+                table[HashSequence(Read32(src + ip - 2))] =
+                    static_cast<int64_t>(ip - 2);
+            }
+        }
+    }
+
+    if (!WriteSequence(src + anchor, srcSize - anchor, 0, 0, op, end)) {
+        return 0;
+    }
+    return static_cast<size_t>(op - dst);
+}
+
+// Read a length continuation, checking every byte against the input end
+static bool ReadLength(const unsigned char*& ip, const unsigned char* end,
+    size_t& length) {
+    unsigned char b;
+    do {
+        if (ip >= end) return false;
+        b = *ip++;
+        length += b;
+    } while (b == 255);
+    return true;
+}
+
+long long Lz4DecompressBlock(const unsigned char* src, size_t srcSize,
+    unsigned char* dst, size_t dstCapacity) {
+    const unsigned char* ip = src;
+    const unsigned char* ipEnd = src + srcSize;
+    size_t op = 0;
+
+    while (ip < ipEnd) {
+        unsigned char token = *ip++;
+
+        size_t literalLength = token >> 4;
+        if (literalLength == 15 && !ReadLength(ip, ipEnd, literalLength)) {
+            return -1;
+        }
+        if (static_cast<size_t>(ipEnd - ip) < literalLength ||
+            dstCapacity - op < literalLength) {
+            return -1;
+        }
+        memcpy(dst + op, ip, literalLength);
+        ip += literalLength;
+        op += literalLength;
+
+        if (ip == ipEnd) {
+            break; // Last sequence has no match
+        }
+
+        if (ipEnd - ip < 2) return -1;
+        size_t offset = ip[0] | (static_cast<size_t>(ip[1]) << 8);
+        ip += 2;
+        if (offset == 0 || offset > op) {
+            return -1;
+        }
+
+        size_t matchLength = token & 15;
+        if (matchLength == 15 && !ReadLength(ip, ipEnd, matchLength)) {
+            return -1;
+        }
+        matchLength += LZ4_MIN_MATCH;
+        if (dstCapacity - op < matchLength) {
+            return -1;
+        }
+        // Byte by byte: the match may overlap the bytes being written
+        for (size_t i = 0; i < matchLength; ++i) {
+            dst[op + i] = dst[op - offset + i];
+        }
+        op += matchLength;
+    }
+    return static_cast<long long>(op);
+}
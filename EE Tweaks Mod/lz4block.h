@@ -0,0 +1,20 @@
+#ifndef LZ4BLOCK_H
+#define LZ4BLOCK_H
+
+#include "pch.h"
+
+// LZ4 block format (no frame header), compatible with the reference
+// LZ4_compress_default/LZ4_decompress_safe. Greedy single-pass matcher:
+// fast, but compresses a little worse than the reference implementation.
+
+// Worst-case compressed size of srcSize bytes
+size_t Lz4CompressBound(size_t srcSize);
+// Returns the compressed size, or 0 if dst is too small
+size_t Lz4CompressBlock(const unsigned char* src, size_t srcSize,
+    unsigned char* dst, size_t dstCapacity);
+// Returns the decompressed size, or -1 if the input is malformed or does not
+// fit in dst. Never reads or writes out of bounds.
+long long Lz4DecompressBlock(const unsigned char* src, size_t srcSize,
+    unsigned char* dst, size_t dstCapacity);
+
+#endif // LZ4BLOCK_H
@@ -0,0 +1,561 @@
+#include "pch.h"
+#include "mapplanner.h"
+#include "globals.h" // Access g_dllDir, g_executableName, MAP_PLAN_FILE
+#include "config.h"  // Access config functions and g_config
+
+#ifdef _WIN32
+#include "logging.h" // Access Log()
+#include "d3dhooks.h" // Access RequestFrameTiming(), GetFrameTimes()
+#endif
+
+// --- Map Memory Model ---
+
+int GetGridLimitTier(int mapSize) {
+    if (mapSize <= 511) return 0;
+    if (mapSize <= 1023) return 1023;
+    if (mapSize <= 2047) return 2047;
+    return MAX_GRID_LIMIT;
+}
+
+int ChooseChunkSetting(int mapSize, int targetTiles, bool allowIntermediate) {
+    if (!allowIntermediate) {
+        return mapSize > ORIGINAL_MAX_MAP_SIZE ? MAX_CHUNK_SETTING :
+            MIN_CHUNK_SETTING;
+    }
+    int setting = MIN_CHUNK_SETTING;
+    while (setting < MAX_CHUNK_SETTING &&
+        (mapSize > (setting + 1) * targetTiles ||
+            (setting == MIN_CHUNK_SETTING && mapSize > ORIGINAL_MAX_MAP_SIZE))) {
+        setting = setting * 2 + 1;
+    }
+    return setting;
+}
+
+uint64_t EstimateMapBytes(const MapMemoryModel& model, int mapSize,
+    int chunkSetting) {
+    double tiles = static_cast<double>(mapSize) * mapSize;
+    double chunks = static_cast<double>(chunkSetting + 1) * (chunkSetting + 1);
+    double bytes = model.baseBytes + model.bytesPerTile * tiles +
+        model.bytesPerChunk * chunks;
+    return bytes > 0 ? static_cast<uint64_t>(bytes) : 0;
+}
+
+int LargestFittingMapSize(const MapMemoryModel& model, uint64_t budget,
+    int chunkSetting) {
+    int low = 0;
+    int high = 2 * (MAX_GRID_LIMIT + 1);
+    while (low < high) { // Estimates grow with the size
+        int middle = (low + high + 1) / 2;
+        if (EstimateMapBytes(model, middle, chunkSetting) <= budget) {
+            low = middle;
+        }
+        else {
+            high = middle - 1;
+        }
+    }
+    return low;
+}
+
+void AddMapCalibrationSample(std::vector<MapCalibrationSample>& samples,
+    const MapCalibrationSample& sample) {
+    for (MapCalibrationSample& existing : samples) {
+        if (existing.mapSize == sample.mapSize &&
+            existing.chunkSetting == sample.chunkSetting) {
+            if (sample.addedBytes > existing.addedBytes) {
+                existing.addedBytes = sample.addedBytes;
+            }
+            return;
+        }
+    }
+    samples.push_back(sample);
+}
+
+// Fit added = base + perTile * size^2 after taking off the chunk part. With
+// a single map size only the base can be fitted; a fit that would make
+// bigger maps cheaper keeps the current per-tile cost.
+bool FitMapMemoryModel(const std::vector<MapCalibrationSample>& samples,
+    MapMemoryModel& model) {
+    if (samples.empty()) {
+        return false;
+    }
+    double n = static_cast<double>(samples.size());
+    double sumX = 0, sumY = 0, sumXX = 0, sumXY = 0;
+    for (const MapCalibrationSample& sample : samples) {
+        double chunks = static_cast<double>(sample.chunkSetting + 1) *
+            (sample.chunkSetting + 1);
+        double x = static_cast<double>(sample.mapSize) * sample.mapSize;
+        double y = static_cast<double>(sample.addedBytes) -
+            model.bytesPerChunk * chunks;
+        sumX += x;
+        sumY += y;
+        sumXX += x * x;
+        sumXY += x * y;
+    }
+    double variance = sumXX - sumX * sumX / n;
+    if (variance > 0) {
+        double slope = (sumXY - sumX * sumY / n) / variance;
+        if (slope > 0) {
+            model.bytesPerTile = slope;
+        }
+    }
+    model.baseBytes = (sumY - model.bytesPerTile * sumX) / n;
+    if (model.baseBytes < 0) model.baseBytes = 0;
+    return true;
+}
+
+// One "size,chunkSetting,addedBytes" line per sample
+bool ReadMapCalibration(std::istream& in,
+    std::vector<MapCalibrationSample>& samples) {
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        MapCalibrationSample sample;
+        unsigned long long added = 0;
+        char comma1 = 0, comma2 = 0;
+        std::istringstream fields(line);
+        if (!(fields >> sample.mapSize >> comma1 >> sample.chunkSetting >>
+            comma2 >> added) || comma1 != ',' || comma2 != ',' ||
+            sample.mapSize <= 0 || sample.chunkSetting < 0) {
+            return false;
+        }
+        sample.addedBytes = added;
+        AddMapCalibrationSample(samples, sample);
+    }
+    return true;
+}
+
+void WriteMapCalibration(std::ostream& out,
+    const std::vector<MapCalibrationSample>& samples) {
+    out << "# size,chunkSetting,addedBytes\n";
+    for (const MapCalibrationSample& sample : samples) {
+        out << sample.mapSize << ',' << sample.chunkSetting << ','
+            << sample.addedBytes << '\n';
+    }
+}
+
+// --- Chunk Dimension Benchmark ---
+
+std::vector<int> GetBenchmarkChunkSettings(int mapSize) {
+    std::vector<int> settings;
+    for (int setting = MIN_CHUNK_SETTING; setting <= MAX_CHUNK_SETTING;
+        setting = setting * 2 + 1) {
+        if (setting > MIN_CHUNK_SETTING || mapSize <= ORIGINAL_MAX_MAP_SIZE) {
+            settings.push_back(setting);
+        }
+    }
+    return settings;
+}
+
+int NextBenchmarkChunkSetting(const std::vector<int>& candidates,
+    const std::vector<ChunkBenchmarkResult>& results, int mapSize) {
+    int best = candidates.empty() ? MAX_CHUNK_SETTING : candidates[0];
+    size_t bestSessions = SIZE_MAX;
+    for (int candidate : candidates) {
+        size_t sessions = 0;
+        for (const ChunkBenchmarkResult& result : results) {
+            if (result.mapSize == mapSize && result.chunkSetting == candidate) {
+                sessions++;
+            }
+        }
+        if (sessions < bestSessions) {
+            best = candidate;
+            bestSessions = sessions;
+        }
+    }
+    return best;
+}
+
+// One "chunkSetting,mapSize,frames,totalUs,p95Us,maxUs" line per session
+bool ReadChunkBenchmark(std::istream& in,
+    std::vector<ChunkBenchmarkResult>& results) {
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        std::replace(line.begin(), line.end(), ',', ' ');
+        ChunkBenchmarkResult result;
+        unsigned long long frames = 0, total = 0, p95 = 0, worst = 0;
+        std::istringstream fields(line);
+        if (!(fields >> result.chunkSetting >> result.mapSize >> frames >>
+            total >> p95 >> worst)) {
+            return false;
+        }
+        result.frames = frames;
+        result.totalMicros = total;
+        result.p95Micros = p95;
+        result.maxMicros = worst;
+        results.push_back(result);
+    }
+    return true;
+}
+
+void WriteChunkBenchmarkResult(std::ostream& out,
+    const ChunkBenchmarkResult& result) {
+    out << result.chunkSetting << ',' << result.mapSize << ','
+        << result.frames << ',' << result.totalMicros << ','
+        << result.p95Micros << ',' << result.maxMicros << '\n';
+}
+
+// --- Configured Sizes ---
+
+// The chunk setting the config asks for on a map of this size
+static int GetConfiguredChunkSetting(int mapSize) {
+    int tiles = GetConfigInt("ChunkDimensionTargetTiles", DEFAULT_CHUNK_TILES);
+    return ChooseChunkSetting(mapSize, tiles < 8 ? 8 : tiles,
+        GetConfigBool("ChunkDimensionIntermediate", false));
+}
+
+int GetLargestConfiguredMapSize() {
+    int largest = 0;
+    if (GetConfigBool("GiganticMapSizeEnabled", true)) {
+        largest = GetConfigInt("GiganticMapSize", 220);
+    }
+    std::vector<int> flatSizes;
+    if (GetConfigBool("CustomFlatWorldSizesEnabled", true) &&
+        ParseIntList(GetConfigString("CustomFlatWorldSizes",
+            DEFAULT_FLAT_MAP_SIZES_STR), flatSizes)) {
+        for (int size : flatSizes) {
+            largest = std::max(largest, size);
+        }
+    }
+    return largest;
+}
+
+// --- Planner ---
+
+#ifdef _WIN32
+const double ADDRESS_SPACE_USABLE = 0.85; // The rest is lost to fragmentation
+
+static bool g_calibrate = false;
+static MapCalibrationSample g_calibrationSample = { 0, 0, 0 };
+static uint64_t g_calibrationStartBytes = 0; // Virtual size when planning
+static bool g_chunkBenchmark = false;
+static ChunkBenchmarkResult g_benchmarkResult = { 0, 0, 0, 0, 0, 0 };
+
+static std::string FormatMB(uint64_t bytes) {
+    return std::to_string(bytes / (1024 * 1024)) + " MB";
+}
+
+typedef LONG(NTAPI* NtQueryInformationProcessFn)(HANDLE process,
+    int infoClass, PVOID info, ULONG infoLength, PULONG returnLength);
+const int PROCESS_VM_COUNTERS = 3; // PROCESSINFOCLASS
+
+// VM_COUNTERS, which winternl.h does not declare
+struct VmCounters {
+    SIZE_T peakVirtualSize;
+    SIZE_T virtualSize;
+    ULONG pageFaultCount;
+    SIZE_T peakWorkingSetSize;
+    SIZE_T workingSetSize;
+    SIZE_T quotaPeakPagedPoolUsage;
+    SIZE_T quotaPagedPoolUsage;
+    SIZE_T quotaPeakNonPagedPoolUsage;
+    SIZE_T quotaNonPagedPoolUsage;
+    SIZE_T pagefileUsage;
+    SIZE_T peakPagefileUsage;
+};
+
+// The address space the process has reserved, now and at its peak.
+// GetProcessMemoryInfo only has the commit charge, which leaves out
+// reserved memory and mapped files.
+static bool QueryVirtualSize(uint64_t& current, uint64_t& peak) {
+    static NtQueryInformationProcessFn queryProcess =
+        reinterpret_cast<NtQueryInformationProcessFn>(GetProcAddress(
+            GetModuleHandleA("ntdll.dll"), "NtQueryInformationProcess"));
+    VmCounters counters = { 0 };
+    if (queryProcess == nullptr || queryProcess(GetCurrentProcess(),
+        PROCESS_VM_COUNTERS, &counters, sizeof(counters), NULL) != 0) {
+        return false;
+    }
+    current = counters.virtualSize;
+    peak = counters.peakVirtualSize;
+    return true;
+}
+
+// Whether the game executable may use more than 2 GB
+static bool IsGameLargeAddressAware() {
+    const unsigned char* base =
+        reinterpret_cast<const unsigned char*>(GetModuleHandleA(NULL));
+    const IMAGE_DOS_HEADER* dosHeader =
+        reinterpret_cast<const IMAGE_DOS_HEADER*>(base);
+    const IMAGE_NT_HEADERS* ntHeaders =
+        reinterpret_cast<const IMAGE_NT_HEADERS*>(base + dosHeader->e_lfanew);
+    return (ntHeaders->FileHeader.Characteristics &
+        IMAGE_FILE_LARGE_ADDRESS_AWARE) != 0;
+}
+
+// Estimate what the configured map sizes need, compare that with the address
+// space left, and warn about (or lower) sizes that will not fit. Runs before
+// the map size patches read the sizes from config.
+bool PlanMapMemory() {
+    Log("Checking Map Memory Planner...");
+    if (!GetConfigBool("MapMemoryPlannerEnabled", true)) {
+        Log("Map Memory Planner is disabled in config.");
+        return false;
+    }
+
+    // The sizes the patches are about to apply
+    struct PlannedSize {
+        std::string name;
+        int size;
+    };
+    std::vector<PlannedSize> sizes;
+    bool gigantic = GetConfigBool("GiganticMapSizeEnabled", true);
+    if (gigantic) {
+        int size = GetConfigInt("GiganticMapSize", 220);
+        sizes.push_back({ "Gigantic", size > 0 ? size : 220 });
+    }
+    std::vector<int> flatSizes;
+    bool flat = GetConfigBool("CustomFlatWorldSizesEnabled", true) &&
+        ParseIntList(GetConfigString("CustomFlatWorldSizes",
+            DEFAULT_FLAT_MAP_SIZES_STR), flatSizes);
+    if (flat) {
+        for (size_t i = 0; i < flatSizes.size(); ++i) {
+            sizes.push_back({ "flat size " + std::to_string(i + 1), flatSizes[i] });
+        }
+    }
+    int largest = 0;
+    for (const PlannedSize& planned : sizes) {
+        largest = std::max(largest, planned.size);
+    }
+    if (largest <= ORIGINAL_MAX_MAP_SIZE) {
+        Log("No map size above " + std::to_string(ORIGINAL_MAX_MAP_SIZE) +
+            " is configured. Nothing to plan.");
+        return false;
+    }
+
+    // Model: config overrides, then measured samples
+    MapMemoryModel model;
+    model.baseBytes = GetConfigInt("MapMemoryPlannerBaseMB", 400) * 1024.0 * 1024.0;
+    model.bytesPerTile = GetConfigInt("MapMemoryPlannerBytesPerTile", 400);
+    std::vector<MapCalibrationSample> samples;
+    std::ifstream calibrationFile(g_dllDir + "\\" + MAP_PLAN_FILE);
+    if (calibrationFile.is_open() &&
+        ReadMapCalibration(calibrationFile, samples) &&
+        FitMapMemoryModel(samples, model)) {
+        Log("Map memory model fitted to " + std::to_string(samples.size()) +
+            " calibration samples.");
+    }
+    Log("Map memory model: " + FormatMB(static_cast<uint64_t>(model.baseBytes)) +
+        " base, " + std::to_string(static_cast<int>(model.bytesPerTile)) +
+        " bytes per tile.");
+
+    // Address space: now, and what it would be with and without the large
+    // address aware flag
+    MEMORYSTATUSEX status = { 0 };
+    status.dwLength = sizeof(status);
+    if (!GlobalMemoryStatusEx(&status)) {
+        Log("Warning: Could not query the address space. Error code: " +
+            std::to_string(GetLastError()));
+        return false;
+    }
+    BOOL wow64 = FALSE;
+    IsWow64Process(GetCurrentProcess(), &wow64);
+    uint64_t inUse = status.ullTotalVirtual - status.ullAvailVirtual;
+    uint64_t withoutLaa = 2ull << 30;
+    uint64_t withLaa = wow64 ? 4ull << 30 : 3ull << 30; // 3 GB needs /3GB
+    bool laa = IsGameLargeAddressAware();
+    // Estimates are on top of what is in use now, as calibration measures
+    auto budgetFor = [inUse](uint64_t addressSpace) -> uint64_t {
+        uint64_t usable = static_cast<uint64_t>(addressSpace * ADDRESS_SPACE_USABLE);
+        return usable > inUse ? usable - inUse : 0;
+    };
+    uint64_t budget = budgetFor(status.ullTotalVirtual);
+
+    int chunkSetting = GetConfiguredChunkSetting(largest);
+    int fitsNow = LargestFittingMapSize(model, budget, chunkSetting);
+    int fitsWithout = LargestFittingMapSize(model, budgetFor(withoutLaa),
+        chunkSetting);
+    int fitsWith = LargestFittingMapSize(model, budgetFor(withLaa), chunkSetting);
+    Log("Address space: " + FormatMB(status.ullTotalVirtual) + " (" +
+        FormatMB(inUse) + " in use at startup, game is " +
+        (laa ? "" : "not ") + "large address aware). Largest map that should "
+        "fit: " + std::to_string(fitsNow) + " (" + std::to_string(fitsWithout) +
+        " without, " + std::to_string(fitsWith) + " with large address "
+        "awareness).");
+
+    // Check each size; optionally lower the ones that do not fit
+    bool clamp = GetConfigBool("MapMemoryPlannerClamp", false);
+    int clampedSize = std::max(fitsNow, ORIGINAL_MAX_MAP_SIZE);
+    bool changed = false;
+    for (PlannedSize& planned : sizes) {
+        uint64_t estimate = EstimateMapBytes(model, planned.size, chunkSetting);
+        if (estimate <= budget) {
+            continue;
+        }
+        std::string message = "Warning: Map size " +
+            std::to_string(planned.size) + " (" + planned.name +
+            ") needs about " + FormatMB(estimate) + " but only " +
+            FormatMB(budget) + " is available.";
+        if (!laa && planned.size <= fitsWith) {
+            message += " It would fit if the game were large address aware.";
+        }
+        if (clamp) {
+            message += " Lowering it to " + std::to_string(clampedSize) + ".";
+            planned.size = clampedSize;
+            changed = true;
+        }
+        Log(message);
+    }
+    if (changed) {
+        if (gigantic) {
+            g_config["GiganticMapSize"] = std::to_string(sizes[0].size);
+        }
+        if (flat) {
+            std::string list;
+            for (size_t i = 0; i < flatSizes.size(); ++i) {
+                if (i > 0) list += ",";
+                list += std::to_string(sizes[sizes.size() - flatSizes.size() + i].size);
+            }
+            g_config["CustomFlatWorldSizes"] = list;
+        }
+        largest = 0;
+        for (const PlannedSize& planned : sizes) {
+            largest = std::max(largest, planned.size);
+        }
+    }
+
+    int gridTier = GetGridLimitTier(largest);
+    Log("Planned for map sizes up to " + std::to_string(largest) + ": grid limit " +
+        (gridTier == 0 ? std::string("original") : std::to_string(gridTier)) +
+        ", chunk setting " +
+        std::to_string(GetConfiguredChunkSetting(largest)) + ".");
+
+    uint64_t peak = 0;
+    if (GetConfigBool("MapMemoryPlannerCalibrate", false) && gigantic &&
+        QueryVirtualSize(g_calibrationStartBytes, peak)) {
+        g_calibrate = true;
+        g_calibrationSample.mapSize = sizes[0].size;
+        g_calibrationSample.chunkSetting = chunkSetting; // Until the patch runs
+        Log("Map Memory Planner calibration: play one match on the Gigantic "
+            "size (" + std::to_string(sizes[0].size) + "); the address space "
+            "it takes is recorded on exit.");
+    }
+    return true;
+}
+
+// Summarize the recorded sessions of one map size, one line per setting
+static void LogChunkBenchmark(const std::vector<ChunkBenchmarkResult>& results,
+    int mapSize) {
+    std::map<int, ChunkBenchmarkResult> totals;
+    std::map<int, int> sessions;
+    for (const ChunkBenchmarkResult& result : results) {
+        if (result.mapSize != mapSize || result.frames == 0) {
+            continue;
+        }
+        ChunkBenchmarkResult& total = totals[result.chunkSetting];
+        total.frames += result.frames;
+        total.totalMicros += result.totalMicros;
+        total.p95Micros = std::max(total.p95Micros, result.p95Micros);
+        total.maxMicros = std::max(total.maxMicros, result.maxMicros);
+        sessions[result.chunkSetting]++;
+    }
+    for (const auto& entry : totals) {
+        const ChunkBenchmarkResult& total = entry.second;
+        std::stringstream ss;
+        ss << std::fixed << std::setprecision(2)
+            << "  Chunk setting " << entry.first << ": "
+            << sessions[entry.first] << " sessions, " << total.frames
+            << " frames, average " << total.totalMicros / 1000.0 / total.frames
+            << " ms, worst 95th percentile " << total.p95Micros / 1000.0
+            << " ms, worst frame " << total.maxMicros / 1000.0 << " ms";
+        Log(ss.str());
+    }
+}
+
+// Pick the chunk setting for the largest configured map size. In benchmark
+// mode each launch takes the next candidate setting instead and its frame
+// times are recorded on exit.
+int PlanChunkDimension(int largestMapSize) {
+    int setting = GetConfiguredChunkSetting(largestMapSize);
+    if (GetConfigBool("ChunkDimensionBenchmark", false)) {
+        std::vector<ChunkBenchmarkResult> results;
+        std::ifstream in(g_dllDir + "\\" + CHUNK_BENCH_FILE);
+        if (in.is_open() && !ReadChunkBenchmark(in, results)) {
+            Log("Warning: " + std::string(CHUNK_BENCH_FILE) + " is damaged. "
+                "Earlier benchmark sessions are ignored.");
+            results.clear();
+        }
+        if (!results.empty()) {
+            Log("Chunk Dimension benchmark so far for map size " +
+                std::to_string(largestMapSize) + ":");
+            LogChunkBenchmark(results, largestMapSize);
+        }
+        setting = NextBenchmarkChunkSetting(
+            GetBenchmarkChunkSettings(largestMapSize), results, largestMapSize);
+        g_chunkBenchmark = true;
+        g_benchmarkResult.chunkSetting = setting;
+        g_benchmarkResult.mapSize = largestMapSize;
+        RequestFrameTiming();
+        Log("Chunk Dimension benchmark: this session uses chunk setting " +
+            std::to_string(setting) + ". Play a match on map size " +
+            std::to_string(largestMapSize) + "; frame times are recorded "
+            "on exit.");
+    }
+    g_calibrationSample.chunkSetting = setting;
+    return setting;
+}
+
+// Record the address space the session took as a calibration sample and the frame
+// times of a benchmark session. Called at shutdown.
+void ShutdownMapPlanner() {
+    if (g_chunkBenchmark && GetFrameTimes().Frames() > 0) {
+        const FrameTimeHistogram& frames = GetFrameTimes();
+        g_benchmarkResult.frames = frames.Frames();
+        g_benchmarkResult.totalMicros = frames.TotalMicros();
+        g_benchmarkResult.p95Micros = frames.Percentile(0.95);
+        g_benchmarkResult.maxMicros = frames.MaxMicros();
+        std::string benchPath = g_dllDir + "\\" + CHUNK_BENCH_FILE;
+        std::ofstream bench(benchPath, std::ios::app);
+        if (bench.is_open()) {
+            WriteChunkBenchmarkResult(bench, g_benchmarkResult);
+            Log("Chunk Dimension benchmark recorded " +
+                std::to_string(g_benchmarkResult.frames) + " frames for chunk "
+                "setting " + std::to_string(g_benchmarkResult.chunkSetting) + ".");
+        }
+        else {
+            Log("Error: Could not write the benchmark to " + benchPath + ".");
+        }
+    }
+    if (!g_calibrate) {
+        return;
+    }
+    // The same measure as at planning time, so the sample is what the match
+    // added on top of the startup use the budget already takes off
+    uint64_t current = 0;
+    uint64_t peak = 0;
+    if (!QueryVirtualSize(current, peak)) {
+        return;
+    }
+    g_calibrationSample.addedBytes = peak > g_calibrationStartBytes ?
+        peak - g_calibrationStartBytes : 0;
+
+    std::string path = g_dllDir + "\\" + MAP_PLAN_FILE;
+    std::vector<MapCalibrationSample> samples;
+    std::ifstream in(path);
+    if (in.is_open() && !ReadMapCalibration(in, samples)) {
+        samples.clear(); // Unreadable: start over
+    }
+    in.close();
+    AddMapCalibrationSample(samples, g_calibrationSample);
+
+    std::ofstream out(path, std::ios::trunc);
+    if (!out.is_open()) {
+        Log("Error: Could not write map calibration to " + path + ".");
+        return;
+    }
+    WriteMapCalibration(out, samples);
+    Log("Map Memory Planner recorded " +
+        FormatMB(g_calibrationSample.addedBytes) + " of address space above "
+        "startup (peak " + FormatMB(peak) + ") for map size " +
+        std::to_string(g_calibrationSample.mapSize) + ".");
+}
+#else
+// Offline tools (tools/scanreplay.cpp) have no frame times to benchmark with
+int PlanChunkDimension(int largestMapSize) {
+    return GetConfiguredChunkSetting(largestMapSize);
+}
+#endif
@@ -0,0 +1,92 @@
+#ifndef MAPPLANNER_H
+#define MAPPLANNER_H
+
+#include "pch.h"
+
+const int ORIGINAL_MAX_MAP_SIZE = 220; // Largest size the unpatched game handles
+const int MAX_GRID_LIMIT = 4095;       // Largest Map Grid Limit tier
+
+// Chunk Dimension values (the "mov [ebp-4], 7" immediate). Only 2^n - 1
+// values are used, as the game's own 7 and the long-used 31 are.
+const int MIN_CHUNK_SETTING = 7;  // The game's value
+const int MAX_CHUNK_SETTING = 31;
+const int DEFAULT_CHUNK_TILES = 28; // Tiles per chunk side at 220 / (7 + 1)
+
+// Estimated address space a match takes on top of what is in use when the
+// planner runs: a fixed part plus a part that grows with the number of tiles
+// and terrain chunks. The defaults are rough; calibration samples replace
+// them with measured values.
+struct MapMemoryModel {
+    double baseBytes = 400.0 * 1024 * 1024;
+    double bytesPerTile = 400.0;
+    double bytesPerChunk = 16.0 * 1024;
+};
+
+// Address space one played match took: the peak virtual size of the
+// process minus its virtual size when the planner ran
+struct MapCalibrationSample {
+    int mapSize;
+    int chunkSetting;
+    uint64_t addedBytes;
+};
+
+// Frame times of one session played with a chunk setting
+struct ChunkBenchmarkResult {
+    int chunkSetting;
+    int mapSize;
+    uint64_t frames;
+    uint64_t totalMicros;
+    uint64_t p95Micros;
+    uint64_t maxMicros;
+};
+
+// Map Grid Limit tier for a map size: 0 if the original 511 limit is
+// enough, else 1023, 2047 or 4095 (also for larger sizes)
+int GetGridLimitTier(int mapSize);
+// Smallest chunk setting whose chunks are at most targetTiles tiles wide
+// on a map of this size (capped at MAX_CHUNK_SETTING). Sizes above 220
+// never keep the game's setting. Without allowIntermediate they get the
+// long-used 31, and targetTiles is ignored.
+int ChooseChunkSetting(int mapSize, int targetTiles, bool allowIntermediate);
+
+uint64_t EstimateMapBytes(const MapMemoryModel& model, int mapSize,
+    int chunkSetting);
+// Largest map size whose estimate fits in budget; 0 if none does
+int LargestFittingMapSize(const MapMemoryModel& model, uint64_t budget,
+    int chunkSetting);
+
+// Keep the highest peak per map size and chunk setting
+void AddMapCalibrationSample(std::vector<MapCalibrationSample>& samples,
+    const MapCalibrationSample& sample);
+// Least-squares fit of the base and per-tile cost. Returns false (model
+// unchanged) if there are no samples.
+bool FitMapMemoryModel(const std::vector<MapCalibrationSample>& samples,
+    MapMemoryModel& model);
+bool ReadMapCalibration(std::istream& in,
+    std::vector<MapCalibrationSample>& samples);
+void WriteMapCalibration(std::ostream& out,
+    const std::vector<MapCalibrationSample>& samples);
+
+// The chunk settings a benchmark of this map size compares. The game's 7
+// is only included for sizes it supports.
+std::vector<int> GetBenchmarkChunkSettings(int mapSize);
+// The candidate with the fewest recorded sessions for the map size, so
+// consecutive launches take turns
+int NextBenchmarkChunkSetting(const std::vector<int>& candidates,
+    const std::vector<ChunkBenchmarkResult>& results, int mapSize);
+bool ReadChunkBenchmark(std::istream& in,
+    std::vector<ChunkBenchmarkResult>& results);
+void WriteChunkBenchmarkResult(std::ostream& out,
+    const ChunkBenchmarkResult& result);
+
+int GetLargestConfiguredMapSize(); // Of the enabled Gigantic and flat sizes
+// The chunk setting to patch in for the configured sizes (or the benchmark)
+int PlanChunkDimension(int largestMapSize);
+
+// Function declarations
+#ifdef _WIN32
+bool PlanMapMemory(); // Runs before the map size patches; may lower sizes
+void ShutdownMapPlanner();
+#endif
+
+#endif // MAPPLANNER_H
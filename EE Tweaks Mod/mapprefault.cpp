@@ -0,0 +1,602 @@
+#include "pch.h"
+#include "mapprefault.h"
+
+#ifdef _WIN32
+#include "logging.h"   // Access Log()
+#include "config.h"    // Access config functions
+#include "counters.h"
+#include "hooks.h"     // Access HookImport()
+#include "scheduler.h" // Access InstallFrameSleepHook()
+#endif
+
+// --- Prefault Queue ---
+
+PrefaultQueue::PrefaultQueue(size_t pageSize, size_t chunkPages)
+    : m_pageSize(pageSize), m_chunkBytes(pageSize * std::max<size_t>(chunkPages, 1)) {
+}
+
+void PrefaultQueue::Add(uintptr_t base, size_t size) {
+    if (size == 0) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_stopping) {
+            return;
+        }
+        m_queue.push_back({ base, base, base + size });
+        m_queued++;
+    }
+    m_blocks++;
+    m_work.notify_one();
+}
+
+void PrefaultQueue::Cancel(uintptr_t base) {
+    if (m_queued == 0) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (auto it = m_queue.begin(); it != m_queue.end(); ++it) {
+        if (it->base == base) {
+            m_queue.erase(it);
+            m_queued--;
+            m_cancelled++;
+            break;
+        }
+    }
+    m_chunkDone.wait(lock, [&] { return m_activeBase != base; });
+}
+
+bool PrefaultQueue::NextChunk(uintptr_t& begin, uintptr_t& end) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_work.wait(lock, [&] { return m_stopping || !m_queue.empty(); });
+    if (m_stopping) {
+        return false;
+    }
+    Block& block = m_queue.front();
+    begin = block.next;
+    // Chunks end on page boundaries, so each page is touched once
+    uintptr_t chunkEnd = (begin & ~static_cast<uintptr_t>(m_pageSize - 1)) +
+        m_chunkBytes;
+    end = std::min(chunkEnd, block.end);
+    block.next = end;
+    m_activeBase = block.base;
+    if (block.next == block.end) {
+        // Still counted as queued until the worker is out of it
+        m_queue.pop_front();
+        m_activeLast = true;
+    }
+    return true;
+}
+
+void PrefaultQueue::ChunkDone(size_t pagesTouched) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_activeBase = 0;
+        if (m_activeLast) {
+            m_activeLast = false;
+            m_queued--;
+        }
+    }
+    m_pagesTouched += pagesTouched;
+    m_chunkDone.notify_all();
+}
+
+void PrefaultQueue::Stop() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+        m_queued -= m_queue.size();
+        m_queue.clear();
+    }
+    m_work.notify_all();
+}
+
+// --- Game Integration ---
+
+#ifdef _WIN32
+typedef LPVOID(WINAPI* HeapAllocFn)(HANDLE, DWORD, SIZE_T);
+typedef LPVOID(WINAPI* HeapReAllocFn)(HANDLE, DWORD, LPVOID, SIZE_T);
+typedef BOOL(WINAPI* HeapFreeFn)(HANDLE, DWORD, LPVOID);
+typedef SIZE_T(WINAPI* HeapSizeFn)(HANDLE, DWORD, LPCVOID);
+typedef LPVOID(WINAPI* VirtualAllocFn)(LPVOID, SIZE_T, DWORD, DWORD);
+typedef BOOL(WINAPI* VirtualFreeFn)(LPVOID, SIZE_T, DWORD);
+
+const size_t PREFAULT_CHUNK_PAGES = 64;
+// A map is done generating at the first pass of the main loop after this
+// long without a large allocation
+const uint64_t GENERATION_QUIET_MICROS = 2000000;
+const int LARGE_PAGE_MAX_FAILURES = 3;
+
+// Whatever was bound before the hooks: the real functions or another hook
+static HeapAllocFn g_originalHeapAlloc = HeapAlloc;
+static HeapReAllocFn g_originalHeapReAlloc = HeapReAlloc;
+static HeapFreeFn g_originalHeapFree = HeapFree;
+static HeapSizeFn g_originalHeapSize = HeapSize;
+static VirtualAllocFn g_originalVirtualAlloc = VirtualAlloc;
+static VirtualFreeFn g_originalVirtualFree = VirtualFree;
+
+static std::unique_ptr<PrefaultQueue> g_prefaultQueue;
+static HANDLE g_prefaultThread = NULL;
+static size_t g_thresholdBytes = SIZE_MAX;
+static size_t g_pageSize = 4096;
+static bool g_measureOnly = false;
+static volatile bool g_detached = false; // Shut down: the queue is left alone
+static LARGE_INTEGER g_counterFrequency = { 0 };
+
+// Large blocks served from large pages instead of the heap, by address
+static std::atomic<size_t> g_largePageSize{ 0 }; // 0 when not in use
+static std::atomic<int> g_largePageFailures{ 0 };
+static std::mutex g_largeBlockMutex;
+struct LargePageBlock {
+    size_t size;     // As requested
+    size_t reserved; // Rounded up to whole large pages
+};
+static std::map<uintptr_t, LargePageBlock> g_largeBlocks;
+static std::atomic<uintptr_t> g_largeLow{ UINTPTR_MAX }; // Covers every block
+static std::atomic<uintptr_t> g_largeHigh{ 0 };
+static std::atomic<uint64_t> g_largePageBytes{ 0 }; // Ever allocated
+
+// The current map generation: from its first large allocation to the first
+// pass of the main loop after the last one
+struct GenerationWindow {
+    bool open;
+    uint64_t startMicros;
+    DWORD startFaults;
+    uint64_t lastLargeMicros;
+    uint64_t passMicros; // First pass since the last large allocation, or 0
+    DWORD passFaults;
+    uint32_t allocations;
+    uint64_t bytes;
+    uint64_t largePageBytes;
+    uint64_t pagesBefore; // Pages touched by the worker when it opened
+};
+static std::mutex g_windowMutex;
+static GenerationWindow g_window = { 0 };
+static std::atomic<bool> g_windowOpen{ false };
+static int g_generations = 0;
+
+static uint64_t NowMicros() {
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return static_cast<uint64_t>(now.QuadPart / g_counterFrequency.QuadPart *
+        1000000 + now.QuadPart % g_counterFrequency.QuadPart * 1000000 /
+        g_counterFrequency.QuadPart);
+}
+
+// Soft and hard faults of the whole process so far
+static DWORD ReadPageFaults() {
+    PROCESS_MEMORY_COUNTERS counters = { 0 };
+    counters.cb = sizeof(counters);
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return 0;
+    }
+    return counters.PageFaultCount;
+}
+
+static std::string FormatMegabytes(uint64_t bytes) {
+    return std::to_string((bytes + 512 * 1024) / (1024 * 1024)) + " MB";
+}
+
+// --- Page Touching ---
+
+// Write-fault each page in without changing it: a locked or of zero is
+// atomic against the game's own stores to the same word. Stops at a page
+// that is no longer there (decommitted under the worker).
+static size_t TouchPages(uintptr_t begin, uintptr_t end) {
+    size_t pages = 0;
+    __try {
+        for (uintptr_t page = begin; page + sizeof(LONG) <= end;
+            page = (page & ~static_cast<uintptr_t>(g_pageSize - 1)) + g_pageSize) {
+            InterlockedOr(reinterpret_cast<volatile LONG*>(page), 0);
+            pages++;
+        }
+    }
+    __except (GetExceptionCode() == EXCEPTION_ACCESS_VIOLATION ?
+        EXCEPTION_EXECUTE_HANDLER : EXCEPTION_CONTINUE_SEARCH) {
+    }
+    return pages;
+}
+
+static DWORD WINAPI PrefaultThreadProc(LPVOID) {
+    uintptr_t begin = 0;
+    uintptr_t end = 0;
+    while (g_prefaultQueue->NextChunk(begin, end)) {
+        g_prefaultQueue->ChunkDone(TouchPages(begin, end));
+        CounterSet(COUNTER_PREFAULTED_PAGES, g_prefaultQueue->PagesTouched());
+    }
+    return 0;
+}
+
+// --- Large Pages ---
+
+static bool EnableLockMemoryPrivilege() {
+    HANDLE token = NULL;
+    if (!OpenProcessToken(GetCurrentProcess(),
+        TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token)) {
+        return false;
+    }
+    TOKEN_PRIVILEGES privileges = { 0 };
+    privileges.PrivilegeCount = 1;
+    privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+    // AdjustTokenPrivileges succeeds without the privilege; the error says so
+    bool enabled = LookupPrivilegeValueA(NULL, "SeLockMemoryPrivilege",
+        &privileges.Privileges[0].Luid) &&
+        AdjustTokenPrivileges(token, FALSE, &privileges, 0, NULL, NULL) &&
+        GetLastError() == ERROR_SUCCESS;
+    CloseHandle(token);
+    return enabled;
+}
+
+// NULL when large pages are off, would waste more than a sixteenth of the
+// block's address space on rounding, or cannot be had
+static LPVOID AllocateLargePages(SIZE_T size) {
+    size_t largePage = g_largePageSize;
+    if (largePage == 0) {
+        return NULL;
+    }
+    size_t rounded = (size + largePage - 1) / largePage * largePage;
+    if (rounded - size > size / 16) {
+        return NULL;
+    }
+    LPVOID pointer = VirtualAlloc(NULL, rounded,
+        MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+    if (pointer == NULL) {
+        // Physical memory too fragmented; it does not get better while running
+        if (++g_largePageFailures == LARGE_PAGE_MAX_FAILURES) {
+            g_largePageSize = 0;
+            Log("Map prefault: large page allocations keep failing (error " +
+                std::to_string(GetLastError()) + "); using normal pages.");
+        }
+        return NULL;
+    }
+    uintptr_t address = reinterpret_cast<uintptr_t>(pointer);
+    {
+        std::lock_guard<std::mutex> lock(g_largeBlockMutex);
+        g_largeBlocks[address] = { size, rounded };
+        if (address < g_largeLow) g_largeLow = address;
+        if (address + rounded > g_largeHigh) g_largeHigh = address + rounded;
+    }
+    g_largePageBytes += rounded;
+    return pointer;
+}
+
+static bool InLargePageRange(LPCVOID pointer) {
+    uintptr_t address = reinterpret_cast<uintptr_t>(pointer);
+    return address >= g_largeLow && address < g_largeHigh;
+}
+
+static bool FindLargePageBlock(LPCVOID pointer, LargePageBlock& block) {
+    if (!InLargePageRange(pointer)) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(g_largeBlockMutex);
+    auto it = g_largeBlocks.find(reinterpret_cast<uintptr_t>(pointer));
+    if (it == g_largeBlocks.end()) {
+        return false;
+    }
+    block = it->second;
+    return true;
+}
+
+static bool FreeLargePages(LPVOID pointer) {
+    if (!InLargePageRange(pointer)) {
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(g_largeBlockMutex);
+        if (g_largeBlocks.erase(reinterpret_cast<uintptr_t>(pointer)) == 0) {
+            return false;
+        }
+    }
+    VirtualFree(pointer, 0, MEM_RELEASE);
+    return true;
+}
+
+// --- Generation Window ---
+
+static void OnLargeAllocation(LPVOID pointer, SIZE_T size, bool largePages) {
+    if (pointer == NULL || g_detached) {
+        return;
+    }
+    uint64_t now = NowMicros();
+    {
+        std::lock_guard<std::mutex> lock(g_windowMutex);
+        if (!g_window.open) {
+            g_window = { 0 };
+            g_window.open = true;
+            g_window.startMicros = now;
+            g_window.startFaults = ReadPageFaults();
+            g_window.pagesBefore = g_prefaultQueue->PagesTouched();
+            g_windowOpen = true;
+        }
+        g_window.lastLargeMicros = now;
+        g_window.passMicros = 0;
+        g_window.allocations++;
+        g_window.bytes += size;
+        if (largePages) {
+            g_window.largePageBytes += size;
+        }
+    }
+    // Large pages are resident from the start
+    if (!largePages && !g_measureOnly) {
+        g_prefaultQueue->Add(reinterpret_cast<uintptr_t>(pointer), size);
+    }
+}
+
+static std::string DescribeGeneration(const GenerationWindow& window,
+    uint64_t endMicros, DWORD endFaults) {
+    uint64_t prefaulted = (g_prefaultQueue->PagesTouched() - window.pagesBefore) *
+        g_pageSize;
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(2) << "Map generation "
+        << g_generations << ": " << (endMicros - window.startMicros) / 1000000.0
+        << " s, page faults " << window.startFaults << " -> " << endFaults
+        << " (+" << (endFaults - window.startFaults) << "), "
+        << window.allocations << " large allocations ("
+        << FormatMegabytes(window.bytes) << "; ";
+    if (g_measureOnly) {
+        ss << "measure only";
+    }
+    else {
+        ss << FormatMegabytes(prefaulted) << " pre-faulted in the background, "
+            << FormatMegabytes(window.largePageBytes) << " in large pages";
+    }
+    ss << ").";
+    return ss.str();
+}
+
+// Main thread only, once per pass of the main loop
+void MapPrefaultOnFrame() {
+    if (!g_windowOpen) {
+        return;
+    }
+    uint64_t now = NowMicros();
+    std::string message;
+    {
+        std::lock_guard<std::mutex> lock(g_windowMutex);
+        if (!g_window.open) {
+            return;
+        }
+        if (g_window.passMicros == 0) {
+            g_window.passMicros = now;
+            g_window.passFaults = ReadPageFaults();
+        }
+        if (now - g_window.lastLargeMicros < GENERATION_QUIET_MICROS) {
+            return;
+        }
+        g_generations++;
+        message = DescribeGeneration(g_window, g_window.passMicros,
+            g_window.passFaults);
+        CounterSet(COUNTER_MAP_GENERATION_MS,
+            (g_window.passMicros - g_window.startMicros) / 1000);
+        g_window.open = false;
+        g_windowOpen = false;
+    }
+    Log(message);
+}
+
+// --- Import Hooks ---
+
+static LPVOID AllocateLarge(HANDLE heap, DWORD flags, SIZE_T size) {
+    LPVOID pointer = AllocateLargePages(size); // Zeroed, as HEAP_ZERO_MEMORY wants
+    bool largePages = pointer != NULL;
+    if (!largePages) {
+        pointer = g_originalHeapAlloc(heap, flags, size);
+    }
+    OnLargeAllocation(pointer, size, largePages);
+    return pointer;
+}
+
+static LPVOID WINAPI HookedHeapAlloc(HANDLE heap, DWORD flags, SIZE_T size) {
+    if (size < g_thresholdBytes) {
+        return g_originalHeapAlloc(heap, flags, size);
+    }
+    return AllocateLarge(heap, flags, size);
+}
+
+// A large-page block keeps its pages when shrinking or growing within them.
+// Fails as HeapReAlloc does: by raising STATUS_NO_MEMORY when the game asked
+// for HEAP_GENERATE_EXCEPTIONS, which the real heap does when it fails.
+static LPVOID ReAllocateLargePages(HANDLE heap, DWORD flags, LPVOID old,
+    const LargePageBlock& block, SIZE_T size) {
+    if (size <= block.reserved) {
+        if ((flags & HEAP_ZERO_MEMORY) && size > block.size) {
+            memset(static_cast<char*>(old) + block.size, 0, size - block.size);
+        }
+        std::lock_guard<std::mutex> lock(g_largeBlockMutex);
+        g_largeBlocks[reinterpret_cast<uintptr_t>(old)].size = size;
+        return old;
+    }
+    if (flags & HEAP_REALLOC_IN_PLACE_ONLY) {
+        if (flags & HEAP_GENERATE_EXCEPTIONS) {
+            RaiseException(STATUS_NO_MEMORY, 0, 0, NULL);
+        }
+        return NULL;
+    }
+    LPVOID pointer = AllocateLarge(heap, flags, size);
+    if (pointer != NULL) {
+        memcpy(pointer, old, std::min<size_t>(block.size, size));
+        FreeLargePages(old);
+    }
+    return pointer;
+}
+
+static LPVOID WINAPI HookedHeapReAlloc(HANDLE heap, DWORD flags, LPVOID old,
+    SIZE_T size) {
+    LargePageBlock block;
+    if (FindLargePageBlock(old, block)) {
+        return ReAllocateLargePages(heap, flags, old, block, size);
+    }
+    if (!g_detached) {
+        g_prefaultQueue->Cancel(reinterpret_cast<uintptr_t>(old));
+    }
+    LPVOID pointer = g_originalHeapReAlloc(heap, flags, old, size);
+    if (size >= g_thresholdBytes) {
+        OnLargeAllocation(pointer, size, false);
+    }
+    return pointer;
+}
+
+static BOOL WINAPI HookedHeapFree(HANDLE heap, DWORD flags, LPVOID pointer) {
+    if (FreeLargePages(pointer)) {
+        return TRUE;
+    }
+    if (!g_detached) {
+        g_prefaultQueue->Cancel(reinterpret_cast<uintptr_t>(pointer));
+    }
+    return g_originalHeapFree(heap, flags, pointer);
+}
+
+static SIZE_T WINAPI HookedHeapSize(HANDLE heap, DWORD flags, LPCVOID pointer) {
+    LargePageBlock block;
+    if (FindLargePageBlock(pointer, block)) {
+        return block.size;
+    }
+    return g_originalHeapSize(heap, flags, pointer);
+}
+
+// Large committed read-write regions the game maps itself
+static LPVOID WINAPI HookedVirtualAlloc(LPVOID address, SIZE_T size, DWORD type,
+    DWORD protect) {
+    LPVOID pointer = g_originalVirtualAlloc(address, size, type, protect);
+    if (size >= g_thresholdBytes && (type & MEM_COMMIT) &&
+        (protect == PAGE_READWRITE || protect == PAGE_EXECUTE_READWRITE)) {
+        OnLargeAllocation(pointer, size, false);
+    }
+    return pointer;
+}
+
+static BOOL WINAPI HookedVirtualFree(LPVOID address, SIZE_T size, DWORD type) {
+    if (!g_detached) {
+        g_prefaultQueue->Cancel(reinterpret_cast<uintptr_t>(address));
+    }
+    return g_originalVirtualFree(address, size, type);
+}
+
+static void TryLargePages() {
+    if (!EnableLockMemoryPrivilege()) {
+        Log("Map prefault: large pages need the 'Lock pages in memory' "
+            "privilege (SeLockMemoryPrivilege); using normal pages.");
+        return;
+    }
+    size_t largePage = GetLargePageMinimum();
+    if (largePage == 0) {
+        Log("Map prefault: the system has no large pages; using normal pages.");
+        return;
+    }
+    g_largePageSize = largePage;
+    Log("Map prefault: large pages of " + std::to_string(largePage / 1024) +
+        " KB enabled.");
+}
+
+// Watch the game's large allocations, touch their pages ahead of it on a
+// background thread and log the page faults and time of each map generation
+bool StartMapPrefault() {
+    Log("Checking Map Prefault...");
+    if (!GetConfigBool("MapPrefaultEnabled", false)) {
+        Log("Map Prefault is disabled in config.");
+        return false;
+    }
+    int thresholdKB = GetConfigInt("MapPrefaultThresholdKB", 4096);
+    if (thresholdKB < 256) thresholdKB = 256;
+    g_measureOnly = GetConfigBool("MapPrefaultMeasureOnly", false);
+
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    g_pageSize = info.dwPageSize;
+    QueryPerformanceFrequency(&g_counterFrequency);
+    g_prefaultQueue.reset(new PrefaultQueue(g_pageSize, PREFAULT_CHUNK_PAGES));
+
+    HMODULE game = GetModuleHandleA(NULL);
+    // The frees first: large-page blocks must never reach the real heap
+    bool freeHooked = HookImport(game, "KERNEL32.dll", "HeapFree",
+        reinterpret_cast<const void*>(HookedHeapFree),
+        reinterpret_cast<void**>(&g_originalHeapFree));
+    HookImport(game, "KERNEL32.dll", "HeapSize",
+        reinterpret_cast<const void*>(HookedHeapSize),
+        reinterpret_cast<void**>(&g_originalHeapSize));
+    HookImport(game, "KERNEL32.dll", "VirtualFree",
+        reinterpret_cast<const void*>(HookedVirtualFree),
+        reinterpret_cast<void**>(&g_originalVirtualFree));
+    if (GetConfigBool("MapPrefaultLargePages", false) && !g_measureOnly) {
+        if (freeHooked) {
+            TryLargePages();
+        }
+        else {
+            Log("Warning: Map prefault: HeapFree is not hooked; large pages "
+                "are off.");
+        }
+    }
+    HookImport(game, "KERNEL32.dll", "HeapReAlloc",
+        reinterpret_cast<const void*>(HookedHeapReAlloc),
+        reinterpret_cast<void**>(&g_originalHeapReAlloc));
+    bool allocHooked = HookImport(game, "KERNEL32.dll", "HeapAlloc",
+        reinterpret_cast<const void*>(HookedHeapAlloc),
+        reinterpret_cast<void**>(&g_originalHeapAlloc));
+    allocHooked = HookImport(game, "KERNEL32.dll", "VirtualAlloc",
+        reinterpret_cast<const void*>(HookedVirtualAlloc),
+        reinterpret_cast<void**>(&g_originalVirtualAlloc)) || allocHooked;
+    if (!allocHooked) {
+        Log("Error: Map prefault found no allocation imports to hook.");
+        return false;
+    }
+    // Allocations are only watched from here on
+    g_thresholdBytes = static_cast<size_t>(thresholdKB) * 1024;
+
+    if (!g_measureOnly && info.dwNumberOfProcessors < 2) {
+        // The worker would only take the faults' time from the game's core
+        g_measureOnly = true;
+        Log("Map prefault: only one processor; pages are not touched in the "
+            "background.");
+    }
+    if (!g_measureOnly) {
+        g_prefaultThread = CreateThread(NULL, 0, PrefaultThreadProc, NULL, 0,
+            NULL);
+        if (g_prefaultThread == NULL) {
+            g_measureOnly = true;
+            Log("Warning: Could not start the prefault thread. Error code: " +
+                std::to_string(GetLastError()) + ". Only measuring.");
+        }
+    }
+    if (!InstallFrameSleepHook()) {
+        Log("Warning: Map prefault needs the main loop's Sleep hook to time "
+            "map generation; only the totals will be logged.");
+    }
+
+    Log("Map Prefault enabled (allocations of " + std::to_string(thresholdKB) +
+        " KB or more" + (g_measureOnly ? ", measure only" : "") +
+        ", page faults so far " + std::to_string(ReadPageFaults()) + ").");
+    return true;
+}
+
+// Log the totals. Called at shutdown: the prefault thread is stopped, and
+// the hooks stay in place but leave the queue alone from then on, in case
+// the thread is killed before it is out of it.
+void ShutdownMapPrefault() {
+    if (!g_prefaultQueue) {
+        return;
+    }
+    g_prefaultQueue->Stop();
+    if (g_prefaultThread != NULL) {
+        WaitForSingleObject(g_prefaultThread, 1000);
+        CloseHandle(g_prefaultThread);
+        g_prefaultThread = NULL;
+    }
+    g_detached = true;
+    if (g_windowOpen && g_windowMutex.try_lock()) {
+        if (g_window.open) {
+            g_generations++;
+            Log(DescribeGeneration(g_window, NowMicros(), ReadPageFaults()) +
+                " Still open at exit.");
+        }
+        g_windowMutex.unlock();
+    }
+    Log("Map Prefault: " + std::to_string(g_generations) + " map generations, " +
+        std::to_string(g_prefaultQueue->Blocks()) + " blocks queued (" +
+        std::to_string(g_prefaultQueue->Cancelled()) + " freed before done), " +
+        FormatMegabytes(g_prefaultQueue->PagesTouched() * g_pageSize) +
+        " pre-faulted, " + FormatMegabytes(g_largePageBytes) +
+        " in large pages, page faults " + std::to_string(ReadPageFaults()) + ".");
+}
+#endif
@@ -0,0 +1,57 @@
+#ifndef MAPPREFAULT_H
+#define MAPPREFAULT_H
+
+#include "pch.h"
+
+// Large blocks waiting to have their pages touched, oldest first. A worker
+// takes one chunk of pages at a time; the block's owner may cancel it at any
+// moment (it is being freed or moved), and Cancel returns only once the
+// worker is out of that block, so the memory can then be released safely.
+class PrefaultQueue {
+public:
+    PrefaultQueue(size_t pageSize, size_t chunkPages);
+
+    void Add(uintptr_t base, size_t size);
+    void Cancel(uintptr_t base); // Cheap when nothing is queued
+    // Worker: wait for the next chunk; false once stopped. The chunk stays
+    // in use until ChunkDone.
+    bool NextChunk(uintptr_t& begin, uintptr_t& end);
+    void ChunkDone(size_t pagesTouched);
+    void Stop();
+
+    uint64_t Blocks() const { return m_blocks; }
+    uint64_t Cancelled() const { return m_cancelled; }
+    uint64_t PagesTouched() const { return m_pagesTouched; }
+
+private:
+    struct Block {
+        uintptr_t base;
+        uintptr_t next; // First page not yet handed out
+        uintptr_t end;
+    };
+
+    size_t m_pageSize;
+    size_t m_chunkBytes;
+    std::mutex m_mutex;
+    std::condition_variable m_work;      // Blocks queued or stopping
+    std::condition_variable m_chunkDone; // Worker left its chunk
+    std::deque<Block> m_queue;           // Guarded by m_mutex
+    uintptr_t m_activeBase = 0;          // Block of the chunk in use, or 0
+    bool m_activeLast = false;           // The chunk in use ends its block
+    bool m_stopping = false;
+    std::atomic<size_t> m_queued{ 0 };   // Blocks queued or in use
+    std::atomic<uint64_t> m_blocks{ 0 };
+    std::atomic<uint64_t> m_cancelled{ 0 };
+    std::atomic<uint64_t> m_pagesTouched{ 0 };
+};
+
+// Function declarations
+#ifdef _WIN32
+bool StartMapPrefault();
+void ShutdownMapPrefault();
+
+// Called from the main loop's Sleep hook (scheduler.cpp)
+void MapPrefaultOnFrame();
+#endif
+
+#endif // MAPPREFAULT_H
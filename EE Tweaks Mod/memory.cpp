@@ -9,10 +9,21 @@ const char* MOD_VERSION = "1.1";
 const char* MOD_AUTHOR = "firebirdblue";
 const char* CONFIG_FILE = "tweaks.config";
 const char* LOG_FILE = "tweaks_log.txt";
+const char* PROFILE_FILE = "tweaks_profile.folded";
+const char* PREFETCH_TRACE_FILE = "tweaks_prefetch.trace";
+const char* MODULE_DUMP_PREFIX = "tweaks_dump_";
+const char* MAP_PLAN_FILE = "tweaks_mapplan.csv";
+const char* CHUNK_BENCH_FILE = "tweaks_chunkbench.csv";
+const char* EXPERIMENT_FILE = "tweaks_experiment.csv";
+const char* LOCK_PROFILE_FILE = "tweaks_locks.txt";
+const char* HEAP_SNAPSHOT_PREFIX = "tweaks_heap_";
+const char* THREAD_MONITOR_FILE = "tweaks_threads.csv";
 std::string g_executableName = "UNKNOWN_EXE";
 std::string g_executablePath = "UNKNOWN_EXE_PATH";
 std::string g_dllDir = ".";
 HMODULE g_hModule = NULL;
+bool g_initFromEntryPoint = false;
+DWORD g_mainThreadId = 0;
 
 const int NUM_FLAT_MAP_SIZES = 25;
 const std::string DEFAULT_FLAT_MAP_SIZES_STR =
@@ -81,6 +92,31 @@ bool HexToBytes(const std::string& hex, std::vector<unsigned char>& bytes) {
     return true;
 }
 
+// Convert hex string with "??" wildcards to bytes plus a match mask
+// (0xFF = byte must match, 0x00 = any byte)
+bool HexToMaskedBytes(const std::string& hex, std::vector<unsigned char>& bytes,
+    std::vector<unsigned char>& mask) {
+    bytes.clear();
+    mask.clear();
+    std::stringstream ss(hex);
+    std::string byteStr;
+
+    while (ss >> byteStr) {
+        if (byteStr == "??" || byteStr == "?") {
+            bytes.push_back(0);
+            mask.push_back(0x00);
+            continue;
+        }
+        std::vector<unsigned char> single;
+        if (!HexToBytes(byteStr, single) || single.size() != 1) {
+            return false;
+        }
+        bytes.push_back(single[0]);
+        mask.push_back(0xFF);
+    }
+    return true;
+}
+
 // Convert a single 32-bit integer to a 4-byte little-endian vector
 void IntToBytesLE(int val, std::vector<unsigned char>& bytes) {
     bytes.resize(4);
@@ -125,6 +161,184 @@ uintptr_t FindPattern(uintptr_t startAddress, size_t searchSize,
     return 0; // Pattern not found
 }
 
+// Run several pattern searches, spreading them across threads when allowed.
+// Threads can only be used outside the loader lock (entry point init).
+void FindPatternsParallel(std::vector<PatternScanJob>& jobs) {
+    unsigned int workerCount = std::thread::hardware_concurrency();
+    if (workerCount == 0) workerCount = 2;
+    if (workerCount > jobs.size()) {
+        workerCount = static_cast<unsigned int>(jobs.size());
+    }
+
+    if (!g_initFromEntryPoint || workerCount < 2) {
+        for (auto& job : jobs) {
+            job.result =
+                FindPattern(job.startAddress, job.searchSize, job.pattern);
+        }
+        return;
+    }
+
+    std::atomic<size_t> nextJob(0);
+    auto worker = [&jobs, &nextJob]() {
+        size_t index;
+        while ((index = nextJob.fetch_add(1)) < jobs.size()) {
+            PatternScanJob& job = jobs[index];
+            job.result =
+                FindPattern(job.startAddress, job.searchSize, job.pattern);
+        }
+    };
+
+    std::vector<std::thread> workers;
+    workers.reserve(workerCount - 1);
+    for (unsigned int i = 1; i < workerCount; ++i) {
+        workers.emplace_back(worker);
+    }
+    worker(); // The calling thread takes its share too
+    for (auto& thread : workers) {
+        thread.join();
+    }
+}
+
+// Find every match of a masked pattern (up to maxMatches)
+std::vector<uintptr_t> FindAllPatternMatches(uintptr_t startAddress,
+    size_t searchSize, const std::vector<unsigned char>& pattern,
+    const std::vector<unsigned char>& mask, size_t maxMatches) {
+    std::vector<uintptr_t> matches;
+    if (pattern.empty() || mask.size() != pattern.size() ||
+        searchSize < pattern.size()) {
+        return matches;
+    }
+
+    const unsigned char* scanBytes =
+        reinterpret_cast<const unsigned char*>(startAddress);
+    size_t patternSize = pattern.size();
+    size_t maxScanPos = searchSize - patternSize;
+
+    for (size_t i = 0; i <= maxScanPos && matches.size() < maxMatches; ++i) {
+        size_t j = 0;
+        while (j < patternSize &&
+            (scanBytes[i + j] & mask[j]) == (pattern[j] & mask[j])) {
+            ++j;
+        }
+        if (j == patternSize) {
+            matches.push_back(startAddress + i);
+        }
+    }
+    return matches;
+}
+
+// --- Memory Backends ---
+
+#ifdef _WIN32
+// The current process, i.e. the running game
+class ProcessMemoryBackend : public MemoryBackend {
+public:
+    bool GetModule(const std::string& moduleName, uintptr_t& baseAddress,
+        size_t& moduleSize) override {
+        HMODULE hModule = GetModuleHandleA(moduleName.c_str());
+        if (!hModule) {
+            Log("Error: Could not get handle for module '" + moduleName + "'.");
+            return false;
+        }
+
+        MODULEINFO moduleInfo = { 0 };
+        if (!GetModuleInformation(GetCurrentProcess(), hModule, &moduleInfo,
+            sizeof(moduleInfo))) {
+            Log("Error: Could not get module information for '" + moduleName +
+                "'. Error code: " + std::to_string(GetLastError()));
+            return false;
+        }
+
+        baseAddress = (uintptr_t)moduleInfo.lpBaseOfDll;
+        moduleSize = moduleInfo.SizeOfImage;
+        return true;
+    }
+
+    bool Read(uintptr_t address, void* buffer, size_t size) override {
+        SIZE_T bytesRead = 0;
+        return ReadProcessMemory(GetCurrentProcess(),
+            reinterpret_cast<LPCVOID>(address), buffer, size, &bytesRead) &&
+            bytesRead == size;
+    }
+
+    bool Write(uintptr_t address, const void* data, size_t size,
+        bool isExecutable) override {
+        LPVOID patchAddr = reinterpret_cast<LPVOID>(address);
+        std::stringstream addrHex;
+        addrHex << "0x" << std::hex << address;
+
+        // --- Change memory protection ---
+        DWORD oldProtect;
+        DWORD newProtect =
+            isExecutable ? PAGE_EXECUTE_READWRITE : PAGE_READWRITE;
+        if (!VirtualProtect(patchAddr, size, newProtect, &oldProtect)) {
+            Log("Error: Failed to change memory protection (" +
+                std::string(isExecutable ? "RWX" : "RW") + ") at " +
+                addrHex.str() + ". Error code: " +
+                std::to_string(GetLastError()));
+            return false;
+        }
+
+        // --- Write the bytes ---
+        SIZE_T bytesWritten = 0;
+        if (!WriteProcessMemory(GetCurrentProcess(), patchAddr, data, size,
+            &bytesWritten) ||
+            bytesWritten != size) {
+            Log("Error: Failed to write memory at " + addrHex.str() +
+                ". Error code: " + std::to_string(GetLastError()) +
+                ". Attempting to restore protection.");
+            VirtualProtect(patchAddr, size, oldProtect,
+                &oldProtect); // Use oldProtect again
+            return false;
+        }
+
+        // Flush instruction cache only if it was executable code
+        if (isExecutable) {
+            FlushInstructionCache(GetCurrentProcess(), patchAddr, size);
+        }
+
+        // --- Restore original memory protection ---
+        DWORD tempProtect; // Needs a variable, even if not used after
+        if (!VirtualProtect(patchAddr, size, oldProtect, &tempProtect)) {
+            Log("Warning: Failed to restore original memory protection at " +
+                addrHex.str() + ". Error code: " +
+                std::to_string(GetLastError()));
+            // Continue anyway, the bytes were written
+        }
+        return true;
+    }
+};
+
+static ProcessMemoryBackend g_processMemory;
+static MemoryBackend* g_memoryBackend = &g_processMemory;
+#else
+// No process to patch outside Windows: tools must install a backend
+class UnavailableMemoryBackend : public MemoryBackend {
+public:
+    bool GetModule(const std::string& moduleName, uintptr_t&, size_t&) override {
+        Log("Error: No memory backend to find module '" + moduleName + "'.");
+        return false;
+    }
+    bool Read(uintptr_t, void*, size_t) override { return false; }
+    bool Write(uintptr_t, const void*, size_t, bool) override { return false; }
+};
+
+static UnavailableMemoryBackend g_unavailableMemory;
+static MemoryBackend* g_memoryBackend = &g_unavailableMemory;
+#endif
+
+MemoryBackend& GetMemoryBackend() {
+    return *g_memoryBackend;
+}
+
+void SetMemoryBackend(MemoryBackend* backend) {
+#ifdef _WIN32
+    g_memoryBackend = backend ? backend : &g_processMemory;
+#else
+    g_memoryBackend = backend ? backend : &g_unavailableMemory;
+#endif
+}
+
 // Generic function to apply a patch (data or code)
 bool ApplyDataPatch(const std::string& patchName, uintptr_t patchAddress,
     const std::vector<unsigned char>& originalBytes,
@@ -146,16 +360,13 @@ bool ApplyDataPatch(const std::string& patchName, uintptr_t patchAddress,
     }
 
     size_t patchSize = targetBytes.size();
-    unsigned char* patchAddr = reinterpret_cast<unsigned char*>(patchAddress);
     std::stringstream addrHex;
     addrHex << "0x" << std::hex << patchAddress;
+    MemoryBackend& memory = GetMemoryBackend();
 
     // --- Safety Check: Verify original bytes before patching ---
     std::vector<unsigned char> currentBytes(patchSize);
-    SIZE_T bytesRead = 0;
-    if (!ReadProcessMemory(GetCurrentProcess(), patchAddr, currentBytes.data(),
-        patchSize, &bytesRead) ||
-        bytesRead != patchSize) {
+    if (!memory.Read(patchAddress, currentBytes.data(), patchSize)) {
         Log("Error: Failed to read memory at address " + addrHex.str() +
             " for verification before patch '" + patchName +
             "'. Error code: " + std::to_string(GetLastError()) +
@@ -180,43 +391,13 @@ bool ApplyDataPatch(const std::string& patchName, uintptr_t patchAddress,
         return false;
     }
 
-    // --- Change memory protection ---
-    DWORD oldProtect;
-    DWORD newProtect =
-        isExecutable ? PAGE_EXECUTE_READWRITE : PAGE_READWRITE;
-    if (!VirtualProtect(patchAddr, patchSize, newProtect, &oldProtect)) {
-        Log("Error: Failed to change memory protection (" +
-            std::string(isExecutable ? "RWX" : "RW") + ") for patch '" +
-            patchName + "'. Error code: " + std::to_string(GetLastError()));
-        return false;
-    }
-
     // --- Apply the patch ---
-    SIZE_T bytesWritten = 0;
-    if (!WriteProcessMemory(GetCurrentProcess(), patchAddr, targetBytes.data(),
-        patchSize, &bytesWritten) ||
-        bytesWritten != patchSize) {
-        Log("Error: Failed to write memory for patch '" + patchName +
-            "'. Error code: " + std::to_string(GetLastError()) +
-            ". Attempting to restore protection.");
-        VirtualProtect(patchAddr, patchSize, oldProtect,
-            &oldProtect); // Use oldProtect again
+    if (!memory.Write(patchAddress, targetBytes.data(), patchSize,
+        isExecutable)) {
+        Log("Error: Failed to write memory for patch '" + patchName + "'.");
         return false;
     }
 
-    // Flush instruction cache only if it was executable code
-    if (isExecutable) {
-        FlushInstructionCache(GetCurrentProcess(), patchAddr, patchSize);
-    }
-
-    // --- Restore original memory protection ---
-    DWORD tempProtect; // Needs a variable, even if not used after
-    if (!VirtualProtect(patchAddr, patchSize, oldProtect, &tempProtect)) {
-        Log("Warning: Failed to restore original memory protection for patch '" +
-            patchName + "'. Error code: " + std::to_string(GetLastError()));
-        // Continue anyway, patch was applied
-    }
-
     Log("Successfully applied patch '" + patchName + "' at address " +
         addrHex.str());
     return true;
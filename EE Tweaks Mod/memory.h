@@ -4,13 +4,45 @@
 #include "pch.h"
 #include "globals.h" // Include for MemoryPatch struct
 
+// Where patches find modules and read/write memory. The DLL uses the live
+// process; the offline replay tool (tools/scanreplay.cpp) substitutes
+// module dumps loaded into its own memory.
+class MemoryBackend {
+public:
+    virtual ~MemoryBackend() {}
+    // Locate a module's image. Logs the reason on failure.
+    virtual bool GetModule(const std::string& moduleName, uintptr_t& baseAddress,
+        size_t& moduleSize) = 0;
+    virtual bool Read(uintptr_t address, void* buffer, size_t size) = 0;
+    // Overwrite bytes, temporarily making them writable. Logs the reason on
+    // failure.
+    virtual bool Write(uintptr_t address, const void* data, size_t size,
+        bool isExecutable) = 0;
+};
+MemoryBackend& GetMemoryBackend();
+void SetMemoryBackend(MemoryBackend* backend); // nullptr = live process
+
 // Function declarations
 bool HexToBytes(const std::string& hex, std::vector<unsigned char>& bytes);
+bool HexToMaskedBytes(const std::string& hex, std::vector<unsigned char>& bytes,
+    std::vector<unsigned char>& mask); // "??" matches any byte
 void IntToBytesLE(int val, std::vector<unsigned char>& bytes);
 void IntsToBytesLE(const std::vector<int>& ints,
     std::vector<unsigned char>& bytes);
 uintptr_t FindPattern(uintptr_t startAddress, size_t searchSize,
     const std::vector<unsigned char>& pattern);
+
+// One pattern search, used to batch scans across threads
+struct PatternScanJob {
+    uintptr_t startAddress;
+    size_t searchSize;
+    std::vector<unsigned char> pattern;
+    uintptr_t result; // Filled in by FindPatternsParallel
+};
+void FindPatternsParallel(std::vector<PatternScanJob>& jobs);
+std::vector<uintptr_t> FindAllPatternMatches(uintptr_t startAddress,
+    size_t searchSize, const std::vector<unsigned char>& pattern,
+    const std::vector<unsigned char>& mask, size_t maxMatches);
 bool ApplyStandardPatch(MemoryPatch& patch);
 bool ApplyDataPatch(const std::string& patchName, uintptr_t patchAddress,
     const std::vector<unsigned char>& originalBytes,
@@ -0,0 +1,252 @@
+#include "pch.h"
+#include "globals.h" // Access g_patches, g_executableName, g_dllDir
+#include "logging.h" // Access Log()
+#include "lz4block.h"
+#include "moduledump.h"
+
+#ifdef _WIN32
+#include "config.h"  // Access config functions
+#include "patches.h" // Access GetModuleInfoByName
+#endif
+
+// --- Dump Format ---
+// Little-endian. Header: "EEMD", version (u32), flags (u32, bit 0 = game
+// executable), base address (u64), image size (u64), block size (u32),
+// FNV-1a of the image (u32), name length (u32) and name. Then one entry per
+// block: u32 payload size (top bit set = stored uncompressed) and payload.
+
+static const char DUMP_MAGIC[4] = { 'E', 'E', 'M', 'D' };
+static const uint32_t DUMP_VERSION = 1;
+static const uint32_t DUMP_BLOCK_SIZE = 64 * 1024;
+static const uint32_t DUMP_STORED_FLAG = 0x80000000u;
+static const uint64_t DUMP_MAX_IMAGE = 1ull << 31; // Larger than any x86 image
+static const uint32_t DUMP_MAX_NAME = 260;
+
+static void WriteU32(std::ostream& out, uint32_t value) {
+    for (int i = 0; i < 4; ++i) out.put(static_cast<char>((value >> (i * 8)) & 0xFF));
+}
+
+static void WriteU64(std::ostream& out, uint64_t value) {
+    WriteU32(out, static_cast<uint32_t>(value & 0xFFFFFFFF));
+    WriteU32(out, static_cast<uint32_t>(value >> 32));
+}
+
+static bool ReadU32(std::istream& in, uint32_t& value) {
+    unsigned char bytes[4];
+    if (!in.read(reinterpret_cast<char*>(bytes), 4)) {
+        return false;
+    }
+    value = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) |
+        (static_cast<uint32_t>(bytes[3]) << 24);
+    return true;
+}
+
+static bool ReadU64(std::istream& in, uint64_t& value) {
+    uint32_t low, high;
+    if (!ReadU32(in, low) || !ReadU32(in, high)) {
+        return false;
+    }
+    value = low | (static_cast<uint64_t>(high) << 32);
+    return true;
+}
+
+static uint32_t HashImage(const std::vector<unsigned char>& image) {
+    uint32_t hash = 2166136261u;
+    for (unsigned char b : image) {
+        hash ^= b;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+bool WriteModuleDump(std::ostream& out, const ModuleDump& dump) {
+    out.write(DUMP_MAGIC, sizeof(DUMP_MAGIC));
+    WriteU32(out, DUMP_VERSION);
+    WriteU32(out, dump.isGameExecutable ? 1 : 0);
+    WriteU64(out, dump.baseAddress);
+    WriteU64(out, dump.image.size());
+    WriteU32(out, DUMP_BLOCK_SIZE);
+    WriteU32(out, HashImage(dump.image));
+    WriteU32(out, static_cast<uint32_t>(dump.name.size()));
+    out.write(dump.name.data(), dump.name.size());
+
+    std::vector<unsigned char> compressed(Lz4CompressBound(DUMP_BLOCK_SIZE));
+    for (size_t offset = 0; offset < dump.image.size(); offset += DUMP_BLOCK_SIZE) {
+        size_t blockSize = dump.image.size() - offset;
+        if (blockSize > DUMP_BLOCK_SIZE) blockSize = DUMP_BLOCK_SIZE;
+        const unsigned char* block = dump.image.data() + offset;
+
+        size_t packedSize = Lz4CompressBlock(block, blockSize, compressed.data(),
+            compressed.size());
+        if (packedSize == 0 || packedSize >= blockSize) {
+            WriteU32(out, static_cast<uint32_t>(blockSize) | DUMP_STORED_FLAG);
+            out.write(reinterpret_cast<const char*>(block), blockSize);
+        }
+        else {
+            WriteU32(out, static_cast<uint32_t>(packedSize));
+            out.write(reinterpret_cast<const char*>(compressed.data()),
+                packedSize);
+        }
+    }
+    return out.good();
+}
+
+bool ReadModuleDump(std::istream& in, ModuleDump& dump) {
+    char magic[sizeof(DUMP_MAGIC)];
+    uint32_t version, flags, blockSize, checksum, nameLength;
+    uint64_t baseAddress, imageSize;
+    if (!in.read(magic, sizeof(magic)) ||
+        memcmp(magic, DUMP_MAGIC, sizeof(magic)) != 0 ||
+        !ReadU32(in, version) || version != DUMP_VERSION ||
+        !ReadU32(in, flags) || !ReadU64(in, baseAddress) ||
+        !ReadU64(in, imageSize) || imageSize > DUMP_MAX_IMAGE ||
+        !ReadU32(in, blockSize) || blockSize == 0 ||
+        blockSize > (DUMP_STORED_FLAG >> 1) ||
+        !ReadU32(in, checksum) || !ReadU32(in, nameLength) ||
+        nameLength > DUMP_MAX_NAME) {
+        return false;
+    }
+
+    dump.name.assign(nameLength, '\0');
+    if (nameLength > 0 && !in.read(&dump.name[0], nameLength)) {
+        return false;
+    }
+    dump.baseAddress = baseAddress;
+    dump.isGameExecutable = (flags & 1) != 0;
+    dump.image.assign(static_cast<size_t>(imageSize), 0);
+
+    std::vector<unsigned char> payload;
+    for (size_t offset = 0; offset < dump.image.size(); offset += blockSize) {
+        size_t expected = dump.image.size() - offset;
+        if (expected > blockSize) expected = blockSize;
+
+        uint32_t entry;
+        if (!ReadU32(in, entry)) {
+            return false;
+        }
+        size_t payloadSize = entry & ~DUMP_STORED_FLAG;
+        if (payloadSize > Lz4CompressBound(blockSize)) {
+            return false;
+        }
+        payload.resize(payloadSize);
+        if (payloadSize > 0 && !in.read(reinterpret_cast<char*>(payload.data()),
+            payloadSize)) {
+            return false;
+        }
+
+        unsigned char* block = dump.image.data() + offset;
+        if (entry & DUMP_STORED_FLAG) {
+            if (payloadSize != expected) {
+                return false;
+            }
+            memcpy(block, payload.data(), expected);
+        }
+        else if (Lz4DecompressBlock(payload.data(), payloadSize, block,
+            expected) != static_cast<long long>(expected)) {
+            return false;
+        }
+    }
+    return HashImage(dump.image) == checksum;
+}
+
+// --- Capturing Dumps ---
+
+#ifdef _WIN32
+// Copy a module's image. Pages that cannot be read (reserved, guard or
+// no-access) are left zeroed.
+static bool CaptureModule(const std::string& moduleName, ModuleDump& dump) {
+    MODULEINFO moduleInfo = { 0 };
+    uintptr_t baseAddress = 0;
+    size_t moduleSize = 0;
+    if (!GetModuleInfoByName(moduleName, moduleInfo, baseAddress, moduleSize)) {
+        return false;
+    }
+
+    dump.name = moduleName;
+    dump.baseAddress = baseAddress;
+    dump.isGameExecutable = moduleName == g_executableName;
+    dump.image.assign(moduleSize, 0);
+
+    uintptr_t address = baseAddress;
+    uintptr_t end = baseAddress + moduleSize;
+    while (address < end) {
+        MEMORY_BASIC_INFORMATION mbi;
+        if (VirtualQuery(reinterpret_cast<LPCVOID>(address), &mbi,
+            sizeof(mbi)) == 0) {
+            break;
+        }
+        uintptr_t regionEnd =
+            reinterpret_cast<uintptr_t>(mbi.BaseAddress) + mbi.RegionSize;
+        if (regionEnd > end) regionEnd = end;
+
+        bool readable = mbi.State == MEM_COMMIT &&
+            (mbi.Protect & (PAGE_NOACCESS | PAGE_GUARD)) == 0;
+        if (readable) {
+            SIZE_T bytesRead = 0;
+            ReadProcessMemory(GetCurrentProcess(),
+                reinterpret_cast<LPCVOID>(address),
+                dump.image.data() + (address - baseAddress),
+                regionEnd - address, &bytesRead);
+        }
+        address = regionEnd;
+    }
+    return true;
+}
+
+// Write the images of every module the patches look in, before anything is
+// patched, so a failed scan can be replayed offline (tools/scanreplay.cpp)
+bool DumpPatchTargetModules() {
+    if (!GetConfigBool("ModuleDumpEnabled", false)) {
+        return false;
+    }
+
+    std::vector<std::string> modules;
+    if (g_executableName != "UNKNOWN_EXE") {
+        modules.push_back(g_executableName);
+    }
+    for (const MemoryPatch& patch : g_patches) {
+        if (patch.moduleIdentifier != "GAME_EXECUTABLE") {
+            modules.push_back(patch.moduleIdentifier);
+        }
+    }
+    modules.push_back("Miles Sound System Mixer.dll"); // AudioSampleRate
+
+    int dumped = 0;
+    std::vector<std::string> seen;
+    for (const std::string& moduleName : modules) {
+        if (std::find(seen.begin(), seen.end(), moduleName) != seen.end()) {
+            continue;
+        }
+        seen.push_back(moduleName);
+
+        if (GetModuleHandleA(moduleName.c_str()) == NULL) {
+            Log("Module dump: '" + moduleName + "' is not loaded, skipped.");
+            continue;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        ModuleDump dump;
+        if (!CaptureModule(moduleName, dump)) {
+            continue;
+        }
+
+        std::string fileName = moduleName;
+        std::replace(fileName.begin(), fileName.end(), ' ', '_');
+        std::string dumpPath = g_dllDir + "\\" + MODULE_DUMP_PREFIX + fileName +
+            ".eemd";
+        std::ofstream dumpFile(dumpPath, std::ios::binary | std::ios::trunc);
+        if (!dumpFile.is_open() || !WriteModuleDump(dumpFile, dump)) {
+            Log("Error: Could not write module dump " + dumpPath + ".");
+            continue;
+        }
+        auto dumpMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        Log("Module dump: wrote " + dumpPath + " (" +
+            std::to_string(dump.image.size() / 1024) + " KB image, " +
+            std::to_string(static_cast<long long>(dumpFile.tellp()) / 1024) +
+            " KB compressed, " + std::to_string(dumpMs) + " ms).");
+        dumped++;
+    }
+    return dumped > 0;
+}
+#endif
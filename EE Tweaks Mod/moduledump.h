@@ -0,0 +1,24 @@
+#ifndef MODULEDUMP_H
+#define MODULEDUMP_H
+
+#include "pch.h"
+
+// A copy of a module's in-memory image, as loaded in the game process
+struct ModuleDump {
+    std::string name;
+    uint64_t baseAddress = 0;
+    bool isGameExecutable = false;
+    std::vector<unsigned char> image; // SizeOfImage bytes, unreadable pages zeroed
+};
+
+// Serialize a dump as LZ4-compressed blocks (see moduledump.cpp for the
+// layout). ReadModuleDump rejects truncated or corrupted files.
+bool WriteModuleDump(std::ostream& out, const ModuleDump& dump);
+bool ReadModuleDump(std::istream& in, ModuleDump& dump);
+
+// Function declarations
+#ifdef _WIN32
+bool DumpPatchTargetModules(); // Writes one dump per module patches target
+#endif
+
+#endif // MODULEDUMP_H
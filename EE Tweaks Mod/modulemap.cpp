@@ -0,0 +1,68 @@
+#include "pch.h"
+#include "modulemap.h"
+
+#ifdef _WIN32
+// Enumerate all modules loaded in this process
+void ModuleMap::Refresh() {
+    std::vector<ModuleRange> modules;
+    HMODULE handles[1024];
+    DWORD bytesNeeded = 0;
+    if (EnumProcessModules(GetCurrentProcess(), handles, sizeof(handles),
+        &bytesNeeded)) {
+        size_t count = bytesNeeded / sizeof(HMODULE);
+        if (count > _countof(handles)) count = _countof(handles);
+        for (size_t i = 0; i < count; ++i) {
+            MODULEINFO info = { 0 };
+            char name[MAX_PATH] = { 0 };
+            if (!GetModuleInformation(GetCurrentProcess(), handles[i], &info,
+                sizeof(info)) ||
+                GetModuleBaseNameA(GetCurrentProcess(), handles[i], name,
+                    MAX_PATH) == 0) {
+                continue;
+            }
+            modules.push_back({ name,
+                reinterpret_cast<uintptr_t>(info.lpBaseOfDll),
+                static_cast<size_t>(info.SizeOfImage) });
+        }
+    }
+    SetModules(modules);
+}
+#endif
+
+// Replace the snapshot (also used to feed synthetic module lists)
+void ModuleMap::SetModules(const std::vector<ModuleRange>& modules) {
+    m_modules = modules;
+    std::sort(m_modules.begin(), m_modules.end(),
+        [](const ModuleRange& a, const ModuleRange& b) {
+            return a.base < b.base;
+        });
+}
+
+// Find the module containing an address, or nullptr
+const ModuleRange* ModuleMap::Find(uintptr_t address) const {
+    auto it = std::upper_bound(m_modules.begin(), m_modules.end(), address,
+        [](uintptr_t value, const ModuleRange& module) {
+            return value < module.base;
+        });
+    if (it == m_modules.begin()) {
+        return nullptr;
+    }
+    --it;
+    if (address - it->base >= it->size) {
+        return nullptr;
+    }
+    return &*it;
+}
+
+// Format an address as "module+0xRVA", or plain hex outside any module
+std::string ModuleMap::Describe(uintptr_t address) const {
+    std::stringstream ss;
+    const ModuleRange* module = Find(address);
+    if (module != nullptr) {
+        ss << module->name << "+0x" << std::hex << (address - module->base);
+    }
+    else {
+        ss << "0x" << std::hex << address;
+    }
+    return ss.str();
+}
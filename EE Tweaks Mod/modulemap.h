@@ -0,0 +1,28 @@
+#ifndef MODULEMAP_H
+#define MODULEMAP_H
+
+#include "pch.h"
+
+// A loaded module's address range
+struct ModuleRange {
+    std::string name;
+    uintptr_t base;
+    size_t size;
+};
+
+// Snapshot of the process's loaded modules for turning raw addresses into
+// module + RVA pairs. Lookups do not allocate.
+class ModuleMap {
+public:
+#ifdef _WIN32
+    void Refresh(); // Re-enumerate the process's modules
+#endif
+    void SetModules(const std::vector<ModuleRange>& modules);
+    const ModuleRange* Find(uintptr_t address) const;
+    std::string Describe(uintptr_t address) const; // "module+0xRVA"
+
+private:
+    std::vector<ModuleRange> m_modules; // Sorted by base address
+};
+
+#endif // MODULEMAP_H
@@ -4,25 +4,34 @@
 #include "config.h"  // Access config functions
 #include "memory.h"  // Access memory utilities
 #include "patches.h"
+#include "mapplanner.h" // Access GetGridLimitTier(), PlanChunkDimension()
+
+// Original bytes the custom patches search for
+static const char* GIGANTIC_MAP_SIZE_HEX = "EB 27 B8 DC 00 00 00 EB"; // 220
+static const char* MAP_GRID_LIMIT_HEX = "72 09 b9 00 04 00 00 3b c1"; // 1024 limit
+static const char* AUDIO_SAMPLE_RATE_HEX = "FF D6 6A 01 6A 02 6A 10 68 22 56"; // 22050
+static const char* CHUNK_DIMENSION_HEX = "F0 C7 45 FC 07 00 00 00 C7";
+static const char* AUDIO_MODULE_NAME = "Miles Sound System Mixer.dll";
+
+std::vector<CustomPatchSignature> GetCustomPatchSignatures() {
+    return {
+        { "CustomFlatWorldSizes", "GAME_EXECUTABLE", ORIGINAL_FLAT_MAP_SIZES_HEX },
+        { "GiganticMapSize", "GAME_EXECUTABLE", GIGANTIC_MAP_SIZE_HEX },
+        { "MapGridLimit", "GAME_EXECUTABLE", MAP_GRID_LIMIT_HEX },
+        { "AudioSampleRate", AUDIO_MODULE_NAME, AUDIO_SAMPLE_RATE_HEX },
+        { "ChunkDimensionLimit", "GAME_EXECUTABLE", CHUNK_DIMENSION_HEX },
+    };
+}
 
 // Helper to get module info
 bool GetModuleInfoByName(const std::string& moduleName, MODULEINFO& moduleInfo,
     uintptr_t& baseAddress, size_t& moduleSize) {
-    HMODULE hModule = GetModuleHandleA(moduleName.c_str());
-    if (!hModule) {
-        Log("Error: Could not get handle for module '" + moduleName + "'.");
-        return false;
-    }
-
-    if (!GetModuleInformation(GetCurrentProcess(), hModule, &moduleInfo,
-        sizeof(moduleInfo))) {
-        Log("Error: Could not get module information for '" + moduleName +
-            "'. Error code: " + std::to_string(GetLastError()));
-        return false;
+    if (!GetMemoryBackend().GetModule(moduleName, baseAddress, moduleSize)) {
+        return false; // Reason already logged
     }
 
-    baseAddress = (uintptr_t)moduleInfo.lpBaseOfDll;
-    moduleSize = moduleInfo.SizeOfImage;
+    moduleInfo.lpBaseOfDll = reinterpret_cast<LPVOID>(baseAddress);
+    moduleInfo.SizeOfImage = static_cast<DWORD>(moduleSize);
     return true;
 }
 
@@ -107,8 +116,12 @@ bool ApplyGiganticMapSizePatch() {
     Log("Gigantic Map Size from config: " + std::to_string(newSize));
 
     // Original: EB 27 B8 DC 00 00 00 EB (DC 00 00 00 = 220 LE)
-    std::vector<unsigned char> originalBytes = { 0xEB, 0x27, 0xB8, 0xDC,
-                                                0x00, 0x00, 0x00, 0xEB };
+    std::vector<unsigned char> originalBytes;
+    if (!HexToBytes(GIGANTIC_MAP_SIZE_HEX, originalBytes)) {
+        Log("Error: Failed to parse hex string for Gigantic Map Size patch. "
+            "Patch aborted.");
+        return false;
+    }
     std::vector<unsigned char> newSizeBytes;
     IntToBytesLE(newSize, newSizeBytes); // Get the 4 bytes for the new size
 
@@ -165,25 +178,26 @@ bool ApplyMapGridLimitPatch() {
         std::to_string(giganticMapSize));
 
     // Original HEX pattern
-    std::string originalHex = "72 09 b9 00 04 00 00 3b c1"; // Original 1024 limit
+    std::string originalHex = MAP_GRID_LIMIT_HEX; // Original 1024 limit
     std::string targetHex;
     std::string patchDescription;
 
-    if (giganticMapSize <= 511) {
+    int gridTier = GetGridLimitTier(giganticMapSize); // Shared with the planner
+    if (gridTier == 0) {
         Log("GiganticMapSize (" + std::to_string(giganticMapSize) +
             ") is within the original limit (<= 511). No Grid Limit patch "
             "needed.");
         return false; // Indicate no patch was applied, not an error
     }
-    else if (giganticMapSize <= 1023) {
+    else if (gridTier == 1023) {
         targetHex = "72 09 b9 00 08 00 00 3b c1"; // 2048 limit
         patchDescription = "1023x1023 limit";
     }
-    else if (giganticMapSize <= 2047) {
+    else if (gridTier == 2047) {
         targetHex = "72 09 b9 00 10 00 00 3b c1"; // 4096 limit
         patchDescription = "2047x2047 limit";
     }
-    else if (giganticMapSize <= 4095) {
+    else if (giganticMapSize <= MAX_GRID_LIMIT) {
         targetHex = "72 09 b9 00 20 00 00 3b c1"; // 8192 limit
         patchDescription = "4095x4095 limit";
     }
@@ -250,8 +264,12 @@ bool ApplyAudioSampleRatePatch() {
     Log("Audio Sample Rate from config: " + std::to_string(sampleRate));
 
     // Original: FF D6 6A 01 6A 02 6A 10 68 22 56 (22050 = 0x5622 LE)
-    std::vector<unsigned char> originalBytes = {
-        0xFF, 0xD6, 0x6A, 0x01, 0x6A, 0x02, 0x6A, 0x10, 0x68, 0x22, 0x56 };
+    std::vector<unsigned char> originalBytes;
+    if (!HexToBytes(AUDIO_SAMPLE_RATE_HEX, originalBytes)) {
+        Log("Error: Failed to parse hex string for Audio Sample Rate patch. "
+            "Patch aborted.");
+        return false;
+    }
 
     // Target: FF D6 6A 01 6A 02 6A 10 68 [RateLowByte] [RateHighByte]
     unsigned char rateLowByte = static_cast<unsigned char>(sampleRate & 0xFF);
@@ -260,7 +278,7 @@ bool ApplyAudioSampleRatePatch() {
         0xFF, 0xD6, 0x6A, 0x01, 0x6A, 0x02, 0x6A, 0x10, 0x68,
         rateLowByte, rateHighByte };
 
-    const char* moduleName = "Miles Sound System Mixer.dll";
+    const char* moduleName = AUDIO_MODULE_NAME;
     MODULEINFO moduleInfo = { 0 };
     uintptr_t baseAddress = 0;
     size_t moduleSize = 0;
@@ -298,52 +316,24 @@ bool ApplyAudioSampleRatePatch() {
 bool ApplyChunkDimensionPatch() {
     Log("Checking Chunk Dimension patch...");
 
-    bool needsPatch = false;
-    int giganticMapSize = 0;
-    std::vector<int> customSizes;
-
-    // Check Gigantic Map Size
-    if (GetConfigBool("GiganticMapSizeEnabled", true)) {
-        giganticMapSize = GetConfigInt("GiganticMapSize", 220);
-        if (giganticMapSize > 220) {
-            Log("GiganticMapSize (" + std::to_string(giganticMapSize) +
-                ") > 220. Chunk Dimension patch required.");
-            needsPatch = true;
-        }
-    }
-
-    // Check Custom Flat World Sizes (only if not already needed)
-    if (!needsPatch && GetConfigBool("CustomFlatWorldSizesEnabled", true)) {
-        std::string sizesStr =
-            GetConfigString("CustomFlatWorldSizes", DEFAULT_FLAT_MAP_SIZES_STR);
-        if (ParseIntList(sizesStr, customSizes)) {
-            for (int size : customSizes) {
-                if (size > 220) {
-                    Log("Found CustomFlatWorldSize (" + std::to_string(size) +
-                        ") > 220. Chunk Dimension patch required.");
-                    needsPatch = true;
-                    break; // Found one, no need to check further
-                }
-            }
-        }
-        else {
-            Log("Warning: Could not parse CustomFlatWorldSizes for Chunk "
-                "Dimension check.");
-        }
-    }
-
-    if (!needsPatch) {
-        Log("No map sizes > 220 found in config. Chunk Dimension patch not "
-            "needed.");
+    // The chunk setting follows the largest configured size, so configs
+    // without big maps keep the game's finer chunks
+    int largestMapSize = GetLargestConfiguredMapSize();
+    int chunkSetting = PlanChunkDimension(largestMapSize);
+    Log("Largest configured map size: " + std::to_string(largestMapSize) +
+        ". Chunk setting: " + std::to_string(chunkSetting) + " (game default " +
+        std::to_string(MIN_CHUNK_SETTING) + ").");
+    if (chunkSetting == MIN_CHUNK_SETTING) {
+        Log("Chunk Dimension patch not needed.");
         return false; // Not an error, just not needed
     }
 
     // Define the patch details
     std::string patchName = "ChunkDimensionLimit";
     // Original: F0 C7 45 FC 07 00 00 00 C7 (mov dword ptr [ebp-4], 7)
-    std::string originalHex = "F0 C7 45 FC 07 00 00 00 C7";
-    // Target:   F0 C7 45 FC 1F 00 00 00 C7 (mov dword ptr [ebp-4], 31)
-    std::string targetHex = "F0 C7 45 FC 1F 00 00 00 C7";
+    std::string originalHex = CHUNK_DIMENSION_HEX;
+    // Target:   F0 C7 45 FC [setting] 00 00 00 C7
+    std::string targetHex = "F0 C7 45 FC 07 00 00 00 C7";
 
     std::vector<unsigned char> originalBytes;
     std::vector<unsigned char> targetBytes;
@@ -353,6 +343,7 @@ bool ApplyChunkDimensionPatch() {
             " patch. Patch aborted.");
         return false;
     }
+    targetBytes[4] = static_cast<unsigned char>(chunkSetting);
 
     MODULEINFO moduleInfo = { 0 };
     uintptr_t baseAddress = 0;
@@ -374,7 +365,8 @@ bool ApplyChunkDimensionPatch() {
     // Apply as code patch (is executable code)
     if (ApplyDataPatch(patchName, patchAddress, originalBytes, targetBytes,
         true)) {
-        Log("Successfully applied " + patchName + " patch.");
+        Log("Successfully applied " + patchName + " patch (chunk setting " +
+            std::to_string(chunkSetting) + ").");
         return true;
     }
     else {
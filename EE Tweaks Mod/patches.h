@@ -12,4 +12,13 @@ bool ApplyMapGridLimitPatch();
 bool ApplyAudioSampleRatePatch();
 bool ApplyChunkDimensionPatch(); // New patch function
 
+// The original bytes a custom patch searches for, so offline tools
+// (tools/compatscan.cpp) can look for them too
+struct CustomPatchSignature {
+    std::string name;
+    std::string moduleIdentifier; // "GAME_EXECUTABLE" or a module name
+    std::string originalHex;
+};
+std::vector<CustomPatchSignature> GetCustomPatchSignatures();
+
 #endif // PATCHES_H
\ No newline at end of file
@@ -3,9 +3,13 @@
 #define PCH_H
 
 // Add headers that are used frequently but changed infrequently
+#ifdef _WIN32 // Portable modules also build on POSIX for tools and tests
 #define WIN32_LEAN_AND_MEAN // Exclude rarely-used stuff from Windows headers
 #include <windows.h>
 #include <psapi.h> // For GetModuleInformation
+#else
+#include "compat.h" // Stand-ins for the few Windows types they use
+#endif
 #include <string>
 #include <vector>
 #include <fstream>
@@ -17,5 +21,14 @@
 #include <filesystem> // For path operations (requires C++17)
 #include <stdexcept>  // For std::stoi exceptions
 #include <ctime>      // For timestamp in log
+#include <chrono>     // For timing the patch pipeline
+#include <thread>     // For parallel scanning outside the loader lock
+#include <mutex>      // For thread-safe logging
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <condition_variable> // For the job scheduler
+#include <unordered_map>      // For the heap profiler's live samples
 
 #endif // PCH_H
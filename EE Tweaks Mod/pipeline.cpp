@@ -0,0 +1,195 @@
+#include "pch.h"
+#include "globals.h" // Access g_patches, g_executableName
+#include "logging.h" // Access Log()
+#include "config.h"  // Access config functions
+#include "memory.h"  // Access pattern scanning
+#include "patches.h"
+#include "counters.h"
+#include "pipeline.h"
+
+#ifdef _WIN32
+#include "crtsimd.h"
+#include "mapplanner.h"
+#include "moduledump.h"
+#endif
+
+static double MillisecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+// Count a custom patch and publish its state
+static void RecordCustomPatch(const char* patchName, bool applied,
+    PatchPipelineReport& report) {
+    PatchPipelineReport::Entry entry;
+    entry.name = patchName;
+    entry.isCustom = true;
+    entry.applied = applied;
+    report.entries.push_back(entry);
+    if (applied) {
+        report.customApplied++;
+    }
+    SetPatchState(patchName, applied ? PATCH_STATE_APPLIED :
+        PATCH_STATE_NOT_APPLIED);
+}
+
+void RunPatchPipeline(bool enableAll, PatchPipelineReport& report) {
+    // 4. Update standard patch enabled status from config
+    for (auto& patch : g_patches) {
+        patch.enabled = enableAll || GetConfigBool(patch.name + "Enabled", false);
+        patch.patchAddress = 0;
+        if (!patch.enabled && patch.name != "BypassMapSizeAssertion") {
+            Log("Config: Patch '" + patch.name + "' disabled.");
+            SetPatchState(patch.name, PATCH_STATE_DISABLED);
+        }
+    }
+
+    // Force enable the assertion bypass patch
+    bool assertionPatchFound = false;
+    for (auto& patch : g_patches) {
+        if (patch.name == "BypassMapSizeAssertion") {
+            if (!patch.enabled) {
+                Log("Info: Forcing 'BypassMapSizeAssertion' patch to enabled state.");
+                patch.enabled = true;
+            }
+            assertionPatchFound = true;
+            break;
+        }
+    }
+    if (!assertionPatchFound) {
+        Log("Error: 'BypassMapSizeAssertion' patch definition not found internally.");
+    }
+
+#ifdef _WIN32
+    // Diagnostic: save the unpatched target modules for offline replay
+    DumpPatchTargetModules();
+#endif
+
+    // 5. Find Standard Patch Locations
+    Log("Scanning for standard patch locations...");
+    std::vector<PatternScanJob> scanJobs;
+    std::vector<MemoryPatch*> scanPatches;
+    std::vector<size_t> scanEntries;
+    for (auto& patch : g_patches) {
+        if (!patch.enabled) {
+            continue;
+        }
+
+        std::string moduleToScan = patch.moduleIdentifier;
+        if (moduleToScan == "GAME_EXECUTABLE") {
+            if (g_executableName == "UNKNOWN_EXE") {
+                Log("Skipping scan for patch '" + patch.name +
+                    "' because game executable name is unknown.");
+                continue;
+            }
+            moduleToScan = g_executableName;
+        }
+
+        PatchPipelineReport::Entry entry;
+        entry.name = patch.name;
+        entry.module = moduleToScan;
+        report.entries.push_back(entry);
+
+        MODULEINFO moduleInfo = { 0 };
+        uintptr_t baseAddress = 0;
+        size_t moduleSize = 0;
+        if (!GetModuleInfoByName(moduleToScan, moduleInfo, baseAddress,
+            moduleSize)) {
+            Log("Warning: Could not get module info for '" + moduleToScan +
+                "' needed by patch '" + patch.name +
+                "'. Patch will be skipped.");
+            continue;
+        }
+        report.entries.back().moduleFound = true;
+
+        PatternScanJob job = { baseAddress, moduleSize, {}, 0 };
+        if (!HexToBytes(patch.originalHex, job.pattern)) {
+            Log("Error: Cannot scan for patch '" + patch.name +
+                "' due to invalid original hex pattern. Skipping patch.");
+            continue;
+        }
+
+        scanJobs.push_back(std::move(job));
+        scanPatches.push_back(&patch);
+        scanEntries.push_back(report.entries.size() - 1);
+    }
+
+    auto scanStart = std::chrono::steady_clock::now();
+    FindPatternsParallel(scanJobs); // Threaded when outside the loader lock
+    double scanMs = MillisecondsSince(scanStart);
+    report.scanMs = scanMs;
+
+    for (size_t i = 0; i < scanJobs.size(); ++i) {
+        MemoryPatch& patch = *scanPatches[i];
+        patch.patchAddress = scanJobs[i].result;
+        report.entries[scanEntries[i]].address = patch.patchAddress;
+
+        if (patch.patchAddress != 0) {
+            std::stringstream ss;
+            ss << "0x" << std::hex << patch.patchAddress;
+            Log("Found pattern for patch '" + patch.name + "' in module '" +
+                report.entries[scanEntries[i]].module + "' at address " +
+                ss.str());
+        }
+        else {
+            Log("Warning: Pattern for patch '" + patch.name + "' not found in '" +
+                report.entries[scanEntries[i]].module +
+                "'. Patch will be skipped.");
+            SetPatchState(patch.name, PATCH_STATE_NOT_FOUND);
+        }
+    }
+    Log("Scanned " + std::to_string(scanJobs.size()) + " standard patterns in " +
+        std::to_string(static_cast<long long>(scanMs)) + " ms.");
+    CounterSet(COUNTER_SCAN_US, static_cast<uint64_t>(scanMs * 1000));
+
+    // 6. Apply Standard Patches
+    Log("Applying enabled standard patches...");
+    auto standardStart = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < scanPatches.size(); ++i) {
+        MemoryPatch& patch = *scanPatches[i];
+        if (ApplyStandardPatch(patch)) { // ApplyStandardPatch now uses ApplyDataPatch
+            report.standardApplied++;
+            report.entries[scanEntries[i]].applied = true;
+            SetPatchState(patch.name, PATCH_STATE_APPLIED);
+        }
+        else if (patch.patchAddress != 0) {
+            SetPatchState(patch.name, PATCH_STATE_NOT_APPLIED);
+        }
+    }
+    report.standardMs = MillisecondsSince(standardStart);
+    Log("Applied " + std::to_string(report.standardApplied) +
+        " standard patches.");
+
+    // 7. Apply Custom Patches
+    Log("Applying custom patches...");
+    auto customStart = std::chrono::steady_clock::now();
+
+    RecordCustomPatch("AudioSampleRate", ApplyAudioSampleRatePatch(), report);
+
+    if (g_executableName != "UNKNOWN_EXE") {
+#ifdef _WIN32
+        PlanMapMemory(); // May lower the sizes below, so runs first
+#endif
+        RecordCustomPatch("CustomFlatWorldSizes",
+            ApplyCustomFlatWorldSizesPatch(), report);
+        RecordCustomPatch("GiganticMapSize", ApplyGiganticMapSizePatch(),
+            report);
+        RecordCustomPatch("MapGridLimit", // Depends on GiganticMapSize
+            ApplyMapGridLimitPatch(), report);
+        // *** APPLY NEW PATCH HERE ***
+        RecordCustomPatch("ChunkDimension", // Follows the largest configured size
+            ApplyChunkDimensionPatch(), report);
+#ifdef _WIN32
+        // Detours need the live process, so offline replays skip it
+        RecordCustomPatch("CrtSimd", ApplyCrtSimdPatch(), report);
+#endif
+    }
+    else {
+        Log("Skipping game executable specific patches (FlatWorldSizes, "
+            "GiganticMapSize, MapGridLimit, ChunkDimension, CrtSimd) because "
+            "game executable name is unknown.");
+    }
+
+    report.customMs = MillisecondsSince(customStart);
+    Log("Applied " + std::to_string(report.customApplied) + " custom patches.");
+}
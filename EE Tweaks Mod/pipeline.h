@@ -0,0 +1,30 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "pch.h"
+
+// What RunPatchPipeline did with each enabled patch, and how long each stage
+// took
+struct PatchPipelineReport {
+    struct Entry {
+        std::string name;
+        std::string module;       // Module scanned (standard patches)
+        bool isCustom = false;
+        bool moduleFound = false; // Standard patches: module info available
+        uintptr_t address = 0;    // Standard patches: where the pattern was found
+        bool applied = false;
+    };
+    std::vector<Entry> entries;
+    int standardApplied = 0;
+    int customApplied = 0;
+    double scanMs = 0;
+    double standardMs = 0;
+    double customMs = 0;
+};
+
+// Steps 4 to 7 of ApplyTweaks: read which patches are enabled, scan for the
+// standard patches, apply them, then apply the custom patches. Also run by
+// tools/scanreplay.cpp against module dumps; enableAll ignores the config.
+void RunPatchPipeline(bool enableAll, PatchPipelineReport& report);
+
+#endif // PIPELINE_H
@@ -0,0 +1,305 @@
+#include "pch.h"
+#include "powermode.h"
+
+#ifdef _WIN32
+#include "logging.h"   // Access Log()
+#include "config.h"    // Access config functions
+#include "scheduler.h" // Access InstallFrameSleepHook()
+#endif
+
+// --- Focus Power Controller ---
+
+const char* PowerModeName(PowerMode mode) {
+    switch (mode) {
+    case POWER_FOREGROUND: return "foreground";
+    case POWER_BACKGROUND: return "background";
+    case POWER_MINIMIZED: return "minimized";
+    default: return "unknown";
+    }
+}
+
+FocusPowerController::FocusPowerController(uint32_t backgroundFps,
+    uint32_t minimizedFps, uint32_t delayMs, bool throttleMultiplayer)
+    : m_delayMicros(static_cast<uint64_t>(delayMs) * 1000),
+    m_throttleMultiplayer(throttleMultiplayer) {
+    m_intervalMicros[POWER_FOREGROUND] = 0;
+    m_intervalMicros[POWER_BACKGROUND] = 1000000 / std::max(backgroundFps, 1u);
+    m_intervalMicros[POWER_MINIMIZED] = 1000000 / std::max(minimizedFps, 1u);
+}
+
+uint32_t FocusPowerController::OnLoopSleep(bool focused, bool minimized,
+    bool multiplayer, uint64_t nowMicros, uint32_t requestedMs) {
+    if (!m_started) {
+        m_started = true;
+        m_modeStart = nowMicros;
+    }
+
+    // Where the window is now, then whether to go there yet
+    PowerMode target = minimized ? POWER_MINIMIZED :
+        focused ? POWER_FOREGROUND : POWER_BACKGROUND;
+    if (multiplayer && !m_throttleMultiplayer) {
+        target = POWER_FOREGROUND;
+    }
+    if (target == POWER_BACKGROUND && m_mode == POWER_FOREGROUND) {
+        if (!m_unfocused) {
+            m_unfocused = true;
+            m_unfocusedSince = nowMicros;
+        }
+        if (nowMicros - m_unfocusedSince < m_delayMicros) {
+            target = POWER_FOREGROUND;
+        }
+    }
+    else {
+        m_unfocused = false;
+    }
+    if (target != m_mode) {
+        Switch(target, nowMicros);
+    }
+
+    uint64_t interval = m_intervalMicros[m_mode];
+    if (interval == 0) {
+        return requestedMs;
+    }
+    // Pace against a deadline; after falling more than a frame behind
+    // (a long load, a stall) start over rather than catch up
+    if (m_nextWake + interval < nowMicros) {
+        m_nextWake = nowMicros;
+    }
+    m_nextWake += interval;
+    uint64_t waitMs = m_nextWake > nowMicros ?
+        (m_nextWake - nowMicros + 999) / 1000 : 0;
+    return std::max(requestedMs, static_cast<uint32_t>(waitMs));
+}
+
+void FocusPowerController::Switch(PowerMode mode, uint64_t nowMicros) {
+    m_modeMicros[m_mode] += nowMicros - m_modeStart;
+    m_mode = mode;
+    m_modeStart = nowMicros;
+    m_nextWake = nowMicros;
+    m_unfocused = false;
+    m_transitions++;
+}
+
+uint64_t FocusPowerController::ModeMicros(PowerMode mode,
+    uint64_t nowMicros) const {
+    uint64_t total = m_modeMicros[mode];
+    if (mode == m_mode && m_started) {
+        total += nowMicros - m_modeStart;
+    }
+    return total;
+}
+
+uint64_t FocusPowerController::SinceTransition(uint64_t nowMicros) const {
+    return m_started ? nowMicros - m_modeStart : 0;
+}
+
+// --- Game Integration ---
+
+#ifdef _WIN32
+const uint64_t FOCUS_POLL_MICROS = 50000; // How often the window state is read
+const uint64_t NETWORK_POLL_MICROS = 1000000; // How often connections are read
+
+// GetExtendedTcpTable and GetExtendedUdpTable, loaded from iphlpapi.dll
+typedef DWORD(WINAPI* GetExtendedTableFn)(PVOID table, PDWORD size, BOOL order,
+    ULONG family, int tableClass, ULONG reserved);
+const ULONG NETWORK_FAMILY_IPV4 = 2;                // AF_INET
+const int TCP_TABLE_OWNER_PID_CONNECTIONS_CLASS = 4; // TCP_TABLE_CLASS
+const int UDP_TABLE_OWNER_PID_CLASS = 1;             // UDP_TABLE_CLASS
+const DWORD TCP_STATE_ESTABLISHED = 5;               // MIB_TCP_STATE_ESTAB
+const size_t TCP_ROW_DWORDS = 6; // MIB_TCPROW_OWNER_PID: state, local, remote, pid
+const size_t UDP_ROW_DWORDS = 3; // MIB_UDPROW_OWNER_PID: local, pid
+
+static std::unique_ptr<FocusPowerController> g_powerController;
+static LARGE_INTEGER g_counterFrequency = { 0 };
+static uint64_t g_lastPoll = 0;
+static bool g_focused = true;
+static bool g_minimized = false;
+static HWND g_gameWindow = NULL; // Last of our windows seen in the foreground
+static GetExtendedTableFn g_getTcpTable = nullptr;
+static GetExtendedTableFn g_getUdpTable = nullptr;
+static uint64_t g_lastNetworkPoll = 0;
+static bool g_networkPolled = false;
+static bool g_multiplayer = false;
+
+static uint64_t NowMicros() {
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return static_cast<uint64_t>(now.QuadPart / g_counterFrequency.QuadPart *
+        1000000 + now.QuadPart % g_counterFrequency.QuadPart * 1000000 /
+        g_counterFrequency.QuadPart);
+}
+
+static std::string FormatSeconds(uint64_t micros) {
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(1) << micros / 1000000.0 << " s";
+    return ss.str();
+}
+
+static void PollWindowState() {
+    HWND foreground = GetForegroundWindow();
+    DWORD processId = 0;
+    if (foreground != NULL) {
+        GetWindowThreadProcessId(foreground, &processId);
+    }
+    g_focused = processId == GetCurrentProcessId();
+    if (g_focused) {
+        g_gameWindow = foreground;
+    }
+    g_minimized = g_gameWindow != NULL && IsIconic(g_gameWindow) != FALSE;
+}
+
+// Read one of the system's IPv4 tables; entries follow a DWORD count
+static bool ReadNetworkTable(GetExtendedTableFn getTable, int tableClass,
+    std::vector<DWORD>& table) {
+    DWORD size = 0;
+    for (int attempt = 0; attempt < 4; ++attempt) {
+        table.resize(size / sizeof(DWORD) + 1);
+        size = static_cast<DWORD>(table.size() * sizeof(DWORD));
+        DWORD result = getTable(table.data(), &size, FALSE, NETWORK_FAMILY_IPV4,
+            tableClass, 0);
+        if (result == NO_ERROR) {
+            return true;
+        }
+        if (result != ERROR_INSUFFICIENT_BUFFER) {
+            return false;
+        }
+    }
+    return false; // Kept growing
+}
+
+// A multiplayer session is taken to be active while the game has a TCP
+// connection to another computer or an open UDP port, as when hosting,
+// joining or playing. Errs on the side of full speed: a table that cannot
+// be read counts as a session.
+static bool ProcessHasNetworkSession() {
+    if (g_getTcpTable == nullptr || g_getUdpTable == nullptr) {
+        return true;
+    }
+    DWORD processId = GetCurrentProcessId();
+    std::vector<DWORD> table;
+    if (!ReadNetworkTable(g_getTcpTable, TCP_TABLE_OWNER_PID_CONNECTIONS_CLASS,
+        table)) {
+        return true;
+    }
+    for (DWORD i = 0; i < table[0]; ++i) {
+        const DWORD* row = &table[1 + i * TCP_ROW_DWORDS];
+        bool loopback = (row[3] & 0xFF) == 127; // Network byte order
+        if (row[5] == processId && row[0] == TCP_STATE_ESTABLISHED && !loopback) {
+            return true;
+        }
+    }
+    if (!ReadNetworkTable(g_getUdpTable, UDP_TABLE_OWNER_PID_CLASS, table)) {
+        return true;
+    }
+    for (DWORD i = 0; i < table[0]; ++i) {
+        if (table[1 + i * UDP_ROW_DWORDS + 2] == processId) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Only read while the game is unfocused: in the foreground the loop runs at
+// full speed anyway, and the tables can take a while with many connections
+static void PollNetworkState(uint64_t now) {
+    if (g_focused && !g_minimized) {
+        g_networkPolled = false;
+        return;
+    }
+    if (g_networkPolled && now - g_lastNetworkPoll < NETWORK_POLL_MICROS) {
+        return;
+    }
+    g_networkPolled = true;
+    g_lastNetworkPoll = now;
+    bool multiplayer = ProcessHasNetworkSession();
+    if (multiplayer != g_multiplayer) {
+        g_multiplayer = multiplayer;
+        Log(multiplayer ? "Power Mode: multiplayer session found, staying at "
+            "full speed." : "Power Mode: no multiplayer session.");
+    }
+}
+
+// Main thread only, once per pass of the main loop
+DWORD PowerModeOnFrameSleep(DWORD milliseconds) {
+    if (!g_powerController) {
+        return milliseconds;
+    }
+    uint64_t now = NowMicros();
+    if (now - g_lastPoll >= FOCUS_POLL_MICROS) {
+        g_lastPoll = now;
+        PollWindowState();
+        PollNetworkState(now);
+    }
+    PowerMode before = g_powerController->Mode();
+    uint64_t inBefore = g_powerController->SinceTransition(now);
+    DWORD result = g_powerController->OnLoopSleep(g_focused, g_minimized,
+        g_multiplayer, now, milliseconds);
+    if (g_powerController->Mode() != before) {
+        Log(std::string("Power mode: ") + PowerModeName(before) + " -> " +
+            PowerModeName(g_powerController->Mode()) + " after " +
+            FormatSeconds(inBefore) + ".");
+    }
+    return result;
+}
+
+// Throttle the main loop while the game is unfocused or minimized
+bool StartPowerMode() {
+    Log("Checking Power Mode...");
+    if (!GetConfigBool("PowerModeEnabled", false)) {
+        Log("Power Mode is disabled in config.");
+        return false;
+    }
+    int backgroundFps = GetConfigInt("PowerModeBackgroundFps", 10);
+    int minimizedFps = GetConfigInt("PowerModeMinimizedFps", 2);
+    int delayMs = GetConfigInt("PowerModeDelayMs", 1000);
+    bool throttleMultiplayer = GetConfigBool("PowerModeInMultiplayer", false);
+    if (backgroundFps < 1) backgroundFps = 1;
+    if (minimizedFps < 1) minimizedFps = 1;
+    if (delayMs < 0) delayMs = 0;
+
+    QueryPerformanceFrequency(&g_counterFrequency);
+    HMODULE ipHelper = LoadLibraryA("iphlpapi.dll");
+    if (ipHelper != NULL) {
+        g_getTcpTable = reinterpret_cast<GetExtendedTableFn>(GetProcAddress(
+            ipHelper, "GetExtendedTcpTable"));
+        g_getUdpTable = reinterpret_cast<GetExtendedTableFn>(GetProcAddress(
+            ipHelper, "GetExtendedUdpTable"));
+    }
+    if (!throttleMultiplayer && (g_getTcpTable == nullptr ||
+        g_getUdpTable == nullptr)) {
+        Log("Warning: Power Mode cannot tell multiplayer sessions apart and "
+            "keeps full speed.");
+    }
+    g_powerController.reset(new FocusPowerController(
+        static_cast<uint32_t>(backgroundFps), static_cast<uint32_t>(minimizedFps),
+        static_cast<uint32_t>(delayMs), throttleMultiplayer));
+    if (!InstallFrameSleepHook()) {
+        g_powerController.reset();
+        Log("Error: Power Mode needs the main loop's Sleep hook.");
+        return false;
+    }
+
+    Log("Power Mode enabled (" + std::to_string(backgroundFps) +
+        " fps in the background, " + std::to_string(minimizedFps) +
+        " fps minimized, after " + std::to_string(delayMs) + " ms" +
+        (throttleMultiplayer ? ", also in multiplayer" : "") + ").");
+    return true;
+}
+
+// Log the time spent in each mode. The controller is left in place: the
+// main thread may still be in the Sleep hook.
+void ShutdownPowerMode() {
+    if (!g_powerController) {
+        return;
+    }
+    uint64_t now = NowMicros();
+    std::string summary = "Power Mode: " +
+        std::to_string(g_powerController->Transitions()) + " transitions";
+    for (int mode = 0; mode < POWER_MODE_COUNT; ++mode) {
+        summary += std::string(", ") + PowerModeName(static_cast<PowerMode>(mode)) +
+            " " + FormatSeconds(g_powerController->ModeMicros(
+                static_cast<PowerMode>(mode), now));
+    }
+    Log(summary + ".");
+}
+#endif
@@ -0,0 +1,63 @@
+#ifndef POWERMODE_H
+#define POWERMODE_H
+
+#include "pch.h"
+
+enum PowerMode {
+    POWER_FOREGROUND = 0, // Full speed
+    POWER_BACKGROUND = 1, // Unfocused
+    POWER_MINIMIZED = 2,
+    POWER_MODE_COUNT
+};
+
+const char* PowerModeName(PowerMode mode);
+
+// Decides how long the game's main loop sleeps, from whether its window has
+// focus or is minimized. In the foreground the game's own sleep is kept; in
+// the background and minimized the loop is paced to a low frame rate
+// against a deadline, so slow frames do not lower it further. Losing focus
+// takes effect after a grace delay (a brief alt-tab or a popup stays at full
+// speed); minimizing and regaining focus take effect at once. During a
+// multiplayer session the loop stays at full speed unless throttleMultiplayer
+// is set, as the other players would have to wait for it.
+class FocusPowerController {
+public:
+    FocusPowerController(uint32_t backgroundFps, uint32_t minimizedFps,
+        uint32_t delayMs, bool throttleMultiplayer);
+
+    // Called once per pass of the main loop; returns the milliseconds to
+    // sleep instead of requestedMs (never less)
+    uint32_t OnLoopSleep(bool focused, bool minimized, bool multiplayer,
+        uint64_t nowMicros, uint32_t requestedMs);
+
+    PowerMode Mode() const { return m_mode; }
+    uint64_t ModeMicros(PowerMode mode, uint64_t nowMicros) const; // Total time in mode
+    uint64_t SinceTransition(uint64_t nowMicros) const; // Time in the current mode
+    uint32_t Transitions() const { return m_transitions; }
+
+private:
+    void Switch(PowerMode mode, uint64_t nowMicros);
+
+    uint64_t m_intervalMicros[POWER_MODE_COUNT];
+    uint64_t m_delayMicros;
+    bool m_throttleMultiplayer;
+    PowerMode m_mode = POWER_FOREGROUND;
+    bool m_started = false;
+    bool m_unfocused = false;       // Focus lost, grace delay running
+    uint64_t m_unfocusedSince = 0;
+    uint64_t m_modeStart = 0;
+    uint64_t m_nextWake = 0;        // Pacing deadline outside the foreground
+    uint64_t m_modeMicros[POWER_MODE_COUNT] = { 0 };
+    uint32_t m_transitions = 0;
+};
+
+// Function declarations
+#ifdef _WIN32
+bool StartPowerMode();
+void ShutdownPowerMode();
+
+// Called from the main loop's Sleep hook (scheduler.cpp)
+DWORD PowerModeOnFrameSleep(DWORD milliseconds);
+#endif
+
+#endif // POWERMODE_H
@@ -0,0 +1,559 @@
+#include "pch.h"
+#include "prefetch.h"
+
+#ifdef _WIN32
+#include "globals.h" // Access g_dllDir, PREFETCH_TRACE_FILE
+#include "logging.h" // Access Log()
+#include "config.h"  // Access config functions
+#include "counters.h"
+#else
+#include <cstring>
+#endif
+
+// --- Trace Format ---
+// Little-endian. Header: "EEPF", version (u32), window ms (u32), read micros
+// (u64), baseline read micros (u64). Then the file count and each path
+// (length + bytes), the record count and each record as file index, offset,
+// length and time delta. Counts, lengths and record fields are LEB128
+// varints, so a typical startup trace is a few KB.
+
+static const char TRACE_MAGIC[4] = { 'E', 'E', 'P', 'F' };
+static const uint32_t TRACE_VERSION = 1;
+static const size_t TRACE_MAX_FILES = 4096;
+static const size_t TRACE_MAX_PATH = 1024;
+static const size_t TRACE_MAX_RECORDS = 65536;
+
+static void WriteFixed(std::ostream& out, uint64_t value, size_t bytes) {
+    for (size_t i = 0; i < bytes; ++i) {
+        out.put(static_cast<char>((value >> (i * 8)) & 0xFF));
+    }
+}
+
+static bool ReadFixed(std::istream& in, uint64_t& value, size_t bytes) {
+    value = 0;
+    for (size_t i = 0; i < bytes; ++i) {
+        int c = in.get();
+        if (c == EOF) {
+            return false;
+        }
+        value |= static_cast<uint64_t>(c & 0xFF) << (i * 8);
+    }
+    return true;
+}
+
+static void WriteVarint(std::ostream& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.put(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.put(static_cast<char>(value));
+}
+
+static bool ReadVarint(std::istream& in, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int c = in.get();
+        if (c == EOF) {
+            return false;
+        }
+        value |= static_cast<uint64_t>(c & 0x7F) << shift;
+        if ((c & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false; // Too long
+}
+
+// --- File Access Trace ---
+
+uint32_t FileAccessTrace::AddFile(const std::string& path) {
+    int existing = FindFile(path);
+    if (existing >= 0) {
+        return static_cast<uint32_t>(existing);
+    }
+    m_files.push_back(path);
+    return static_cast<uint32_t>(m_files.size() - 1);
+}
+
+int FileAccessTrace::FindFile(const std::string& path) const {
+    for (size_t i = 0; i < m_files.size(); ++i) {
+        if (m_files[i] == path) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+bool FileAccessTrace::AddRead(uint32_t fileIndex, uint64_t offset,
+    uint32_t length, uint32_t timeMs) {
+    if (length == 0 || fileIndex >= m_files.size()) {
+        return false;
+    }
+    if (!m_records.empty()) {
+        TraceRecord& last = m_records.back();
+        if (last.fileIndex == fileIndex && last.offset + last.length == offset &&
+            static_cast<uint64_t>(last.length) + length <= UINT32_MAX) {
+            last.length += length; // Sequential read: extend
+            return true;
+        }
+    }
+    if (m_records.size() >= TRACE_MAX_RECORDS) {
+        return false;
+    }
+    m_records.push_back({ fileIndex, offset, length, timeMs });
+    return true;
+}
+
+void FileAccessTrace::Clear() {
+    m_files.clear();
+    m_records.clear();
+    windowMs = 0;
+    readMicros = 0;
+    baselineReadMicros = 0;
+}
+
+bool FileAccessTrace::WriteTo(std::ostream& out) const {
+    out.write(TRACE_MAGIC, sizeof(TRACE_MAGIC));
+    WriteFixed(out, TRACE_VERSION, 4);
+    WriteFixed(out, windowMs, 4);
+    WriteFixed(out, readMicros, 8);
+    WriteFixed(out, baselineReadMicros, 8);
+
+    WriteVarint(out, m_files.size());
+    for (const std::string& path : m_files) {
+        WriteVarint(out, path.size());
+        out.write(path.data(), path.size());
+    }
+
+    WriteVarint(out, m_records.size());
+    uint32_t previousTime = 0;
+    for (const TraceRecord& record : m_records) {
+        WriteVarint(out, record.fileIndex);
+        WriteVarint(out, record.offset);
+        WriteVarint(out, record.length);
+        // Records are in time order; clamp in case the caller was not
+        WriteVarint(out, record.timeMs >= previousTime ?
+            record.timeMs - previousTime : 0);
+        if (record.timeMs > previousTime) previousTime = record.timeMs;
+    }
+    return out.good();
+}
+
+// Load a trace. Leaves the trace empty and returns false if the data is
+// truncated or not a valid trace.
+bool FileAccessTrace::ReadFrom(std::istream& in) {
+    Clear();
+    char magic[sizeof(TRACE_MAGIC)];
+    uint64_t version, window, micros, baseline;
+    if (!in.read(magic, sizeof(magic)) ||
+        memcmp(magic, TRACE_MAGIC, sizeof(magic)) != 0 ||
+        !ReadFixed(in, version, 4) || version != TRACE_VERSION ||
+        !ReadFixed(in, window, 4) || !ReadFixed(in, micros, 8) ||
+        !ReadFixed(in, baseline, 8)) {
+        return false;
+    }
+
+    uint64_t fileCount;
+    if (!ReadVarint(in, fileCount) || fileCount > TRACE_MAX_FILES) {
+        return false;
+    }
+    for (uint64_t i = 0; i < fileCount; ++i) {
+        uint64_t length;
+        if (!ReadVarint(in, length) || length > TRACE_MAX_PATH) {
+            Clear();
+            return false;
+        }
+        std::string path(static_cast<size_t>(length), '\0');
+        if (length > 0 && !in.read(&path[0], static_cast<std::streamsize>(length))) {
+            Clear();
+            return false;
+        }
+        m_files.push_back(path);
+    }
+
+    uint64_t recordCount;
+    if (!ReadVarint(in, recordCount) || recordCount > TRACE_MAX_RECORDS) {
+        Clear();
+        return false;
+    }
+    uint64_t time = 0;
+    for (uint64_t i = 0; i < recordCount; ++i) {
+        uint64_t fileIndex, offset, length, delta;
+        if (!ReadVarint(in, fileIndex) || !ReadVarint(in, offset) ||
+            !ReadVarint(in, length) || !ReadVarint(in, delta) ||
+            fileIndex >= m_files.size() || length == 0 || length > UINT32_MAX) {
+            Clear();
+            return false;
+        }
+        time += delta;
+        m_records.push_back({ static_cast<uint32_t>(fileIndex), offset,
+            static_cast<uint32_t>(length),
+            static_cast<uint32_t>(time < UINT32_MAX ? time : UINT32_MAX) });
+    }
+
+    windowMs = static_cast<uint32_t>(window);
+    readMicros = micros;
+    baselineReadMicros = baseline;
+    return true;
+}
+
+// --- Prefetch Plan ---
+
+std::vector<PrefetchRange> BuildPrefetchPlan(const FileAccessTrace& trace,
+    uint32_t chunkSize) {
+    // Reading through a gap this small is cheaper than a separate request
+    const uint64_t mergeGap = 64 * 1024;
+    if (chunkSize == 0) chunkSize = 256 * 1024;
+
+    struct Span {
+        uint32_t fileIndex;
+        uint64_t start;
+        uint64_t end;
+        uint32_t firstTime;
+    };
+
+    // Merge each file's ranges, keeping the earliest access time
+    std::vector<Span> spans;
+    for (const TraceRecord& record : trace.Records()) {
+        spans.push_back({ record.fileIndex, record.offset,
+            record.offset + record.length, record.timeMs });
+    }
+    std::sort(spans.begin(), spans.end(), [](const Span& a, const Span& b) {
+        return a.fileIndex != b.fileIndex ? a.fileIndex < b.fileIndex :
+            a.start < b.start;
+    });
+    std::vector<Span> merged;
+    for (const Span& span : spans) {
+        if (!merged.empty() && merged.back().fileIndex == span.fileIndex &&
+            span.start <= merged.back().end + mergeGap) {
+            Span& last = merged.back();
+            if (span.end > last.end) last.end = span.end;
+            if (span.firstTime < last.firstTime) last.firstTime = span.firstTime;
+        }
+        else {
+            merged.push_back(span);
+        }
+    }
+
+    // Replay in the order the game needed the data
+    std::stable_sort(merged.begin(), merged.end(),
+        [](const Span& a, const Span& b) { return a.firstTime < b.firstTime; });
+
+    std::vector<PrefetchRange> plan;
+    for (const Span& span : merged) {
+        for (uint64_t offset = span.start; offset < span.end; offset += chunkSize) {
+            uint64_t remaining = span.end - offset;
+            plan.push_back({ span.fileIndex, offset,
+                static_cast<uint32_t>(remaining < chunkSize ? remaining :
+                    chunkSize) });
+        }
+    }
+    return plan;
+}
+
+// --- Prefetch Coverage ---
+
+void PrefetchCoverage::Add(uint32_t fileIndex, uint64_t offset,
+    uint64_t length) {
+    if (length == 0) {
+        return;
+    }
+    std::map<uint64_t, uint64_t>& ranges = m_ranges[fileIndex];
+    uint64_t start = offset;
+    uint64_t end = offset + length;
+
+    // Absorb every range that overlaps or touches [start, end)
+    auto it = ranges.upper_bound(start);
+    if (it != ranges.begin()) {
+        auto previous = std::prev(it);
+        if (previous->second >= start) {
+            it = previous;
+        }
+    }
+    while (it != ranges.end() && it->first <= end) {
+        if (it->first < start) start = it->first;
+        if (it->second > end) end = it->second;
+        it = ranges.erase(it);
+    }
+    ranges[start] = end;
+}
+
+bool PrefetchCoverage::Contains(uint32_t fileIndex, uint64_t offset,
+    uint64_t length) const {
+    auto file = m_ranges.find(fileIndex);
+    if (file == m_ranges.end()) {
+        return false;
+    }
+    auto it = file->second.upper_bound(offset);
+    if (it == file->second.begin()) {
+        return false;
+    }
+    --it;
+    return it->first <= offset && offset + length <= it->second;
+}
+
+// --- Startup Recorder and Replay ---
+
+#ifdef _WIN32
+struct TracedHandle {
+    uint32_t recordIndex; // File index in this launch's trace
+    int replayIndex;      // File index in the replayed trace, or -1
+};
+
+static std::mutex g_prefetchMutex;
+static FileAccessTrace g_recordedTrace; // This launch
+static FileAccessTrace g_replayTrace;   // Previous launch
+static PrefetchCoverage g_coverage;
+static std::map<HANDLE, TracedHandle> g_tracedHandles;
+static std::atomic<bool> g_recordingActive(false);
+static bool g_replaying = false;
+static std::chrono::steady_clock::time_point g_windowStart;
+static uint32_t g_windowMs = 30000;
+static uint32_t g_chunkSize = 256 * 1024;
+static uint64_t g_windowReads = 0;
+static uint64_t g_hitReads = 0;
+static std::atomic<uint64_t> g_prefetchedBytes(0);
+static HANDLE g_prefetchThread = NULL;
+static volatile bool g_prefetchStop = false;
+
+static uint32_t ElapsedWindowMs() {
+    return static_cast<uint32_t>(
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - g_windowStart).count());
+}
+
+// Stop recording, save the trace and log how this launch went
+static void FinishTraceWindow() {
+    if (!g_recordingActive.exchange(false)) {
+        return; // Already finished
+    }
+
+    std::lock_guard<std::mutex> lock(g_prefetchMutex);
+    g_recordedTrace.windowMs = g_windowMs;
+    // The first launch without a replay sets the baseline later launches are
+    // compared against
+    g_recordedTrace.baselineReadMicros = g_replaying ?
+        g_replayTrace.baselineReadMicros : g_recordedTrace.readMicros;
+
+    std::string tracePath = g_dllDir + "\\" + PREFETCH_TRACE_FILE;
+    std::ofstream traceFile(tracePath, std::ios::binary | std::ios::trunc);
+    if (!traceFile.is_open() || !g_recordedTrace.WriteTo(traceFile)) {
+        Log("Error: Could not write startup trace to " + tracePath + ".");
+    }
+    else {
+        Log("Startup trace saved: " +
+            std::to_string(g_recordedTrace.Records().size()) + " ranges in " +
+            std::to_string(g_recordedTrace.Files().size()) + " files.");
+    }
+
+    uint64_t readMs = g_recordedTrace.readMicros / 1000;
+    if (!g_replaying) {
+        Log("Startup prefetch: game spent " + std::to_string(readMs) +
+            " ms in file reads during the first " +
+            std::to_string(g_windowMs / 1000) + " s (baseline, no prefetch).");
+        return;
+    }
+
+    uint64_t hitPercent = g_windowReads ? g_hitReads * 100 / g_windowReads : 0;
+    std::string message = "Startup prefetch: read ahead " +
+        std::to_string(g_prefetchedBytes.load() / 1024) + " KB, " +
+        std::to_string(g_hitReads) + " of " + std::to_string(g_windowReads) +
+        " game reads hit prefetched data (" + std::to_string(hitPercent) +
+        "%). Game spent " + std::to_string(readMs) + " ms in file reads";
+    uint64_t baselineMs = g_recordedTrace.baselineReadMicros / 1000;
+    if (g_recordedTrace.baselineReadMicros > 0) {
+        message += " (baseline " + std::to_string(baselineMs) + " ms, saved " +
+            std::to_string(static_cast<long long>(baselineMs) -
+                static_cast<long long>(readMs)) + " ms)";
+    }
+    Log(message + ".");
+}
+
+// Read the previous launch's data ahead of the game at background priority,
+// then close the trace window
+static DWORD WINAPI PrefetchThreadProc(LPVOID) {
+    // Background mode also lowers the thread's I/O priority
+    SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+
+    if (g_replaying) {
+        std::vector<PrefetchRange> plan = BuildPrefetchPlan(g_replayTrace,
+            g_chunkSize);
+        std::vector<char> buffer(g_chunkSize);
+        HANDLE file = INVALID_HANDLE_VALUE;
+        uint32_t openIndex = UINT32_MAX;
+
+        for (const PrefetchRange& range : plan) {
+            if (g_prefetchStop || ElapsedWindowMs() >= g_windowMs) {
+                break;
+            }
+            if (range.fileIndex != openIndex) {
+                if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+                // Share everything so this handle never makes the game's
+                // own opens fail
+                file = CreateFileA(g_replayTrace.Files()[range.fileIndex].c_str(),
+                    GENERIC_READ,
+                    FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+                    OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+                openIndex = range.fileIndex;
+            }
+            if (file == INVALID_HANDLE_VALUE) {
+                continue; // File is gone; skip its ranges
+            }
+
+            LARGE_INTEGER distance;
+            distance.QuadPart = static_cast<LONGLONG>(range.offset);
+            DWORD bytesRead = 0;
+            if (!SetFilePointerEx(file, distance, NULL, FILE_BEGIN) ||
+                !ReadFile(file, buffer.data(), range.length, &bytesRead, NULL)) {
+                continue;
+            }
+            g_prefetchedBytes += bytesRead;
+            CounterAdd(COUNTER_PREFETCH_BYTES, bytesRead);
+            std::lock_guard<std::mutex> lock(g_prefetchMutex);
+            g_coverage.Add(range.fileIndex, range.offset, bytesRead);
+        }
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+    }
+
+    SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_END);
+    while (!g_prefetchStop && ElapsedWindowMs() < g_windowMs) {
+        Sleep(100);
+    }
+    if (!g_prefetchStop) {
+        FinishTraceWindow();
+    }
+    return 0;
+}
+
+// Load the previous launch's trace and start recording this one. Returns
+// true if the file hooks are needed.
+bool StartPrefetch() {
+    if (!GetConfigBool("StartupPrefetchEnabled", false)) {
+        return false;
+    }
+
+    int windowSeconds = GetConfigInt("StartupPrefetchSeconds", 30);
+    if (windowSeconds < 1) windowSeconds = 1;
+    if (windowSeconds > 600) windowSeconds = 600;
+    int chunkKB = GetConfigInt("StartupPrefetchChunkKB", 256);
+    if (chunkKB < 4) chunkKB = 4;
+    if (chunkKB > 4096) chunkKB = 4096;
+    g_windowMs = static_cast<uint32_t>(windowSeconds) * 1000;
+    g_chunkSize = static_cast<uint32_t>(chunkKB) * 1024;
+
+    std::string tracePath = g_dllDir + "\\" + PREFETCH_TRACE_FILE;
+    std::ifstream traceFile(tracePath, std::ios::binary);
+    if (traceFile.is_open()) {
+        g_replaying = g_replayTrace.ReadFrom(traceFile) &&
+            !g_replayTrace.Records().empty();
+        if (!g_replaying) {
+            Log("Warning: Startup trace " + tracePath +
+                " is invalid or empty. Recording a new one.");
+        }
+    }
+
+    g_windowStart = std::chrono::steady_clock::now();
+    g_recordingActive = true;
+    g_prefetchStop = false;
+    g_prefetchThread = CreateThread(NULL, 0, PrefetchThreadProc, NULL, 0, NULL);
+    if (g_prefetchThread == NULL) {
+        Log("Error: Could not start the startup prefetch thread. Error code: " +
+            std::to_string(GetLastError()));
+        g_recordingActive = false;
+        return false;
+    }
+
+    if (g_replaying) {
+        Log("Startup prefetch: replaying " +
+            std::to_string(g_replayTrace.Records().size()) + " ranges from " +
+            std::to_string(g_replayTrace.Files().size()) +
+            " files, recording for " + std::to_string(windowSeconds) + " s.");
+    }
+    else {
+        Log("Startup prefetch: no trace yet, recording the first " +
+            std::to_string(windowSeconds) + " s of file reads.");
+    }
+    return true;
+}
+
+// Trace read-only opens made during the window
+void PrefetchOnOpen(HANDLE file, const char* path, DWORD access) {
+    if (!g_recordingActive || file == INVALID_HANDLE_VALUE || path == nullptr ||
+        (access & (GENERIC_WRITE | GENERIC_ALL)) != 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(g_prefetchMutex);
+    if (g_recordedTrace.Files().size() >= TRACE_MAX_FILES) {
+        return;
+    }
+    TracedHandle traced;
+    traced.recordIndex = g_recordedTrace.AddFile(path);
+    traced.replayIndex = g_replaying ? g_replayTrace.FindFile(path) : -1;
+    g_tracedHandles[file] = traced;
+}
+
+bool PrefetchTracesHandle(HANDLE file) {
+    if (!g_recordingActive) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(g_prefetchMutex);
+    return g_tracedHandles.find(file) != g_tracedHandles.end();
+}
+
+// Record a completed synchronous read of a traced handle
+void PrefetchOnRead(HANDLE file, uint64_t offset, DWORD bytesRead,
+    uint64_t micros) {
+    if (!g_recordingActive) {
+        return;
+    }
+    uint32_t timeMs = ElapsedWindowMs();
+    if (timeMs >= g_windowMs) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(g_prefetchMutex);
+    auto it = g_tracedHandles.find(file);
+    if (it == g_tracedHandles.end()) {
+        return;
+    }
+    g_recordedTrace.readMicros += micros;
+    if (bytesRead == 0) {
+        return;
+    }
+    g_recordedTrace.AddRead(it->second.recordIndex, offset, bytesRead, timeMs);
+
+    if (g_replaying) {
+        g_windowReads++;
+        CounterAdd(COUNTER_PREFETCH_READS, 1);
+        if (it->second.replayIndex >= 0 &&
+            g_coverage.Contains(static_cast<uint32_t>(it->second.replayIndex),
+                offset, bytesRead)) {
+            g_hitReads++;
+            CounterAdd(COUNTER_PREFETCH_HITS, 1);
+        }
+    }
+}
+
+void PrefetchOnClose(HANDLE file) {
+    if (!g_recordingActive) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(g_prefetchMutex);
+    g_tracedHandles.erase(file);
+}
+
+// Save the trace if the game exits before the window ends. Called at
+// shutdown, while the prefetch thread is still running: it is stopped first
+// so it cannot finish the window at the same time.
+void ShutdownPrefetch() {
+    if (g_prefetchThread == NULL) {
+        return;
+    }
+    g_prefetchStop = true;
+    // It checks the flag between chunks and every 100 ms while waiting
+    WaitForSingleObject(g_prefetchThread, 2000);
+    CloseHandle(g_prefetchThread);
+    g_prefetchThread = NULL;
+    FinishTraceWindow();
+}
+#endif
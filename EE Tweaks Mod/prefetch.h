@@ -0,0 +1,76 @@
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include "pch.h"
+
+// One read (or run of back-to-back reads) seen during startup
+struct TraceRecord {
+    uint32_t fileIndex;
+    uint64_t offset;
+    uint32_t length;
+    uint32_t timeMs; // Since the start of the trace window
+};
+
+// The files and byte ranges read during the first seconds of a launch.
+// Stored as a small binary file; see WriteTo for the layout.
+class FileAccessTrace {
+public:
+    uint32_t AddFile(const std::string& path); // Returns the existing index if known
+    int FindFile(const std::string& path) const; // -1 if not in the trace
+    // Record a read; extends the previous record if it continues it
+    bool AddRead(uint32_t fileIndex, uint64_t offset, uint32_t length,
+        uint32_t timeMs);
+    void Clear();
+
+    bool WriteTo(std::ostream& out) const;
+    bool ReadFrom(std::istream& in);
+
+    const std::vector<std::string>& Files() const { return m_files; }
+    const std::vector<TraceRecord>& Records() const { return m_records; }
+
+    uint32_t windowMs = 0;
+    uint64_t readMicros = 0;         // Time the game spent in traced reads
+    uint64_t baselineReadMicros = 0; // Same, from the last launch without prefetch
+
+private:
+    std::vector<std::string> m_files;
+    std::vector<TraceRecord> m_records;
+};
+
+// A byte range for the replay thread to read ahead
+struct PrefetchRange {
+    uint32_t fileIndex;
+    uint64_t offset;
+    uint32_t length;
+};
+
+// Turn a trace into read-ahead work: ranges of each file are merged (small
+// gaps are read through), ordered by when the game first needed them and
+// split into chunks of at most chunkSize bytes.
+std::vector<PrefetchRange> BuildPrefetchPlan(const FileAccessTrace& trace,
+    uint32_t chunkSize);
+
+// The byte ranges prefetched so far, per file
+class PrefetchCoverage {
+public:
+    void Add(uint32_t fileIndex, uint64_t offset, uint64_t length);
+    bool Contains(uint32_t fileIndex, uint64_t offset, uint64_t length) const;
+
+private:
+    std::map<uint32_t, std::map<uint64_t, uint64_t>> m_ranges; // start -> end
+};
+
+// Function declarations
+#ifdef _WIN32
+bool StartPrefetch(); // Returns true if the file hooks are needed
+void ShutdownPrefetch();
+
+// Called from the file API hooks (fileio.cpp)
+void PrefetchOnOpen(HANDLE file, const char* path, DWORD access);
+bool PrefetchTracesHandle(HANDLE file);
+void PrefetchOnRead(HANDLE file, uint64_t offset, DWORD bytesRead,
+    uint64_t micros);
+void PrefetchOnClose(HANDLE file);
+#endif
+
+#endif // PREFETCH_H
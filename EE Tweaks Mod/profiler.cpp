@@ -0,0 +1,259 @@
+#include "pch.h"
+#include "profiler.h"
+
+#ifdef _WIN32
+#include "globals.h" // Access g_dllDir, g_mainThreadId
+#include "logging.h" // Access Log()
+#include "config.h"  // Access config functions
+#include "counters.h"
+#endif
+
+// --- Stack Sample Table ---
+
+// FNV-1a over the frame addresses
+static uint32_t HashFrames(const uintptr_t* frames, size_t depth) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < depth; ++i) {
+        uintptr_t value = frames[i];
+        for (size_t b = 0; b < sizeof(uintptr_t); ++b) {
+            hash ^= static_cast<uint32_t>((value >> (b * 8)) & 0xFF);
+            hash *= 16777619u;
+        }
+    }
+    return hash;
+}
+
+bool StackSampleTable::Initialize(size_t capacity) {
+    size_t size = 1;
+    while (size < capacity) size <<= 1;
+    try {
+        m_entries.assign(size, Entry());
+    }
+    catch (const std::bad_alloc&) {
+        m_entries.clear();
+        return false;
+    }
+    m_mask = size - 1;
+    m_used = 0;
+    m_totalSamples = 0;
+    m_droppedSamples = 0;
+    return true;
+}
+
+// Count one sample of a stack. Uses linear probing and refuses new stacks
+// once the table is 3/4 full so probe chains stay short.
+bool StackSampleTable::Add(const uintptr_t* frames, size_t depth) {
+    if (m_entries.empty() || depth == 0) {
+        return false;
+    }
+    if (depth > PROFILER_MAX_DEPTH) depth = PROFILER_MAX_DEPTH;
+    m_totalSamples++;
+
+    uint32_t hash = HashFrames(frames, depth);
+    size_t index = hash & m_mask;
+    for (size_t probe = 0; probe <= m_mask; ++probe) {
+        Entry& entry = m_entries[index];
+        if (entry.count == 0) {
+            if (m_used + 1 > (m_entries.size() / 4) * 3) {
+                break; // Table full
+            }
+            entry.hash = hash;
+            entry.depth = static_cast<uint32_t>(depth);
+            memcpy(entry.frames, frames, depth * sizeof(uintptr_t));
+            entry.count = 1;
+            m_used++;
+            return true;
+        }
+        if (entry.hash == hash && entry.depth == depth &&
+            memcmp(entry.frames, frames, depth * sizeof(uintptr_t)) == 0) {
+            entry.count++;
+            return true;
+        }
+        index = (index + 1) & m_mask;
+    }
+    m_droppedSamples++;
+    return false;
+}
+
+// Write "root;...;leaf count" lines, the input format of flamegraph.pl
+void StackSampleTable::WriteFolded(std::ostream& out,
+    const ModuleMap& modules) const {
+    for (const Entry& entry : m_entries) {
+        if (entry.count == 0) {
+            continue;
+        }
+        for (uint32_t i = entry.depth; i > 0; --i) {
+            out << modules.Describe(entry.frames[i - 1]);
+            if (i > 1) out << ';';
+        }
+        out << ' ' << entry.count << '\n';
+    }
+}
+
+// --- Stack Walk ---
+
+// Follow the chain of saved frame pointers from framePointer. Each frame
+// holds the caller's frame pointer, then the return address. Only addresses
+// in [stackLow, stackHigh) are read, so no faults are possible.
+size_t WalkFrameChain(uintptr_t instruction, uintptr_t framePointer,
+    uintptr_t stackLow, uintptr_t stackHigh, uintptr_t* frames,
+    size_t maxDepth) {
+    if (maxDepth == 0) {
+        return 0;
+    }
+    size_t depth = 0;
+    frames[depth++] = instruction;
+
+    uintptr_t frame = framePointer;
+    while (depth < maxDepth && frame >= stackLow &&
+        (frame & (sizeof(uintptr_t) - 1)) == 0 &&
+        frame + 2 * sizeof(uintptr_t) <= stackHigh) {
+        const uintptr_t* slots = reinterpret_cast<const uintptr_t*>(frame);
+        uintptr_t next = slots[0];
+        uintptr_t returnAddress = slots[1];
+        if (returnAddress == 0) {
+            break;
+        }
+        frames[depth++] = returnAddress;
+        if (next <= frame) {
+            break; // Frames must move towards the stack base
+        }
+        frame = next;
+    }
+    return depth;
+}
+
+// --- Main Thread Sampler ---
+
+#ifdef _WIN32
+static StackSampleTable g_sampleTable;
+static HANDLE g_samplerThread = NULL;
+static volatile bool g_samplerStop = false;
+static DWORD g_sampleIntervalMs = 5;
+static size_t g_sampleMaxDepth = 16;
+
+// Walk the EBP frame chain of a suspended thread. Only reads addresses inside
+// the committed part of its stack, so no faults are possible.
+static size_t CaptureStack(const CONTEXT& context, uintptr_t* frames,
+    size_t maxDepth) {
+#ifdef _WIN64
+    frames[0] = static_cast<uintptr_t>(context.Rip);
+    return 1; // x64 code has no frame pointer chain to follow
+#else
+    MEMORY_BASIC_INFORMATION mbi;
+    if (VirtualQuery(reinterpret_cast<LPCVOID>(context.Esp), &mbi,
+        sizeof(mbi)) == 0) {
+        frames[0] = context.Eip;
+        return 1;
+    }
+    return WalkFrameChain(context.Eip, context.Ebp, context.Esp,
+        reinterpret_cast<uintptr_t>(mbi.BaseAddress) + mbi.RegionSize, frames,
+        maxDepth);
+#endif
+}
+
+// Periodically suspend the main thread and record where it is.
+// Nothing here may allocate while the main thread is suspended: it could be
+// holding the heap lock.
+static DWORD WINAPI SamplerThreadProc(LPVOID) {
+    HANDLE mainThread = OpenThread(
+        THREAD_SUSPEND_RESUME | THREAD_GET_CONTEXT | THREAD_QUERY_INFORMATION,
+        FALSE, g_mainThreadId);
+    if (mainThread == NULL) {
+        Log("Error: Sampling profiler could not open the main thread. Error "
+            "code: " + std::to_string(GetLastError()));
+        return 1;
+    }
+
+    uintptr_t frames[PROFILER_MAX_DEPTH];
+    while (!g_samplerStop) {
+        Sleep(g_sampleIntervalMs);
+
+        if (SuspendThread(mainThread) == static_cast<DWORD>(-1)) {
+            break; // Main thread is gone
+        }
+        CONTEXT context = { 0 };
+        context.ContextFlags = CONTEXT_CONTROL;
+        size_t depth = 0;
+        if (GetThreadContext(mainThread, &context)) {
+            depth = CaptureStack(context, frames, g_sampleMaxDepth);
+        }
+        ResumeThread(mainThread);
+
+        if (depth > 0) {
+            g_sampleTable.Add(frames, depth);
+            CounterAdd(COUNTER_PROFILER_SAMPLES, 1);
+        }
+    }
+
+    CloseHandle(mainThread);
+    return 0;
+}
+
+// Start the background sampler if enabled in config
+bool StartSamplingProfiler() {
+    if (!GetConfigBool("SamplingProfilerEnabled", false)) {
+        return false;
+    }
+
+    int interval = GetConfigInt("SamplingProfilerIntervalMs", 5);
+    if (interval < 1) interval = 1;
+    int maxDepth = GetConfigInt("SamplingProfilerMaxDepth", 16);
+    if (maxDepth < 1) maxDepth = 1;
+    if (maxDepth > static_cast<int>(PROFILER_MAX_DEPTH)) {
+        maxDepth = static_cast<int>(PROFILER_MAX_DEPTH);
+    }
+    int tableSize = GetConfigInt("SamplingProfilerTableSize", 16384);
+    if (tableSize < 1024) tableSize = 1024;
+
+    g_sampleIntervalMs = static_cast<DWORD>(interval);
+    g_sampleMaxDepth = static_cast<size_t>(maxDepth);
+    if (!g_sampleTable.Initialize(static_cast<size_t>(tableSize))) {
+        Log("Error: Could not allocate the sampling profiler table.");
+        return false;
+    }
+
+    g_samplerStop = false;
+    g_samplerThread = CreateThread(NULL, 0, SamplerThreadProc, NULL, 0, NULL);
+    if (g_samplerThread == NULL) {
+        Log("Error: Could not start the sampling profiler thread. Error code: " +
+            std::to_string(GetLastError()));
+        return false;
+    }
+    SetThreadPriority(g_samplerThread, THREAD_PRIORITY_TIME_CRITICAL);
+
+    Log("Sampling profiler started (interval " + std::to_string(interval) +
+        " ms, depth " + std::to_string(maxDepth) + ", main thread " +
+        std::to_string(g_mainThreadId) + ").");
+    return true;
+}
+
+// Write the folded stacks. Called at shutdown, with the sampler still
+// running: it is stopped first so the table no longer changes.
+void ShutdownSamplingProfiler() {
+    if (g_samplerThread == NULL) {
+        return;
+    }
+    g_samplerStop = true;
+    WaitForSingleObject(g_samplerThread, 1000);
+    CloseHandle(g_samplerThread);
+    g_samplerThread = NULL;
+
+    ModuleMap modules;
+    modules.Refresh();
+
+    std::string profilePath = g_dllDir + "\\" + PROFILE_FILE;
+    std::ofstream profileFile(profilePath, std::ios::trunc);
+    if (!profileFile.is_open()) {
+        Log("Error: Could not write profile to " + profilePath + ".");
+        return;
+    }
+    g_sampleTable.WriteFolded(profileFile, modules);
+    profileFile.close();
+
+    Log("Sampling profiler wrote " + std::to_string(g_sampleTable.UniqueStacks()) +
+        " unique stacks (" + std::to_string(g_sampleTable.TotalSamples()) +
+        " samples, " + std::to_string(g_sampleTable.DroppedSamples()) +
+        " dropped) to " + profilePath + ".");
+}
+#endif
@@ -0,0 +1,45 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "pch.h"
+#include "modulemap.h"
+
+const size_t PROFILER_MAX_DEPTH = 32;
+
+// Fixed-capacity hash table of sampled call stacks. Memory is allocated once
+// up front so samples can be recorded without touching the heap.
+class StackSampleTable {
+public:
+    bool Initialize(size_t capacity); // Rounded up to a power of two
+    bool Add(const uintptr_t* frames, size_t depth); // frames[0] = leaf
+    void WriteFolded(std::ostream& out, const ModuleMap& modules) const;
+
+    uint64_t TotalSamples() const { return m_totalSamples; }
+    uint64_t DroppedSamples() const { return m_droppedSamples; }
+    size_t UniqueStacks() const { return m_used; }
+
+private:
+    struct Entry {
+        uint64_t count; // 0 = empty slot
+        uint32_t hash;
+        uint32_t depth;
+        uintptr_t frames[PROFILER_MAX_DEPTH];
+    };
+
+    std::vector<Entry> m_entries;
+    size_t m_mask = 0;
+    size_t m_used = 0;
+    uint64_t m_totalSamples = 0;
+    uint64_t m_droppedSamples = 0;
+};
+
+// Function declarations
+size_t WalkFrameChain(uintptr_t instruction, uintptr_t framePointer,
+    uintptr_t stackLow, uintptr_t stackHigh, uintptr_t* frames,
+    size_t maxDepth);
+#ifdef _WIN32
+bool StartSamplingProfiler();
+void ShutdownSamplingProfiler();
+#endif
+
+#endif // PROFILER_H
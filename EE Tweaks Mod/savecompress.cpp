@@ -0,0 +1,979 @@
+#include "pch.h"
+#include "lz4block.h"
+#include "savecompress.h"
+
+#ifdef _WIN32
+#include "globals.h"
+#include "logging.h" // Access Log()
+#include "config.h"  // Access config functions
+#include "counters.h"
+#else
+#include <unistd.h>
+#include <sys/stat.h>
+#include <cerrno>
+#endif
+
+// --- File Format ---
+// Little-endian. Header: "EELZ", version (u32), block size (u32) and FNV-1a
+// of those 12 bytes (u32). Files without a valid header are plain files.
+// Then block payloads in the order they were written: an LZ4 block, or the
+// plain bytes where compression does not help. A block that is rewritten
+// gets a new payload at the end unless it fits where its last one from the
+// same session is. Space left unused is reclaimed by copying the live
+// payloads to a new file, which then replaces the old one.
+// After the payloads, the index: "EELI", block count (u32), file size (u64)
+// and per block its payload offset (u64, 0 = all zeros), payload size (u32,
+// top bit set = stored uncompressed) and FNV-1a of its bytes (u32). Trailer:
+// index offset (u64), index size (u32) and "EELZ". A file with a header but
+// no valid trailer was never finished and is reported as damaged.
+
+static const char FILE_MAGIC[4] = { 'E', 'E', 'L', 'Z' };
+static const char INDEX_MAGIC[4] = { 'E', 'E', 'L', 'I' };
+static const uint32_t FILE_VERSION = 2;
+static const uint32_t STORED_FLAG = 0x80000000u;
+static const uint32_t INDEX_HEADER_SIZE = 16;
+static const uint32_t INDEX_ENTRY_SIZE = 16;
+static const uint32_t MIN_BLOCK_SIZE = 4096;
+static const uint32_t MAX_BLOCK_SIZE = 16 * 1024 * 1024;
+
+static void PutU32(unsigned char* p, uint32_t value) {
+    for (int i = 0; i < 4; ++i) p[i] = static_cast<unsigned char>(value >> (i * 8));
+}
+
+static void PutU64(unsigned char* p, uint64_t value) {
+    PutU32(p, static_cast<uint32_t>(value & 0xFFFFFFFF));
+    PutU32(p + 4, static_cast<uint32_t>(value >> 32));
+}
+
+static uint32_t GetU32(const unsigned char* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+static uint64_t GetU64(const unsigned char* p) {
+    return GetU32(p) | (static_cast<uint64_t>(GetU32(p + 4)) << 32);
+}
+
+static uint32_t HashBytes(const unsigned char* data, size_t size) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static uint64_t MicrosSince(std::chrono::steady_clock::time_point start) {
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count());
+}
+
+// --- Platform File Access ---
+// Positional, so the file position of the handle does not matter
+
+#ifdef _WIN32
+// These go to the real functions: only the game executable's imports are
+// hooked
+static bool NativeReadAt(NativeFile file, uint64_t offset, void* buffer,
+    uint32_t size) {
+    OVERLAPPED overlapped = { 0 };
+    overlapped.Offset = static_cast<DWORD>(offset & 0xFFFFFFFF);
+    overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+    DWORD count = 0;
+    return ReadFile(file, buffer, size, &count, &overlapped) && count == size;
+}
+
+static bool NativeWriteAt(NativeFile file, uint64_t offset, const void* data,
+    uint32_t size) {
+    OVERLAPPED overlapped = { 0 };
+    overlapped.Offset = static_cast<DWORD>(offset & 0xFFFFFFFF);
+    overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+    DWORD count = 0;
+    return WriteFile(file, data, size, &count, &overlapped) && count == size;
+}
+
+static bool NativeSize(NativeFile file, uint64_t& size) {
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize)) {
+        return false;
+    }
+    size = static_cast<uint64_t>(fileSize.QuadPart);
+    return true;
+}
+
+#else
+static bool NativeReadAt(NativeFile file, uint64_t offset, void* buffer,
+    uint32_t size) {
+    unsigned char* bytes = static_cast<unsigned char*>(buffer);
+    while (size > 0) {
+        ssize_t count = pread(file, bytes, size, static_cast<off_t>(offset));
+        if (count < 0 && errno == EINTR) continue;
+        if (count <= 0) return false;
+        bytes += count;
+        offset += static_cast<uint64_t>(count);
+        size -= static_cast<uint32_t>(count);
+    }
+    return true;
+}
+
+static bool NativeWriteAt(NativeFile file, uint64_t offset, const void* data,
+    uint32_t size) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    while (size > 0) {
+        ssize_t count = pwrite(file, bytes, size, static_cast<off_t>(offset));
+        if (count < 0 && errno == EINTR) continue;
+        if (count <= 0) return false;
+        bytes += count;
+        offset += static_cast<uint64_t>(count);
+        size -= static_cast<uint32_t>(count);
+    }
+    return true;
+}
+
+static bool NativeSize(NativeFile file, uint64_t& size) {
+    struct stat info;
+    if (fstat(file, &info) != 0) {
+        return false;
+    }
+    size = static_cast<uint64_t>(info.st_size);
+    return true;
+}
+#endif
+
+static bool IsValidHeader(const unsigned char* header) {
+    return memcmp(header, FILE_MAGIC, sizeof(FILE_MAGIC)) == 0 &&
+        GetU32(header + 12) == HashBytes(header, 12);
+}
+
+// --- Compressed File ---
+
+CompressedFile::CompressedFile(NativeFile file, uint32_t blockSize)
+    : m_file(file), m_blockSize(blockSize) {
+    if (m_blockSize < MIN_BLOCK_SIZE) m_blockSize = MIN_BLOCK_SIZE;
+    if (m_blockSize > MAX_BLOCK_SIZE) m_blockSize = MAX_BLOCK_SIZE;
+}
+
+bool CompressedFile::IsCompressed(NativeFile file) {
+    uint64_t size = 0;
+    if (!NativeSize(file, size) || size < COMPRESSED_FILE_HEADER_SIZE) {
+        return false;
+    }
+    unsigned char header[COMPRESSED_FILE_HEADER_SIZE];
+    return NativeReadAt(file, 0, header, sizeof(header)) &&
+        IsValidHeader(header);
+}
+
+bool CompressedFile::Create() {
+    unsigned char header[COMPRESSED_FILE_HEADER_SIZE] = { 0 };
+    memcpy(header, FILE_MAGIC, sizeof(FILE_MAGIC));
+    PutU32(header + 4, FILE_VERSION);
+    PutU32(header + 8, m_blockSize);
+    PutU32(header + 12, HashBytes(header, 12));
+    if (!NativeWriteAt(m_file, 0, header, sizeof(header))) {
+        return false;
+    }
+    m_index.clear();
+    m_size = 0;
+    m_position = 0;
+    m_appendOffset = COMPRESSED_FILE_HEADER_SIZE;
+    m_sessionStart = m_appendOffset;
+    m_indexDirty = true; // Even an empty file needs its index
+    return true;
+}
+
+bool CompressedFile::Open() {
+    uint64_t fileSize = 0;
+    unsigned char header[COMPRESSED_FILE_HEADER_SIZE];
+    unsigned char trailer[COMPRESSED_FILE_TRAILER_SIZE];
+    if (!NativeSize(m_file, fileSize) ||
+        !NativeReadAt(m_file, 0, header, sizeof(header))) {
+        return false;
+    }
+    // Too short for an index: never finished
+    if (fileSize < COMPRESSED_FILE_HEADER_SIZE + INDEX_HEADER_SIZE +
+        COMPRESSED_FILE_TRAILER_SIZE) {
+        m_corrupt = true;
+        return false;
+    }
+    if (!NativeReadAt(m_file, fileSize - sizeof(trailer), trailer,
+        sizeof(trailer))) {
+        return false;
+    }
+    uint32_t blockSize = GetU32(header + 8);
+    uint64_t indexOffset = GetU64(trailer);
+    uint32_t indexSize = GetU32(trailer + 8);
+    if (!IsValidHeader(header) || GetU32(header + 4) != FILE_VERSION ||
+        blockSize < MIN_BLOCK_SIZE || blockSize > MAX_BLOCK_SIZE ||
+        memcmp(trailer + 12, FILE_MAGIC, sizeof(FILE_MAGIC)) != 0 ||
+        indexOffset < COMPRESSED_FILE_HEADER_SIZE ||
+        indexSize < INDEX_HEADER_SIZE ||
+        indexOffset + indexSize + sizeof(trailer) != fileSize) {
+        m_corrupt = true;
+        return false;
+    }
+
+    std::vector<unsigned char> index(indexSize);
+    if (!NativeReadAt(m_file, indexOffset, index.data(), indexSize)) {
+        return false;
+    }
+    uint32_t count = GetU32(index.data() + 4);
+    uint64_t size = GetU64(index.data() + 8);
+    uint64_t neededBlocks = (size + blockSize - 1) / blockSize;
+    if (memcmp(index.data(), INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0 ||
+        count != neededBlocks ||
+        indexSize != INDEX_HEADER_SIZE +
+        static_cast<uint64_t>(count) * INDEX_ENTRY_SIZE) {
+        m_corrupt = true;
+        return false;
+    }
+
+    size_t maxPayload = Lz4CompressBound(blockSize);
+    m_index.resize(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        const unsigned char* p = index.data() + INDEX_HEADER_SIZE +
+            static_cast<size_t>(i) * INDEX_ENTRY_SIZE;
+        BlockEntry& entry = m_index[i];
+        entry.offset = GetU64(p);
+        entry.entry = GetU32(p + 8);
+        entry.checksum = GetU32(p + 12);
+        uint32_t payload = entry.entry & ~STORED_FLAG;
+        if (entry.offset != 0 && (entry.offset < COMPRESSED_FILE_HEADER_SIZE ||
+            payload > maxPayload || entry.offset + payload > indexOffset)) {
+            m_corrupt = true;
+            return false;
+        }
+    }
+
+    m_blockSize = blockSize;
+    m_size = size;
+    m_position = 0;
+    m_appendOffset = fileSize; // Changes go after the current index
+    m_sessionStart = fileSize;
+    m_indexDirty = false;
+    return true;
+}
+
+// Make m_block hold block index, decompressed and zero-filled past the end
+// of the file
+bool CompressedFile::LoadBlock(uint64_t index) {
+    if (index == m_blockIndex) {
+        return true;
+    }
+    if (!StoreBlock()) {
+        return false;
+    }
+    if (m_block.size() != m_blockSize) {
+        try {
+            m_block.resize(m_blockSize);
+        }
+        catch (const std::bad_alloc&) {
+            return false;
+        }
+    }
+
+    uint64_t blockStart = index * m_blockSize;
+    size_t valid = 0;
+    if (index < m_index.size() && m_index[index].offset != 0) {
+        const BlockEntry& entry = m_index[index];
+        uint32_t payload = entry.entry & ~STORED_FLAG;
+        auto start = std::chrono::steady_clock::now();
+        if ((entry.entry & STORED_FLAG) != 0) {
+            if (payload > m_blockSize ||
+                !NativeReadAt(m_file, entry.offset, m_block.data(), payload)) {
+                m_corrupt = payload > m_blockSize;
+                return false;
+            }
+            valid = payload;
+        }
+        else {
+            m_packed.resize(Lz4CompressBound(m_blockSize));
+            if (!NativeReadAt(m_file, entry.offset, m_packed.data(), payload)) {
+                return false;
+            }
+            long long unpacked = Lz4DecompressBlock(m_packed.data(), payload,
+                m_block.data(), m_block.size());
+            if (unpacked < 0) {
+                m_corrupt = true;
+                return false;
+            }
+            valid = static_cast<size_t>(unpacked);
+        }
+        if (HashBytes(m_block.data(), valid) != entry.checksum) {
+            m_corrupt = true;
+            return false;
+        }
+        m_codecMicros += MicrosSince(start);
+    }
+    // A truncated file can leave old bytes in the last payload
+    if (blockStart + valid > m_size) {
+        valid = m_size > blockStart ? static_cast<size_t>(m_size - blockStart) : 0;
+    }
+    memset(m_block.data() + valid, 0, m_block.size() - valid);
+    m_blockIndex = index;
+    m_blockDirty = false;
+    return true;
+}
+
+// Append the block being edited as a new payload
+bool CompressedFile::StoreBlock() {
+    if (!m_blockDirty) {
+        return true;
+    }
+    uint64_t blockStart = m_blockIndex * m_blockSize;
+    size_t length = m_size - blockStart < m_blockSize ?
+        static_cast<size_t>(m_size - blockStart) : m_blockSize;
+
+    auto start = std::chrono::steady_clock::now();
+    m_packed.resize(Lz4CompressBound(m_blockSize));
+    size_t packedSize = Lz4CompressBlock(m_block.data(), length,
+        m_packed.data(), m_packed.size());
+    BlockEntry entry;
+    entry.offset = m_appendOffset;
+    entry.checksum = HashBytes(m_block.data(), length);
+    const BlockEntry* previous = m_blockIndex < m_index.size() ?
+        &m_index[static_cast<size_t>(m_blockIndex)] : nullptr;
+    const unsigned char* payload = m_packed.data();
+    if (packedSize == 0 || packedSize >= length) {
+        entry.entry = static_cast<uint32_t>(length) | STORED_FLAG;
+        payload = m_block.data();
+        packedSize = length;
+    }
+    else {
+        entry.entry = static_cast<uint32_t>(packedSize);
+    }
+    m_codecMicros += MicrosSince(start);
+
+    // A payload written since the file was opened is in no index on disk,
+    // so it can be overwritten if the new one fits
+    bool inPlace = previous != nullptr && previous->offset >= m_sessionStart &&
+        packedSize <= (previous->entry & ~STORED_FLAG);
+    if (inPlace) {
+        entry.offset = previous->offset;
+    }
+    if (!NativeWriteAt(m_file, entry.offset, payload,
+        static_cast<uint32_t>(packedSize))) {
+        return false; // Still dirty: the next flush tries again
+    }
+    if (m_index.size() <= m_blockIndex) {
+        m_index.resize(static_cast<size_t>(m_blockIndex) + 1, BlockEntry());
+    }
+    m_index[static_cast<size_t>(m_blockIndex)] = entry;
+    if (!inPlace) {
+        m_appendOffset += packedSize;
+    }
+    m_blockDirty = false;
+    return true;
+}
+
+// Bytes of payload the index still refers to
+uint64_t CompressedFile::LiveBytes() const {
+    uint64_t live = 0;
+    for (const BlockEntry& entry : m_index) {
+        if (entry.offset != 0) live += entry.entry & ~STORED_FLAG;
+    }
+    return live;
+}
+
+// Append the index and trailer after the payloads
+bool CompressedFile::WriteIndex() {
+    size_t indexSize = INDEX_HEADER_SIZE + m_index.size() * INDEX_ENTRY_SIZE;
+    std::vector<unsigned char> index(indexSize + COMPRESSED_FILE_TRAILER_SIZE);
+    memcpy(index.data(), INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    PutU32(index.data() + 4, static_cast<uint32_t>(m_index.size()));
+    PutU64(index.data() + 8, m_size);
+    unsigned char* p = index.data() + INDEX_HEADER_SIZE;
+    for (const BlockEntry& entry : m_index) {
+        PutU64(p, entry.offset);
+        PutU32(p + 8, entry.entry);
+        PutU32(p + 12, entry.checksum);
+        p += INDEX_ENTRY_SIZE;
+    }
+    PutU64(p, m_appendOffset);
+    PutU32(p + 8, static_cast<uint32_t>(indexSize));
+    memcpy(p + 12, FILE_MAGIC, sizeof(FILE_MAGIC));
+
+    if (!NativeWriteAt(m_file, m_appendOffset, index.data(),
+        static_cast<uint32_t>(index.size()))) {
+        return false;
+    }
+    m_appendOffset += index.size();
+    return true;
+}
+
+// Rewriting the whole file for a little unused space costs more than it
+// saves; more than an eighth is reclaimed
+bool CompressedFile::NeedsCompacting() const {
+    if (m_indexDirty || m_corrupt || m_appendOffset == 0) {
+        return false;
+    }
+    uint64_t live = LiveBytes() + INDEX_HEADER_SIZE +
+        m_index.size() * INDEX_ENTRY_SIZE + COMPRESSED_FILE_TRAILER_SIZE;
+    uint64_t used = COMPRESSED_FILE_HEADER_SIZE + live;
+    return m_appendOffset > used && m_appendOffset - used > live / 8;
+}
+
+// Copy the payloads the index refers to, in file order, then the index.
+// This file is only read, so it stays valid whatever happens to target.
+bool CompressedFile::CompactTo(NativeFile target) {
+    if (m_indexDirty || m_corrupt) {
+        return false;
+    }
+    CompressedFile copy(target, m_blockSize);
+    if (!copy.Create()) {
+        return false;
+    }
+    std::vector<size_t> order;
+    for (size_t i = 0; i < m_index.size(); ++i) {
+        if (m_index[i].offset != 0) order.push_back(i);
+    }
+    std::sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+        return m_index[a].offset < m_index[b].offset;
+    });
+    copy.m_index = m_index;
+    for (size_t i : order) {
+        BlockEntry& entry = copy.m_index[i];
+        uint32_t payload = entry.entry & ~STORED_FLAG;
+        m_packed.resize(payload);
+        if (!NativeReadAt(m_file, entry.offset, m_packed.data(), payload) ||
+            !NativeWriteAt(target, copy.m_appendOffset, m_packed.data(),
+                payload)) {
+            return false;
+        }
+        entry.offset = copy.m_appendOffset;
+        copy.m_appendOffset += payload;
+    }
+    copy.m_size = m_size;
+    return copy.WriteIndex();
+}
+
+bool CompressedFile::Read(void* buffer, uint32_t size, uint32_t& bytesRead) {
+    bytesRead = 0;
+    uint64_t available = m_position < m_size ? m_size - m_position : 0;
+    uint32_t remaining = available < size ? static_cast<uint32_t>(available) : size;
+    unsigned char* out = static_cast<unsigned char*>(buffer);
+    uint32_t copied = 0;
+    while (copied < remaining) {
+        uint64_t position = m_position + copied;
+        if (!LoadBlock(position / m_blockSize)) {
+            return false;
+        }
+        size_t offset = static_cast<size_t>(position % m_blockSize);
+        uint32_t chunk = m_blockSize - static_cast<uint32_t>(offset);
+        if (chunk > remaining - copied) chunk = remaining - copied;
+        memcpy(out + copied, m_block.data() + offset, chunk);
+        copied += chunk;
+    }
+    m_position += copied;
+    bytesRead = copied;
+    return true;
+}
+
+bool CompressedFile::Write(const void* data, uint32_t size) {
+    const unsigned char* in = static_cast<const unsigned char*>(data);
+    uint32_t written = 0;
+    while (written < size) {
+        uint64_t position = m_position + written;
+        uint64_t index = position / m_blockSize;
+        size_t offset = static_cast<size_t>(position % m_blockSize);
+        uint32_t chunk = m_blockSize - static_cast<uint32_t>(offset);
+        if (chunk > size - written) chunk = size - written;
+
+        if (offset == 0 && chunk == m_blockSize && index != m_blockIndex) {
+            // Replaces the whole block: no need to load it
+            if (!StoreBlock()) {
+                return false;
+            }
+            m_block.resize(m_blockSize);
+            m_blockIndex = index;
+        }
+        else if (!LoadBlock(index)) {
+            return false;
+        }
+        memcpy(m_block.data() + offset, in + written, chunk);
+        m_blockDirty = true;
+        m_indexDirty = true;
+        written += chunk;
+        if (position + chunk > m_size) m_size = position + chunk;
+    }
+    m_position += written;
+    return true;
+}
+
+bool CompressedFile::Seek(int64_t distance, SeekOrigin origin,
+    uint64_t& newPosition) {
+    int64_t base = 0;
+    if (origin == SEEK_FROM_CURRENT) base = static_cast<int64_t>(m_position);
+    else if (origin == SEEK_FROM_END) base = static_cast<int64_t>(m_size);
+    int64_t target = base + distance;
+    if (target < 0) {
+        return false;
+    }
+    m_position = static_cast<uint64_t>(target); // Past EOF is allowed
+    newPosition = m_position;
+    return true;
+}
+
+bool CompressedFile::Truncate() {
+    if (m_position == m_size) {
+        return true;
+    }
+    uint64_t blocks = (m_position + m_blockSize - 1) / m_blockSize;
+    if (m_blockIndex != UINT64_MAX && m_blockIndex >= blocks) {
+        m_blockIndex = UINT64_MAX; // Beyond the new end: drop it
+        m_blockDirty = false;
+    }
+    if (m_index.size() > blocks) {
+        m_index.resize(static_cast<size_t>(blocks));
+    }
+    bool shrinking = m_position < m_size;
+    m_size = m_position;
+    m_indexDirty = true;
+
+    // The block holding the new end is rewritten without the cut bytes, so
+    // they do not come back if the file grows again
+    size_t keep = static_cast<size_t>(m_position % m_blockSize);
+    if (shrinking && keep != 0) {
+        if (!LoadBlock(m_position / m_blockSize)) {
+            return false;
+        }
+        memset(m_block.data() + keep, 0, m_block.size() - keep);
+        m_blockDirty = true;
+    }
+    return true;
+}
+
+bool CompressedFile::Flush() {
+    return StoreBlock();
+}
+
+bool CompressedFile::Close() {
+    if (!StoreBlock()) {
+        return false;
+    }
+    if (!m_indexDirty) {
+        return true;
+    }
+
+    uint64_t count = (m_size + m_blockSize - 1) / m_blockSize;
+    m_index.resize(static_cast<size_t>(count), BlockEntry());
+    // Nothing before the new index is touched, so until it is written the
+    // file still opens with the last one
+    if (!WriteIndex()) {
+        return false;
+    }
+    m_sessionStart = m_appendOffset;
+    m_indexDirty = false;
+    return true;
+}
+
+// --- File API Integration ---
+
+#ifdef _WIN32
+struct CompressedHandle {
+    std::unique_ptr<CompressedFile> file;
+    std::string path;
+};
+
+static bool g_saveCompressionEnabled = false;
+static std::atomic<size_t> g_openCompressedFiles{ 0 };
+static std::vector<std::string> g_savePaths; // Lowercase path fragments
+static uint32_t g_saveBlockSize = 64 * 1024;
+static std::mutex g_saveMutex;
+static std::map<HANDLE, CompressedHandle> g_compressedFiles;
+static uint64_t g_savesWritten = 0;
+static uint64_t g_savesRead = 0;
+static uint64_t g_plainSavesRead = 0;
+
+static bool IsSavePath(const char* path) {
+    if (path == nullptr) {
+        return false;
+    }
+    std::string lowerPath = path;
+    std::transform(lowerPath.begin(), lowerPath.end(), lowerPath.begin(),
+        [](unsigned char c) { return static_cast<char>(tolower(c)); });
+    std::replace(lowerPath.begin(), lowerPath.end(), '/', '\\');
+    for (const std::string& fragment : g_savePaths) {
+        if (lowerPath.find(fragment) != std::string::npos) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// The error a failed call on a compressed handle reports
+static void SetCompressedFileError(const CompressedFile& file) {
+    if (file.Corrupt()) {
+        SetLastError(ERROR_FILE_CORRUPT);
+    }
+}
+
+bool InitializeSaveCompression() {
+    if (!GetConfigBool("SaveCompressionEnabled", false)) {
+        return false;
+    }
+    std::stringstream paths(GetConfigString("SaveCompressionPaths",
+        "saved games"));
+    std::string fragment;
+    while (std::getline(paths, fragment, ',')) {
+        fragment = Trim(fragment);
+        if (fragment.empty()) {
+            continue;
+        }
+        std::transform(fragment.begin(), fragment.end(), fragment.begin(),
+            [](unsigned char c) { return static_cast<char>(tolower(c)); });
+        std::replace(fragment.begin(), fragment.end(), '/', '\\');
+        g_savePaths.push_back(fragment);
+    }
+    if (g_savePaths.empty()) {
+        Log("Warning: SaveCompressionPaths is empty. Save compression is "
+            "disabled.");
+        return false;
+    }
+
+    int blockKB = GetConfigInt("SaveCompressionBlockKB", 64);
+    if (blockKB < 16) blockKB = 16;
+    if (blockKB > 1024) blockKB = 1024;
+    g_saveBlockSize = static_cast<uint32_t>(blockKB) * 1024;
+    g_saveCompressionEnabled = true;
+    Log("Save compression enabled (" + std::to_string(blockKB) +
+        " KB blocks).");
+    return true;
+}
+
+// The access to open a file with. Compressed files are also read while
+// being written (to edit a block again), so write-only opens get read
+// access too.
+DWORD SaveCompressionAccess(const char* path, DWORD access, DWORD flags) {
+    if (!g_saveCompressionEnabled || (access & GENERIC_WRITE) == 0 ||
+        (flags & FILE_FLAG_OVERLAPPED) != 0 || !IsSavePath(path)) {
+        return access;
+    }
+    return access | GENERIC_READ;
+}
+
+// Attach a compressed save, or an empty file opened for writing. Plain saves are left alone. access is what the handle was
+// actually opened with.
+bool SaveCompressionOnOpen(HANDLE file, const char* path, DWORD access,
+    DWORD flags) {
+    if (!g_saveCompressionEnabled || file == INVALID_HANDLE_VALUE ||
+        (access & GENERIC_READ) == 0 ||
+        (flags & (FILE_FLAG_OVERLAPPED | FILE_FLAG_NO_BUFFERING)) != 0 ||
+        !IsSavePath(path)) {
+        return false;
+    }
+
+    std::unique_ptr<CompressedFile> compressed(
+        new CompressedFile(file, g_saveBlockSize));
+    uint64_t size = 0;
+    LARGE_INTEGER fileSize;
+    if (GetFileSizeEx(file, &fileSize)) {
+        size = static_cast<uint64_t>(fileSize.QuadPart);
+    }
+    if (CompressedFile::IsCompressed(file)) {
+        if (!compressed->Open()) {
+            Log("Error: Save compression could not read the index of " +
+                std::string(path) + (compressed->Corrupt() ?
+                    " (file is damaged or was never finished)." : "."));
+            return false; // The game sees the raw file and rejects it
+        }
+    }
+    else if (size == 0 && (access & GENERIC_WRITE) != 0) {
+        if (!compressed->Create()) {
+            Log("Error: Save compression could not start " +
+                std::string(path) + ". Error code: " +
+                std::to_string(GetLastError()));
+            return false;
+        }
+    }
+    else {
+        if (size > 0 && (access & GENERIC_WRITE) == 0) {
+            g_plainSavesRead++;
+        }
+        return false; // Plain file: passed through
+    }
+
+    std::lock_guard<std::mutex> lock(g_saveMutex);
+    CompressedHandle& handle = g_compressedFiles[file]; // Replaces a stale entry
+    if (!handle.file) {
+        g_openCompressedFiles++;
+    }
+    handle.file = std::move(compressed);
+    handle.path = path;
+    return true;
+}
+
+// Serve a ReadFile call. Returns false if the handle is not compressed, in
+// which case the caller goes on with its other handling.
+bool SaveCompressionOnRead(HANDLE file, LPVOID buffer, DWORD bytesToRead,
+    LPDWORD bytesRead, LPOVERLAPPED overlapped, BOOL& result) {
+    if (g_openCompressedFiles == 0) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(g_saveMutex);
+    auto it = g_compressedFiles.find(file);
+    if (it == g_compressedFiles.end()) {
+        return false;
+    }
+    CompressedFile& compressed = *it->second.file;
+
+    if (overlapped != NULL) {
+        // Synchronous handle: the read starts at the given offset
+        uint64_t position = 0;
+        compressed.Seek(static_cast<int64_t>(overlapped->Offset |
+            (static_cast<uint64_t>(overlapped->OffsetHigh) << 32)),
+            SEEK_FROM_BEGIN, position);
+    }
+    else if (bytesRead == NULL) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        result = FALSE;
+        return true;
+    }
+
+    uint32_t served = 0;
+    bool ok = compressed.Read(buffer, bytesToRead, served);
+    if (bytesRead != NULL) *bytesRead = served;
+    if (overlapped != NULL) {
+        overlapped->Internal = 0;
+        overlapped->InternalHigh = served;
+    }
+    if (ok) {
+        SetLastError(NO_ERROR);
+    }
+    else {
+        SetCompressedFileError(compressed);
+        Log("Error: Save compression could not read " + it->second.path +
+            ". Error code: " + std::to_string(GetLastError()));
+    }
+    result = ok ? TRUE : FALSE;
+    return true;
+}
+
+bool SaveCompressionOnWrite(HANDLE file, LPCVOID buffer, DWORD bytesToWrite,
+    LPDWORD bytesWritten, LPOVERLAPPED overlapped, BOOL& result) {
+    if (g_openCompressedFiles == 0) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(g_saveMutex);
+    auto it = g_compressedFiles.find(file);
+    if (it == g_compressedFiles.end()) {
+        return false;
+    }
+    CompressedFile& compressed = *it->second.file;
+
+    if (overlapped != NULL) {
+        uint64_t position = 0;
+        compressed.Seek(static_cast<int64_t>(overlapped->Offset |
+            (static_cast<uint64_t>(overlapped->OffsetHigh) << 32)),
+            SEEK_FROM_BEGIN, position);
+    }
+    else if (bytesWritten == NULL) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        result = FALSE;
+        return true;
+    }
+
+    bool ok = compressed.Write(buffer, bytesToWrite);
+    DWORD written = ok ? bytesToWrite : 0;
+    if (bytesWritten != NULL) *bytesWritten = written;
+    if (overlapped != NULL) {
+        overlapped->Internal = 0;
+        overlapped->InternalHigh = written;
+    }
+    if (ok) {
+        SetLastError(NO_ERROR);
+    }
+    else {
+        SetCompressedFileError(compressed);
+    }
+    result = ok ? TRUE : FALSE;
+    return true;
+}
+
+// Move a compressed file's position. Returns false if the handle is not
+// compressed.
+bool SaveCompressionOnSeek(HANDLE file, LONGLONG distance, DWORD moveMethod,
+    LONGLONG& newPosition, bool& success) {
+    if (g_openCompressedFiles == 0 || moveMethod > FILE_END) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(g_saveMutex);
+    auto it = g_compressedFiles.find(file);
+    if (it == g_compressedFiles.end()) {
+        return false;
+    }
+    uint64_t position = it->second.file->Position();
+    success = it->second.file->Seek(distance,
+        static_cast<SeekOrigin>(moveMethod), position);
+    newPosition = static_cast<LONGLONG>(position);
+    SetLastError(success ? NO_ERROR : ERROR_NEGATIVE_SEEK);
+    return true;
+}
+
+// The size the game sees: uncompressed
+bool SaveCompressionGetSize(HANDLE file, uint64_t& size) {
+    if (g_openCompressedFiles == 0) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(g_saveMutex);
+    auto it = g_compressedFiles.find(file);
+    if (it == g_compressedFiles.end()) {
+        return false;
+    }
+    size = it->second.file->Size();
+    SetLastError(NO_ERROR);
+    return true;
+}
+
+bool SaveCompressionOnSetEndOfFile(HANDLE file, BOOL& result) {
+    if (g_openCompressedFiles == 0) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(g_saveMutex);
+    auto it = g_compressedFiles.find(file);
+    if (it == g_compressedFiles.end()) {
+        return false;
+    }
+    result = it->second.file->Truncate() ? TRUE : FALSE;
+    return true;
+}
+
+// Writes out the block being edited. The index is only written on close,
+// so a save is complete once the game closes it.
+bool SaveCompressionOnFlush(HANDLE file, BOOL& result) {
+    if (g_openCompressedFiles == 0) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(g_saveMutex);
+    auto it = g_compressedFiles.find(file);
+    if (it == g_compressedFiles.end()) {
+        return false;
+    }
+    result = it->second.file->Flush() ? TRUE : FALSE;
+    return true;
+}
+
+// Finish a compressed file and log what compression did for it. Returns
+// false, with the error set, if it could not be finished.
+static bool FinishCompressedFile(CompressedHandle& handle) {
+    CompressedFile& compressed = *handle.file;
+    bool modified = compressed.Modified();
+    if (!compressed.Close()) {
+        SetCompressedFileError(compressed);
+        DWORD error = GetLastError();
+        Log("Error: Save compression could not finish " + handle.path +
+            ". Error code: " + std::to_string(error));
+        SetLastError(error);
+        return false;
+    }
+
+    uint64_t size = compressed.Size();
+    uint64_t stored = compressed.StoredBytes();
+    uint64_t percent = size > 0 ? stored * 100 / size : 100;
+    std::string timing = std::to_string(compressed.CodecMicros() / 1000) + " ms";
+    if (modified) {
+        g_savesWritten++;
+        CounterAdd(COUNTER_SAVE_BYTES, size);
+        CounterAdd(COUNTER_SAVE_STORED_BYTES, stored);
+        Log("Save compression: wrote " + handle.path + ", " +
+            std::to_string(size / 1024) + " KB stored in " +
+            std::to_string(stored / 1024) + " KB (" + std::to_string(percent) +
+            "%), " + timing + " compressing.");
+    }
+    else {
+        g_savesRead++;
+        Log("Save compression: read " + handle.path + " (" +
+            std::to_string(size / 1024) + " KB, " + std::to_string(percent) +
+            "% on disk), " + timing + " decompressing.");
+    }
+    return true;
+}
+
+bool SaveCompressionOnClose(HANDLE file, std::string& compactPath) {
+    compactPath.clear();
+    if (g_openCompressedFiles == 0) {
+        return true;
+    }
+    std::lock_guard<std::mutex> lock(g_saveMutex);
+    auto it = g_compressedFiles.find(file);
+    if (it == g_compressedFiles.end()) {
+        return true;
+    }
+    bool finished = FinishCompressedFile(it->second);
+    if (finished && it->second.file->NeedsCompacting()) {
+        compactPath = it->second.path;
+    }
+    g_compressedFiles.erase(it);
+    g_openCompressedFiles--;
+    return finished;
+}
+
+// Copy the live blocks of a closed save to a file next to it and move that
+// over the save. Until the move, the save is untouched and valid; if any
+// step fails, the copy is deleted and the save keeps its unused space.
+void SaveCompressionCompact(const std::string& path) {
+    std::string compactPath = path + ".compact";
+    HANDLE source = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+        NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (source == INVALID_HANDLE_VALUE) {
+        Log("Warning: Save compression could not reopen " + path +
+            " to compact it. Error code: " + std::to_string(GetLastError()));
+        return;
+    }
+    HANDLE target = CreateFileA(compactPath.c_str(),
+        GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+        FILE_ATTRIBUTE_NORMAL, NULL);
+    if (target == INVALID_HANDLE_VALUE) {
+        Log("Warning: Save compression could not create " + compactPath +
+            ". Error code: " + std::to_string(GetLastError()));
+        CloseHandle(source);
+        return;
+    }
+
+    CompressedFile compressed(source, g_saveBlockSize);
+    uint64_t before = 0;
+    LARGE_INTEGER size;
+    if (GetFileSizeEx(source, &size)) {
+        before = static_cast<uint64_t>(size.QuadPart);
+    }
+    bool copied = compressed.Open() && compressed.CompactTo(target) &&
+        FlushFileBuffers(target);
+    uint64_t after = 0;
+    if (copied && GetFileSizeEx(target, &size)) {
+        after = static_cast<uint64_t>(size.QuadPart);
+    }
+    DWORD error = GetLastError();
+    CloseHandle(target);
+    CloseHandle(source);
+    if (copied && MoveFileExA(compactPath.c_str(), path.c_str(),
+        MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+        Log("Save compression: compacted " + path + " from " +
+            std::to_string(before / 1024) + " KB to " +
+            std::to_string(after / 1024) + " KB.");
+        return;
+    }
+    if (copied) {
+        error = GetLastError();
+    }
+    DeleteFileA(compactPath.c_str());
+    Log("Warning: Save compression could not compact " + path +
+        ". Error code: " + std::to_string(error));
+}
+
+// Finish files the game never closed and log the totals. Called on process
+// detach. They are not compacted: the game still holds them open.
+void ShutdownSaveCompression() {
+    if (!g_saveCompressionEnabled) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(g_saveMutex);
+    for (auto& entry : g_compressedFiles) {
+        FinishCompressedFile(entry.second);
+    }
+    g_compressedFiles.clear();
+    g_openCompressedFiles = 0;
+    Log("Save compression: " + std::to_string(g_savesWritten) +
+        " files written and " + std::to_string(g_savesRead) +
+        " read compressed, " + std::to_string(g_plainSavesRead) +
+        " plain files read.");
+}
+#endif
@@ -0,0 +1,99 @@
+#ifndef SAVECOMPRESS_H
+#define SAVECOMPRESS_H
+
+#include "pch.h"
+#include "iocache.h" // NativeFile, SeekOrigin
+
+const uint32_t COMPRESSED_FILE_HEADER_SIZE = 16;
+const uint32_t COMPRESSED_FILE_TRAILER_SIZE = 16;
+
+// A file stored as LZ4-compressed blocks (see savecompress.cpp for the
+// layout), read and written through the usual file calls as if it were the
+// plain file. Blocks are found through an index, so seeks are cheap and
+// rewriting part of the file only recompresses the blocks it touches
+// (appended as new versions; CompactTo copies out the live ones). Not
+// thread-safe; one object per open file.
+class CompressedFile {
+public:
+    CompressedFile(NativeFile file, uint32_t blockSize);
+
+    // Whether file starts with a compressed file header. Open fails on one
+    // that was never finished.
+    static bool IsCompressed(NativeFile file);
+
+    bool Create(); // Start a new compressed file in an empty file
+    bool Open();   // Load the index of an existing compressed file
+    bool Read(void* buffer, uint32_t size, uint32_t& bytesRead);
+    bool Write(const void* data, uint32_t size);
+    // Returns false (position unchanged) on a negative result
+    bool Seek(int64_t distance, SeekOrigin origin, uint64_t& newPosition);
+    bool Truncate(); // Make the current position the end of the file
+    bool Flush();    // Write out the block being edited
+    // Flush and append a new index if anything changed
+    bool Close();
+    // After Close: whether more than an eighth of the file is unused
+    bool NeedsCompacting() const;
+    // After Close: write a copy without the unused space to the empty file
+    // target. This file is left as it is; the caller swaps them.
+    bool CompactTo(NativeFile target);
+
+    uint64_t Position() const { return m_position; }
+    uint64_t Size() const { return m_size; }
+    uint64_t StoredBytes() const { return m_appendOffset; } // On disk, so far
+    uint64_t CodecMicros() const { return m_codecMicros; }
+    bool Modified() const { return m_indexDirty; }
+    bool Corrupt() const { return m_corrupt; }
+
+private:
+    struct BlockEntry {
+        uint64_t offset;   // 0 = never written: all zeros
+        uint32_t entry;    // Payload size; top bit set = stored uncompressed
+        uint32_t checksum; // FNV-1a of the uncompressed bytes
+    };
+
+    bool LoadBlock(uint64_t index);
+    bool StoreBlock();
+    uint64_t LiveBytes() const;
+    bool WriteIndex();
+
+    NativeFile m_file;
+    uint32_t m_blockSize;
+    std::vector<BlockEntry> m_index;
+    std::vector<unsigned char> m_block;  // Uncompressed block being accessed
+    std::vector<unsigned char> m_packed; // Compression scratch
+    uint64_t m_blockIndex = UINT64_MAX;  // Which block m_block holds
+    bool m_blockDirty = false;
+    bool m_indexDirty = false;
+    bool m_corrupt = false;
+    uint64_t m_size = 0;
+    uint64_t m_position = 0;
+    uint64_t m_appendOffset = 0; // Where the next payload goes
+    uint64_t m_sessionStart = 0; // Payloads from here on are in no index yet
+    uint64_t m_codecMicros = 0;
+};
+
+// Function declarations
+#ifdef _WIN32
+bool InitializeSaveCompression(); // Returns true if the file hooks are needed
+void ShutdownSaveCompression();
+
+// Called from the file API hooks (fileio.cpp)
+DWORD SaveCompressionAccess(const char* path, DWORD access, DWORD flags);
+bool SaveCompressionOnOpen(HANDLE file, const char* path, DWORD access,
+    DWORD flags); // True if the handle is compressed
+bool SaveCompressionOnRead(HANDLE file, LPVOID buffer, DWORD bytesToRead,
+    LPDWORD bytesRead, LPOVERLAPPED overlapped, BOOL& result);
+bool SaveCompressionOnWrite(HANDLE file, LPCVOID buffer, DWORD bytesToWrite,
+    LPDWORD bytesWritten, LPOVERLAPPED overlapped, BOOL& result);
+bool SaveCompressionOnSeek(HANDLE file, LONGLONG distance, DWORD moveMethod,
+    LONGLONG& newPosition, bool& success);
+bool SaveCompressionGetSize(HANDLE file, uint64_t& size);
+bool SaveCompressionOnSetEndOfFile(HANDLE file, BOOL& result);
+bool SaveCompressionOnFlush(HANDLE file, BOOL& result);
+// False if the file could not be finished; GetLastError() says why.
+// compactPath is set if the file should be compacted once it is closed.
+bool SaveCompressionOnClose(HANDLE file, std::string& compactPath);
+void SaveCompressionCompact(const std::string& path); // After the close
+#endif
+
+#endif // SAVECOMPRESS_H
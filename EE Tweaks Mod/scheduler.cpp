@@ -0,0 +1,381 @@
+#include "pch.h"
+#include "scheduler.h"
+
+#ifdef _WIN32
+#include "globals.h"  // Access g_executableName, g_mainThreadId, g_patches
+#include "logging.h"  // Access Log()
+#include "config.h"   // Access config functions
+#include "memory.h"   // Access FindPattern(), HexToBytes()
+#include "patches.h"  // Access GetModuleInfoByName()
+#include "hooks.h"    // Access HookImport()
+#include "detour.h"   // Access DecodeInstruction()
+#include "counters.h"
+#include "powermode.h" // Access PowerModeOnFrameSleep()
+#include "mapprefault.h" // Access MapPrefaultOnFrame()
+#include <intrin.h>   // _ReturnAddress
+#endif
+
+// --- Job Scheduler ---
+
+// The worker the current thread is, so jobs submitted from a job stay local
+static thread_local const JobScheduler* t_scheduler = nullptr;
+static thread_local size_t t_workerIndex = 0;
+
+JobScheduler::~JobScheduler() {
+    Stop();
+}
+
+bool JobScheduler::Start(size_t workerCount) {
+    if (Running() || workerCount == 0) {
+        return false;
+    }
+    m_stopping = false;
+    m_queued = 0;
+    for (size_t i = 0; i < workerCount; ++i) {
+        m_queues.push_back(std::unique_ptr<WorkerQueue>(new WorkerQueue()));
+    }
+    try {
+        for (size_t i = 0; i < workerCount; ++i) {
+            m_threads.emplace_back(&JobScheduler::WorkerLoop, this, i);
+        }
+    }
+    catch (const std::system_error&) {
+        Stop(); // Keep none rather than fewer than asked for
+        return false;
+    }
+    return true;
+}
+
+void JobScheduler::Stop() {
+    {
+        std::lock_guard<std::mutex> lock(m_wakeMutex);
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+    for (std::thread& thread : m_threads) {
+        if (thread.joinable()) thread.join();
+    }
+    m_threads.clear();
+    m_queues.clear();
+}
+
+void JobScheduler::Abandon() {
+    {
+        std::lock_guard<std::mutex> lock(m_wakeMutex);
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+    for (std::thread& thread : m_threads) {
+        if (thread.joinable()) thread.detach();
+    }
+    m_threads.clear();
+    // The queues stay: a worker may still be running
+}
+
+bool JobScheduler::Submit(Job job) {
+    if (!Running() || !job) {
+        return false;
+    }
+    size_t index = t_scheduler == this ? t_workerIndex :
+        m_nextQueue.fetch_add(1) % m_queues.size();
+    m_pending++;
+    {
+        std::lock_guard<std::mutex> lock(m_queues[index]->mutex);
+        m_queues[index]->jobs.push_back(std::move(job));
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_wakeMutex);
+        m_queued++;
+    }
+    m_wake.notify_one();
+    return true;
+}
+
+void JobScheduler::WaitIdle() {
+    std::unique_lock<std::mutex> lock(m_wakeMutex);
+    m_idle.wait(lock, [this] { return m_pending == 0; });
+}
+
+// Own queue from the back (newest, still in cache), others from the front
+bool JobScheduler::TakeJob(size_t index, Job& job) {
+    size_t count = m_queues.size();
+    for (size_t offset = 0; offset < count; ++offset) {
+        WorkerQueue& queue = *m_queues[(index + offset) % count];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.jobs.empty()) {
+            continue;
+        }
+        if (offset == 0) {
+            job = std::move(queue.jobs.back());
+            queue.jobs.pop_back();
+        }
+        else {
+            job = std::move(queue.jobs.front());
+            queue.jobs.pop_front();
+            m_stolen++;
+        }
+        return true;
+    }
+    return false;
+}
+
+void JobScheduler::WorkerLoop(size_t index) {
+    t_scheduler = this;
+    t_workerIndex = index;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(m_wakeMutex);
+            m_wake.wait(lock, [this] { return m_stopping || m_queued > 0; });
+            if (m_queued == 0) {
+                return; // Stopping and nothing left to run
+            }
+            m_queued--; // Claim one job; it is in some queue
+        }
+        Job job;
+        while (!TakeJob(index, job)) {
+            std::this_thread::yield(); // Its Submit is between push and count
+        }
+        job();
+        m_executed++;
+        if (--m_pending == 0) {
+            std::lock_guard<std::mutex> lock(m_wakeMutex);
+            m_idle.notify_all();
+        }
+    }
+}
+
+// --- Frame Scheduler ---
+
+void FrameScheduler::AddFrameCallback(Job callback) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_callbacks.push_back(std::move(callback));
+}
+
+void FrameScheduler::Post(Job job, bool mainThreadOnly) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_posted.push_back({ std::move(job), mainThreadOnly });
+}
+
+size_t FrameScheduler::Pending() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_posted.size();
+}
+
+uint64_t FrameScheduler::RunFrame(uint64_t budgetMicros, JobScheduler* workers) {
+    auto start = std::chrono::steady_clock::now();
+    auto elapsedMicros = [start]() -> uint64_t {
+        return static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start).count());
+    };
+
+    std::vector<Job> callbacks;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        callbacks = m_callbacks;
+    }
+    for (Job& callback : callbacks) {
+        callback();
+    }
+
+    // Posted jobs run in order until the budget is used up
+    while (elapsedMicros() < budgetMicros) {
+        PostedJob posted;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_posted.empty()) {
+                break;
+            }
+            posted = std::move(m_posted.front());
+            m_posted.pop_front();
+        }
+        posted.job();
+    }
+
+    uint64_t spent = elapsedMicros();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (spent >= budgetMicros) {
+        m_overBudget++;
+    }
+    if (workers != nullptr && workers->Running()) {
+        for (auto it = m_posted.begin(); it != m_posted.end();) {
+            if (!it->mainThreadOnly && workers->Submit(it->job)) {
+                it = m_posted.erase(it);
+                m_spilled++;
+            }
+            else {
+                ++it;
+            }
+        }
+    }
+    return spent;
+}
+
+// --- Per-Frame Hook ---
+
+#ifdef _WIN32
+typedef VOID(WINAPI* SleepFn)(DWORD);
+
+static SleepFn g_originalSleep = nullptr;
+static uintptr_t g_frameReturnAddress = 0; // Right after the main loop's Sleep call
+static JobScheduler g_jobScheduler;
+static FrameScheduler g_frameScheduler;
+static bool g_schedulerRunning = false;
+static uint64_t g_frameBudgetMicros = 1000;
+static uint64_t g_frameHookCalls = 0;
+static bool g_frameHookTried = false;
+
+// The game sleeps once per pass of its main loop; the mod's frame work runs
+// just before that sleep, and power mode may lengthen the sleep
+static VOID WINAPI HookedSleep(DWORD milliseconds) {
+    if (reinterpret_cast<uintptr_t>(_ReturnAddress()) == g_frameReturnAddress &&
+        GetCurrentThreadId() == g_mainThreadId) {
+        if (g_schedulerRunning) {
+            g_frameHookCalls++;
+            uint64_t spent = g_frameScheduler.RunFrame(g_frameBudgetMicros,
+                &g_jobScheduler);
+            CounterSet(COUNTER_FRAME_WORK_US, spent);
+            CounterSet(COUNTER_JOBS_EXECUTED, g_jobScheduler.Executed());
+            CounterSet(COUNTER_JOBS_STOLEN, g_jobScheduler.Stolen());
+            CounterSet(COUNTER_JOBS_SPILLED, g_frameScheduler.Spilled());
+        }
+        MapPrefaultOnFrame();
+        milliseconds = PowerModeOnFrameSleep(milliseconds);
+    }
+    g_originalSleep(milliseconds);
+}
+
+// Find the main loop's Sleep call: the instruction right after the
+// SetSleepToZero pattern, patched or not
+static uintptr_t FindFrameSleepCall() {
+    for (const MemoryPatch& patch : g_patches) {
+        if (patch.name != "SetSleepToZero") {
+            continue;
+        }
+        std::vector<unsigned char> originalBytes;
+        std::vector<unsigned char> targetBytes;
+        if (!HexToBytes(patch.originalHex, originalBytes) ||
+            !HexToBytes(patch.targetHex, targetBytes)) {
+            return 0;
+        }
+        uintptr_t address = patch.patchAddress;
+        if (address == 0) {
+            MODULEINFO moduleInfo = { 0 };
+            uintptr_t baseAddress = 0;
+            size_t moduleSize = 0;
+            if (!GetModuleInfoByName(g_executableName, moduleInfo, baseAddress,
+                moduleSize)) {
+                return 0;
+            }
+            address = FindPattern(baseAddress, moduleSize, originalBytes);
+            if (address == 0) {
+                address = FindPattern(baseAddress, moduleSize, targetBytes);
+            }
+        }
+        return address == 0 ? 0 : address + originalBytes.size();
+    }
+    return 0;
+}
+
+// Hook the main loop's Sleep call. Safe to call more than once; the hook is
+// installed by whichever feature asks first.
+bool InstallFrameSleepHook() {
+    if (g_frameHookTried) {
+        return g_frameReturnAddress != 0;
+    }
+    g_frameHookTried = true;
+
+    uintptr_t sleepCall = FindFrameSleepCall();
+    InstructionInfo info = { 0 };
+    bool isCall = sleepCall != 0 &&
+        DecodeInstruction(reinterpret_cast<const unsigned char*>(sleepCall),
+            info) != 0 &&
+        (reinterpret_cast<const unsigned char*>(sleepCall)[info.opcodeOffset] ==
+            0xE8 ||
+            reinterpret_cast<const unsigned char*>(sleepCall)[info.opcodeOffset] ==
+            0xFF);
+    if (!isCall) {
+        Log("Warning: Main loop sleep call not found.");
+        return false;
+    }
+    g_frameReturnAddress = sleepCall + info.length;
+    if (!HookImport(GetModuleHandleA(NULL), "KERNEL32.dll", "Sleep",
+        reinterpret_cast<const void*>(HookedSleep),
+        reinterpret_cast<void**>(&g_originalSleep))) {
+        g_frameReturnAddress = 0;
+        Log("Warning: Could not hook Sleep.");
+        return false;
+    }
+    return true;
+}
+
+// Start the worker pool and hook the main loop's sleep for per-frame work
+bool StartJobScheduler() {
+    Log("Checking Job Scheduler...");
+    if (!GetConfigBool("JobSchedulerEnabled", false)) {
+        Log("Job Scheduler is disabled in config.");
+        return false;
+    }
+    int workers = GetConfigInt("JobSchedulerWorkers", 2);
+    int cores = static_cast<int>(std::thread::hardware_concurrency());
+    if (workers < 1) workers = 1;
+    if (cores > 1 && workers > cores - 1) workers = cores - 1; // Leave the game a core
+    int budget = GetConfigInt("FrameWorkBudgetMicros", 1000);
+    if (budget < 100) budget = 100;
+    g_frameBudgetMicros = static_cast<uint64_t>(budget);
+
+    if (!g_jobScheduler.Start(static_cast<size_t>(workers))) {
+        Log("Error: Could not start the job scheduler threads.");
+        return false;
+    }
+    g_schedulerRunning = true;
+
+    // Hook the sleep; without it only worker jobs are available
+    if (!InstallFrameSleepHook()) {
+        Log("Warning: Per-frame callbacks will not run.");
+    }
+
+    Log("Job Scheduler started (" + std::to_string(workers) + " workers, " +
+        std::to_string(budget) + " us main thread budget per frame" +
+        (g_frameReturnAddress != 0 ? ", per-frame hook installed)." : ")."));
+    return true;
+}
+
+// Log the totals and leave the workers to the system; jobs still queued do
+// not run. Called from the ExitProcess hook, where the process is about to
+// end anyway, or on FreeLibrary from DllMain, where joining threads would
+// deadlock on the loader lock.
+void ShutdownJobScheduler() {
+    if (!g_schedulerRunning) {
+        return;
+    }
+    g_schedulerRunning = false;
+    Log("Job Scheduler: " + std::to_string(g_jobScheduler.Executed()) +
+        " jobs run by workers (" + std::to_string(g_jobScheduler.Stolen()) +
+        " stolen, " + std::to_string(g_frameScheduler.Spilled()) +
+        " spilled from the main thread), " + std::to_string(g_frameHookCalls) +
+        " frames, " + std::to_string(g_frameScheduler.OverBudget()) +
+        " over budget.");
+    g_jobScheduler.Abandon();
+}
+
+bool SubmitJob(Job job) {
+    return g_schedulerRunning && g_jobScheduler.Submit(std::move(job));
+}
+
+bool PostToMainThread(Job job, bool mainThreadOnly) {
+    if (!g_schedulerRunning || g_frameReturnAddress == 0) {
+        return false;
+    }
+    g_frameScheduler.Post(std::move(job), mainThreadOnly);
+    return true;
+}
+
+bool AddFrameCallback(Job callback) {
+    if (!g_schedulerRunning || g_frameReturnAddress == 0) {
+        return false;
+    }
+    g_frameScheduler.AddFrameCallback(std::move(callback));
+    return true;
+}
+#endif
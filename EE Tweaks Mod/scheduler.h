@@ -0,0 +1,96 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "pch.h"
+
+typedef std::function<void()> Job;
+
+// A fixed pool of worker threads with one job queue each. A worker runs its
+// own newest job first and, when its queue is empty, steals the oldest job
+// of another worker. Jobs submitted by a worker go to its own queue.
+class JobScheduler {
+public:
+    JobScheduler() = default;
+    ~JobScheduler();
+    JobScheduler(const JobScheduler&) = delete;
+    JobScheduler& operator=(const JobScheduler&) = delete;
+
+    bool Start(size_t workerCount);
+    void Stop();    // Run the queued jobs, then end the workers
+    void Abandon(); // Leave the workers to the system (process exit)
+    bool Submit(Job job); // False if the scheduler is not running
+    void WaitIdle();      // Until every submitted job has finished
+
+    bool Running() const { return !m_threads.empty(); }
+    size_t WorkerCount() const { return m_threads.size(); }
+    uint64_t Executed() const { return m_executed; }
+    uint64_t Stolen() const { return m_stolen; }
+
+private:
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+    };
+
+    void WorkerLoop(size_t index);
+    bool TakeJob(size_t index, Job& job);
+
+    std::vector<std::unique_ptr<WorkerQueue>> m_queues;
+    std::vector<std::thread> m_threads;
+    std::mutex m_wakeMutex;
+    std::condition_variable m_wake; // Jobs queued or stopping
+    std::condition_variable m_idle; // Last pending job finished
+    size_t m_queued = 0;            // In a queue; guarded by m_wakeMutex
+    std::atomic<size_t> m_pending{ 0 }; // Submitted and not finished
+    std::atomic<size_t> m_nextQueue{ 0 };
+    bool m_stopping = false;        // Guarded by m_wakeMutex
+    std::atomic<uint64_t> m_executed{ 0 };
+    std::atomic<uint64_t> m_stolen{ 0 };
+};
+
+// Work for the game's main thread, run once per frame. Frame callbacks run
+// every frame; posted jobs run until the frame's time budget is used up.
+// Jobs that may run on any thread are then handed to the workers, the rest
+// wait for the next frame. Post may be called from any thread.
+class FrameScheduler {
+public:
+    void AddFrameCallback(Job callback);
+    void Post(Job job, bool mainThreadOnly);
+    // Returns the microseconds spent on the main thread
+    uint64_t RunFrame(uint64_t budgetMicros, JobScheduler* workers);
+
+    size_t Pending();
+    uint64_t Spilled() const { return m_spilled; }   // Handed to workers
+    uint64_t OverBudget() const { return m_overBudget; } // Frames past the budget
+
+private:
+    struct PostedJob {
+        Job job;
+        bool mainThreadOnly;
+    };
+
+    std::mutex m_mutex;
+    std::vector<Job> m_callbacks;
+    std::deque<PostedJob> m_posted;
+    uint64_t m_spilled = 0;
+    uint64_t m_overBudget = 0;
+};
+
+// Function declarations
+#ifdef _WIN32
+bool StartJobScheduler();
+void ShutdownJobScheduler();
+// Hook the main loop's Sleep; shared by the scheduler, power mode and map
+// prefault
+bool InstallFrameSleepHook();
+
+// For features: each returns false if the scheduler is not running, in which
+// case the caller does the work itself
+bool SubmitJob(Job job);
+// Without mainThreadOnly, a job the frame's budget has no room for goes to
+// the workers instead of waiting for the next frame
+bool PostToMainThread(Job job, bool mainThreadOnly);
+bool AddFrameCallback(Job callback);
+#endif
+
+#endif // SCHEDULER_H
@@ -0,0 +1,496 @@
+#include "pch.h"
+#include "softblit.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#define BLIT_SSE2
+#include <emmintrin.h> // SSE2
+#endif
+
+#ifdef _WIN32
+#include <ddraw.h>
+#include "logging.h" // Access Log()
+#include "config.h"  // Access config functions
+#include "hooks.h"   // Access HookVtableEntry()
+#include "counters.h"
+#endif
+
+// --- Blit Kernels ---
+// Each row is done 16 bytes at a time, the pixels left over one by one
+
+static void CopyRow(uint8_t* d, const uint8_t* s, size_t bytes) {
+#ifdef BLIT_SSE2
+    while (bytes >= 64) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 16));
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 32));
+        __m128i e = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 48));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(d), a);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(d + 16), b);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(d + 32), c);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(d + 48), e);
+        d += 64;
+        s += 64;
+        bytes -= 64;
+    }
+    while (bytes >= 16) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(d),
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(s)));
+        d += 16;
+        s += 16;
+        bytes -= 16;
+    }
+#endif
+    memcpy(d, s, bytes);
+}
+
+// pattern holds whole pixels, so every 4-byte step starts a pixel
+static void FillRow(uint8_t* d, size_t bytes, uint32_t pattern) {
+#ifdef BLIT_SSE2
+    const __m128i fill = _mm_set1_epi32(static_cast<int>(pattern));
+    while (bytes >= 64) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(d), fill);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(d + 16), fill);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(d + 32), fill);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(d + 48), fill);
+        d += 64;
+        bytes -= 64;
+    }
+    while (bytes >= 16) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(d), fill);
+        d += 16;
+        bytes -= 16;
+    }
+#endif
+    while (bytes >= 4) {
+        memcpy(d, &pattern, 4);
+        d += 4;
+        bytes -= 4;
+    }
+    memcpy(d, &pattern, bytes); // A last 16-bit pixel
+}
+
+void BlitCopy(uint8_t* dst, ptrdiff_t dstPitch, const uint8_t* src,
+    ptrdiff_t srcPitch, size_t rowBytes, size_t rows) {
+    for (size_t row = 0; row < rows; ++row) {
+        CopyRow(dst, src, rowBytes);
+        dst += dstPitch;
+        src += srcPitch;
+    }
+}
+
+void BlitColorKey16(uint8_t* dst, ptrdiff_t dstPitch, const uint8_t* src,
+    ptrdiff_t srcPitch, size_t width, size_t rows, uint16_t key, uint16_t keyMask) {
+    const uint16_t maskedKey = key & keyMask;
+#ifdef BLIT_SSE2
+    const __m128i keyVector = _mm_set1_epi16(static_cast<short>(maskedKey));
+    const __m128i maskVector = _mm_set1_epi16(static_cast<short>(keyMask));
+#endif
+    for (size_t row = 0; row < rows; ++row) {
+        uint16_t* d = reinterpret_cast<uint16_t*>(dst);
+        const uint16_t* s = reinterpret_cast<const uint16_t*>(src);
+        size_t x = 0;
+#ifdef BLIT_SSE2
+        for (; x + 8 <= width; x += 8) {
+            __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + x));
+            __m128i transparent = _mm_cmpeq_epi16(
+                _mm_and_si128(pixels, maskVector), keyVector);
+            int mask = _mm_movemask_epi8(transparent);
+            if (mask == 0xFFFF) {
+                continue; // Nothing to draw; sprites have long transparent runs
+            }
+            __m128i* out = reinterpret_cast<__m128i*>(d + x);
+            if (mask != 0) {
+                pixels = _mm_or_si128(
+                    _mm_and_si128(transparent, _mm_loadu_si128(out)),
+                    _mm_andnot_si128(transparent, pixels));
+            }
+            _mm_storeu_si128(out, pixels);
+        }
+#endif
+        for (; x < width; ++x) {
+            if ((s[x] & keyMask) != maskedKey) d[x] = s[x];
+        }
+        dst += dstPitch;
+        src += srcPitch;
+    }
+}
+
+void BlitColorKey32(uint8_t* dst, ptrdiff_t dstPitch, const uint8_t* src,
+    ptrdiff_t srcPitch, size_t width, size_t rows, uint32_t key, uint32_t keyMask) {
+    const uint32_t maskedKey = key & keyMask;
+#ifdef BLIT_SSE2
+    const __m128i keyVector = _mm_set1_epi32(static_cast<int>(maskedKey));
+    const __m128i maskVector = _mm_set1_epi32(static_cast<int>(keyMask));
+#endif
+    for (size_t row = 0; row < rows; ++row) {
+        uint32_t* d = reinterpret_cast<uint32_t*>(dst);
+        const uint32_t* s = reinterpret_cast<const uint32_t*>(src);
+        size_t x = 0;
+#ifdef BLIT_SSE2
+        for (; x + 4 <= width; x += 4) {
+            __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + x));
+            __m128i transparent = _mm_cmpeq_epi32(
+                _mm_and_si128(pixels, maskVector), keyVector);
+            int mask = _mm_movemask_epi8(transparent);
+            if (mask == 0xFFFF) {
+                continue;
+            }
+            __m128i* out = reinterpret_cast<__m128i*>(d + x);
+            if (mask != 0) {
+                pixels = _mm_or_si128(
+                    _mm_and_si128(transparent, _mm_loadu_si128(out)),
+                    _mm_andnot_si128(transparent, pixels));
+            }
+            _mm_storeu_si128(out, pixels);
+        }
+#endif
+        for (; x < width; ++x) {
+            if ((s[x] & keyMask) != maskedKey) d[x] = s[x];
+        }
+        dst += dstPitch;
+        src += srcPitch;
+    }
+}
+
+void BlitFill16(uint8_t* dst, ptrdiff_t pitch, size_t width, size_t rows,
+    uint16_t color) {
+    uint32_t pattern = static_cast<uint32_t>(color) * 0x10001u;
+    for (size_t row = 0; row < rows; ++row) {
+        FillRow(dst, width * 2, pattern);
+        dst += pitch;
+    }
+}
+
+void BlitFill32(uint8_t* dst, ptrdiff_t pitch, size_t width, size_t rows,
+    uint32_t color) {
+    for (size_t row = 0; row < rows; ++row) {
+        FillRow(dst, width * 4, color);
+        dst += pitch;
+    }
+}
+
+// --- Surface Blit Hooks ---
+// Blt and BltFast between two system-memory surfaces are done here when they
+// are plain: no stretching, no clipper, no effects, and both surfaces of the
+// same 16- or 32-bit RGB format. Everything else goes to DirectDraw.
+
+#ifdef _WIN32
+// Vtable slots, in the method order of ddraw.h
+const size_t DIRECTDRAW7_SLOT_CREATE_SURFACE = 6;
+const size_t SURFACE7_SLOT_BLT = 5;
+const size_t SURFACE7_SLOT_BLT_FAST = 7;
+
+// Flags that do not change what a blit does to the pixels
+const DWORD BLT_WAIT_FLAGS = DDBLT_WAIT | DDBLT_ASYNC | DDBLT_DONOTWAIT;
+const DWORD BLTFAST_WAIT_FLAGS = DDBLTFAST_WAIT | DDBLTFAST_DONOTWAIT;
+
+typedef HRESULT(WINAPI* CreateSurfaceFn)(void* self, DDSURFACEDESC2* desc,
+    IDirectDrawSurface7** surface, IUnknown* outer);
+typedef HRESULT(WINAPI* SurfaceBltFn)(void* self, RECT* destinationRect,
+    IDirectDrawSurface7* source, RECT* sourceRect, DWORD flags, DDBLTFX* fx);
+typedef HRESULT(WINAPI* SurfaceBltFastFn)(void* self, DWORD x, DWORD y,
+    IDirectDrawSurface7* source, RECT* sourceRect, DWORD flags);
+
+static CreateSurfaceFn g_originalCreateSurface = nullptr;
+static SurfaceBltFn g_originalSurfaceBlt = nullptr;
+static SurfaceBltFastFn g_originalSurfaceBltFast = nullptr;
+
+static bool g_softwareBlitEnabled = false;
+static std::atomic<uint64_t> g_copies{ 0 };
+static std::atomic<uint64_t> g_keyedCopies{ 0 };
+static std::atomic<uint64_t> g_fills{ 0 };
+static std::atomic<uint64_t> g_blitBytes{ 0 };
+static std::atomic<uint64_t> g_forwarded{ 0 };
+
+enum SoftwareBlitKind {
+    SOFT_BLIT_COPY,
+    SOFT_BLIT_COLOR_KEY,
+    SOFT_BLIT_FILL,
+};
+
+static bool IsSystemMemory(IDirectDrawSurface7* surface) {
+    DDSCAPS2 caps = { 0 };
+    return SUCCEEDED(surface->GetCaps(&caps)) &&
+        (caps.dwCaps & DDSCAPS_SYSTEMMEMORY) != 0;
+}
+
+// 16- or 32-bit RGB; 0 for any other format
+static DWORD GetBlitPixelBytes(const DDPIXELFORMAT& format) {
+    if ((format.dwFlags & DDPF_RGB) == 0 ||
+        (format.dwFlags & (DDPF_FOURCC | DDPF_PALETTEINDEXED8 |
+            DDPF_PALETTEINDEXED4)) != 0) {
+        return 0;
+    }
+    return format.dwRGBBitCount == 16 || format.dwRGBBitCount == 32 ?
+        format.dwRGBBitCount / 8 : 0;
+}
+
+static bool SameFormat(const DDPIXELFORMAT& a, const DDPIXELFORMAT& b) {
+    return a.dwRGBBitCount == b.dwRGBBitCount && a.dwRBitMask == b.dwRBitMask &&
+        a.dwGBitMask == b.dwGBitMask && a.dwBBitMask == b.dwBBitMask &&
+        ((a.dwFlags & DDPF_ALPHAPIXELS) == 0 ||
+            a.dwRGBAlphaBitMask == b.dwRGBAlphaBitMask);
+}
+
+// The rectangle, or the whole surface for NULL. False if it is empty or
+// does not fit the surface.
+static bool ResolveRect(const RECT* rect, const DDSURFACEDESC2& desc,
+    RECT& resolved) {
+    if (rect == NULL) {
+        SetRect(&resolved, 0, 0, static_cast<int>(desc.dwWidth),
+            static_cast<int>(desc.dwHeight));
+        return desc.dwWidth != 0 && desc.dwHeight != 0;
+    }
+    resolved = *rect;
+    return resolved.left >= 0 && resolved.top >= 0 &&
+        resolved.left < resolved.right && resolved.top < resolved.bottom &&
+        resolved.right <= static_cast<LONG>(desc.dwWidth) &&
+        resolved.bottom <= static_cast<LONG>(desc.dwHeight);
+}
+
+static uint8_t* PixelAddress(const DDSURFACEDESC2& desc, const RECT& rect,
+    DWORD pixelBytes) {
+    return static_cast<uint8_t*>(desc.lpSurface) +
+        static_cast<ptrdiff_t>(rect.top) * desc.lPitch +
+        static_cast<ptrdiff_t>(rect.left) * pixelBytes;
+}
+
+// Run a blit with the kernels. destinationPoint is set for BltFast, which
+// places the source rectangle there; key is nullptr to use the source's own
+// color key. False if DirectDraw has to do it; nothing is written then.
+static bool TrySoftwareBlit(IDirectDrawSurface7* destination,
+    const RECT* destinationRect, const POINT* destinationPoint,
+    IDirectDrawSurface7* source, const RECT* sourceRect, SoftwareBlitKind kind,
+    const DDCOLORKEY* key, DWORD fillColor) {
+    if (kind != SOFT_BLIT_FILL && (source == nullptr || source == destination)) {
+        return false;
+    }
+    if (!IsSystemMemory(destination) ||
+        (kind != SOFT_BLIT_FILL && !IsSystemMemory(source))) {
+        return false;
+    }
+    DDCOLORKEY sourceKey = { 0 };
+    if (kind == SOFT_BLIT_COLOR_KEY) {
+        if (key == nullptr) {
+            if (FAILED(source->GetColorKey(DDCKEY_SRCBLT, &sourceKey))) {
+                return false;
+            }
+            key = &sourceKey;
+        }
+        if (key->dwColorSpaceLowValue != key->dwColorSpaceHighValue) {
+            return false; // Key ranges are rare; left to DirectDraw
+        }
+    }
+    if (destinationPoint == nullptr) {
+        // Blt clips to an attached clipper; BltFast never clips
+        IDirectDrawClipper* clipper = nullptr;
+        if (SUCCEEDED(destination->GetClipper(&clipper))) {
+            clipper->Release();
+            return false;
+        }
+    }
+
+    const DWORD lockFlags = DDLOCK_WAIT | DDLOCK_NOSYSLOCK;
+    DDSURFACEDESC2 target = { 0 };
+    target.dwSize = sizeof(target);
+    if (FAILED(destination->Lock(NULL, &target, lockFlags |
+        (kind == SOFT_BLIT_COLOR_KEY ? 0 : DDLOCK_WRITEONLY), NULL))) {
+        return false;
+    }
+    DDSURFACEDESC2 from = { 0 };
+    from.dwSize = sizeof(from);
+    if (kind != SOFT_BLIT_FILL &&
+        FAILED(source->Lock(NULL, &from, lockFlags | DDLOCK_READONLY, NULL))) {
+        destination->Unlock(NULL);
+        return false;
+    }
+
+    DWORD pixelBytes = GetBlitPixelBytes(target.ddpfPixelFormat);
+    RECT to = { 0 };
+    RECT at = { 0 };
+    bool plain = pixelBytes != 0;
+    if (plain && kind != SOFT_BLIT_FILL) {
+        plain = SameFormat(target.ddpfPixelFormat, from.ddpfPixelFormat) &&
+            ResolveRect(sourceRect, from, at);
+        if (plain && destinationPoint != nullptr) {
+            RECT placed = { destinationPoint->x, destinationPoint->y,
+                destinationPoint->x + (at.right - at.left),
+                destinationPoint->y + (at.bottom - at.top) };
+            plain = ResolveRect(&placed, target, to);
+        }
+        else if (plain) {
+            plain = ResolveRect(destinationRect, target, to) &&
+                to.right - to.left == at.right - at.left &&
+                to.bottom - to.top == at.bottom - at.top; // No stretching
+        }
+    }
+    else if (plain) {
+        plain = ResolveRect(destinationRect, target, to);
+    }
+
+    if (plain) {
+        size_t width = static_cast<size_t>(to.right - to.left);
+        size_t rows = static_cast<size_t>(to.bottom - to.top);
+        uint8_t* out = PixelAddress(target, to, pixelBytes);
+        const uint8_t* in = kind == SOFT_BLIT_FILL ? nullptr :
+            PixelAddress(from, at, pixelBytes);
+        const DDPIXELFORMAT& format = target.ddpfPixelFormat;
+        uint32_t keyMask = format.dwRBitMask | format.dwGBitMask |
+            format.dwBBitMask | ((format.dwFlags & DDPF_ALPHAPIXELS) != 0 ?
+                format.dwRGBAlphaBitMask : 0);
+        if (keyMask == 0) keyMask = 0xFFFFFFFF;
+
+        if (kind == SOFT_BLIT_COPY) {
+            BlitCopy(out, target.lPitch, in, from.lPitch, width * pixelBytes, rows);
+            g_copies++;
+        }
+        else if (kind == SOFT_BLIT_COLOR_KEY && pixelBytes == 2) {
+            BlitColorKey16(out, target.lPitch, in, from.lPitch, width, rows,
+                static_cast<uint16_t>(key->dwColorSpaceLowValue),
+                static_cast<uint16_t>(keyMask));
+            g_keyedCopies++;
+        }
+        else if (kind == SOFT_BLIT_COLOR_KEY) {
+            BlitColorKey32(out, target.lPitch, in, from.lPitch, width, rows,
+                key->dwColorSpaceLowValue, keyMask);
+            g_keyedCopies++;
+        }
+        else if (pixelBytes == 2) {
+            BlitFill16(out, target.lPitch, width, rows,
+                static_cast<uint16_t>(fillColor));
+            g_fills++;
+        }
+        else {
+            BlitFill32(out, target.lPitch, width, rows, fillColor);
+            g_fills++;
+        }
+        uint64_t bytes = static_cast<uint64_t>(width) * rows * pixelBytes;
+        g_blitBytes += bytes;
+        CounterAdd(COUNTER_SOFTWARE_BLITS, 1);
+        CounterAdd(COUNTER_SOFTWARE_BLIT_BYTES, bytes);
+    }
+
+    if (kind != SOFT_BLIT_FILL) {
+        source->Unlock(NULL);
+    }
+    destination->Unlock(NULL);
+    return plain;
+}
+
+static HRESULT WINAPI HookedSurfaceBlt(void* self, RECT* destinationRect,
+    IDirectDrawSurface7* source, RECT* sourceRect, DWORD flags, DDBLTFX* fx) {
+    IDirectDrawSurface7* destination = static_cast<IDirectDrawSurface7*>(self);
+    DWORD operation = flags & ~BLT_WAIT_FLAGS;
+    bool done = false;
+    if (operation == 0 && source != nullptr) {
+        done = TrySoftwareBlit(destination, destinationRect, nullptr, source,
+            sourceRect, SOFT_BLIT_COPY, nullptr, 0);
+    }
+    else if (operation == DDBLT_KEYSRC) {
+        done = TrySoftwareBlit(destination, destinationRect, nullptr, source,
+            sourceRect, SOFT_BLIT_COLOR_KEY, nullptr, 0);
+    }
+    else if (operation == DDBLT_KEYSRCOVERRIDE && fx != nullptr) {
+        done = TrySoftwareBlit(destination, destinationRect, nullptr, source,
+            sourceRect, SOFT_BLIT_COLOR_KEY, &fx->ddckSrcColorkey, 0);
+    }
+    else if (operation == DDBLT_COLORFILL && fx != nullptr) {
+        done = TrySoftwareBlit(destination, destinationRect, nullptr, nullptr,
+            nullptr, SOFT_BLIT_FILL, nullptr, fx->dwFillColor);
+    }
+    if (done) {
+        return DD_OK;
+    }
+    g_forwarded++;
+    return g_originalSurfaceBlt(self, destinationRect, source, sourceRect,
+        flags, fx);
+}
+
+static HRESULT WINAPI HookedSurfaceBltFast(void* self, DWORD x, DWORD y,
+    IDirectDrawSurface7* source, RECT* sourceRect, DWORD flags) {
+    IDirectDrawSurface7* destination = static_cast<IDirectDrawSurface7*>(self);
+    DWORD operation = flags & ~BLTFAST_WAIT_FLAGS;
+    POINT point = { static_cast<LONG>(x), static_cast<LONG>(y) };
+    bool done = false;
+    if (operation == DDBLTFAST_NOCOLORKEY) {
+        done = TrySoftwareBlit(destination, nullptr, &point, source, sourceRect,
+            SOFT_BLIT_COPY, nullptr, 0);
+    }
+    else if (operation == DDBLTFAST_SRCCOLORKEY) {
+        done = TrySoftwareBlit(destination, nullptr, &point, source, sourceRect,
+            SOFT_BLIT_COLOR_KEY, nullptr, 0);
+    }
+    if (done) {
+        return DD_OK;
+    }
+    g_forwarded++;
+    return g_originalSurfaceBltFast(self, x, y, source, sourceRect, flags);
+}
+
+// The first surface created gives the vtable every surface shares
+static HRESULT WINAPI HookedCreateSurface(void* self, DDSURFACEDESC2* desc,
+    IDirectDrawSurface7** surface, IUnknown* outer) {
+    HRESULT result = g_originalCreateSurface(self, desc, surface, outer);
+    if (FAILED(result) || surface == nullptr || *surface == nullptr ||
+        !g_softwareBlitEnabled || g_originalSurfaceBlt != nullptr) {
+        return result;
+    }
+    bool hooked =
+        HookVtableEntry(*surface, SURFACE7_SLOT_BLT,
+            reinterpret_cast<const void*>(HookedSurfaceBlt),
+            reinterpret_cast<void**>(&g_originalSurfaceBlt)) &&
+        HookVtableEntry(*surface, SURFACE7_SLOT_BLT_FAST,
+            reinterpret_cast<const void*>(HookedSurfaceBltFast),
+            reinterpret_cast<void**>(&g_originalSurfaceBltFast));
+    if (!hooked) {
+        // A slot that was hooked forwards everything from here on
+        Log("Warning: Could not hook surface blits. Software Blit not applied.");
+        g_softwareBlitEnabled = false;
+    }
+    return result;
+}
+
+// Read config. Returns true if the Direct3D hooks are needed.
+bool InitializeSoftwareBlit() {
+    Log("Checking Software Blit...");
+    if (!GetConfigBool("SoftwareBlitEnabled", false)) {
+        Log("Software Blit is disabled in config.");
+        return false;
+    }
+    if (!IsProcessorFeaturePresent(PF_XMMI64_INSTRUCTIONS_AVAILABLE)) {
+        Log("Warning: CPU does not support SSE2. Software Blit skipped.");
+        return false;
+    }
+    g_softwareBlitEnabled = true;
+    return true;
+}
+
+// Installed before Texture Dedup's hooks, so its proxies are unwrapped by
+// the time a blit gets here
+void SoftwareBlitOnDirectDraw(void* directDraw) {
+    if (!g_softwareBlitEnabled || g_originalCreateSurface != nullptr) {
+        return;
+    }
+    if (!HookVtableEntry(directDraw, DIRECTDRAW7_SLOT_CREATE_SURFACE,
+        reinterpret_cast<const void*>(HookedCreateSurface),
+        reinterpret_cast<void**>(&g_originalCreateSurface))) {
+        Log("Warning: Could not hook IDirectDraw7::CreateSurface. Software "
+            "Blit not applied.");
+        g_softwareBlitEnabled = false;
+    }
+}
+
+// Log the totals. Called at shutdown.
+void ShutdownSoftwareBlit() {
+    uint64_t done = g_copies + g_keyedCopies + g_fills;
+    if (done == 0 && g_forwarded == 0) {
+        return;
+    }
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(1) << "Software Blit: " << g_copies
+        << " copies, " << g_keyedCopies << " color key copies, " << g_fills
+        << " fills (" << g_blitBytes / (1024.0 * 1024.0) << " MB), "
+        << g_forwarded << " left to DirectDraw.";
+    Log(ss.str());
+}
+#endif
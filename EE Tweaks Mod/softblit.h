@@ -0,0 +1,30 @@
+#ifndef SOFTBLIT_H
+#define SOFTBLIT_H
+
+#include "pch.h"
+
+// Blit kernels for 16- and 32-bit surfaces in system memory, using SSE2
+// where the build has it. Pitches are in bytes and may be negative; widths
+// are in pixels. Source and destination must not overlap.
+void BlitCopy(uint8_t* dst, ptrdiff_t dstPitch, const uint8_t* src,
+    ptrdiff_t srcPitch, size_t rowBytes, size_t rows);
+// Source pixels whose masked value equals the masked key are left out
+void BlitColorKey16(uint8_t* dst, ptrdiff_t dstPitch, const uint8_t* src,
+    ptrdiff_t srcPitch, size_t width, size_t rows, uint16_t key, uint16_t keyMask);
+void BlitColorKey32(uint8_t* dst, ptrdiff_t dstPitch, const uint8_t* src,
+    ptrdiff_t srcPitch, size_t width, size_t rows, uint32_t key, uint32_t keyMask);
+void BlitFill16(uint8_t* dst, ptrdiff_t pitch, size_t width, size_t rows,
+    uint16_t color);
+void BlitFill32(uint8_t* dst, ptrdiff_t pitch, size_t width, size_t rows,
+    uint32_t color);
+
+// Function declarations
+#ifdef _WIN32
+bool InitializeSoftwareBlit(); // Reads config
+void ShutdownSoftwareBlit();
+
+// Called from the Direct3D hook chain (d3dhooks.cpp)
+void SoftwareBlitOnDirectDraw(void* directDraw);
+#endif
+
+#endif // SOFTBLIT_H
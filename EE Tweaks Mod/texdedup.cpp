@@ -0,0 +1,939 @@
+#include "pch.h"
+#include "texdedup.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#define CONTENT_HASH_SSE2
+#include <emmintrin.h> // SSE2
+#endif
+
+#ifdef _WIN32
+#include <ddraw.h>
+#include "logging.h" // Access Log()
+#include "config.h"  // Access config functions
+#include "hooks.h"   // Access HookVtableEntry()
+#include "counters.h"
+#endif
+
+// --- Content Hash ---
+
+alignas(16) static const uint64_t HASH_KEYS[8] = {
+    0xbe4ba423396cfeb8ull, 0x1cad21f72c81017cull, 0xdb979083e96dd4deull,
+    0x1f67b3b7a4a44072ull, 0x78e5c0cc4ee679cbull, 0x2172ffcc7dd05a82ull,
+    0x8e2443f7744608b8ull, 0x4c263a81e69035e0ull,
+};
+alignas(16) static const uint64_t HASH_SCRAMBLE_KEYS[8] = {
+    0xcb00c391bb52283cull, 0xa32e531b8b65d088ull, 0x4ef90da297486471ull,
+    0xd8acdea946ef1938ull, 0x3f349ce33f76faa8ull, 0x1d4f0bc7c7bbdcf9ull,
+    0x3159b4cd4be0518aull, 0x647378d9c97e9fc8ull,
+};
+static const uint32_t HASH_PRIME32 = 0x9E3779B1u;
+static const uint64_t HASH_PRIME64 = 0x9E3779B185EBCA87ull;
+static const uint64_t HASH_STRIPES_PER_SCRAMBLE = 16;
+
+static uint64_t Avalanche(uint64_t value) {
+    value ^= value >> 33;
+    value *= 0xff51afd7ed558ccdull;
+    value ^= value >> 33;
+    value *= 0xc4ceb9fe1a85ec53ull;
+    value ^= value >> 33;
+    return value;
+}
+
+bool ContentHasher::Sse2Available() {
+#ifdef CONTENT_HASH_SSE2
+    return true;
+#else
+    return false;
+#endif
+}
+
+ContentHasher::ContentHasher(bool useSse2) : m_sse2(useSse2 && Sse2Available()) {
+    for (size_t i = 0; i < 8; ++i) {
+        m_acc[i] = HASH_KEYS[(i + 4) & 7] ^ HASH_PRIME64;
+    }
+}
+
+// Each lane adds key-mixed 32x32 products to itself and the raw data to its
+// neighbour; every 16 stripes the lanes are scrambled so no input bits pile
+// up unmixed. This is the shape SSE2 handles well (two lanes per register).
+void ContentHasher::ProcessStripes(const unsigned char* data, size_t count) {
+#ifdef CONTENT_HASH_SSE2
+    if (m_sse2) {
+        __m128i acc[4];
+        for (size_t v = 0; v < 4; ++v) {
+            acc[v] = _mm_load_si128(reinterpret_cast<const __m128i*>(m_acc + v * 2));
+        }
+        const __m128i prime = _mm_set1_epi32(static_cast<int>(HASH_PRIME32));
+        for (size_t s = 0; s < count; ++s, data += 64) {
+            for (size_t v = 0; v < 4; ++v) {
+                __m128i value = _mm_loadu_si128(
+                    reinterpret_cast<const __m128i*>(data + v * 16));
+                __m128i keyed = _mm_xor_si128(value, _mm_load_si128(
+                    reinterpret_cast<const __m128i*>(HASH_KEYS + v * 2)));
+                __m128i high = _mm_shuffle_epi32(keyed, _MM_SHUFFLE(0, 3, 0, 1));
+                __m128i product = _mm_mul_epu32(keyed, high);
+                __m128i swapped = _mm_shuffle_epi32(value, _MM_SHUFFLE(1, 0, 3, 2));
+                acc[v] = _mm_add_epi64(acc[v], _mm_add_epi64(product, swapped));
+            }
+            if (++m_stripes % HASH_STRIPES_PER_SCRAMBLE == 0) {
+                for (size_t v = 0; v < 4; ++v) {
+                    __m128i mixed = _mm_xor_si128(acc[v], _mm_srli_epi64(acc[v], 47));
+                    mixed = _mm_xor_si128(mixed, _mm_load_si128(
+                        reinterpret_cast<const __m128i*>(HASH_SCRAMBLE_KEYS + v * 2)));
+                    __m128i low = _mm_mul_epu32(mixed, prime);
+                    __m128i high = _mm_mul_epu32(_mm_srli_epi64(mixed, 32), prime);
+                    acc[v] = _mm_add_epi64(low, _mm_slli_epi64(high, 32));
+                }
+            }
+        }
+        for (size_t v = 0; v < 4; ++v) {
+            _mm_store_si128(reinterpret_cast<__m128i*>(m_acc + v * 2), acc[v]);
+        }
+        return;
+    }
+#endif
+    for (size_t s = 0; s < count; ++s, data += 64) {
+        for (size_t i = 0; i < 8; ++i) {
+            uint64_t value;
+            memcpy(&value, data + i * 8, sizeof(value));
+            uint64_t keyed = value ^ HASH_KEYS[i];
+            m_acc[i ^ 1] += value;
+            m_acc[i] += (keyed & 0xFFFFFFFFull) * (keyed >> 32);
+        }
+        if (++m_stripes % HASH_STRIPES_PER_SCRAMBLE == 0) {
+            for (size_t i = 0; i < 8; ++i) {
+                uint64_t mixed = m_acc[i] ^ (m_acc[i] >> 47) ^ HASH_SCRAMBLE_KEYS[i];
+                m_acc[i] = mixed * HASH_PRIME32;
+            }
+        }
+    }
+}
+
+void ContentHasher::Update(const void* data, size_t size) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    m_length += size;
+    if (m_buffered > 0) {
+        size_t take = std::min(size, sizeof(m_buffer) - m_buffered);
+        memcpy(m_buffer + m_buffered, bytes, take);
+        m_buffered += take;
+        bytes += take;
+        size -= take;
+        if (m_buffered < sizeof(m_buffer)) {
+            return;
+        }
+        ProcessStripes(m_buffer, 1);
+        m_buffered = 0;
+    }
+    size_t stripes = size / 64;
+    ProcessStripes(bytes, stripes);
+    bytes += stripes * 64;
+    size -= stripes * 64;
+    memcpy(m_buffer, bytes, size);
+    m_buffered = size;
+}
+
+uint64_t ContentHasher::Finish() {
+    if (m_buffered > 0) {
+        memset(m_buffer + m_buffered, 0, sizeof(m_buffer) - m_buffered);
+        ProcessStripes(m_buffer, 1);
+        m_buffered = 0;
+    }
+    uint64_t hash = m_length * HASH_PRIME64;
+    for (size_t i = 0; i < 8; ++i) {
+        hash = (hash ^ Avalanche(m_acc[i] + i)) * HASH_PRIME64;
+    }
+    return Avalanche(hash);
+}
+
+// --- Dedup Table ---
+
+uintptr_t TextureDedupTable::Share(const TextureKey& key, uintptr_t surface,
+    uint64_t bytes) {
+    auto it = m_entries.find(key);
+    if (it == m_entries.end()) {
+        m_entries[key] = { surface, 1, bytes };
+        return surface;
+    }
+    it->second.references++;
+    m_savedBytes += it->second.bytes;
+    if (m_savedBytes > m_peakSavedBytes) m_peakSavedBytes = m_savedBytes;
+    return it->second.surface;
+}
+
+bool TextureDedupTable::Release(const TextureKey& key, uintptr_t surface) {
+    auto it = m_entries.find(key);
+    if (it == m_entries.end() || it->second.surface != surface) {
+        return false;
+    }
+    if (--it->second.references > 0) {
+        m_savedBytes -= it->second.bytes;
+        return false;
+    }
+    m_entries.erase(it);
+    return true;
+}
+
+uint32_t TextureDedupTable::References(const TextureKey& key) const {
+    auto it = m_entries.find(key);
+    return it != m_entries.end() ? it->second.references : 0;
+}
+
+// --- Texture Surface Sharing ---
+// Each texture the renderer creates is handed out as a proxy object that
+// forwards to a real surface. When a texture has been written, its pixels
+// are hashed; if another texture already holds the same content, the proxy
+// switches to that surface and its own is released. A proxy that is about
+// to be written gets a private copy first (copy-on-lock).
+
+#ifdef _WIN32
+static const GUID GUID_UNKNOWN = { 0x00000000, 0x0000, 0x0000,
+    { 0xC0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x46 } };
+static const GUID GUID_DIRECTDRAW_SURFACE7 = { 0x06675a80, 0x3b9b, 0x11d2,
+    { 0xb9, 0x2f, 0x00, 0x60, 0x97, 0x97, 0xea, 0x5b } };
+
+// Vtable slots, in the method order of ddraw.h and d3d.h
+const size_t DIRECTDRAW7_SLOT_CREATE_SURFACE = 6;
+const size_t SURFACE7_SLOT_BLT = 5;
+const size_t SURFACE7_SLOT_BLT_FAST = 7;
+const size_t DEVICE_SLOT_PRELOAD = 24;
+const size_t DEVICE_SLOT_GET_TEXTURE = 34;
+const size_t DEVICE_SLOT_SET_TEXTURE = 35;
+const size_t DEVICE_SLOT_LOAD = 43;
+
+// A texture rewritten more often than this is dynamic and is not shared
+const int DEDUP_MAX_WRITES = 4;
+// Texture stages of a Direct3D 7 device
+const DWORD TEXTURE_STAGES = 8;
+
+typedef HRESULT(WINAPI* CreateSurfaceFn)(void* self, DDSURFACEDESC2* desc,
+    IDirectDrawSurface7** surface, IUnknown* outer);
+typedef HRESULT(WINAPI* SurfaceBltFn)(void* self, RECT* destinationRect,
+    IDirectDrawSurface7* source, RECT* sourceRect, DWORD flags, DDBLTFX* fx);
+typedef HRESULT(WINAPI* SurfaceBltFastFn)(void* self, DWORD x, DWORD y,
+    IDirectDrawSurface7* source, RECT* sourceRect, DWORD flags);
+typedef HRESULT(WINAPI* PreLoadFn)(void* self, IDirectDrawSurface7* texture);
+typedef HRESULT(WINAPI* GetTextureFn)(void* self, DWORD stage,
+    IDirectDrawSurface7** texture);
+typedef HRESULT(WINAPI* SetTextureFn)(void* self, DWORD stage,
+    IDirectDrawSurface7* texture);
+typedef HRESULT(WINAPI* LoadFn)(void* self, IDirectDrawSurface7* destination,
+    POINT* destinationPoint, IDirectDrawSurface7* source, RECT* sourceRect,
+    DWORD flags);
+
+static CreateSurfaceFn g_originalCreateSurface = nullptr;
+static SurfaceBltFn g_originalSurfaceBlt = nullptr;
+static SurfaceBltFastFn g_originalSurfaceBltFast = nullptr;
+static PreLoadFn g_originalPreLoad = nullptr;
+static GetTextureFn g_originalGetTexture = nullptr;
+static SetTextureFn g_originalSetTexture = nullptr;
+static LoadFn g_originalLoad = nullptr;
+
+static bool g_dedupEnabled = false;
+static bool g_useSse2 = false;
+static std::mutex g_dedupMutex;
+static TextureDedupTable g_dedupTable;
+static void* g_proxyVtable = nullptr;
+static std::atomic<uint64_t> g_proxiesCreated{ 0 };
+static std::atomic<uint64_t> g_textureCopies{ 0 };
+static std::atomic<uint64_t> g_hashCollisions{ 0 };
+
+// The proxy last set on each texture stage, so GetTexture can hand it back.
+// Not a reference: a proxy clears its stages when it is deleted.
+static std::mutex g_stageMutex;
+static void* g_stageProxies[TEXTURE_STAGES] = { nullptr };
+
+// Bytes of one row of pixels, without pitch padding
+static size_t GetRowBytes(const DDSURFACEDESC2& desc) {
+    return static_cast<size_t>(desc.dwWidth) *
+        (desc.ddpfPixelFormat.dwRGBBitCount / 8);
+}
+
+// Hash the pixels and layout of a surface
+static bool HashSurface(IDirectDrawSurface7* surface, TextureKey& key) {
+    DDSURFACEDESC2 desc = { 0 };
+    desc.dwSize = sizeof(desc);
+    if (FAILED(surface->Lock(NULL, &desc, DDLOCK_WAIT | DDLOCK_READONLY, NULL))) {
+        return false;
+    }
+    ContentHasher content(g_useSse2);
+    size_t rowBytes = GetRowBytes(desc);
+    const unsigned char* row = static_cast<const unsigned char*>(desc.lpSurface);
+    for (DWORD y = 0; y < desc.dwHeight; ++y, row += desc.lPitch) {
+        content.Update(row, rowBytes);
+    }
+    surface->Unlock(NULL);
+
+    struct Layout {
+        DWORD width, height, caps, caps2;
+        DDPIXELFORMAT format;
+        DWORD hasColorKey;
+        DDCOLORKEY colorKey;
+    } layout = { 0 };
+    layout.width = desc.dwWidth;
+    layout.height = desc.dwHeight;
+    layout.caps = desc.ddsCaps.dwCaps;
+    layout.caps2 = desc.ddsCaps.dwCaps2;
+    layout.format = desc.ddpfPixelFormat;
+    layout.hasColorKey = SUCCEEDED(surface->GetColorKey(DDCKEY_SRCBLT,
+        &layout.colorKey)) ? 1 : 0;
+    ContentHasher layoutHasher(false);
+    layoutHasher.Update(&layout, sizeof(layout));
+
+    key.contentHash = content.Finish();
+    key.layoutHash = layoutHasher.Finish();
+    return true;
+}
+
+// Confirm a hash match byte by byte
+static bool SameContent(IDirectDrawSurface7* a, IDirectDrawSurface7* b) {
+    DDSURFACEDESC2 descA = { 0 }, descB = { 0 };
+    descA.dwSize = descB.dwSize = sizeof(DDSURFACEDESC2);
+    if (FAILED(a->Lock(NULL, &descA, DDLOCK_WAIT | DDLOCK_READONLY, NULL))) {
+        return false;
+    }
+    if (FAILED(b->Lock(NULL, &descB, DDLOCK_WAIT | DDLOCK_READONLY, NULL))) {
+        a->Unlock(NULL);
+        return false;
+    }
+    bool same = descA.dwWidth == descB.dwWidth &&
+        descA.dwHeight == descB.dwHeight &&
+        GetRowBytes(descA) == GetRowBytes(descB);
+    size_t rowBytes = GetRowBytes(descA);
+    const unsigned char* rowA = static_cast<const unsigned char*>(descA.lpSurface);
+    const unsigned char* rowB = static_cast<const unsigned char*>(descB.lpSurface);
+    for (DWORD y = 0; same && y < descA.dwHeight; ++y) {
+        same = memcmp(rowA, rowB, rowBytes) == 0;
+        rowA += descA.lPitch;
+        rowB += descB.lPitch;
+    }
+    b->Unlock(NULL);
+    a->Unlock(NULL);
+    return same;
+}
+
+class SurfaceProxy final : public IDirectDrawSurface7 {
+public:
+    SurfaceProxy(void* directDraw, IDirectDrawSurface7* real,
+        const DDSURFACEDESC2& createDesc)
+        : m_directDraw(directDraw), m_real(real), m_createDesc(createDesc) {
+        DDSURFACEDESC2 desc = { 0 };
+        desc.dwSize = sizeof(desc);
+        if (SUCCEEDED(real->GetSurfaceDesc(&desc))) {
+            m_bytes = static_cast<uint64_t>(desc.lPitch) * desc.dwHeight;
+        }
+    }
+
+    IDirectDrawSurface7* Real() const { return m_real; }
+
+    // Writes through paths other than this object (IDirect3DDevice7::Load)
+    bool BeginExternalWrite() { return Unshare(); }
+    void EndExternalWrite() { TryShare(); }
+
+    // IUnknown
+    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID iid, void** object) override {
+        if (object == nullptr) {
+            return E_POINTER;
+        }
+        if (memcmp(&iid, &GUID_UNKNOWN, sizeof(GUID)) == 0 ||
+            memcmp(&iid, &GUID_DIRECTDRAW_SURFACE7, sizeof(GUID)) == 0) {
+            AddRef();
+            *object = this;
+            return S_OK;
+        }
+        // Another interface reaches the real surface directly; it must never
+        // change under it
+        Detach();
+        return m_real->QueryInterface(iid, object);
+    }
+    ULONG STDMETHODCALLTYPE AddRef() override {
+        return static_cast<ULONG>(InterlockedIncrement(&m_references));
+    }
+    // AddRef unless the last reference is already gone
+    bool TryAddRef() {
+        LONG references = m_references;
+        while (references > 0) {
+            LONG seen = InterlockedCompareExchange(&m_references,
+                references + 1, references);
+            if (seen == references) {
+                return true;
+            }
+            references = seen;
+        }
+        return false;
+    }
+    ULONG STDMETHODCALLTYPE Release() override {
+        LONG references = InterlockedDecrement(&m_references);
+        if (references == 0) {
+            if (m_registered) {
+                std::lock_guard<std::mutex> lock(g_dedupMutex);
+                g_dedupTable.Release(m_key, reinterpret_cast<uintptr_t>(m_real));
+            }
+            {
+                std::lock_guard<std::mutex> lock(g_stageMutex);
+                for (void*& proxy : g_stageProxies) {
+                    if (proxy == this) proxy = nullptr;
+                }
+            }
+            m_real->Release();
+            delete this;
+        }
+        return static_cast<ULONG>(references);
+    }
+
+    // Writing methods: make the surface private first
+    HRESULT STDMETHODCALLTYPE Lock(LPRECT rect, LPDDSURFACEDESC2 desc,
+        DWORD flags, HANDLE event) override {
+        bool write = (flags & DDLOCK_READONLY) == 0;
+        if (write && !Unshare()) {
+            return DDERR_OUTOFMEMORY;
+        }
+        HRESULT result = m_real->Lock(rect, desc, flags, event);
+        if (SUCCEEDED(result) && write) {
+            m_writeLocks++;
+        }
+        return result;
+    }
+    HRESULT STDMETHODCALLTYPE Unlock(LPRECT rect) override {
+        HRESULT result = m_real->Unlock(rect);
+        if (SUCCEEDED(result) && m_writeLocks > 0 && --m_writeLocks == 0) {
+            TryShare();
+        }
+        return result;
+    }
+    HRESULT STDMETHODCALLTYPE GetDC(HDC* dc) override {
+        if (!Unshare()) {
+            return DDERR_OUTOFMEMORY;
+        }
+        HRESULT result = m_real->GetDC(dc);
+        if (SUCCEEDED(result)) {
+            m_writeLocks++;
+        }
+        return result;
+    }
+    HRESULT STDMETHODCALLTYPE ReleaseDC(HDC dc) override {
+        HRESULT result = m_real->ReleaseDC(dc);
+        if (SUCCEEDED(result) && m_writeLocks > 0 && --m_writeLocks == 0) {
+            TryShare();
+        }
+        return result;
+    }
+    HRESULT STDMETHODCALLTYPE Blt(LPRECT destinationRect,
+        LPDIRECTDRAWSURFACE7 source, LPRECT sourceRect, DWORD flags,
+        LPDDBLTFX fx) override {
+        if (!Unshare()) {
+            return DDERR_OUTOFMEMORY;
+        }
+        HRESULT result = m_real->Blt(destinationRect, Unwrap(source),
+            sourceRect, flags, fx);
+        if (SUCCEEDED(result)) {
+            TryShare();
+        }
+        return result;
+    }
+    HRESULT STDMETHODCALLTYPE BltFast(DWORD x, DWORD y,
+        LPDIRECTDRAWSURFACE7 source, LPRECT sourceRect, DWORD flags) override {
+        if (!Unshare()) {
+            return DDERR_OUTOFMEMORY;
+        }
+        HRESULT result = m_real->BltFast(x, y, Unwrap(source), sourceRect, flags);
+        if (SUCCEEDED(result)) {
+            TryShare();
+        }
+        return result;
+    }
+    HRESULT STDMETHODCALLTYPE BltBatch(LPDDBLTBATCH batch, DWORD count,
+        DWORD flags) override {
+        Detach();
+        std::vector<DDBLTBATCH> unwrapped(batch, batch + count);
+        for (DDBLTBATCH& entry : unwrapped) {
+            entry.lpDDSSrc = Unwrap(entry.lpDDSSrc);
+        }
+        return m_real->BltBatch(unwrapped.data(), count, flags);
+    }
+    HRESULT STDMETHODCALLTYPE SetColorKey(DWORD flags, LPDDCOLORKEY key) override {
+        if (!Unshare()) {
+            return DDERR_OUTOFMEMORY;
+        }
+        return m_real->SetColorKey(flags, key);
+    }
+    HRESULT STDMETHODCALLTYPE SetPriority(DWORD priority) override {
+        if (!Unshare()) {
+            return DDERR_OUTOFMEMORY;
+        }
+        return m_real->SetPriority(priority);
+    }
+    HRESULT STDMETHODCALLTYPE SetLOD(DWORD lod) override {
+        if (!Unshare()) {
+            return DDERR_OUTOFMEMORY;
+        }
+        return m_real->SetLOD(lod);
+    }
+    HRESULT STDMETHODCALLTYPE ChangeUniquenessValue() override {
+        if (!Unshare()) {
+            return DDERR_OUTOFMEMORY;
+        }
+        return m_real->ChangeUniquenessValue();
+    }
+
+    // Per-surface state that sharing cannot keep apart: never share again
+    HRESULT STDMETHODCALLTYPE AddAttachedSurface(LPDIRECTDRAWSURFACE7 surface) override {
+        Detach();
+        return m_real->AddAttachedSurface(Unwrap(surface));
+    }
+    HRESULT STDMETHODCALLTYPE DeleteAttachedSurface(DWORD flags,
+        LPDIRECTDRAWSURFACE7 surface) override {
+        Detach();
+        return m_real->DeleteAttachedSurface(flags, Unwrap(surface));
+    }
+    HRESULT STDMETHODCALLTYPE Flip(LPDIRECTDRAWSURFACE7 target, DWORD flags) override {
+        Detach();
+        return m_real->Flip(Unwrap(target), flags);
+    }
+    HRESULT STDMETHODCALLTYPE SetClipper(LPDIRECTDRAWCLIPPER clipper) override {
+        Detach();
+        return m_real->SetClipper(clipper);
+    }
+    HRESULT STDMETHODCALLTYPE SetPalette(LPDIRECTDRAWPALETTE palette) override {
+        Detach();
+        return m_real->SetPalette(palette);
+    }
+    HRESULT STDMETHODCALLTYPE SetSurfaceDesc(LPDDSURFACEDESC2 desc, DWORD flags) override {
+        Detach();
+        return m_real->SetSurfaceDesc(desc, flags);
+    }
+    HRESULT STDMETHODCALLTYPE SetPrivateData(REFGUID tag, LPVOID data,
+        DWORD size, DWORD flags) override {
+        Detach();
+        return m_real->SetPrivateData(tag, data, size, flags);
+    }
+    HRESULT STDMETHODCALLTYPE FreePrivateData(REFGUID tag) override {
+        Detach();
+        return m_real->FreePrivateData(tag);
+    }
+    HRESULT STDMETHODCALLTYPE UpdateOverlay(LPRECT sourceRect,
+        LPDIRECTDRAWSURFACE7 destination, LPRECT destinationRect, DWORD flags,
+        LPDDOVERLAYFX fx) override {
+        Detach();
+        return m_real->UpdateOverlay(sourceRect, Unwrap(destination),
+            destinationRect, flags, fx);
+    }
+    HRESULT STDMETHODCALLTYPE UpdateOverlayZOrder(DWORD flags,
+        LPDIRECTDRAWSURFACE7 reference) override {
+        Detach();
+        return m_real->UpdateOverlayZOrder(flags, Unwrap(reference));
+    }
+    HRESULT STDMETHODCALLTYPE SetOverlayPosition(LONG x, LONG y) override {
+        Detach();
+        return m_real->SetOverlayPosition(x, y);
+    }
+    HRESULT STDMETHODCALLTYPE AddOverlayDirtyRect(LPRECT rect) override {
+        Detach();
+        return m_real->AddOverlayDirtyRect(rect);
+    }
+    HRESULT STDMETHODCALLTYPE UpdateOverlayDisplay(DWORD flags) override {
+        Detach();
+        return m_real->UpdateOverlayDisplay(flags);
+    }
+
+    // Reading methods forward unchanged
+    HRESULT STDMETHODCALLTYPE EnumAttachedSurfaces(LPVOID context,
+        LPDDENUMSURFACESCALLBACK7 callback) override {
+        return m_real->EnumAttachedSurfaces(context, callback);
+    }
+    HRESULT STDMETHODCALLTYPE EnumOverlayZOrders(DWORD flags, LPVOID context,
+        LPDDENUMSURFACESCALLBACK7 callback) override {
+        return m_real->EnumOverlayZOrders(flags, context, callback);
+    }
+    HRESULT STDMETHODCALLTYPE GetAttachedSurface(LPDDSCAPS2 caps,
+        LPDIRECTDRAWSURFACE7* surface) override {
+        return m_real->GetAttachedSurface(caps, surface);
+    }
+    HRESULT STDMETHODCALLTYPE GetBltStatus(DWORD flags) override {
+        return m_real->GetBltStatus(flags);
+    }
+    HRESULT STDMETHODCALLTYPE GetCaps(LPDDSCAPS2 caps) override {
+        return m_real->GetCaps(caps);
+    }
+    HRESULT STDMETHODCALLTYPE GetClipper(LPDIRECTDRAWCLIPPER* clipper) override {
+        return m_real->GetClipper(clipper);
+    }
+    HRESULT STDMETHODCALLTYPE GetColorKey(DWORD flags, LPDDCOLORKEY key) override {
+        return m_real->GetColorKey(flags, key);
+    }
+    HRESULT STDMETHODCALLTYPE GetFlipStatus(DWORD flags) override {
+        return m_real->GetFlipStatus(flags);
+    }
+    HRESULT STDMETHODCALLTYPE GetOverlayPosition(LPLONG x, LPLONG y) override {
+        return m_real->GetOverlayPosition(x, y);
+    }
+    HRESULT STDMETHODCALLTYPE GetPalette(LPDIRECTDRAWPALETTE* palette) override {
+        return m_real->GetPalette(palette);
+    }
+    HRESULT STDMETHODCALLTYPE GetPixelFormat(LPDDPIXELFORMAT format) override {
+        return m_real->GetPixelFormat(format);
+    }
+    HRESULT STDMETHODCALLTYPE GetSurfaceDesc(LPDDSURFACEDESC2 desc) override {
+        return m_real->GetSurfaceDesc(desc);
+    }
+    HRESULT STDMETHODCALLTYPE Initialize(LPDIRECTDRAW directDraw,
+        LPDDSURFACEDESC2 desc) override {
+        return m_real->Initialize(directDraw, desc);
+    }
+    HRESULT STDMETHODCALLTYPE IsLost() override {
+        return m_real->IsLost();
+    }
+    HRESULT STDMETHODCALLTYPE Restore() override {
+        return m_real->Restore();
+    }
+    HRESULT STDMETHODCALLTYPE GetDDInterface(LPVOID* directDraw) override {
+        return m_real->GetDDInterface(directDraw);
+    }
+    HRESULT STDMETHODCALLTYPE PageLock(DWORD flags) override {
+        return m_real->PageLock(flags);
+    }
+    HRESULT STDMETHODCALLTYPE PageUnlock(DWORD flags) override {
+        return m_real->PageUnlock(flags);
+    }
+    HRESULT STDMETHODCALLTYPE GetPrivateData(REFGUID tag, LPVOID data,
+        LPDWORD size) override {
+        return m_real->GetPrivateData(tag, data, size);
+    }
+    HRESULT STDMETHODCALLTYPE GetUniquenessValue(LPDWORD value) override {
+        return m_real->GetUniquenessValue(value);
+    }
+    HRESULT STDMETHODCALLTYPE GetPriority(LPDWORD priority) override {
+        return m_real->GetPriority(priority);
+    }
+    HRESULT STDMETHODCALLTYPE GetLOD(LPDWORD lod) override {
+        return m_real->GetLOD(lod);
+    }
+
+    static IDirectDrawSurface7* Unwrap(IDirectDrawSurface7* surface);
+
+private:
+    ~SurfaceProxy() = default;
+
+    IDirectDrawSurface7* CreateCopy();
+    bool Unshare();
+    void Detach();
+    void TryShare();
+
+    void* m_directDraw;          // Creator, for copies
+    IDirectDrawSurface7* m_real; // One reference held
+    DDSURFACEDESC2 m_createDesc;
+    uint64_t m_bytes = 0;
+    LONG m_references = 1;
+    int m_writeLocks = 0;
+    int m_writes = 0;
+    bool m_pinned = false;       // Never shared again
+    bool m_registered = false;   // m_real is counted in the table under m_key
+    TextureKey m_key = { 0, 0 };
+};
+
+IDirectDrawSurface7* SurfaceProxy::Unwrap(IDirectDrawSurface7* surface) {
+    if (surface != nullptr && g_proxyVtable != nullptr &&
+        *reinterpret_cast<void**>(surface) == g_proxyVtable) {
+        return static_cast<SurfaceProxy*>(surface)->Real();
+    }
+    return surface;
+}
+
+// A new surface like the one this proxy was created with, holding a copy of
+// the current pixels and color key
+IDirectDrawSurface7* SurfaceProxy::CreateCopy() {
+    DDSURFACEDESC2 createDesc = m_createDesc;
+    IDirectDrawSurface7* copy = nullptr;
+    if (FAILED(g_originalCreateSurface(m_directDraw, &createDesc, &copy,
+        nullptr)) || copy == nullptr) {
+        return nullptr;
+    }
+
+    DDSURFACEDESC2 source = { 0 }, destination = { 0 };
+    source.dwSize = destination.dwSize = sizeof(DDSURFACEDESC2);
+    if (FAILED(m_real->Lock(NULL, &source, DDLOCK_WAIT | DDLOCK_READONLY, NULL))) {
+        copy->Release();
+        return nullptr;
+    }
+    if (FAILED(copy->Lock(NULL, &destination, DDLOCK_WAIT | DDLOCK_WRITEONLY,
+        NULL))) {
+        m_real->Unlock(NULL);
+        copy->Release();
+        return nullptr;
+    }
+    size_t rowBytes = GetRowBytes(source);
+    const unsigned char* from = static_cast<const unsigned char*>(source.lpSurface);
+    unsigned char* to = static_cast<unsigned char*>(destination.lpSurface);
+    for (DWORD y = 0; y < source.dwHeight; ++y) {
+        memcpy(to, from, rowBytes);
+        from += source.lPitch;
+        to += destination.lPitch;
+    }
+    copy->Unlock(NULL);
+    m_real->Unlock(NULL);
+
+    DDCOLORKEY colorKey;
+    if (SUCCEEDED(m_real->GetColorKey(DDCKEY_SRCBLT, &colorKey))) {
+        copy->SetColorKey(DDCKEY_SRCBLT, &colorKey);
+    }
+    DWORD value;
+    if (SUCCEEDED(m_real->GetPriority(&value))) copy->SetPriority(value);
+    if (SUCCEEDED(m_real->GetLOD(&value))) copy->SetLOD(value);
+    g_textureCopies++;
+    return copy;
+}
+
+// Make sure no other texture uses m_real. Fails only if a needed copy
+// could not be made.
+bool SurfaceProxy::Unshare() {
+    if (!m_registered) {
+        return true;
+    }
+    std::lock_guard<std::mutex> lock(g_dedupMutex);
+    if (g_dedupTable.References(m_key) > 1) {
+        IDirectDrawSurface7* copy = CreateCopy();
+        if (copy == nullptr) {
+            return false;
+        }
+        g_dedupTable.Release(m_key, reinterpret_cast<uintptr_t>(m_real));
+        m_real->Release();
+        m_real = copy;
+    }
+    else {
+        g_dedupTable.Release(m_key, reinterpret_cast<uintptr_t>(m_real));
+    }
+    m_registered = false;
+    CounterSet(COUNTER_TEXTURE_DEDUP_SAVED_BYTES, g_dedupTable.SavedBytes());
+    return true;
+}
+
+void SurfaceProxy::Detach() {
+    if (!m_pinned) {
+        m_pinned = true;
+        Unshare(); // If no copy can be made, keep sharing until written
+    }
+}
+
+// After a write: switch to a surface that already holds the same content
+void SurfaceProxy::TryShare() {
+    if (m_pinned || m_registered) {
+        return;
+    }
+    if (++m_writes > DEDUP_MAX_WRITES) {
+        m_pinned = true; // Rewritten all the time: dynamic
+        return;
+    }
+    TextureKey key;
+    if (!HashSurface(m_real, key)) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(g_dedupMutex);
+    IDirectDrawSurface7* shared = reinterpret_cast<IDirectDrawSurface7*>(
+        g_dedupTable.Share(key, reinterpret_cast<uintptr_t>(m_real), m_bytes));
+    if (shared != m_real) {
+        if (!SameContent(shared, m_real)) {
+            g_dedupTable.Release(key, reinterpret_cast<uintptr_t>(shared));
+            g_hashCollisions++;
+            return;
+        }
+        shared->AddRef();
+        m_real->Release();
+        m_real = shared;
+    }
+    m_key = key;
+    m_registered = true;
+    CounterSet(COUNTER_TEXTURE_DEDUP_SAVED_BYTES, g_dedupTable.SavedBytes());
+    CounterSet(COUNTER_TEXTURE_DEDUP_UNIQUE, g_dedupTable.UniqueTextures());
+}
+
+// Only plain, non-mipmapped RGB textures that cannot be lost are shared
+static bool CanShare(const DDSURFACEDESC2& desc) {
+    const DDSCAPS2& caps = desc.ddsCaps;
+    if ((caps.dwCaps & DDSCAPS_TEXTURE) == 0 ||
+        (caps.dwCaps & (DDSCAPS_MIPMAP | DDSCAPS_COMPLEX)) != 0 ||
+        (caps.dwCaps2 & DDSCAPS2_CUBEMAP) != 0) {
+        return false;
+    }
+    if ((caps.dwCaps & DDSCAPS_SYSTEMMEMORY) == 0 &&
+        (caps.dwCaps2 & (DDSCAPS2_TEXTUREMANAGE | DDSCAPS2_D3DTEXTUREMANAGE)) == 0) {
+        return false;
+    }
+    const DDPIXELFORMAT& format = desc.ddpfPixelFormat;
+    return (format.dwFlags & DDPF_RGB) != 0 &&
+        (format.dwFlags & (DDPF_FOURCC | DDPF_PALETTEINDEXED8)) == 0 &&
+        format.dwRGBBitCount >= 8 && format.dwRGBBitCount % 8 == 0;
+}
+
+// Surfaces passed to real surfaces' Blt and BltFast may be proxies
+static HRESULT WINAPI HookedSurfaceBlt(void* self, RECT* destinationRect,
+    IDirectDrawSurface7* source, RECT* sourceRect, DWORD flags, DDBLTFX* fx) {
+    return g_originalSurfaceBlt(self, destinationRect,
+        SurfaceProxy::Unwrap(source), sourceRect, flags, fx);
+}
+
+static HRESULT WINAPI HookedSurfaceBltFast(void* self, DWORD x, DWORD y,
+    IDirectDrawSurface7* source, RECT* sourceRect, DWORD flags) {
+    return g_originalSurfaceBltFast(self, x, y, SurfaceProxy::Unwrap(source),
+        sourceRect, flags);
+}
+
+static HRESULT WINAPI HookedCreateSurface(void* self, DDSURFACEDESC2* desc,
+    IDirectDrawSurface7** surface, IUnknown* outer) {
+    HRESULT result = g_originalCreateSurface(self, desc, surface, outer);
+    if (FAILED(result) || surface == nullptr || *surface == nullptr ||
+        desc == nullptr || outer != nullptr) {
+        return result;
+    }
+    IDirectDrawSurface7* real = *surface;
+    if (g_originalSurfaceBlt == nullptr) {
+        // Every real surface shares this vtable
+        HookVtableEntry(real, SURFACE7_SLOT_BLT,
+            reinterpret_cast<const void*>(HookedSurfaceBlt),
+            reinterpret_cast<void**>(&g_originalSurfaceBlt));
+        HookVtableEntry(real, SURFACE7_SLOT_BLT_FAST,
+            reinterpret_cast<const void*>(HookedSurfaceBltFast),
+            reinterpret_cast<void**>(&g_originalSurfaceBltFast));
+        if (g_originalSurfaceBlt == nullptr || g_originalSurfaceBltFast == nullptr) {
+            Log("Warning: Could not hook surface blits. Texture Dedup not applied.");
+            g_dedupEnabled = false;
+        }
+    }
+
+    DDSURFACEDESC2 actual = { 0 };
+    actual.dwSize = sizeof(actual);
+    if (!g_dedupEnabled || g_originalSetTexture == nullptr ||
+        FAILED(real->GetSurfaceDesc(&actual)) ||
+        !CanShare(actual)) {
+        return result;
+    }
+    SurfaceProxy* proxy = new (std::nothrow) SurfaceProxy(self, real, *desc);
+    if (proxy == nullptr) {
+        return result;
+    }
+    g_proxyVtable = *reinterpret_cast<void**>(proxy);
+    g_proxiesCreated++;
+    *surface = proxy;
+    return result;
+}
+
+static HRESULT WINAPI HookedPreLoad(void* self, IDirectDrawSurface7* texture) {
+    return g_originalPreLoad(self, SurfaceProxy::Unwrap(texture));
+}
+
+static HRESULT WINAPI HookedSetTexture(void* self, DWORD stage,
+    IDirectDrawSurface7* texture) {
+    HRESULT result = g_originalSetTexture(self, stage,
+        SurfaceProxy::Unwrap(texture));
+    if (SUCCEEDED(result) && stage < TEXTURE_STAGES) {
+        std::lock_guard<std::mutex> lock(g_stageMutex);
+        g_stageProxies[stage] = SurfaceProxy::Unwrap(texture) != texture ?
+            texture : nullptr;
+    }
+    return result;
+}
+
+// The device holds the real surface; give the game back the proxy it set
+static HRESULT WINAPI HookedGetTexture(void* self, DWORD stage,
+    IDirectDrawSurface7** texture) {
+    HRESULT result = g_originalGetTexture(self, stage, texture);
+    if (FAILED(result) || texture == nullptr || *texture == nullptr ||
+        stage >= TEXTURE_STAGES) {
+        return result;
+    }
+    std::lock_guard<std::mutex> lock(g_stageMutex);
+    SurfaceProxy* proxy = static_cast<SurfaceProxy*>(
+        static_cast<IDirectDrawSurface7*>(g_stageProxies[stage]));
+    if (proxy != nullptr && proxy->TryAddRef()) {
+        (*texture)->Release();
+        *texture = proxy;
+    }
+    return result;
+}
+
+// Load writes into its destination like a blit
+static HRESULT WINAPI HookedLoad(void* self, IDirectDrawSurface7* destination,
+    POINT* destinationPoint, IDirectDrawSurface7* source, RECT* sourceRect,
+    DWORD flags) {
+    SurfaceProxy* proxy = SurfaceProxy::Unwrap(destination) != destination ?
+        static_cast<SurfaceProxy*>(destination) : nullptr;
+    if (proxy != nullptr && !proxy->BeginExternalWrite()) {
+        return DDERR_OUTOFMEMORY;
+    }
+    HRESULT result = g_originalLoad(self, SurfaceProxy::Unwrap(destination),
+        destinationPoint, SurfaceProxy::Unwrap(source), sourceRect, flags);
+    if (proxy != nullptr && SUCCEEDED(result)) {
+        proxy->EndExternalWrite();
+    }
+    return result;
+}
+
+// Read config. Returns true if the Direct3D hooks are needed.
+bool InitializeTextureDedup() {
+    Log("Checking Texture Dedup...");
+    if (!GetConfigBool("TextureDedupEnabled", false)) {
+        Log("Texture Dedup is disabled in config.");
+        return false;
+    }
+    g_useSse2 = IsProcessorFeaturePresent(PF_XMMI64_INSTRUCTIONS_AVAILABLE) != 0;
+    g_dedupEnabled = true;
+    return true;
+}
+
+void TextureDedupOnDirectDraw(void* directDraw) {
+    if (!g_dedupEnabled || g_originalCreateSurface != nullptr) {
+        return;
+    }
+    if (!HookVtableEntry(directDraw, DIRECTDRAW7_SLOT_CREATE_SURFACE,
+        reinterpret_cast<const void*>(HookedCreateSurface),
+        reinterpret_cast<void**>(&g_originalCreateSurface))) {
+        Log("Warning: Could not hook IDirectDraw7::CreateSurface. Texture "
+            "Dedup not applied.");
+        g_dedupEnabled = false;
+    }
+}
+
+// Textures reach the device as proxies; give it the real surfaces. Installed
+// after the state filter so the filter sees real surfaces too. Proxies are
+// only made once these hooks are in place.
+void TextureDedupOnDevice(void* device) {
+    if (g_originalCreateSurface == nullptr || g_originalSetTexture != nullptr) {
+        return;
+    }
+    bool hooked =
+        HookVtableEntry(device, DEVICE_SLOT_PRELOAD,
+            reinterpret_cast<const void*>(HookedPreLoad),
+            reinterpret_cast<void**>(&g_originalPreLoad)) &&
+        HookVtableEntry(device, DEVICE_SLOT_GET_TEXTURE,
+            reinterpret_cast<const void*>(HookedGetTexture),
+            reinterpret_cast<void**>(&g_originalGetTexture)) &&
+        HookVtableEntry(device, DEVICE_SLOT_SET_TEXTURE,
+            reinterpret_cast<const void*>(HookedSetTexture),
+            reinterpret_cast<void**>(&g_originalSetTexture)) &&
+        HookVtableEntry(device, DEVICE_SLOT_LOAD,
+            reinterpret_cast<const void*>(HookedLoad),
+            reinterpret_cast<void**>(&g_originalLoad));
+    if (!hooked) {
+        Log("Warning: Could not hook the Direct3D texture calls. Texture Dedup "
+            "not applied.");
+        g_dedupEnabled = false;
+        g_originalSetTexture = nullptr; // No proxies without all four
+    }
+}
+
+// Log the savings. Called at shutdown.
+void ShutdownTextureDedup() {
+    if (g_proxiesCreated == 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(g_dedupMutex);
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(1) << "Texture Dedup: "
+        << g_proxiesCreated << " textures, " << g_dedupTable.UniqueTextures()
+        << " distinct contents, "
+        << g_dedupTable.SavedBytes() / (1024.0 * 1024.0) << " MB saved (peak "
+        << g_dedupTable.PeakSavedBytes() / (1024.0 * 1024.0) << " MB), "
+        << g_textureCopies << " copies on write, " << g_hashCollisions
+        << " hash collisions.";
+    Log(ss.str());
+}
+#endif
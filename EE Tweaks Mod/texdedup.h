@@ -0,0 +1,77 @@
+#ifndef TEXDEDUP_H
+#define TEXDEDUP_H
+
+#include "pch.h"
+
+// 64-bit hash of a byte stream for spotting identical texture contents.
+// Works on 64-byte stripes with eight multiply-accumulate lanes; the SSE2
+// and scalar paths give the same result. Not a cryptographic hash: equal
+// hashes are confirmed by comparing the data.
+class ContentHasher {
+public:
+    explicit ContentHasher(bool useSse2);
+    void Update(const void* data, size_t size);
+    uint64_t Finish();
+
+    static bool Sse2Available(); // Compiled in for this target
+
+private:
+    void ProcessStripes(const unsigned char* data, size_t count);
+
+    alignas(16) uint64_t m_acc[8];
+    unsigned char m_buffer[64];
+    size_t m_buffered = 0;
+    uint64_t m_length = 0;
+    uint64_t m_stripes = 0;
+    bool m_sse2;
+};
+
+// Identifies texture contents: pixel hash plus a hash of everything else
+// that must match for two surfaces to be interchangeable
+struct TextureKey {
+    uint64_t contentHash;
+    uint64_t layoutHash; // Size, pixel format, caps, color key
+    bool operator<(const TextureKey& other) const {
+        return contentHash != other.contentHash ?
+            contentHash < other.contentHash : layoutHash < other.layoutHash;
+    }
+};
+
+// Which surface holds each distinct texture content, and how many textures
+// use it. Not thread-safe.
+class TextureDedupTable {
+public:
+    // Register a texture whose content is in surface. Returns the surface
+    // that already holds the same content (taking a reference on it), or
+    // surface itself if the content is new.
+    uintptr_t Share(const TextureKey& key, uintptr_t surface, uint64_t bytes);
+    // Drop a reference taken by Share. Returns true if it was the last one.
+    bool Release(const TextureKey& key, uintptr_t surface);
+    uint32_t References(const TextureKey& key) const;
+
+    size_t UniqueTextures() const { return m_entries.size(); }
+    uint64_t SavedBytes() const { return m_savedBytes; }
+    uint64_t PeakSavedBytes() const { return m_peakSavedBytes; }
+
+private:
+    struct Entry {
+        uintptr_t surface;
+        uint32_t references;
+        uint64_t bytes;
+    };
+    std::map<TextureKey, Entry> m_entries;
+    uint64_t m_savedBytes = 0;
+    uint64_t m_peakSavedBytes = 0;
+};
+
+// Function declarations
+#ifdef _WIN32
+bool InitializeTextureDedup(); // Reads config
+void ShutdownTextureDedup();
+
+// Called from the Direct3D hook chain (d3dhooks.cpp)
+void TextureDedupOnDirectDraw(void* directDraw);
+void TextureDedupOnDevice(void* device);
+#endif
+
+#endif // TEXDEDUP_H
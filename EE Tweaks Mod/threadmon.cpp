@@ -0,0 +1,424 @@
+#include "pch.h"
+#include "threadmon.h"
+
+#ifdef _WIN32
+#include <tlhelp32.h>
+#include "globals.h"  // Access g_dllDir, g_mainThreadId, THREAD_MONITOR_FILE
+#include "logging.h"  // Access Log()
+#include "config.h"   // Access config functions
+#include "counters.h"
+#elif defined(__linux__)
+#include <dirent.h>
+#include <cstdlib>
+#include <unistd.h>
+#endif
+
+// --- Thread Sampling ---
+
+#ifdef _WIN32
+typedef LONG(NTAPI* NtQueryInformationThreadFn)(HANDLE thread, int infoClass,
+    PVOID info, ULONG infoLength, PULONG returnLength);
+const int THREAD_QUERY_SET_WIN32_START_ADDRESS = 9; // THREADINFOCLASS
+
+static uint64_t FileTimeTo100ns(const FILETIME& time) {
+    return (static_cast<uint64_t>(time.dwHighDateTime) << 32) |
+        time.dwLowDateTime;
+}
+
+bool SampleProcessThreads(std::vector<ThreadSample>& threads) {
+    static NtQueryInformationThreadFn queryThread =
+        reinterpret_cast<NtQueryInformationThreadFn>(GetProcAddress(
+            GetModuleHandleA("ntdll.dll"), "NtQueryInformationThread"));
+    threads.clear();
+    HANDLE snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPTHREAD, 0);
+    if (snapshot == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    DWORD processId = GetCurrentProcessId();
+    THREADENTRY32 entry = { 0 };
+    entry.dwSize = sizeof(entry);
+    for (BOOL more = Thread32First(snapshot, &entry); more;
+        more = Thread32Next(snapshot, &entry)) {
+        if (entry.th32OwnerProcessID != processId) {
+            continue;
+        }
+        HANDLE thread = OpenThread(THREAD_QUERY_INFORMATION, FALSE,
+            entry.th32ThreadID);
+        if (thread == NULL) {
+            continue; // Ended since the snapshot
+        }
+        ThreadSample sample = { entry.th32ThreadID, 0, std::string(), 0, 0 };
+        FILETIME creation, exit, kernel, user;
+        if (GetThreadTimes(thread, &creation, &exit, &kernel, &user)) {
+            sample.cpuMicros = (FileTimeTo100ns(kernel) + FileTimeTo100ns(user)) / 10;
+        }
+        ULONG64 cycles = 0;
+        if (QueryThreadCycleTime(thread, &cycles)) {
+            sample.cycles = cycles;
+        }
+        PVOID start = nullptr;
+        if (queryThread != nullptr && queryThread(thread,
+            THREAD_QUERY_SET_WIN32_START_ADDRESS, &start, sizeof(start), NULL) == 0) {
+            sample.startAddress = reinterpret_cast<uintptr_t>(start);
+        }
+        CloseHandle(thread);
+        threads.push_back(sample);
+    }
+    CloseHandle(snapshot);
+    return true;
+}
+#elif defined(__linux__)
+bool SampleProcessThreads(std::vector<ThreadSample>& threads) {
+    threads.clear();
+    DIR* tasks = opendir("/proc/self/task");
+    if (tasks == nullptr) {
+        return false;
+    }
+    const uint64_t ticksPerSecond = static_cast<uint64_t>(sysconf(_SC_CLK_TCK));
+    while (dirent* entry = readdir(tasks)) {
+        if (entry->d_name[0] < '0' || entry->d_name[0] > '9') {
+            continue;
+        }
+        std::ifstream stat(std::string("/proc/self/task/") + entry->d_name +
+            "/stat");
+        std::string line;
+        size_t open = std::string::npos;
+        size_t close = std::string::npos;
+        if (!std::getline(stat, line) ||
+            (open = line.find('(')) == std::string::npos ||
+            (close = line.rfind(')')) == std::string::npos || close < open) {
+            continue; // Ended meanwhile
+        }
+        // "tid (name) state ...": utime and stime are fields 14 and 15
+        std::istringstream fields(line.substr(close + 1));
+        std::string field;
+        uint64_t ticks = 0;
+        for (int index = 3; index <= 15 && fields >> field; ++index) {
+            if (index >= 14) ticks += std::strtoull(field.c_str(), nullptr, 10);
+        }
+        ThreadSample sample = {
+            static_cast<uint32_t>(std::strtoul(entry->d_name, nullptr, 10)), 0,
+            line.substr(open + 1, close - open - 1),
+            ticks * 1000000 / ticksPerSecond, 0 };
+        threads.push_back(sample);
+    }
+    closedir(tasks);
+    return true;
+}
+#endif
+
+// --- Thread Identification ---
+
+// Modules whose threads have a known job. Threads started through the C
+// runtime (_beginthreadex, std::thread) show the runtime's start routine
+// and keep their module+RVA only.
+struct ThreadRole {
+    const char* module;
+    const char* role;
+};
+
+static const ThreadRole THREAD_ROLES[] = {
+    { "EE-AOC.exe", "game" },
+    { "Empire Earth.exe", "game" },
+    { "mss32.dll", "Miles" },
+    { "DX7HRTnLDisplay.dll", "renderer" },
+    { "DX7HRDisplay.dll", "renderer" },
+    { "ddraw.dll", "DirectDraw" },
+    { "d3dim700.dll", "Direct3D" },
+    { "dsound.dll", "DirectSound" },
+    { "dplayx.dll", "DirectPlay" },
+    { "winmm.dll", "winmm" },
+    { "tweaks.dll", "tweaks" },
+    { "ntdll.dll", "system" },
+};
+
+static bool SameModuleName(const std::string& a, const char* b) {
+    size_t length = strlen(b);
+    if (a.size() != length) {
+        return false;
+    }
+    for (size_t i = 0; i < length; ++i) {
+        if (std::tolower(static_cast<unsigned char>(a[i])) !=
+            std::tolower(static_cast<unsigned char>(b[i]))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string IdentifyThread(const ThreadSample& thread, uint32_t mainThreadId,
+    const ModuleMap& modules) {
+    std::string where = thread.startAddress != 0 ?
+        modules.Describe(thread.startAddress) : thread.name;
+    if (thread.id == mainThreadId) {
+        return where.empty() ? "main" : "main (" + where + ")";
+    }
+    const ModuleRange* module = thread.startAddress != 0 ?
+        modules.Find(thread.startAddress) : nullptr;
+    if (module != nullptr) {
+        for (const ThreadRole& role : THREAD_ROLES) {
+            if (SameModuleName(module->name, role.module)) {
+                return std::string(role.role) + " (" + where + ")";
+            }
+        }
+    }
+    return where.empty() ? "unknown" : where;
+}
+
+// --- Usage Tracker ---
+
+void ThreadUsageTracker::Update(uint64_t wallMicros,
+    const std::vector<ThreadSample>& threads, const Identify& identify) {
+    bool first = m_updates == 0;
+    uint64_t previous = m_lastMicros;
+    m_intervalMicros = first ? 0 : wallMicros - previous;
+    if (first) {
+        m_firstMicros = wallMicros;
+    }
+    m_lastMicros = wallMicros;
+    m_updates++;
+
+    std::map<uint32_t, size_t> alive;
+    for (const ThreadSample& sample : threads) {
+        auto known = m_aliveIndex.find(sample.id);
+        if (known != m_aliveIndex.end()) {
+            ThreadUsage& usage = m_threads[known->second];
+            if (sample.cpuMicros >= usage.lastCpuMicros &&
+                sample.startAddress == usage.startAddress) {
+                uint64_t cpu = sample.cpuMicros - usage.lastCpuMicros;
+                uint64_t cycles = sample.cycles >= usage.lastCycles ?
+                    sample.cycles - usage.lastCycles : 0;
+                usage.cpuMicros += cpu;
+                usage.cycles += cycles;
+                usage.intervalCycles = cycles;
+                usage.utilization = m_intervalMicros != 0 ?
+                    static_cast<double>(cpu) / m_intervalMicros : 0.0;
+                usage.peakUtilization = std::max(usage.peakUtilization,
+                    usage.utilization);
+                usage.lastSeenMicros = wallMicros;
+                usage.lastCpuMicros = sample.cpuMicros;
+                usage.lastCycles = sample.cycles;
+                alive[sample.id] = known->second;
+                continue;
+            }
+            usage.alive = false; // The id was reused by a new thread
+        }
+
+        // New: a baseline on the first sample, else it ran only in this interval
+        ThreadUsage usage;
+        usage.id = sample.id;
+        usage.startAddress = sample.startAddress;
+        usage.label = identify(sample);
+        usage.alive = true;
+        usage.firstSeenMicros = first ? wallMicros : previous;
+        usage.lastSeenMicros = wallMicros;
+        usage.cpuMicros = first ? 0 : sample.cpuMicros;
+        usage.cycles = first ? 0 : sample.cycles;
+        usage.intervalCycles = usage.cycles;
+        usage.utilization = m_intervalMicros != 0 ?
+            static_cast<double>(usage.cpuMicros) / m_intervalMicros : 0.0;
+        usage.peakUtilization = usage.utilization;
+        usage.lastCpuMicros = sample.cpuMicros;
+        usage.lastCycles = sample.cycles;
+        alive[sample.id] = m_threads.size();
+        m_threads.push_back(usage);
+    }
+
+    for (const auto& entry : m_aliveIndex) {
+        if (alive.find(entry.first) == alive.end() ||
+            alive[entry.first] != entry.second) {
+            ThreadUsage& ended = m_threads[entry.second];
+            ended.alive = false;
+            ended.utilization = 0.0;
+            ended.intervalCycles = 0;
+        }
+    }
+    m_aliveIndex.swap(alive);
+}
+
+double ThreadUsageTracker::ProcessUtilization() const {
+    double total = 0.0;
+    for (const auto& entry : m_aliveIndex) {
+        total += m_threads[entry.second].utilization;
+    }
+    return total;
+}
+
+// --- Reports ---
+
+void WriteThreadSeriesHeader(std::ostream& out) {
+    out << "seconds,thread,label,cpu_percent,megacycles\n";
+}
+
+void WriteThreadSeriesRows(std::ostream& out, const ThreadUsageTracker& tracker) {
+    if (!tracker.HasInterval()) {
+        return;
+    }
+    std::stringstream rows;
+    rows << std::fixed;
+    double seconds = tracker.MonitoredMicros() / 1000000.0;
+    for (const ThreadUsage& usage : tracker.Threads()) {
+        if (!usage.alive) {
+            continue;
+        }
+        std::string label = usage.label;
+        std::replace(label.begin(), label.end(), ',', ' ');
+        rows << std::setprecision(1) << seconds << ',' << usage.id << ',' << label
+            << ',' << usage.utilization * 100 << ',' << std::setprecision(2)
+            << usage.intervalCycles / 1000000.0 << '\n';
+    }
+    out << rows.str();
+}
+
+std::vector<std::string> SummarizeThreads(const ThreadUsageTracker& tracker,
+    size_t maxThreads) {
+    std::vector<const ThreadUsage*> threads;
+    for (const ThreadUsage& usage : tracker.Threads()) {
+        threads.push_back(&usage);
+    }
+    std::stable_sort(threads.begin(), threads.end(),
+        [](const ThreadUsage* a, const ThreadUsage* b) {
+            return a->cpuMicros > b->cpuMicros;
+        });
+    std::vector<std::string> lines;
+    for (size_t i = 0; i < threads.size() && i < maxThreads; ++i) {
+        const ThreadUsage& usage = *threads[i];
+        uint64_t lifetime = usage.lastSeenMicros - usage.firstSeenMicros;
+        std::stringstream ss;
+        ss << std::fixed << std::setprecision(1) << usage.label << ", thread "
+            << usage.id << ": " << usage.cpuMicros / 1000000.0 << " s CPU ("
+            << std::setprecision(0)
+            << (lifetime != 0 ? usage.cpuMicros * 100.0 / lifetime : 0.0)
+            << "% of a core on average, " << usage.peakUtilization * 100
+            << "% peak";
+        if (usage.cycles != 0) {
+            ss << ", " << usage.cycles / 1000000 << " Mcycles";
+        }
+        ss << (usage.alive ? ")" : ", ended)");
+        lines.push_back(ss.str());
+    }
+    return lines;
+}
+
+// --- Background Monitor ---
+
+#ifdef _WIN32
+static HANDLE g_monitorThread = NULL;
+static volatile bool g_monitorStop = false;
+static DWORD g_monitorIntervalMs = 1000;
+static std::mutex g_monitorMutex; // Tracker, modules and series file
+static ThreadUsageTracker g_tracker;
+static ModuleMap g_modules;
+static std::ofstream g_seriesFile;
+
+static uint64_t ReadWallMicros() {
+    static LARGE_INTEGER frequency = { 0 };
+    if (frequency.QuadPart == 0) QueryPerformanceFrequency(&frequency);
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return static_cast<uint64_t>(now.QuadPart / frequency.QuadPart * 1000000 +
+        now.QuadPart % frequency.QuadPart * 1000000 / frequency.QuadPart);
+}
+
+static std::string IdentifyNewThread(const ThreadSample& thread) {
+    // Modules load at any time; refresh when a start address is in none
+    if (thread.startAddress != 0 && g_modules.Find(thread.startAddress) == nullptr) {
+        g_modules.Refresh();
+    }
+    return IdentifyThread(thread, g_mainThreadId, g_modules);
+}
+
+static DWORD WINAPI MonitorThreadProc(LPVOID) {
+    std::vector<ThreadSample> threads;
+    for (;;) {
+        if (!SampleProcessThreads(threads)) {
+            Log("Error: Thread monitor could not list the threads. Error "
+                "code: " + std::to_string(GetLastError()));
+            return 1;
+        }
+        {
+            std::lock_guard<std::mutex> lock(g_monitorMutex);
+            g_tracker.Update(ReadWallMicros(), threads, IdentifyNewThread);
+            if (g_seriesFile.is_open()) {
+                WriteThreadSeriesRows(g_seriesFile, g_tracker);
+                g_seriesFile.flush();
+            }
+            for (const ThreadUsage& usage : g_tracker.Threads()) {
+                if (usage.alive && usage.id == g_mainThreadId) {
+                    CounterSet(COUNTER_MAIN_THREAD_CPU_PERCENT,
+                        static_cast<uint64_t>(usage.utilization * 100 + 0.5));
+                }
+            }
+            CounterSet(COUNTER_PROCESS_CPU_PERCENT,
+                static_cast<uint64_t>(g_tracker.ProcessUtilization() * 100 + 0.5));
+        }
+        if (g_monitorStop) {
+            return 0;
+        }
+        Sleep(g_monitorIntervalMs);
+    }
+}
+
+// Start the background monitor if enabled in config
+bool StartThreadMonitor() {
+    if (!GetConfigBool("ThreadMonitorEnabled", false)) {
+        return false;
+    }
+    int interval = GetConfigInt("ThreadMonitorIntervalMs", 1000);
+    if (interval < 100) interval = 100;
+    g_monitorIntervalMs = static_cast<DWORD>(interval);
+
+    std::string seriesPath = g_dllDir + "\\" + THREAD_MONITOR_FILE;
+    g_seriesFile.open(seriesPath, std::ios::trunc);
+    if (g_seriesFile.is_open()) {
+        WriteThreadSeriesHeader(g_seriesFile);
+    }
+    else {
+        Log("Warning: Could not create " + seriesPath + ". Thread monitor "
+            "will only log the summary.");
+    }
+
+    g_monitorStop = false;
+    g_monitorThread = CreateThread(NULL, 0, MonitorThreadProc, NULL, 0, NULL);
+    if (g_monitorThread == NULL) {
+        Log("Error: Could not start the thread monitor thread. Error code: " +
+            std::to_string(GetLastError()));
+        g_seriesFile.close();
+        return false;
+    }
+    Log("Thread monitor started (interval " + std::to_string(interval) +
+        " ms, writing " + seriesPath + ").");
+    return true;
+}
+
+// Log the per-thread summary. Called at shutdown; the monitor thread is
+// stopped first. If it is still sampling after the wait, the summary is
+// skipped.
+void ShutdownThreadMonitor() {
+    if (g_monitorThread == NULL) {
+        return;
+    }
+    g_monitorStop = true;
+    WaitForSingleObject(g_monitorThread, g_monitorIntervalMs + 1000);
+    CloseHandle(g_monitorThread);
+    g_monitorThread = NULL;
+
+    std::unique_lock<std::mutex> lock(g_monitorMutex, std::try_to_lock);
+    if (!lock.owns_lock()) {
+        Log("Thread monitor: stopped during a sample; no summary.");
+        return;
+    }
+    g_seriesFile.close();
+    int rows = GetConfigInt("ThreadMonitorSummaryRows", 10);
+    if (rows < 1) rows = 1;
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(1) << "Thread monitor: "
+        << g_tracker.Threads().size() << " threads over "
+        << g_tracker.MonitoredMicros() / 1000000.0 << " s. Busiest:";
+    Log(ss.str());
+    for (const std::string& line : SummarizeThreads(g_tracker,
+        static_cast<size_t>(rows))) {
+        Log("  " + line);
+    }
+}
+#endif
@@ -0,0 +1,85 @@
+#ifndef THREADMON_H
+#define THREADMON_H
+
+#include "pch.h"
+#include "modulemap.h"
+
+// One thread of the process at one moment
+struct ThreadSample {
+    uint32_t id;
+    uintptr_t startAddress; // 0 where the system does not tell (Linux)
+    std::string name;       // Name the system gives it, if any
+    uint64_t cpuMicros;     // User and kernel time since it started
+    uint64_t cycles;        // CPU cycles since it started; 0 if unknown
+};
+
+// Read every thread of this process: Toolhelp on Windows, /proc/self/task
+// on Linux. False if the threads cannot be listed at all.
+bool SampleProcessThreads(std::vector<ThreadSample>& threads);
+
+// Name a thread by what started it: "main", a role such as "Miles" or
+// "renderer" from the module its start address is in, with module+RVA, or
+// its system name when there is no start address
+std::string IdentifyThread(const ThreadSample& thread, uint32_t mainThreadId,
+    const ModuleMap& modules);
+
+// A thread as seen across samples. Times only count from the first sample:
+// CPU used before the monitor started is not included.
+struct ThreadUsage {
+    uint32_t id;
+    uintptr_t startAddress;
+    std::string label;
+    bool alive;              // Present in the last sample
+    uint64_t firstSeenMicros; // Start of the first interval it ran in
+    uint64_t lastSeenMicros;
+    uint64_t cpuMicros;       // Used while monitored
+    uint64_t cycles;
+    double utilization;       // Last interval; 1.0 = one core fully busy
+    double peakUtilization;
+    uint64_t intervalCycles;  // Last interval
+    uint64_t lastCpuMicros;   // Totals of the last sample
+    uint64_t lastCycles;
+};
+
+// Turns successive thread samples into per-thread utilization. A thread that
+// first appears after the first sample started during the interval, so all
+// of its CPU time counts. A thread id that comes back with less CPU time or
+// another start address is a new thread. Threads that start and end between
+// two samples are not seen.
+class ThreadUsageTracker {
+public:
+    typedef std::function<std::string(const ThreadSample&)> Identify;
+
+    // identify is called once per new thread to give its label
+    void Update(uint64_t wallMicros, const std::vector<ThreadSample>& threads,
+        const Identify& identify);
+
+    const std::vector<ThreadUsage>& Threads() const { return m_threads; }
+    bool HasInterval() const { return m_updates > 1; }
+    uint64_t IntervalMicros() const { return m_intervalMicros; }
+    uint64_t MonitoredMicros() const { return m_lastMicros - m_firstMicros; }
+    double ProcessUtilization() const; // Last interval, all threads
+
+private:
+    std::vector<ThreadUsage> m_threads;      // In the order first seen
+    std::map<uint32_t, size_t> m_aliveIndex; // Thread id to entry
+    uint64_t m_updates = 0;
+    uint64_t m_firstMicros = 0;
+    uint64_t m_lastMicros = 0;
+    uint64_t m_intervalMicros = 0;
+};
+
+// CSV time series: a header, then one row per running thread per interval
+void WriteThreadSeriesHeader(std::ostream& out);
+void WriteThreadSeriesRows(std::ostream& out, const ThreadUsageTracker& tracker);
+// Threads by CPU time used, most first, one line each
+std::vector<std::string> SummarizeThreads(const ThreadUsageTracker& tracker,
+    size_t maxThreads);
+
+// Function declarations
+#ifdef _WIN32
+bool StartThreadMonitor();
+void ShutdownThreadMonitor();
+#endif
+
+#endif // THREADMON_H
@@ -0,0 +1,192 @@
+#include "pch.h"
+#include "timesource.h"
+
+#ifdef _WIN32
+#include "logging.h" // Access Log()
+#include "config.h"  // Access config functions
+#include "hooks.h"   // Access HookImport()
+#endif
+
+// --- Millisecond Clock ---
+
+void MillisecondClock::Initialize(uint64_t counterNow, uint64_t frequency,
+    uint32_t realMsNow) {
+    m_counterBase = counterNow;
+    m_frequency = frequency ? frequency : 1;
+    m_epochMs = realMsNow;
+    m_adjustMs = 0;
+    m_lastMs = realMsNow;
+}
+
+uint32_t MillisecondClock::Now(uint64_t counterNow) const {
+    uint64_t elapsed = counterNow >= m_counterBase ? counterNow - m_counterBase : 0;
+    // Split so elapsed * 1000 cannot overflow for fast counters
+    uint64_t milliseconds = (elapsed / m_frequency) * 1000 +
+        (elapsed % m_frequency) * 1000 / m_frequency;
+    // Truncating to 32 bits gives the real clock's wraparound
+    uint32_t now = m_epochMs + static_cast<uint32_t>(milliseconds) +
+        m_adjustMs.load(std::memory_order_relaxed);
+    // After a backward adjustment, hold at the largest value handed out
+    uint32_t last = m_lastMs.load(std::memory_order_relaxed);
+    while (static_cast<int32_t>(now - last) > 0) {
+        if (m_lastMs.compare_exchange_weak(last, now, std::memory_order_relaxed)) {
+            return now;
+        }
+    }
+    return static_cast<int32_t>(now - last) < 0 ? last : now;
+}
+
+int32_t MillisecondClock::Drift(uint64_t counterNow, uint32_t realMsNow) const {
+    return static_cast<int32_t>(Now(counterNow) - realMsNow);
+}
+
+void MillisecondClock::Adjust(int32_t milliseconds) {
+    // Unsigned wraparound makes negative amounts subtract
+    m_adjustMs.fetch_add(static_cast<uint32_t>(milliseconds),
+        std::memory_order_relaxed);
+}
+
+int32_t MillisecondClock::Correct(uint64_t counterNow, uint32_t realMsNow,
+    int32_t limitMs) {
+    int32_t drift = Drift(counterNow, realMsNow);
+    if (drift < -limitMs || drift > limitMs) {
+        Adjust(-drift);
+    }
+    return drift;
+}
+
+// --- Game Integration ---
+
+#ifdef _WIN32
+typedef DWORD(WINAPI* MillisecondTimerFn)();
+
+// One redirected import: its clock and drift check state
+struct TimerRedirect {
+    const char* dll;
+    const char* name;
+    MillisecondTimerFn original;
+    MillisecondClock clock;
+    std::atomic<uint64_t> nextCheck{ 0 };
+    std::atomic<int32_t> maxDrift{ 0 };
+    std::atomic<bool> warned{ false };
+    bool installed = false;
+};
+
+static TimerRedirect g_timeGetTime;
+static TimerRedirect g_getTickCount;
+static uint64_t g_checkIntervalTicks = 0;
+static int32_t g_driftLimitMs = 20;
+
+static uint64_t ReadCounter() {
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    return static_cast<uint64_t>(counter.QuadPart);
+}
+
+// Every few seconds one caller compares the clock with the real timer and
+// corrects it if it drifted past the limit either way. A clock that ran ahead
+// stands still until the real timer catches up, and a warning is logged.
+static DWORD ReadRedirectedTimer(TimerRedirect& redirect) {
+    uint64_t counter = ReadCounter();
+    uint64_t nextCheck = redirect.nextCheck.load(std::memory_order_relaxed);
+    if (counter >= nextCheck && redirect.nextCheck.compare_exchange_strong(
+        nextCheck, counter + g_checkIntervalTicks)) {
+        int32_t drift = redirect.clock.Correct(counter, redirect.original(),
+            g_driftLimitMs);
+        int32_t magnitude = drift < 0 ? -drift : drift;
+        if (magnitude > redirect.maxDrift.load(std::memory_order_relaxed)) {
+            redirect.maxDrift.store(magnitude, std::memory_order_relaxed);
+        }
+        if (drift > g_driftLimitMs && !redirect.warned.exchange(true)) {
+            Log("Warning: High resolution " + std::string(redirect.name) +
+                " was " + std::to_string(drift) + " ms ahead of the system "
+                "timer. Holding it until the system timer catches up.");
+        }
+    }
+    return redirect.clock.Now(counter);
+}
+
+static DWORD WINAPI HookedTimeGetTime() {
+    return ReadRedirectedTimer(g_timeGetTime);
+}
+
+static DWORD WINAPI HookedGetTickCount() {
+    return ReadRedirectedTimer(g_getTickCount);
+}
+
+static bool InstallTimerRedirect(TimerRedirect& redirect, const void* hook,
+    uint64_t frequency) {
+    HMODULE exporter = GetModuleHandleA(redirect.dll);
+    redirect.original = exporter ? reinterpret_cast<MillisecondTimerFn>(
+        GetProcAddress(exporter, redirect.name)) : nullptr;
+    if (redirect.original == nullptr) {
+        return false;
+    }
+
+    // Take the epoch from the real timer so the game sees no jump
+    redirect.clock.Initialize(ReadCounter(), frequency, redirect.original());
+    redirect.nextCheck = ReadCounter() + g_checkIntervalTicks;
+    void* previous = nullptr;
+    if (!HookImport(GetModuleHandleA(NULL), redirect.dll, redirect.name, hook,
+        &previous)) {
+        return false;
+    }
+    redirect.installed = true;
+    return true;
+}
+
+// Redirect the game's millisecond timers to the performance counter
+bool ApplyHighResolutionTimers() {
+    Log("Checking High Resolution Timers...");
+    if (!GetConfigBool("HighResolutionTimersEnabled", false)) {
+        Log("High Resolution Timers are disabled in config.");
+        return false;
+    }
+
+    LARGE_INTEGER frequency;
+    if (!QueryPerformanceFrequency(&frequency) || frequency.QuadPart <= 0) {
+        Log("Warning: No performance counter available. High Resolution "
+            "Timers not applied.");
+        return false;
+    }
+
+    int driftLimit = GetConfigInt("HighResolutionTimersDriftLimitMs", 20);
+    if (driftLimit < 1) driftLimit = 1;
+    g_driftLimitMs = driftLimit;
+    g_checkIntervalTicks = static_cast<uint64_t>(frequency.QuadPart) * 5;
+
+    g_timeGetTime.dll = "WINMM.dll";
+    g_timeGetTime.name = "timeGetTime";
+    g_getTickCount.dll = "KERNEL32.dll";
+    g_getTickCount.name = "GetTickCount";
+
+    uint64_t counterFrequency = static_cast<uint64_t>(frequency.QuadPart);
+    bool timeGetTimeHooked = InstallTimerRedirect(g_timeGetTime,
+        reinterpret_cast<const void*>(HookedTimeGetTime), counterFrequency);
+    bool getTickCountHooked = InstallTimerRedirect(g_getTickCount,
+        reinterpret_cast<const void*>(HookedGetTickCount), counterFrequency);
+    if (!timeGetTimeHooked && !getTickCountHooked) {
+        Log("Warning: The game imports neither timeGetTime nor GetTickCount. "
+            "High Resolution Timers not applied.");
+        return false;
+    }
+
+    Log("Redirected" + std::string(timeGetTimeHooked ? " timeGetTime" : "") +
+        std::string(getTickCountHooked ? " GetTickCount" : "") +
+        " to the performance counter (" +
+        std::to_string(counterFrequency) + " Hz).");
+    return true;
+}
+
+// Log the largest drift seen. Called at shutdown.
+void ShutdownHighResolutionTimers() {
+    const TimerRedirect* redirects[] = { &g_timeGetTime, &g_getTickCount };
+    for (const TimerRedirect* redirect : redirects) {
+        if (redirect->installed) {
+            Log("High resolution " + std::string(redirect->name) +
+                ": largest drift from the system timer was " +
+                std::to_string(redirect->maxDrift.load()) + " ms.");
+        }
+    }
+}
+#endif
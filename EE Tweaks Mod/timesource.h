@@ -0,0 +1,37 @@
+#ifndef TIMESOURCE_H
+#define TIMESOURCE_H
+
+#include "pch.h"
+
+// A 32-bit millisecond clock (like timeGetTime/GetTickCount) driven by a
+// high-resolution counter. It starts at the value the real clock had when it
+// was created, so callers see no jump, and wraps modulo 2^32 like the real
+// one. It never goes backwards. Reads are lock-free and thread-safe.
+class MillisecondClock {
+public:
+    void Initialize(uint64_t counterNow, uint64_t frequency, uint32_t realMsNow);
+    uint32_t Now(uint64_t counterNow) const;
+    // This clock minus the real clock, wrap-aware (positive = this is ahead)
+    int32_t Drift(uint64_t counterNow, uint32_t realMsNow) const;
+    // Move the clock by this much. Backward moves hold it at its current
+    // value until the counter has caught up.
+    void Adjust(int32_t milliseconds);
+    // Pull the clock back to the real one if it drifted more than limitMs
+    // either way. Returns the drift found.
+    int32_t Correct(uint64_t counterNow, uint32_t realMsNow, int32_t limitMs);
+
+private:
+    uint64_t m_counterBase = 0;
+    uint64_t m_frequency = 1000;
+    uint32_t m_epochMs = 0;
+    std::atomic<uint32_t> m_adjustMs{ 0 };
+    mutable std::atomic<uint32_t> m_lastMs{ 0 }; // Largest value returned
+};
+
+// Function declarations
+#ifdef _WIN32
+bool ApplyHighResolutionTimers();
+void ShutdownHighResolutionTimers();
+#endif
+
+#endif // TIMESOURCE_H
@@ -0,0 +1,480 @@
+#include "pch.h"
+#include "vbring.h"
+
+#ifdef _WIN32
+#include "logging.h" // Access Log()
+#include "config.h"  // Access config functions
+#include "hooks.h"   // Access HookVtableEntry()
+#include "counters.h"
+#endif
+
+// --- Vertex Formats ---
+
+// Same bit layout as D3DFVF_* in d3dtypes.h
+uint32_t GetFvfVertexSize(uint32_t fvf) {
+    uint32_t size = 0;
+    switch (fvf & 0x00E) { // D3DFVF_POSITION_MASK
+    case 0x002: size = 12; break; // XYZ
+    case 0x004: size = 16; break; // XYZRHW
+    case 0x006: size = 16; break; // XYZB1
+    case 0x008: size = 20; break; // XYZB2
+    case 0x00A: size = 24; break; // XYZB3
+    case 0x00C: size = 28; break; // XYZB4
+    case 0x00E: size = 32; break; // XYZB5
+    default: return 0;
+    }
+    if (fvf & 0x010) size += 12; // NORMAL
+    if (fvf & 0x020) size += 4;  // RESERVED1
+    if (fvf & 0x040) size += 4;  // DIFFUSE
+    if (fvf & 0x080) size += 4;  // SPECULAR
+
+    uint32_t textureSets = (fvf >> 8) & 0xF; // D3DFVF_TEXCOUNT_MASK
+    if (textureSets > 8) {
+        return 0;
+    }
+    for (uint32_t i = 0; i < textureSets; ++i) {
+        switch ((fvf >> (16 + i * 2)) & 3) { // D3DFVF_TEXTUREFORMAT*
+        case 0: size += 8; break;  // 2 floats
+        case 1: size += 12; break; // 3 floats
+        case 2: size += 16; break; // 4 floats
+        case 3: size += 4; break;  // 1 float
+        }
+    }
+    return size;
+}
+
+// --- Vertex Ring Allocator ---
+
+void VertexRing::Reset(uint32_t capacity) {
+    m_capacity = capacity;
+    m_head = 0;
+    m_epoch++;
+    m_wraps = 0;
+}
+
+bool VertexRing::Allocate(uint32_t count, uint32_t& offset, bool& discard) {
+    if (count == 0 || count > m_capacity) {
+        return false;
+    }
+    discard = false;
+    if (m_head == 0) {
+        discard = true; // Fresh ring: nothing to preserve
+    }
+    else if (count > m_capacity - m_head) {
+        m_head = 0;
+        m_epoch++;
+        m_wraps++;
+        discard = true;
+    }
+    offset = m_head;
+    m_head += count;
+    return true;
+}
+
+// --- Managed Vertex Buffers ---
+// The renderer's vertex buffers are created in system memory, where locking
+// them is cheap. When one is drawn, the vertices used by the draw are copied
+// into a write-only ring buffer with the same vertex format and the draw is
+// redirected there. A buffer drawn again unchanged reuses its copy while the
+// ring has not wrapped.
+
+#ifdef _WIN32
+// Vtable slots, in the method order of d3d.h
+const size_t D3D7_SLOT_CREATE_VERTEX_BUFFER = 5;
+const size_t DEVICE_SLOT_DRAW_PRIMITIVE_VB = 31;
+const size_t DEVICE_SLOT_DRAW_INDEXED_PRIMITIVE_VB = 32;
+const size_t VB_SLOT_RELEASE = 2;
+const size_t VB_SLOT_LOCK = 3;
+const size_t VB_SLOT_UNLOCK = 4;
+const size_t VB_SLOT_PROCESS_VERTICES = 5;
+const size_t VB_SLOT_PROCESS_VERTICES_STRIDED = 8;
+
+// D3DVBCAPS_* and DDLOCK_* values
+const DWORD VBCAPS_SYSTEM_MEMORY = 0x00000800;
+const DWORD VBCAPS_WRITE_ONLY = 0x00010000;
+const DWORD LOCK_WAIT = 0x00000001;
+const DWORD LOCK_READ_ONLY = 0x00000010;
+const DWORD LOCK_WRITE_ONLY = 0x00000020;
+const DWORD LOCK_NO_OVERWRITE = 0x00001000;
+const DWORD LOCK_DISCARD_CONTENTS = 0x00002000;
+
+struct VertexBufferDesc { // D3DVERTEXBUFFERDESC
+    DWORD size;
+    DWORD caps;
+    DWORD fvf;
+    DWORD numVertices;
+};
+
+typedef HRESULT(WINAPI* CreateVertexBufferFn)(void* self,
+    VertexBufferDesc* desc, void** vertexBuffer, DWORD flags);
+typedef HRESULT(WINAPI* DrawPrimitiveVBFn)(void* self, DWORD primitiveType,
+    void* vertexBuffer, DWORD startVertex, DWORD numVertices, DWORD flags);
+typedef HRESULT(WINAPI* DrawIndexedPrimitiveVBFn)(void* self,
+    DWORD primitiveType, void* vertexBuffer, DWORD startVertex,
+    DWORD numVertices, WORD* indices, DWORD indexCount, DWORD flags);
+typedef ULONG(WINAPI* ReleaseFn)(void* self);
+typedef HRESULT(WINAPI* LockFn)(void* self, DWORD flags, void** data,
+    DWORD* size);
+typedef HRESULT(WINAPI* UnlockFn)(void* self);
+// ProcessVertices and ProcessVerticesStrided take the same argument sizes
+typedef HRESULT(WINAPI* ProcessVerticesFn)(void* self, DWORD operation,
+    DWORD destinationIndex, DWORD count, void* source, DWORD sourceArg,
+    void* device, DWORD flags);
+
+static CreateVertexBufferFn g_originalCreateVertexBuffer = nullptr;
+static DrawPrimitiveVBFn g_originalDrawPrimitiveVB = nullptr;
+static DrawIndexedPrimitiveVBFn g_originalDrawIndexedPrimitiveVB = nullptr;
+static ReleaseFn g_originalRelease = nullptr;
+static LockFn g_originalLock = nullptr;
+static ProcessVerticesFn g_originalProcessVertices = nullptr;
+static ProcessVerticesFn g_originalProcessVerticesStrided = nullptr;
+
+// One ring per vertex format
+struct StreamRing {
+    void* buffer;
+    uint32_t stride;
+    VertexRing ring;
+};
+
+// A renderer buffer and the ring copy of the range drawn last
+struct ManagedBuffer {
+    uint32_t fvf;
+    uint32_t stride;
+    bool dirty;
+    DWORD copyStart;
+    DWORD copyCount;
+    uint32_t ringOffset;
+    uint32_t ringEpoch;
+};
+
+static bool g_managedEnabled = false;
+static uint32_t g_ringBytes = 2 * 1024 * 1024;
+static void* g_direct3D = nullptr;
+static void* g_device = nullptr;
+static std::map<uint32_t, StreamRing> g_rings;
+static std::map<void*, ManagedBuffer> g_buffers;
+static LARGE_INTEGER g_counterFrequency = { 0 };
+static LONGLONG g_stallTicks = 0; // A ring lock slower than this is a stall
+
+static uint64_t g_draws = 0;
+static uint64_t g_reusedDraws = 0;
+static uint64_t g_uploadedBytes = 0;
+static uint64_t g_stalls = 0;
+static uint64_t g_fallbacks = 0;
+
+// Buffers are locked through their own vtable: ring buffers may belong to a
+// different class than the renderer's
+static HRESULT LockBuffer(void* vertexBuffer, DWORD flags, void** data) {
+    void** vtable = *reinterpret_cast<void***>(vertexBuffer);
+    return reinterpret_cast<LockFn>(vtable[VB_SLOT_LOCK])(vertexBuffer, flags,
+        data, nullptr);
+}
+
+static void UnlockBuffer(void* vertexBuffer) {
+    void** vtable = *reinterpret_cast<void***>(vertexBuffer);
+    reinterpret_cast<UnlockFn>(vtable[VB_SLOT_UNLOCK])(vertexBuffer);
+}
+
+// Create the ring for a vertex format on first use
+static StreamRing* GetRing(uint32_t fvf, uint32_t stride) {
+    auto it = g_rings.find(fvf);
+    if (it != g_rings.end()) {
+        return it->second.buffer ? &it->second : nullptr;
+    }
+
+    StreamRing& stream = g_rings[fvf];
+    stream.buffer = nullptr;
+    stream.stride = stride;
+    uint32_t vertices = g_ringBytes / stride;
+    if (vertices > 0xFFFF) vertices = 0xFFFF; // Limit of many DX7 drivers
+
+    VertexBufferDesc desc = { sizeof(VertexBufferDesc), VBCAPS_WRITE_ONLY, fvf,
+        vertices };
+    HRESULT result = g_originalCreateVertexBuffer(g_direct3D, &desc,
+        &stream.buffer, 0);
+    if (FAILED(result)) {
+        stream.buffer = nullptr;
+        std::stringstream ss;
+        ss << "0x" << std::hex << fvf << ". Error code: 0x" << result;
+        Log("Warning: Could not create a vertex ring for format " + ss.str());
+        return nullptr;
+    }
+    stream.ring.Reset(vertices);
+    return &stream;
+}
+
+// Copy the vertices of a draw into the ring unless the last copy is still
+// valid. On success startVertex is rewritten to the ring position.
+static void* RedirectDraw(void* vertexBuffer, DWORD& startVertex,
+    DWORD numVertices) {
+    auto it = g_buffers.find(vertexBuffer);
+    if (it == g_buffers.end()) {
+        return nullptr;
+    }
+    ManagedBuffer& managed = it->second;
+    StreamRing* stream = GetRing(managed.fvf, managed.stride);
+    if (stream == nullptr) {
+        return nullptr;
+    }
+    g_draws++;
+
+    if (!managed.dirty && managed.copyStart == startVertex &&
+        managed.copyCount == numVertices &&
+        stream->ring.IsCurrent(managed.ringEpoch)) {
+        g_reusedDraws++;
+        startVertex = managed.ringOffset;
+        return stream->buffer;
+    }
+
+    uint32_t offset;
+    bool discard;
+    uint64_t wrapsBefore = stream->ring.Wraps();
+    if (!stream->ring.Allocate(numVertices, offset, discard)) {
+        g_fallbacks++;
+        return nullptr;
+    }
+    if (stream->ring.Wraps() != wrapsBefore) {
+        CounterAdd(COUNTER_VB_RING_WRAPS, 1);
+    }
+
+    void* source = nullptr;
+    if (FAILED(LockBuffer(vertexBuffer, LOCK_WAIT | LOCK_READ_ONLY, &source))) {
+        g_buffers.erase(it); // Optimized buffers cannot be locked
+        g_fallbacks++;
+        return nullptr;
+    }
+
+    LARGE_INTEGER lockStart, lockEnd;
+    QueryPerformanceCounter(&lockStart);
+    void* destination = nullptr;
+    HRESULT result = LockBuffer(stream->buffer, LOCK_WAIT | LOCK_WRITE_ONLY |
+        (discard ? LOCK_DISCARD_CONTENTS : LOCK_NO_OVERWRITE), &destination);
+    QueryPerformanceCounter(&lockEnd);
+    if (lockEnd.QuadPart - lockStart.QuadPart > g_stallTicks) {
+        g_stalls++;
+        CounterAdd(COUNTER_VB_RING_STALLS, 1);
+    }
+    if (FAILED(result)) {
+        UnlockBuffer(vertexBuffer);
+        g_fallbacks++;
+        return nullptr;
+    }
+
+    size_t bytes = static_cast<size_t>(numVertices) * managed.stride;
+    memcpy(static_cast<unsigned char*>(destination) +
+        static_cast<size_t>(offset) * managed.stride,
+        static_cast<const unsigned char*>(source) +
+        static_cast<size_t>(startVertex) * managed.stride, bytes);
+    UnlockBuffer(stream->buffer);
+    UnlockBuffer(vertexBuffer);
+    g_uploadedBytes += bytes;
+    CounterAdd(COUNTER_VB_RING_BYTES, bytes);
+
+    managed.dirty = false;
+    managed.copyStart = startVertex;
+    managed.copyCount = numVertices;
+    managed.ringOffset = offset;
+    managed.ringEpoch = stream->ring.Epoch();
+    startVertex = offset;
+    return stream->buffer;
+}
+
+// Any write makes the ring copy stale
+static void MarkDirty(void* vertexBuffer) {
+    auto it = g_buffers.find(vertexBuffer);
+    if (it != g_buffers.end()) {
+        it->second.dirty = true;
+    }
+}
+
+static HRESULT WINAPI HookedLock(void* self, DWORD flags, void** data,
+    DWORD* size) {
+    if ((flags & LOCK_READ_ONLY) == 0) {
+        MarkDirty(self);
+    }
+    return g_originalLock(self, flags, data, size);
+}
+
+static HRESULT WINAPI HookedProcessVertices(void* self, DWORD operation,
+    DWORD destinationIndex, DWORD count, void* source, DWORD sourceArg,
+    void* device, DWORD flags) {
+    MarkDirty(self);
+    return g_originalProcessVertices(self, operation, destinationIndex, count,
+        source, sourceArg, device, flags);
+}
+
+static HRESULT WINAPI HookedProcessVerticesStrided(void* self, DWORD operation,
+    DWORD destinationIndex, DWORD count, void* source, DWORD sourceArg,
+    void* device, DWORD flags) {
+    MarkDirty(self);
+    return g_originalProcessVerticesStrided(self, operation, destinationIndex,
+        count, source, sourceArg, device, flags);
+}
+
+// A released buffer's address may be reused by the next one, so its entry
+// goes with the last reference
+static ULONG WINAPI HookedRelease(void* self) {
+    ULONG references = g_originalRelease(self);
+    if (references == 0) {
+        g_buffers.erase(self);
+    }
+    return references;
+}
+
+// The write paths of vertex buffers can only be hooked once one exists; all
+// renderer buffers share one vtable
+static bool HookVertexBufferWrites(void* vertexBuffer) {
+    if (g_originalLock != nullptr) {
+        return true;
+    }
+    return HookVtableEntry(vertexBuffer, VB_SLOT_RELEASE,
+            reinterpret_cast<const void*>(HookedRelease),
+            reinterpret_cast<void**>(&g_originalRelease)) &&
+        HookVtableEntry(vertexBuffer, VB_SLOT_PROCESS_VERTICES,
+            reinterpret_cast<const void*>(HookedProcessVertices),
+            reinterpret_cast<void**>(&g_originalProcessVertices)) &&
+        HookVtableEntry(vertexBuffer, VB_SLOT_PROCESS_VERTICES_STRIDED,
+            reinterpret_cast<const void*>(HookedProcessVerticesStrided),
+            reinterpret_cast<void**>(&g_originalProcessVerticesStrided)) &&
+        HookVtableEntry(vertexBuffer, VB_SLOT_LOCK,
+            reinterpret_cast<const void*>(HookedLock),
+            reinterpret_cast<void**>(&g_originalLock));
+}
+
+// Renderer buffers go to system memory and stay readable for the copies
+static HRESULT WINAPI HookedCreateVertexBuffer(void* self,
+    VertexBufferDesc* desc, void** vertexBuffer, DWORD flags) {
+    if (self != g_direct3D || desc == nullptr ||
+        GetFvfVertexSize(desc->fvf) == 0) {
+        return g_originalCreateVertexBuffer(self, desc, vertexBuffer, flags);
+    }
+    VertexBufferDesc systemDesc = *desc;
+    systemDesc.caps = (systemDesc.caps | VBCAPS_SYSTEM_MEMORY) &
+        ~VBCAPS_WRITE_ONLY;
+    HRESULT result = g_originalCreateVertexBuffer(self, &systemDesc,
+        vertexBuffer, flags);
+    if (SUCCEEDED(result) && vertexBuffer != nullptr && *vertexBuffer != nullptr &&
+        HookVertexBufferWrites(*vertexBuffer)) {
+        ManagedBuffer managed = { systemDesc.fvf,
+            GetFvfVertexSize(systemDesc.fvf), true, 0, 0, 0, 0 };
+        g_buffers[*vertexBuffer] = managed; // Erased by HookedRelease
+    }
+    return result;
+}
+
+static HRESULT WINAPI HookedDrawPrimitiveVB(void* self, DWORD primitiveType,
+    void* vertexBuffer, DWORD startVertex, DWORD numVertices, DWORD flags) {
+    if (self == g_device) {
+        DWORD ringStart = startVertex;
+        void* ringBuffer = RedirectDraw(vertexBuffer, ringStart, numVertices);
+        if (ringBuffer != nullptr) {
+            return g_originalDrawPrimitiveVB(self, primitiveType, ringBuffer,
+                ringStart, numVertices, flags);
+        }
+    }
+    return g_originalDrawPrimitiveVB(self, primitiveType, vertexBuffer,
+        startVertex, numVertices, flags);
+}
+
+// Indices are relative to startVertex, so they need no rewriting
+static HRESULT WINAPI HookedDrawIndexedPrimitiveVB(void* self,
+    DWORD primitiveType, void* vertexBuffer, DWORD startVertex,
+    DWORD numVertices, WORD* indices, DWORD indexCount, DWORD flags) {
+    if (self == g_device) {
+        DWORD ringStart = startVertex;
+        void* ringBuffer = RedirectDraw(vertexBuffer, ringStart, numVertices);
+        if (ringBuffer != nullptr) {
+            return g_originalDrawIndexedPrimitiveVB(self, primitiveType,
+                ringBuffer, ringStart, numVertices, indices, indexCount, flags);
+        }
+    }
+    return g_originalDrawIndexedPrimitiveVB(self, primitiveType, vertexBuffer,
+        startVertex, numVertices, indices, indexCount, flags);
+}
+
+// Read config. Returns true if the Direct3D hooks are needed.
+bool InitializeManagedVertexBuffers() {
+    Log("Checking Managed Vertex Buffers...");
+    if (!GetConfigBool("ManagedVertexBuffersEnabled", false)) {
+        Log("Managed Vertex Buffers are disabled in config.");
+        return false;
+    }
+    int ringKB = GetConfigInt("ManagedVertexBuffersRingKB", 2048);
+    if (ringKB < 256) ringKB = 256;
+    if (ringKB > 16384) ringKB = 16384;
+    g_ringBytes = static_cast<uint32_t>(ringKB) * 1024;
+
+    QueryPerformanceFrequency(&g_counterFrequency);
+    g_stallTicks = g_counterFrequency.QuadPart / 2000; // 0.5 ms
+    g_managedEnabled = true;
+    return true;
+}
+
+void ManagedVertexBuffersOnDirect3D(void* direct3D) {
+    if (!g_managedEnabled) {
+        return;
+    }
+    if (g_originalCreateVertexBuffer == nullptr &&
+        !HookVtableEntry(direct3D, D3D7_SLOT_CREATE_VERTEX_BUFFER,
+            reinterpret_cast<const void*>(HookedCreateVertexBuffer),
+            reinterpret_cast<void**>(&g_originalCreateVertexBuffer))) {
+        Log("Warning: Could not hook IDirect3D7::CreateVertexBuffer. Managed "
+            "Vertex Buffers not applied.");
+        g_managedEnabled = false;
+        return;
+    }
+    g_direct3D = direct3D;
+}
+
+// Start redirecting the draws of a new device. Rings of an earlier device
+// are released and every copy in them is stale.
+void ManagedVertexBuffersOnDevice(void* device) {
+    if (!g_managedEnabled || g_originalCreateVertexBuffer == nullptr) {
+        return;
+    }
+    for (auto& entry : g_rings) {
+        if (entry.second.buffer != nullptr) {
+            void** vtable = *reinterpret_cast<void***>(entry.second.buffer);
+            reinterpret_cast<ReleaseFn>(vtable[VB_SLOT_RELEASE])(
+                entry.second.buffer);
+        }
+    }
+    g_rings.clear();
+    for (auto& entry : g_buffers) {
+        entry.second.dirty = true;
+    }
+
+    if (g_originalDrawPrimitiveVB == nullptr) {
+        bool hooked =
+            HookVtableEntry(device, DEVICE_SLOT_DRAW_PRIMITIVE_VB,
+                reinterpret_cast<const void*>(HookedDrawPrimitiveVB),
+                reinterpret_cast<void**>(&g_originalDrawPrimitiveVB)) &&
+            HookVtableEntry(device, DEVICE_SLOT_DRAW_INDEXED_PRIMITIVE_VB,
+                reinterpret_cast<const void*>(HookedDrawIndexedPrimitiveVB),
+                reinterpret_cast<void**>(&g_originalDrawIndexedPrimitiveVB));
+        if (!hooked) {
+            Log("Warning: Could not hook the vertex buffer draw calls. Managed "
+                "Vertex Buffers not applied.");
+            g_managedEnabled = false;
+            return;
+        }
+    }
+    g_device = device;
+}
+
+// Log the statistics. Called at shutdown.
+void ShutdownManagedVertexBuffers() {
+    if (g_draws == 0) {
+        return;
+    }
+    uint64_t wraps = 0;
+    for (const auto& entry : g_rings) {
+        wraps += entry.second.ring.Wraps();
+    }
+    Log("Managed Vertex Buffers: " + std::to_string(g_draws) + " draws (" +
+        std::to_string(g_reusedDraws) + " reused a copy), " +
+        std::to_string(g_uploadedBytes / 1024) + " KB copied, " +
+        std::to_string(wraps) + " ring wraps, " + std::to_string(g_stalls) +
+        " stalls, " + std::to_string(g_fallbacks) + " fallbacks.");
+}
+#endif
@@ -0,0 +1,44 @@
+#ifndef VBRING_H
+#define VBRING_H
+
+#include "pch.h"
+
+// Bytes per vertex of a flexible vertex format (D3DFVF_* bits); 0 if the
+// format is not valid
+uint32_t GetFvfVertexSize(uint32_t fvf);
+
+// Allocates vertex ranges from a ring buffer front to back. Ranges are never
+// reused until the ring wraps; at that point the caller must lock with
+// DDLOCK_DISCARDCONTENTS, which hands it fresh memory and invalidates every
+// earlier range (the epoch changes), so the GPU never waits on a range that is
+// still being drawn from.
+class VertexRing {
+public:
+    void Reset(uint32_t capacity);
+    // Reserve count vertices. discard is set for the first range after a
+    // wrap. Fails if count does not fit in the ring at all.
+    bool Allocate(uint32_t count, uint32_t& offset, bool& discard);
+    bool IsCurrent(uint32_t epoch) const { return epoch == m_epoch; }
+
+    uint32_t Capacity() const { return m_capacity; }
+    uint32_t Epoch() const { return m_epoch; }
+    uint64_t Wraps() const { return m_wraps; }
+
+private:
+    uint32_t m_capacity = 0;
+    uint32_t m_head = 0;
+    uint32_t m_epoch = 0;
+    uint64_t m_wraps = 0;
+};
+
+// Function declarations
+#ifdef _WIN32
+bool InitializeManagedVertexBuffers(); // Reads config
+void ShutdownManagedVertexBuffers();
+
+// Called from the Direct3D hook chain (d3dhooks.cpp)
+void ManagedVertexBuffersOnDirect3D(void* direct3D);
+void ManagedVertexBuffersOnDevice(void* device);
+#endif
+
+#endif // VBRING_H
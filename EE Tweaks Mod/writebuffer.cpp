@@ -0,0 +1,370 @@
+#include "pch.h"
+#include "writebuffer.h"
+
+#ifdef _WIN32
+#include "globals.h"
+#include "logging.h" // Access Log()
+#include "config.h"  // Access config functions
+#include "counters.h"
+#else
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+// --- Platform File Access ---
+
+#ifdef _WIN32
+// These go to the real functions: only the game executable's imports are
+// hooked
+static bool NativeWrite(NativeFile file, const unsigned char* data,
+    uint32_t size, uint32_t& written) {
+    DWORD count = 0;
+    BOOL ok = WriteFile(file, data, size, &count, NULL);
+    written = count;
+    return ok != FALSE;
+}
+
+static bool NativePosition(NativeFile file, uint64_t& position) {
+    LARGE_INTEGER zero = { 0 };
+    LARGE_INTEGER current;
+    if (!SetFilePointerEx(file, zero, &current, FILE_CURRENT)) {
+        return false;
+    }
+    position = static_cast<uint64_t>(current.QuadPart);
+    return true;
+}
+#else
+static bool NativeWrite(NativeFile file, const unsigned char* data,
+    uint32_t size, uint32_t& written) {
+    ssize_t count;
+    do {
+        count = write(file, data, size);
+    } while (count < 0 && errno == EINTR);
+    written = count > 0 ? static_cast<uint32_t>(count) : 0;
+    return count >= 0;
+}
+
+static bool NativePosition(NativeFile file, uint64_t& position) {
+    off_t current = lseek(file, 0, SEEK_CUR);
+    if (current < 0) {
+        return false;
+    }
+    position = static_cast<uint64_t>(current);
+    return true;
+}
+#endif
+
+// --- Write Coalescer ---
+
+WriteCoalescer::WriteCoalescer(size_t bufferSize)
+    : m_bufferSize(bufferSize < 4096 ? 4096 : bufferSize) {
+}
+
+void WriteCoalescer::Attach(NativeFile file) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    BufferedFile& buffered = m_files[file]; // Replaces a stale entry
+    buffered.data.clear();
+    buffered.used = 0;
+    buffered.position = 0;
+    buffered.positionKnown = false;
+}
+
+bool WriteCoalescer::Detach(NativeFile file) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_files.find(file);
+    if (it == m_files.end()) {
+        return true;
+    }
+    bool flushed = FlushLocked(file, it->second);
+    m_files.erase(it);
+    return flushed;
+}
+
+bool WriteCoalescer::IsAttached(NativeFile file) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_files.find(file) != m_files.end();
+}
+
+size_t WriteCoalescer::AttachedFiles() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_files.size();
+}
+
+// Write all of data at the file position. A short write without an error
+// (disk full) counts as a failure, as it would for the caller.
+bool WriteCoalescer::WriteNative(NativeFile file, BufferedFile& buffered,
+    const unsigned char* data, size_t size) {
+    while (size > 0) {
+        uint32_t chunk = size > 0x40000000 ? 0x40000000 :
+            static_cast<uint32_t>(size);
+        uint32_t written = 0;
+        bool ok = NativeWrite(file, data, chunk, written);
+        m_nativeWrites++;
+        m_bytesWritten += written;
+        buffered.position += written;
+        if (!ok || written == 0) {
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+bool WriteCoalescer::FlushLocked(NativeFile file, BufferedFile& buffered) {
+    if (buffered.used == 0) {
+        return true;
+    }
+    bool ok = WriteNative(file, buffered, buffered.data.data(), buffered.used);
+    buffered.used = 0; // Like the game's own writes, failed data is not retried
+    if (!ok) {
+        buffered.positionKnown = false;
+    }
+    return ok;
+}
+
+bool WriteCoalescer::Write(NativeFile file, const void* data, uint32_t size,
+    bool& success) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_files.find(file);
+    if (it == m_files.end()) {
+        return false;
+    }
+    BufferedFile& buffered = it->second;
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+
+    if (buffered.used + size > m_bufferSize) {
+        if (!FlushLocked(file, buffered)) {
+            success = false;
+            return true;
+        }
+    }
+    if (size >= m_bufferSize) {
+        success = WriteNative(file, buffered, bytes, size); // Already large
+        if (!success) buffered.positionKnown = false;
+        return true;
+    }
+    if (buffered.data.empty()) {
+        try {
+            buffered.data.resize(m_bufferSize);
+        }
+        catch (const std::bad_alloc&) {
+            success = WriteNative(file, buffered, bytes, size);
+            return true;
+        }
+    }
+    memcpy(buffered.data.data() + buffered.used, bytes, size);
+    buffered.used += size;
+    m_writesBuffered++;
+    success = true;
+    return true;
+}
+
+// The caller is about to access the file another way (a read moves the
+// file position too), so the position is asked again next time
+bool WriteCoalescer::Flush(NativeFile file) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_files.find(file);
+    if (it == m_files.end()) {
+        return true;
+    }
+    bool flushed = FlushLocked(file, it->second);
+    it->second.positionKnown = false;
+    return flushed;
+}
+
+bool WriteCoalescer::FlushAll() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    bool ok = true;
+    for (auto& entry : m_files) {
+        ok = FlushLocked(entry.first, entry.second) && ok;
+    }
+    return ok;
+}
+
+bool WriteCoalescer::GetPosition(NativeFile file, uint64_t& position) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_files.find(file);
+    if (it == m_files.end()) {
+        return false;
+    }
+    BufferedFile& buffered = it->second;
+    if (!buffered.positionKnown) {
+        // Buffered data has not moved the file position yet
+        if (!NativePosition(file, buffered.position)) {
+            return false;
+        }
+        buffered.positionKnown = true;
+    }
+    position = buffered.position + buffered.used;
+    return true;
+}
+
+void WriteCoalescer::Reposition(NativeFile file) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_files.find(file);
+    if (it != m_files.end()) {
+        it->second.positionKnown = false;
+    }
+}
+
+// --- File API Integration ---
+
+#ifdef _WIN32
+static WriteCoalescer* g_writeCoalescer = nullptr;
+static std::vector<std::string> g_writePaths; // Lowercase path fragments
+static uint64_t g_filesCoalesced = 0;
+
+static void PublishWriteCounters() {
+    uint64_t buffered = g_writeCoalescer->WritesBuffered();
+    uint64_t native = g_writeCoalescer->NativeWrites();
+    CounterSet(COUNTER_WRITES_BUFFERED, buffered);
+    CounterSet(COUNTER_WRITE_CALLS, native);
+    CounterSet(COUNTER_WRITE_CALLS_AVOIDED, buffered > native ? buffered - native : 0);
+}
+
+bool InitializeWriteCoalescing() {
+    if (!GetConfigBool("WriteCoalescingEnabled", false)) {
+        return false;
+    }
+
+    std::stringstream paths(GetConfigString("WriteCoalescingPaths",
+        "saved games"));
+    std::string fragment;
+    while (std::getline(paths, fragment, ',')) {
+        fragment = Trim(fragment);
+        if (fragment.empty()) {
+            continue;
+        }
+        std::transform(fragment.begin(), fragment.end(), fragment.begin(),
+            [](unsigned char c) { return static_cast<char>(tolower(c)); });
+        std::replace(fragment.begin(), fragment.end(), '/', '\\');
+        g_writePaths.push_back(fragment);
+    }
+    if (g_writePaths.empty()) {
+        Log("Warning: WriteCoalescingPaths is empty. Write coalescing "
+            "disabled.");
+        return false;
+    }
+
+    int bufferKB = GetConfigInt("WriteCoalescingBufferKB", 1024);
+    if (bufferKB < 64) bufferKB = 64;
+    if (bufferKB > 16384) bufferKB = 16384;
+    g_writeCoalescer = new WriteCoalescer(static_cast<size_t>(bufferKB) * 1024);
+    Log("Write coalescing enabled (" + std::to_string(bufferKB) +
+        " KB buffer per file).");
+    return true;
+}
+
+// Attach synchronous opens for writing of save and recording files
+void WriteCoalescingOnOpen(HANDLE file, const char* path, DWORD access,
+    DWORD flags) {
+    if (g_writeCoalescer == nullptr || file == INVALID_HANDLE_VALUE ||
+        path == nullptr) {
+        return;
+    }
+    if ((access & GENERIC_WRITE) == 0 ||
+        (flags & (FILE_FLAG_OVERLAPPED | FILE_FLAG_NO_BUFFERING |
+            FILE_FLAG_WRITE_THROUGH)) != 0) {
+        return;
+    }
+    std::string lowerPath = path;
+    std::transform(lowerPath.begin(), lowerPath.end(), lowerPath.begin(),
+        [](unsigned char c) { return static_cast<char>(tolower(c)); });
+    std::replace(lowerPath.begin(), lowerPath.end(), '/', '\\');
+    for (const std::string& fragment : g_writePaths) {
+        if (lowerPath.find(fragment) != std::string::npos) {
+            g_writeCoalescer->Attach(file);
+            g_filesCoalesced++;
+            Log("Write coalescing: buffering writes to " + std::string(path) +
+                ".");
+            return;
+        }
+    }
+}
+
+// Buffer a WriteFile call. Returns false if the handle is not buffered, in
+// which case the caller forwards to the real WriteFile.
+bool WriteCoalescingOnWrite(HANDLE file, LPCVOID buffer, DWORD bytesToWrite,
+    LPDWORD bytesWritten, LPOVERLAPPED overlapped, BOOL& result) {
+    if (g_writeCoalescer == nullptr) {
+        return false;
+    }
+    if (overlapped != NULL || bytesWritten == NULL) {
+        // Not a plain sequential write: let it through in order
+        if (!g_writeCoalescer->Flush(file)) {
+            result = FALSE;
+            return true;
+        }
+        return false;
+    }
+
+    bool success = false;
+    if (!g_writeCoalescer->Write(file, buffer, bytesToWrite, success)) {
+        return false;
+    }
+    if (success) {
+        *bytesWritten = bytesToWrite;
+        SetLastError(NO_ERROR);
+    }
+    else {
+        *bytesWritten = 0; // GetLastError() is the failed write's
+    }
+    PublishWriteCounters();
+    result = success ? TRUE : FALSE;
+    return true;
+}
+
+bool WriteCoalescingFlush(HANDLE file) {
+    if (g_writeCoalescer == nullptr) {
+        return true;
+    }
+    bool flushed = g_writeCoalescer->Flush(file);
+    if (!flushed) {
+        Log("Error: Write coalescing could not write buffered data. Error "
+            "code: " + std::to_string(GetLastError()));
+    }
+    return flushed;
+}
+
+bool WriteCoalescingGetPosition(HANDLE file, uint64_t& position) {
+    return g_writeCoalescer != nullptr &&
+        g_writeCoalescer->GetPosition(file, position);
+}
+
+void WriteCoalescingOnSeek(HANDLE file) {
+    if (g_writeCoalescer != nullptr) {
+        g_writeCoalescer->Reposition(file);
+    }
+}
+
+bool WriteCoalescingOnClose(HANDLE file) {
+    if (g_writeCoalescer == nullptr) {
+        return true;
+    }
+    bool flushed = g_writeCoalescer->Detach(file);
+    DWORD error = GetLastError();
+    if (!flushed) {
+        Log("Error: Write coalescing could not write buffered data before "
+            "close. Error code: " + std::to_string(error));
+    }
+    PublishWriteCounters();
+    SetLastError(error);
+    return flushed;
+}
+
+// Write out files the game never closed and log the totals. Called at
+// shutdown.
+void ShutdownWriteCoalescing() {
+    if (g_writeCoalescer == nullptr) {
+        return;
+    }
+    g_writeCoalescer->FlushAll();
+    uint64_t buffered = g_writeCoalescer->WritesBuffered();
+    uint64_t native = g_writeCoalescer->NativeWrites();
+    Log("Write coalescing: " + std::to_string(g_filesCoalesced) + " files, " +
+        std::to_string(buffered) + " game writes became " +
+        std::to_string(native) + " writes (" +
+        std::to_string(g_writeCoalescer->BytesWritten() / 1024) + " KB).");
+}
+#endif
@@ -0,0 +1,73 @@
+#ifndef WRITEBUFFER_H
+#define WRITEBUFFER_H
+
+#include "pch.h"
+#include "iocache.h" // NativeFile
+
+// Collects the small sequential writes of attached files in a buffer per
+// file and writes them out in large blocks. The caller flushes before
+// anything else touches the file (a seek, read, size query or close), so
+// the file gets the same bytes at the same offsets, in fewer writes.
+class WriteCoalescer {
+public:
+    explicit WriteCoalescer(size_t bufferSize);
+
+    void Attach(NativeFile file);
+    bool Detach(NativeFile file); // Flushes first; false if that failed
+    bool IsAttached(NativeFile file);
+
+    // Buffer (or write through) a write. Returns false if the file is not
+    // attached. success is false if a write to the file failed; the OS error
+    // is left for the caller.
+    bool Write(NativeFile file, const void* data, uint32_t size, bool& success);
+    bool Flush(NativeFile file); // True if nothing failed (or not attached)
+    bool FlushAll();
+    // The position the owner of the file sees: the file position plus the
+    // buffered bytes. Returns false if the file is not attached.
+    bool GetPosition(NativeFile file, uint64_t& position);
+    void Reposition(NativeFile file); // The file position was moved
+
+    size_t AttachedFiles();
+    uint64_t WritesBuffered() const { return m_writesBuffered; }
+    uint64_t NativeWrites() const { return m_nativeWrites; }
+    uint64_t BytesWritten() const { return m_bytesWritten; }
+
+private:
+    struct BufferedFile {
+        std::vector<unsigned char> data; // Allocated on the first write
+        size_t used;
+        uint64_t position; // Of the file itself, if positionKnown
+        bool positionKnown;
+    };
+
+    bool FlushLocked(NativeFile file, BufferedFile& buffered);
+    bool WriteNative(NativeFile file, BufferedFile& buffered,
+        const unsigned char* data, size_t size);
+
+    size_t m_bufferSize;
+    std::mutex m_mutex;
+    std::map<NativeFile, BufferedFile> m_files;
+    std::atomic<uint64_t> m_writesBuffered{ 0 };
+    std::atomic<uint64_t> m_nativeWrites{ 0 };
+    std::atomic<uint64_t> m_bytesWritten{ 0 };
+};
+
+// Function declarations
+#ifdef _WIN32
+bool InitializeWriteCoalescing(); // Returns true if the file hooks are needed
+void ShutdownWriteCoalescing();
+
+// Called from the file API hooks (fileio.cpp)
+void WriteCoalescingOnOpen(HANDLE file, const char* path, DWORD access,
+    DWORD flags);
+bool WriteCoalescingOnWrite(HANDLE file, LPCVOID buffer, DWORD bytesToWrite,
+    LPDWORD bytesWritten, LPOVERLAPPED overlapped, BOOL& result);
+bool WriteCoalescingFlush(HANDLE file); // Before other access; false on error
+bool WriteCoalescingGetPosition(HANDLE file, uint64_t& position);
+void WriteCoalescingOnSeek(HANDLE file);
+// False if the buffered data could not be written; GetLastError() is the
+// failed write's
+bool WriteCoalescingOnClose(HANDLE file);
+#endif
+
+#endif // WRITEBUFFER_H
@@ -0,0 +1,305 @@
+// blitbench: checks the software blit kernels (SoftwareBlitEnabled=true)
+// against a plain per-pixel reference, then measures the speed of both.
+//
+// Build (Linux, from the repository root):
+//   g++ -std=c++17 -O2 -I"EE Tweaks Mod" -o blitbench tools/blitbench.cpp
+//       "EE Tweaks Mod/softblit.cpp"
+//
+// Usage: blitbench [-n megabytes] [-check]
+//   Runs the correctness check (random sizes, pitches, alignments and color
+//   keys), then the benchmark with the given megabytes per measurement
+//   (default 256). -check skips the benchmark. Exits with 1 on a mismatch.
+
+#include "pch.h"
+#include "softblit.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+// --- Reference ---
+
+static void ReferenceCopy(uint8_t* dst, ptrdiff_t dstPitch, const uint8_t* src,
+    ptrdiff_t srcPitch, size_t rowBytes, size_t rows) {
+    for (size_t row = 0; row < rows; ++row) {
+        for (size_t i = 0; i < rowBytes; ++i) dst[i] = src[i];
+        dst += dstPitch;
+        src += srcPitch;
+    }
+}
+
+template <typename Pixel>
+static void ReferenceColorKey(uint8_t* dst, ptrdiff_t dstPitch,
+    const uint8_t* src, ptrdiff_t srcPitch, size_t width, size_t rows,
+    Pixel key, Pixel keyMask) {
+    for (size_t row = 0; row < rows; ++row) {
+        for (size_t x = 0; x < width; ++x) {
+            Pixel pixel;
+            memcpy(&pixel, src + x * sizeof(Pixel), sizeof(Pixel));
+            if ((pixel & keyMask) != (key & keyMask)) {
+                memcpy(dst + x * sizeof(Pixel), &pixel, sizeof(Pixel));
+            }
+        }
+        dst += dstPitch;
+        src += srcPitch;
+    }
+}
+
+template <typename Pixel>
+static void ReferenceFill(uint8_t* dst, ptrdiff_t pitch, size_t width,
+    size_t rows, Pixel color) {
+    for (size_t row = 0; row < rows; ++row) {
+        for (size_t x = 0; x < width; ++x) {
+            memcpy(dst + x * sizeof(Pixel), &color, sizeof(Pixel));
+        }
+        dst += pitch;
+    }
+}
+
+// --- Correctness Check ---
+
+enum BlitOperation { OP_COPY, OP_COLOR_KEY, OP_FILL };
+static const char* OPERATION_NAMES[] = { "copy", "color key", "fill" };
+
+static uint32_t g_random = 0x12345678;
+
+static uint32_t Random() {
+    g_random ^= g_random << 13;
+    g_random ^= g_random >> 17;
+    g_random ^= g_random << 5;
+    return g_random;
+}
+
+// One surface in a buffer with guard bytes around it, so writes outside the
+// blitted rectangle show up as differences too
+struct TestSurface {
+    std::vector<uint8_t> buffer;
+    size_t offset; // Of the first row
+    ptrdiff_t pitch;
+
+    uint8_t* Rows() { return buffer.data() + offset; }
+};
+
+static TestSurface MakeSurface(size_t rowBytes, size_t rows, size_t pixelBytes,
+    bool bottomUp) {
+    TestSurface surface;
+    size_t pitch = rowBytes + (Random() % 8) * pixelBytes;
+    size_t misalignment = (Random() % 16) & ~(pixelBytes - 1);
+    surface.buffer.resize(misalignment + pitch * rows + 64);
+    for (uint8_t& byte : surface.buffer) byte = static_cast<uint8_t>(Random());
+    surface.offset = misalignment + (bottomUp ? pitch * (rows - 1) : 0);
+    surface.pitch = bottomUp ? -static_cast<ptrdiff_t>(pitch) :
+        static_cast<ptrdiff_t>(pitch);
+    return surface;
+}
+
+// Pixels of a source with many pixels equal to the key, some equal only
+// outside the key mask, and long transparent runs
+static void PaintKeyedSource(TestSurface& surface, size_t width, size_t rows,
+    size_t pixelBytes, uint32_t key, uint32_t keyMask) {
+    uint8_t* row = surface.Rows();
+    for (size_t y = 0; y < rows; ++y) {
+        bool run = Random() % 4 == 0;
+        for (size_t x = 0; x < width; ++x) {
+            uint32_t pixel = Random();
+            uint32_t choice = Random() % 8;
+            if (run || choice < 3) pixel = key;
+            else if (choice == 3) pixel = key ^ (~keyMask & Random());
+            memcpy(row + x * pixelBytes, &pixel, pixelBytes);
+        }
+        row += surface.pitch;
+    }
+}
+
+static bool CheckOnce(BlitOperation operation, size_t pixelBytes) {
+    size_t width = 1 + Random() % (Random() % 4 == 0 ? 700 : 40);
+    size_t rows = 1 + Random() % 12;
+    size_t rowBytes = width * pixelBytes;
+    uint32_t key = Random();
+    uint32_t keyMask = 0xFFFFFFFF;
+    switch (Random() % 3) {
+    case 1: keyMask = pixelBytes == 2 ? 0x7FFF : 0x00FFFFFF; break; // X1R5G5B5, X8R8G8B8
+    case 2: keyMask = Random(); break;
+    }
+    uint32_t fill = Random();
+
+    TestSurface source = MakeSurface(rowBytes, rows, pixelBytes, Random() % 4 == 0);
+    TestSurface expected = MakeSurface(rowBytes, rows, pixelBytes, Random() % 4 == 0);
+    if (operation == OP_COLOR_KEY) {
+        PaintKeyedSource(source, width, rows, pixelBytes, key, keyMask);
+    }
+    TestSurface actual = expected;
+
+    switch (operation) {
+    case OP_COPY:
+        ReferenceCopy(expected.Rows(), expected.pitch, source.Rows(),
+            source.pitch, rowBytes, rows);
+        BlitCopy(actual.Rows(), actual.pitch, source.Rows(), source.pitch,
+            rowBytes, rows);
+        break;
+    case OP_COLOR_KEY:
+        if (pixelBytes == 2) {
+            ReferenceColorKey<uint16_t>(expected.Rows(), expected.pitch,
+                source.Rows(), source.pitch, width, rows,
+                static_cast<uint16_t>(key), static_cast<uint16_t>(keyMask));
+            BlitColorKey16(actual.Rows(), actual.pitch, source.Rows(),
+                source.pitch, width, rows, static_cast<uint16_t>(key),
+                static_cast<uint16_t>(keyMask));
+        }
+        else {
+            ReferenceColorKey<uint32_t>(expected.Rows(), expected.pitch,
+                source.Rows(), source.pitch, width, rows, key, keyMask);
+            BlitColorKey32(actual.Rows(), actual.pitch, source.Rows(),
+                source.pitch, width, rows, key, keyMask);
+        }
+        break;
+    case OP_FILL:
+        if (pixelBytes == 2) {
+            ReferenceFill<uint16_t>(expected.Rows(), expected.pitch, width,
+                rows, static_cast<uint16_t>(fill));
+            BlitFill16(actual.Rows(), actual.pitch, width, rows,
+                static_cast<uint16_t>(fill));
+        }
+        else {
+            ReferenceFill<uint32_t>(expected.Rows(), expected.pitch, width,
+                rows, fill);
+            BlitFill32(actual.Rows(), actual.pitch, width, rows, fill);
+        }
+        break;
+    }
+
+    if (actual.buffer != expected.buffer) {
+        printf("MISMATCH: %s %zu-bit, %zux%zu pixels, pitch %td, key %08x "
+            "mask %08x\n", OPERATION_NAMES[operation], pixelBytes * 8, width,
+            rows, actual.pitch, key, keyMask);
+        return false;
+    }
+    return true;
+}
+
+static bool RunCheck() {
+    const int trials = 2000;
+    bool passed = true;
+    for (int operation = OP_COPY; operation <= OP_FILL; ++operation) {
+        for (size_t pixelBytes = 2; pixelBytes <= 4; pixelBytes += 2) {
+            int failures = 0;
+            for (int i = 0; i < trials && failures < 5; ++i) {
+                if (!CheckOnce(static_cast<BlitOperation>(operation), pixelBytes)) {
+                    failures++;
+                }
+            }
+            printf("  %-9s %2zu-bit: %s\n", OPERATION_NAMES[operation],
+                pixelBytes * 8, failures == 0 ? "ok" : "FAILED");
+            passed = passed && failures == 0;
+        }
+    }
+    return passed;
+}
+
+// --- Benchmark ---
+
+struct BenchmarkSize {
+    const char* name;
+    size_t width;
+    size_t height;
+};
+
+static const BenchmarkSize BENCHMARK_SIZES[] = {
+    { "32x32 sprite", 32, 32 },
+    { "128x128", 128, 128 },
+    { "800x600", 800, 600 },
+    { "1024x768", 1024, 768 },
+};
+
+// Run one blit repeatedly until megabytes have been written; returns MB/s
+template <typename Blit>
+static double Measure(size_t bytesPerBlit, size_t megabytes, Blit blit) {
+    size_t iterations = std::max<size_t>(1, (megabytes << 20) / bytesPerBlit);
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; ++i) blit();
+    double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    return seconds > 0.0 ? iterations * bytesPerBlit / 1048576.0 / seconds : 0.0;
+}
+
+static void RunBenchmark(size_t megabytes) {
+    printf("\n%-14s %-10s %6s %12s %12s %8s\n", "size", "operation", "bits",
+        "reference", "SSE2", "speedup");
+    for (const BenchmarkSize& size : BENCHMARK_SIZES) {
+        for (int operation = OP_COPY; operation <= OP_FILL; ++operation) {
+            for (size_t pixelBytes = 2; pixelBytes <= 4; pixelBytes += 2) {
+                size_t rowBytes = size.width * pixelBytes;
+                ptrdiff_t pitch = static_cast<ptrdiff_t>(rowBytes);
+                std::vector<uint8_t> source(rowBytes * size.height);
+                std::vector<uint8_t> target(rowBytes * size.height);
+                // A sprite-like source: about a third transparent
+                uint32_t key = 0xF81F;
+                for (size_t i = 0; i + pixelBytes <= source.size(); i += pixelBytes) {
+                    uint32_t pixel = Random() % 3 == 0 ? key : Random();
+                    memcpy(&source[i], &pixel, pixelBytes);
+                }
+                uint8_t* d = target.data();
+                const uint8_t* s = source.data();
+                size_t w = size.width;
+                size_t h = size.height;
+                double rates[2];
+                for (int variant = 0; variant < 2; ++variant) {
+                    bool simd = variant == 1;
+                    auto blit = [&]() {
+                        if (operation == OP_COPY) {
+                            if (simd) BlitCopy(d, pitch, s, pitch, rowBytes, h);
+                            else ReferenceCopy(d, pitch, s, pitch, rowBytes, h);
+                        }
+                        else if (operation == OP_COLOR_KEY && pixelBytes == 2) {
+                            if (simd) BlitColorKey16(d, pitch, s, pitch, w, h, 0xF81F, 0xFFFF);
+                            else ReferenceColorKey<uint16_t>(d, pitch, s, pitch, w, h, 0xF81F, 0xFFFF);
+                        }
+                        else if (operation == OP_COLOR_KEY) {
+                            if (simd) BlitColorKey32(d, pitch, s, pitch, w, h, key, 0xFFFFFF);
+                            else ReferenceColorKey<uint32_t>(d, pitch, s, pitch, w, h, key, 0xFFFFFF);
+                        }
+                        else if (pixelBytes == 2) {
+                            if (simd) BlitFill16(d, pitch, w, h, 0x1234);
+                            else ReferenceFill<uint16_t>(d, pitch, w, h, 0x1234);
+                        }
+                        else {
+                            if (simd) BlitFill32(d, pitch, w, h, 0x123456);
+                            else ReferenceFill<uint32_t>(d, pitch, w, h, 0x123456);
+                        }
+                    };
+                    rates[variant] = Measure(rowBytes * h, megabytes, blit);
+                }
+                printf("%-14s %-10s %6zu %7.0f MB/s %7.0f MB/s %7.2fx\n",
+                    size.name, OPERATION_NAMES[operation], pixelBytes * 8,
+                    rates[0], rates[1], rates[0] > 0.0 ? rates[1] / rates[0] : 0.0);
+            }
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    size_t megabytes = 256;
+    bool benchmark = true;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-n" && i + 1 < argc) megabytes = strtoul(argv[++i], nullptr, 10);
+        else if (arg == "-check") benchmark = false;
+        else {
+            fprintf(stderr, "Usage: blitbench [-n megabytes] [-check]\n");
+            return 2;
+        }
+    }
+    if (megabytes == 0) {
+        fprintf(stderr, "Usage: blitbench [-n megabytes] [-check]\n");
+        return 2;
+    }
+
+    printf("Correctness against the reference:\n");
+    if (!RunCheck()) {
+        return 1;
+    }
+    if (benchmark) {
+        RunBenchmark(megabytes);
+    }
+    return 0;
+}
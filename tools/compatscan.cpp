@@ -0,0 +1,446 @@
+// compatscan: checks which game builds the mod's patches will find. Maps
+// every .exe and .dll under the given directories, searches each for the
+// original bytes of every standard patch (g_patches) and custom patch, and
+// writes a binary x patch matrix of hit counts and RVAs.
+//
+// Build (Linux, from the repository root):
+//   g++ -std=c++17 -O2 -pthread -I"EE Tweaks Mod" -o compatscan
+//       tools/compatscan.cpp "EE Tweaks Mod/memory.cpp"
+//       "EE Tweaks Mod/patches.cpp" "EE Tweaks Mod/config.cpp"
+//       "EE Tweaks Mod/logging.cpp" "EE Tweaks Mod/mapplanner.cpp"
+//
+// Usage: compatscan [-t threads] [-a] [-c matrix.csv] [-j matrix.json] dir...
+//   -t  scan threads (default: all cores)
+//   -a  search every binary for every patch, not just the patches that
+//       target it (the game executable patches go to each .exe, the others
+//       to the DLL of that name)
+//   -c  write the matrix as CSV. Cells: "-" (not searched), "0", or
+//       "hits:rva;rva..." with up to 8 RVAs
+//   -j  write the matrix and the scan throughput as JSON
+// A patch applies cleanly where its pattern is found exactly once.
+
+#include "pch.h"
+#include "globals.h"
+#include "logging.h"
+#include "memory.h"
+#include "patches.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fcntl.h>
+#include <strings.h> // strcasecmp
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const size_t MAX_COUNTED_HITS = 64; // Enough to call it ambiguous
+static const size_t MAX_LISTED_RVAS = 8;
+
+struct Signature {
+    std::string name;
+    std::string moduleIdentifier;
+    std::vector<unsigned char> pattern;
+    std::vector<unsigned char> mask;
+};
+
+struct Section {
+    uint32_t rva;
+    uint32_t fileOffset;
+    uint32_t fileSize;
+};
+
+// A binary mapped read-only, with its sections to turn offsets into RVAs
+struct MappedBinary {
+    std::string path;
+    std::string fileName;
+    bool isExecutable = false;
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+    std::vector<Section> sections;
+};
+
+struct ScanResult {
+    bool searched = false;
+    size_t hits = 0;
+    std::vector<uint32_t> rvas;
+};
+
+static uint16_t ReadU16(const unsigned char* p) {
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+static uint32_t ReadU32(const unsigned char* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+// Read the section table. Returns false if the file is not a PE image.
+static bool ParseSections(MappedBinary& binary) {
+    const unsigned char* data = binary.data;
+    if (binary.size < 0x40 || data[0] != 'M' || data[1] != 'Z') {
+        return false;
+    }
+    uint32_t peOffset = ReadU32(data + 0x3C);
+    if (peOffset > binary.size || binary.size - peOffset < 24 ||
+        memcmp(data + peOffset, "PE\0\0", 4) != 0) {
+        return false;
+    }
+    uint16_t sectionCount = ReadU16(data + peOffset + 6);
+    uint16_t optionalSize = ReadU16(data + peOffset + 20);
+    size_t table = static_cast<size_t>(peOffset) + 24 + optionalSize;
+    if (table + static_cast<size_t>(sectionCount) * 40 > binary.size) {
+        return false;
+    }
+    for (uint16_t i = 0; i < sectionCount; ++i) {
+        const unsigned char* header = data + table + i * 40;
+        Section section;
+        section.rva = ReadU32(header + 12);
+        section.fileSize = ReadU32(header + 16);
+        section.fileOffset = ReadU32(header + 20);
+        if (section.fileSize > 0) {
+            binary.sections.push_back(section);
+        }
+    }
+    return true;
+}
+
+// The RVA a file offset is loaded at, or the offset itself in the headers
+static uint32_t OffsetToRva(const MappedBinary& binary, size_t offset) {
+    for (const Section& section : binary.sections) {
+        if (offset >= section.fileOffset &&
+            offset - section.fileOffset < section.fileSize) {
+            return static_cast<uint32_t>(section.rva + (offset - section.fileOffset));
+        }
+    }
+    return static_cast<uint32_t>(offset);
+}
+
+static bool MapBinary(const std::string& path, MappedBinary& binary) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        close(fd);
+        return false;
+    }
+    void* view = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ,
+        MAP_PRIVATE, fd, 0);
+    close(fd); // The mapping keeps the file open
+    if (view == MAP_FAILED) {
+        return false;
+    }
+    binary.path = path;
+    binary.data = static_cast<const unsigned char*>(view);
+    binary.size = static_cast<size_t>(info.st_size);
+    if (!ParseSections(binary)) {
+        munmap(view, binary.size);
+        return false;
+    }
+    return true;
+}
+
+static bool HasExtension(const std::string& name, const char* extension) {
+    size_t length = strlen(extension);
+    return name.size() > length &&
+        strcasecmp(name.c_str() + name.size() - length, extension) == 0;
+}
+
+// Whether a signature is meant for a binary
+static bool Targets(const Signature& signature, const MappedBinary& binary) {
+    if (signature.moduleIdentifier == "GAME_EXECUTABLE") {
+        return binary.isExecutable;
+    }
+    return strcasecmp(signature.moduleIdentifier.c_str(),
+        binary.fileName.c_str()) == 0;
+}
+
+static std::vector<Signature> LoadSignatures() {
+    std::vector<Signature> signatures;
+    auto add = [&signatures](const std::string& name,
+        const std::string& moduleIdentifier, const std::string& hex) {
+        Signature signature;
+        signature.name = name;
+        signature.moduleIdentifier = moduleIdentifier;
+        if (!HexToMaskedBytes(hex, signature.pattern, signature.mask)) {
+            fprintf(stderr, "Skipping %s: bad pattern\n", name.c_str());
+            return;
+        }
+        signatures.push_back(std::move(signature));
+    };
+    for (const MemoryPatch& patch : g_patches) {
+        add(patch.name, patch.moduleIdentifier, patch.originalHex);
+    }
+    for (const CustomPatchSignature& patch : GetCustomPatchSignatures()) {
+        add(patch.name, patch.moduleIdentifier, patch.originalHex);
+    }
+    return signatures;
+}
+
+static std::string Hex(uint32_t value) {
+    char text[16];
+    snprintf(text, sizeof(text), "0x%x", value);
+    return text;
+}
+
+static std::string CsvField(const std::string& text) {
+    if (text.find_first_of(",\"\n") == std::string::npos) {
+        return text;
+    }
+    std::string quoted = "\"";
+    for (char c : text) {
+        if (c == '"') quoted += '"';
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+static std::string JsonString(const std::string& text) {
+    std::string escaped = "\"";
+    for (unsigned char c : text) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+            escaped += static_cast<char>(c);
+        }
+        else if (c < 0x20) {
+            char code[8];
+            snprintf(code, sizeof(code), "\\u%04x", c);
+            escaped += code;
+        }
+        else {
+            escaped += static_cast<char>(c);
+        }
+    }
+    return escaped + "\"";
+}
+
+static const char* Classify(const ScanResult& result) {
+    if (!result.searched) return "not searched";
+    if (result.hits == 0) return "missing";
+    return result.hits == 1 ? "unique" : "ambiguous";
+}
+
+static std::string CsvCell(const ScanResult& result) {
+    if (!result.searched) {
+        return "-";
+    }
+    std::string cell = std::to_string(result.hits);
+    if (result.hits >= MAX_COUNTED_HITS) cell += "+";
+    for (size_t i = 0; i < result.rvas.size(); ++i) {
+        cell += (i == 0 ? ':' : ';') + Hex(result.rvas[i]);
+    }
+    return cell;
+}
+
+static void PrintUsage() {
+    fprintf(stderr, "Usage: compatscan [-t threads] [-a] [-c matrix.csv] "
+        "[-j matrix.json] dir...\n");
+}
+
+int main(int argc, char** argv) {
+    unsigned int threadCount = std::thread::hardware_concurrency();
+    bool searchAll = false;
+    std::string csvPath;
+    std::string jsonPath;
+    std::vector<std::string> roots;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-t" && i + 1 < argc) {
+            threadCount = static_cast<unsigned int>(atoi(argv[++i]));
+        }
+        else if (arg == "-a") {
+            searchAll = true;
+        }
+        else if (arg == "-c" && i + 1 < argc) {
+            csvPath = argv[++i];
+        }
+        else if (arg == "-j" && i + 1 < argc) {
+            jsonPath = argv[++i];
+        }
+        else if (!arg.empty() && arg[0] == '-') {
+            PrintUsage();
+            return 2;
+        }
+        else {
+            roots.push_back(arg);
+        }
+    }
+    if (roots.empty()) {
+        PrintUsage();
+        return 2;
+    }
+    if (threadCount == 0) threadCount = 1;
+
+    g_loggingEnabled = false; // Log() still reaches stderr
+    std::vector<Signature> signatures = LoadSignatures();
+
+    // Find and map the binaries
+    auto mapStart = std::chrono::steady_clock::now();
+    std::vector<MappedBinary> binaries;
+    for (const std::string& root : roots) {
+        std::error_code error;
+        std::filesystem::recursive_directory_iterator it(root,
+            std::filesystem::directory_options::skip_permission_denied, error);
+        if (error) {
+            fprintf(stderr, "Could not read %s: %s\n", root.c_str(),
+                error.message().c_str());
+            return 1;
+        }
+        for (; it != std::filesystem::recursive_directory_iterator();
+            it.increment(error)) {
+            if (error) break;
+            if (!it->is_regular_file(error)) continue;
+            std::string fileName = it->path().filename().string();
+            bool isExecutable = HasExtension(fileName, ".exe");
+            if (!isExecutable && !HasExtension(fileName, ".dll")) continue;
+            MappedBinary binary;
+            if (!MapBinary(it->path().string(), binary)) {
+                fprintf(stderr, "Skipping %s: not a PE image\n",
+                    it->path().string().c_str());
+                continue;
+            }
+            binary.fileName = fileName;
+            binary.isExecutable = isExecutable;
+            binaries.push_back(std::move(binary));
+        }
+    }
+    std::sort(binaries.begin(), binaries.end(),
+        [](const MappedBinary& a, const MappedBinary& b) { return a.path < b.path; });
+    double mapMs = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - mapStart).count();
+    if (binaries.empty()) {
+        fprintf(stderr, "No .exe or .dll files found.\n");
+        return 1;
+    }
+
+    // One job per binary and signature, spread over the threads
+    std::vector<ScanResult> results(binaries.size() * signatures.size());
+    std::vector<size_t> jobs;
+    uint64_t bytesScanned = 0;
+    for (size_t b = 0; b < binaries.size(); ++b) {
+        for (size_t s = 0; s < signatures.size(); ++s) {
+            if (searchAll || Targets(signatures[s], binaries[b])) {
+                jobs.push_back(b * signatures.size() + s);
+                bytesScanned += binaries[b].size;
+            }
+        }
+    }
+    std::atomic<size_t> nextJob(0);
+    auto worker = [&]() {
+        size_t index;
+        while ((index = nextJob.fetch_add(1)) < jobs.size()) {
+            size_t cell = jobs[index];
+            const MappedBinary& binary = binaries[cell / signatures.size()];
+            const Signature& signature = signatures[cell % signatures.size()];
+            uintptr_t start = reinterpret_cast<uintptr_t>(binary.data);
+            std::vector<uintptr_t> matches = FindAllPatternMatches(start,
+                binary.size, signature.pattern, signature.mask,
+                MAX_COUNTED_HITS);
+            ScanResult& result = results[cell];
+            result.searched = true;
+            result.hits = matches.size();
+            for (size_t i = 0; i < matches.size() && i < MAX_LISTED_RVAS; ++i) {
+                result.rvas.push_back(OffsetToRva(binary, matches[i] - start));
+            }
+        }
+    };
+    auto scanStart = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (unsigned int i = 1; i < threadCount && i < jobs.size(); ++i) {
+        workers.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : workers) {
+        thread.join();
+    }
+    double scanMs = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - scanStart).count();
+    double mbPerSecond = scanMs > 0 ?
+        bytesScanned / (1024.0 * 1024.0) / (scanMs / 1000.0) : 0;
+
+    // Summary: per patch, in how many binaries it would apply
+    uint64_t mappedBytes = 0;
+    for (const MappedBinary& binary : binaries) mappedBytes += binary.size;
+    printf("Mapped %zu binaries (%.1f MB) in %.1f ms.\n", binaries.size(),
+        mappedBytes / (1024.0 * 1024.0), mapMs);
+    printf("Ran %zu searches (%.1f MB) on %u thread(s) in %.1f ms: %.0f MB/s.\n\n",
+        jobs.size(), bytesScanned / (1024.0 * 1024.0), threadCount, scanMs,
+        mbPerSecond);
+    printf("%-30s %8s %8s %9s\n", "Patch", "unique", "missing", "ambiguous");
+    for (size_t s = 0; s < signatures.size(); ++s) {
+        int unique = 0, missing = 0, ambiguous = 0;
+        for (size_t b = 0; b < binaries.size(); ++b) {
+            const ScanResult& result = results[b * signatures.size() + s];
+            if (!result.searched) continue;
+            if (result.hits == 0) missing++;
+            else if (result.hits == 1) unique++;
+            else ambiguous++;
+        }
+        printf("%-30s %8d %8d %9d\n", signatures[s].name.c_str(), unique,
+            missing, ambiguous);
+    }
+
+    if (!csvPath.empty()) {
+        std::ofstream csv(csvPath, std::ios::trunc);
+        if (!csv.is_open()) {
+            fprintf(stderr, "Could not write %s\n", csvPath.c_str());
+            return 1;
+        }
+        csv << "binary,size";
+        for (const Signature& signature : signatures) {
+            csv << ',' << CsvField(signature.name);
+        }
+        csv << '\n';
+        for (size_t b = 0; b < binaries.size(); ++b) {
+            csv << CsvField(binaries[b].path) << ',' << binaries[b].size;
+            for (size_t s = 0; s < signatures.size(); ++s) {
+                csv << ',' << CsvField(CsvCell(results[b * signatures.size() + s]));
+            }
+            csv << '\n';
+        }
+        printf("\nMatrix written to %s.\n", csvPath.c_str());
+    }
+
+    if (!jsonPath.empty()) {
+        std::ofstream json(jsonPath, std::ios::trunc);
+        if (!json.is_open()) {
+            fprintf(stderr, "Could not write %s\n", jsonPath.c_str());
+            return 1;
+        }
+        json << "{\n  \"scan\": { \"binaries\": " << binaries.size()
+            << ", \"searches\": " << jobs.size() << ", \"threads\": "
+            << threadCount << ", \"bytesScanned\": " << bytesScanned
+            << ", \"mapMs\": " << mapMs << ", \"scanMs\": " << scanMs
+            << ", \"mbPerSecond\": " << mbPerSecond << " },\n";
+        json << "  \"binaries\": [\n";
+        for (size_t b = 0; b < binaries.size(); ++b) {
+            json << "    { \"path\": " << JsonString(binaries[b].path)
+                << ", \"size\": " << binaries[b].size << ", \"patches\": {";
+            bool first = true;
+            for (size_t s = 0; s < signatures.size(); ++s) {
+                const ScanResult& result = results[b * signatures.size() + s];
+                if (!result.searched) continue;
+                json << (first ? "\n" : ",\n") << "      "
+                    << JsonString(signatures[s].name) << ": { \"hits\": "
+                    << result.hits << ", \"status\": \"" << Classify(result)
+                    << "\", \"rvas\": [";
+                for (size_t i = 0; i < result.rvas.size(); ++i) {
+                    json << (i ? ", " : "") << '"' << Hex(result.rvas[i]) << '"';
+                }
+                json << "] }";
+                first = false;
+            }
+            json << (first ? "" : "\n    ") << "} }"
+                << (b + 1 < binaries.size() ? "," : "") << '\n';
+        }
+        json << "  ]\n}\n";
+        printf("%sJSON written to %s.\n", csvPath.empty() ? "\n" : "",
+            jsonPath.c_str());
+    }
+
+    for (const MappedBinary& binary : binaries) {
+        munmap(const_cast<unsigned char*>(binary.data), binary.size);
+    }
+    return 0;
+}
@@ -0,0 +1,153 @@
+// counterreader: prints the live counters a running game publishes when
+// SharedCountersEnabled=true (see counters.h for the layout).
+//
+// Build (Linux, from the repository root):
+//   g++ -std=c++17 -O2 -DCOUNTERS_READER -I"EE Tweaks Mod" -o counterreader
+//       tools/counterreader.cpp "EE Tweaks Mod/counters.cpp" -lrt
+// Build (Windows, Developer Command Prompt, from the repository root):
+//   cl /std:c++17 /EHsc /O2 /DCOUNTERS_READER /I"EE Tweaks Mod"
+//       tools\counterreader.cpp "EE Tweaks Mod\counters.cpp"
+//
+// Usage: counterreader <game process id> [-i interval_ms] [-n samples] [--csv]
+//   Without -i the counters are printed once. With -i they are polled until
+//   the game exits (or -n samples were taken); --csv prints one row per poll.
+
+#include "pch.h"
+#include "counters.h"
+
+#include <cstdio>
+#include <cstdlib>
+#ifndef _WIN32
+#include <signal.h>
+#endif
+
+static void PrintTable(const SharedCounterBlock& block) {
+    printf("Process %u, layout version %u, started at %llu\n", block.processId,
+        block.version, static_cast<unsigned long long>(block.startTime));
+    for (size_t i = 0; i < block.counterCount && i < COUNTER_SLOTS; ++i) {
+        const char* name = GetCounterName(i);
+        uint64_t value = block.counters[i].load(std::memory_order_relaxed);
+        if (name != nullptr) {
+            printf("  %-20s %llu\n", name, static_cast<unsigned long long>(value));
+        }
+        else {
+            printf("  counter%-13zu %llu\n", i,
+                static_cast<unsigned long long>(value));
+        }
+    }
+
+    uint32_t patchCount = block.patchCount.load(std::memory_order_acquire);
+    if (patchCount > COUNTER_PATCH_SLOTS) patchCount = COUNTER_PATCH_SLOTS;
+    for (uint32_t i = 0; i < patchCount; ++i) {
+        const CounterPatchEntry& entry = block.patches[i];
+        printf("  patch %-30.*s %s\n", static_cast<int>(COUNTER_PATCH_NAME_SIZE),
+            entry.name,
+            GetPatchStateName(entry.state.load(std::memory_order_relaxed)));
+    }
+}
+
+static void PrintCsvHeader(const SharedCounterBlock& block) {
+    printf("time_ms");
+    for (size_t i = 0; i < block.counterCount && i < COUNTER_SLOTS; ++i) {
+        const char* name = GetCounterName(i);
+        if (name != nullptr) printf(",%s", name);
+        else printf(",counter%zu", i);
+    }
+    printf("\n");
+}
+
+static void PrintCsvRow(const SharedCounterBlock& block, long long timeMs) {
+    printf("%lld", timeMs);
+    for (size_t i = 0; i < block.counterCount && i < COUNTER_SLOTS; ++i) {
+        printf(",%llu", static_cast<unsigned long long>(
+            block.counters[i].load(std::memory_order_relaxed)));
+    }
+    printf("\n");
+    fflush(stdout);
+}
+
+// The block stays readable after the game exits; check the process instead
+static bool ProcessAlive(uint32_t processId) {
+#ifdef _WIN32
+    HANDLE process = OpenProcess(SYNCHRONIZE, FALSE, processId);
+    if (process == NULL) {
+        return false;
+    }
+    bool alive = WaitForSingleObject(process, 0) == WAIT_TIMEOUT;
+    CloseHandle(process);
+    return alive;
+#else
+    return kill(static_cast<pid_t>(processId), 0) == 0 || errno == EPERM;
+#endif
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: counterreader <pid> [-i interval_ms] "
+            "[-n samples] [--csv]\n");
+        return 2;
+    }
+    uint32_t processId = static_cast<uint32_t>(strtoul(argv[1], nullptr, 10));
+    int intervalMs = 0;
+    long long samples = 0;
+    bool csv = false;
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-i" && i + 1 < argc) intervalMs = atoi(argv[++i]);
+        else if (arg == "-n" && i + 1 < argc) samples = atoll(argv[++i]);
+        else if (arg == "--csv") csv = true;
+        else {
+            fprintf(stderr, "Unknown option %s\n", arg.c_str());
+            return 2;
+        }
+    }
+
+    SharedCounterMapping mapping;
+    if (!mapping.Open(processId)) {
+        fprintf(stderr, "No counters for process %u (%s). Is "
+            "SharedCountersEnabled set?\n", processId,
+            SharedCounterMapping::NameFor(processId).c_str());
+        return 1;
+    }
+    const SharedCounterBlock& block = *mapping.Block();
+    if (block.magic.load(std::memory_order_acquire) != COUNTER_BLOCK_MAGIC) {
+        fprintf(stderr, "Counter block is not initialized yet.\n");
+        return 1;
+    }
+    if (block.version != COUNTER_BLOCK_VERSION ||
+        block.blockSize < sizeof(SharedCounterBlock)) {
+        fprintf(stderr, "Counter layout version %u is not supported (expected "
+            "%u).\n", block.version, COUNTER_BLOCK_VERSION);
+        return 1;
+    }
+
+    if (intervalMs <= 0) {
+        if (csv) {
+            PrintCsvHeader(block);
+            PrintCsvRow(block, 0);
+        }
+        else {
+            PrintTable(block);
+        }
+        return 0;
+    }
+
+    if (csv) PrintCsvHeader(block);
+    auto start = std::chrono::steady_clock::now();
+    for (long long taken = 0; samples == 0 || taken < samples; ++taken) {
+        long long timeMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        if (csv) {
+            PrintCsvRow(block, timeMs);
+        }
+        else {
+            printf("--- %lld ms\n", timeMs);
+            PrintTable(block);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(intervalMs));
+        if (!ProcessAlive(processId)) {
+            break;
+        }
+    }
+    return 0;
+}
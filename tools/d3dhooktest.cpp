@@ -0,0 +1,487 @@
+// d3dhooktest: runs the Direct3D State Filter's hooks (D3DStateFilterEnabled
+// =true) against mock device, DirectDraw and surface vtables, and checks
+// that the state the mock device ends up with is always the state the game
+// asked for, also across failed calls, state blocks and device loss.
+//
+// Build (Linux, from the repository root):
+//   g++ -std=c++17 -O2 -I"EE Tweaks Mod" -o d3dhooktest tools/d3dhooktest.cpp
+//       "EE Tweaks Mod/d3dhooks.cpp"
+//
+// Usage: d3dhooktest
+//   Prints each failed check and exits with 1 if there was one.
+
+#include "pch.h"
+#include "d3dhooks.h"
+#include "hooks.h"
+
+#include <cstdio>
+#include <random>
+
+static int g_failures = 0;
+
+static void Check(bool condition, const std::string& what) {
+    if (!condition) {
+        printf("FAILED: %s\n", what.c_str());
+        g_failures++;
+    }
+}
+
+// The mock vtables are plain writable arrays, so patching them needs none of
+// the page protection work of the real HookVtableEntry (hooks.cpp)
+bool HookVtableEntry(void* object, size_t index, const void* replacement,
+    void** original) {
+    void** vtable = *reinterpret_cast<void***>(object);
+    *original = vtable[index];
+    vtable[index] = const_cast<void*>(replacement);
+    return true;
+}
+
+// --- Mock Objects ---
+
+const HRESULT MOCK_ERROR = static_cast<HRESULT>(0x80004005); // E_FAIL
+const HRESULT MOCK_WRONG_MODE = static_cast<HRESULT>(0x8876024B);
+
+// The methods of each interface in the order d3d.h and ddraw.h declare them,
+// so the slots are counted here rather than copied from d3dhooks.cpp
+enum DeviceMethod { // IDirect3DDevice7
+    DEVICE_QUERY_INTERFACE, DEVICE_ADD_REF, DEVICE_RELEASE, GET_CAPS,
+    ENUM_TEXTURE_FORMATS, BEGIN_SCENE, END_SCENE, GET_DIRECT3D,
+    SET_RENDER_TARGET, GET_RENDER_TARGET, CLEAR, SET_TRANSFORM, GET_TRANSFORM,
+    SET_VIEWPORT, MULTIPLY_TRANSFORM, GET_VIEWPORT, SET_MATERIAL, GET_MATERIAL,
+    SET_LIGHT, GET_LIGHT, SET_RENDER_STATE, GET_RENDER_STATE, BEGIN_STATE_BLOCK,
+    END_STATE_BLOCK, PRE_LOAD, DRAW_PRIMITIVE, DRAW_INDEXED_PRIMITIVE,
+    SET_CLIP_STATUS, GET_CLIP_STATUS, DRAW_PRIMITIVE_STRIDED,
+    DRAW_INDEXED_PRIMITIVE_STRIDED, DRAW_PRIMITIVE_VB, DRAW_INDEXED_PRIMITIVE_VB,
+    COMPUTE_SPHERE_VISIBILITY, GET_TEXTURE, SET_TEXTURE, GET_TEXTURE_STAGE_STATE,
+    SET_TEXTURE_STAGE_STATE, VALIDATE_DEVICE, APPLY_STATE_BLOCK,
+    CAPTURE_STATE_BLOCK, DELETE_STATE_BLOCK, CREATE_STATE_BLOCK, LOAD,
+    LIGHT_ENABLE, GET_LIGHT_ENABLE, SET_CLIP_PLANE, GET_CLIP_PLANE, GET_INFO,
+    DEVICE_METHOD_COUNT
+};
+
+enum DirectDrawMethod { // IDirectDraw7
+    DIRECTDRAW_QUERY_INTERFACE, DIRECTDRAW_ADD_REF, DIRECTDRAW_RELEASE, COMPACT,
+    CREATE_CLIPPER, CREATE_PALETTE, CREATE_SURFACE, DUPLICATE_SURFACE,
+    ENUM_DISPLAY_MODES, ENUM_SURFACES, FLIP_TO_GDI_SURFACE, DIRECTDRAW_GET_CAPS,
+    GET_DISPLAY_MODE, GET_FOURCC_CODES, GET_GDI_SURFACE, GET_MONITOR_FREQUENCY,
+    GET_SCAN_LINE, GET_VERTICAL_BLANK_STATUS, DIRECTDRAW_INITIALIZE,
+    RESTORE_DISPLAY_MODE, SET_COOPERATIVE_LEVEL, SET_DISPLAY_MODE,
+    WAIT_FOR_VERTICAL_BLANK, GET_AVAILABLE_VID_MEM, GET_SURFACE_FROM_DC,
+    RESTORE_ALL_SURFACES, TEST_COOPERATIVE_LEVEL, GET_DEVICE_IDENTIFIER,
+    START_MODE_TEST, EVALUATE_MODE, DIRECTDRAW_METHOD_COUNT
+};
+
+enum SurfaceMethod { // IDirectDrawSurface7
+    SURFACE_QUERY_INTERFACE, SURFACE_ADD_REF, SURFACE_RELEASE,
+    ADD_ATTACHED_SURFACE, ADD_OVERLAY_DIRTY_RECT, BLT, BLT_BATCH, BLT_FAST,
+    DELETE_ATTACHED_SURFACE, ENUM_ATTACHED_SURFACES, ENUM_OVERLAY_Z_ORDERS, FLIP,
+    GET_ATTACHED_SURFACE, GET_BLT_STATUS, SURFACE_GET_CAPS, GET_CLIPPER,
+    GET_COLOR_KEY, GET_DC, GET_FLIP_STATUS, GET_OVERLAY_POSITION, GET_PALETTE,
+    GET_PIXEL_FORMAT, GET_SURFACE_DESC, SURFACE_INITIALIZE, IS_LOST, LOCK,
+    RELEASE_DC, SURFACE_RESTORE, SET_CLIPPER, SET_COLOR_KEY,
+    SET_OVERLAY_POSITION, SET_PALETTE, UNLOCK, UPDATE_OVERLAY,
+    UPDATE_OVERLAY_DISPLAY, UPDATE_OVERLAY_Z_ORDER, GET_DD_INTERFACE,
+    PAGE_LOCK, PAGE_UNLOCK, SET_SURFACE_DESC, SET_PRIVATE_DATA,
+    GET_PRIVATE_DATA, FREE_PRIVATE_DATA, GET_UNIQUENESS_VALUE,
+    CHANGE_UNIQUENESS_VALUE, SET_PRIORITY, GET_PRIORITY, SET_LOD, GET_LOD,
+    SURFACE_METHOD_COUNT
+};
+
+struct MockDevice {
+    void** vtable;
+    std::map<DWORD, DWORD> renderStates;
+    std::map<std::pair<DWORD, DWORD>, DWORD> stageStates;
+    std::map<DWORD, void*> textures;
+    uint64_t calls = 0;
+    bool failNext = false;
+    bool recording = false;
+    std::map<DWORD, DWORD> block; // Render states recorded in the state block
+
+    // A lost device comes back with its states reset
+    void Lose() {
+        renderStates.clear();
+        stageStates.clear();
+        textures.clear();
+    }
+};
+
+static MockDevice* AsDevice(void* self) {
+    return static_cast<MockDevice*>(self);
+}
+
+static HRESULT WINAPI MockSetRenderState(void* self, DWORD state, DWORD value) {
+    MockDevice* device = AsDevice(self);
+    device->calls++;
+    if (device->failNext) {
+        device->failNext = false;
+        return MOCK_ERROR;
+    }
+    if (device->recording) {
+        device->block[state] = value; // Recorded, not applied
+    }
+    else {
+        device->renderStates[state] = value;
+    }
+    return S_OK;
+}
+
+static HRESULT WINAPI MockSetTexture(void* self, DWORD stage, void* texture) {
+    MockDevice* device = AsDevice(self);
+    device->calls++;
+    if (device->failNext) {
+        device->failNext = false;
+        return MOCK_ERROR;
+    }
+    if (!device->recording) device->textures[stage] = texture;
+    return S_OK;
+}
+
+static HRESULT WINAPI MockSetTextureStageState(void* self, DWORD stage,
+    DWORD type, DWORD value) {
+    MockDevice* device = AsDevice(self);
+    device->calls++;
+    if (device->failNext) {
+        device->failNext = false;
+        return MOCK_ERROR;
+    }
+    if (!device->recording) device->stageStates[{ stage, type }] = value;
+    return S_OK;
+}
+
+static HRESULT WINAPI MockBeginStateBlock(void* self) {
+    AsDevice(self)->recording = true;
+    AsDevice(self)->block.clear();
+    return S_OK;
+}
+
+static HRESULT WINAPI MockEndStateBlock(void* self, DWORD* block) {
+    AsDevice(self)->recording = false;
+    *block = 1;
+    return S_OK;
+}
+
+static HRESULT WINAPI MockApplyStateBlock(void* self, DWORD) {
+    MockDevice* device = AsDevice(self);
+    for (const auto& entry : device->block) {
+        device->renderStates[entry.first] = entry.second;
+    }
+    return S_OK;
+}
+
+static void* g_deviceVtable[DEVICE_METHOD_COUNT];
+
+struct MockDirectDraw {
+    void** vtable;
+    HRESULT cooperativeLevel = S_OK;
+    int restores = 0;
+};
+
+static HRESULT WINAPI MockRestoreAllSurfaces(void* self) {
+    static_cast<MockDirectDraw*>(self)->restores++;
+    return S_OK;
+}
+
+static HRESULT WINAPI MockTestCooperativeLevel(void* self) {
+    return static_cast<MockDirectDraw*>(self)->cooperativeLevel;
+}
+
+static void* g_directDrawVtable[DIRECTDRAW_METHOD_COUNT];
+
+struct MockSurface {
+    void** vtable;
+    int restores = 0;
+    int releasedDCs = 0;
+};
+
+static HRESULT WINAPI MockSurfaceRestore(void* self) {
+    static_cast<MockSurface*>(self)->restores++;
+    return S_OK;
+}
+
+// Its neighbour, with another signature: hooking it by mistake breaks the stack
+static HRESULT WINAPI MockSurfaceReleaseDC(void* self, void* dc) {
+    if (dc != nullptr) {
+        static_cast<MockSurface*>(self)->releasedDCs++;
+    }
+    return S_OK;
+}
+
+static void* g_surfaceVtable[SURFACE_METHOD_COUNT];
+
+// Slots whose entry differs from the copy taken before hooking
+static std::vector<size_t> PatchedSlots(void* const* vtable,
+    const std::vector<void*>& before) {
+    std::vector<size_t> patched;
+    for (size_t i = 0; i < before.size(); ++i) {
+        if (vtable[i] != before[i]) patched.push_back(i);
+    }
+    return patched;
+}
+
+// --- Calls Through The Vtables ---
+
+typedef HRESULT(WINAPI* SetRenderStateFn)(void*, DWORD, DWORD);
+typedef HRESULT(WINAPI* SetTextureFn)(void*, DWORD, void*);
+typedef HRESULT(WINAPI* SetTextureStageStateFn)(void*, DWORD, DWORD, DWORD);
+typedef HRESULT(WINAPI* NoArgumentFn)(void*);
+typedef HRESULT(WINAPI* ReleaseDCFn)(void*, void*); // HDC
+typedef HRESULT(WINAPI* EndStateBlockFn)(void*, DWORD*);
+typedef HRESULT(WINAPI* ApplyStateBlockFn)(void*, DWORD);
+
+template <typename Fn>
+static Fn Slot(void* object, size_t index) {
+    return reinterpret_cast<Fn>((*reinterpret_cast<void***>(object))[index]);
+}
+
+static HRESULT SetRenderState(MockDevice& device, DWORD state, DWORD value) {
+    return Slot<SetRenderStateFn>(&device, SET_RENDER_STATE)(&device, state,
+        value);
+}
+
+static HRESULT SetTexture(MockDevice& device, DWORD stage, void* texture) {
+    return Slot<SetTextureFn>(&device, SET_TEXTURE)(&device, stage, texture);
+}
+
+static HRESULT SetTextureStageState(MockDevice& device, DWORD stage,
+    DWORD type, DWORD value) {
+    return Slot<SetTextureStageStateFn>(&device, SET_TEXTURE_STAGE_STATE)(
+        &device, stage, type, value);
+}
+
+static HRESULT TestCooperativeLevel(MockDirectDraw& directDraw) {
+    return Slot<NoArgumentFn>(&directDraw, TEST_COOPERATIVE_LEVEL)(&directDraw);
+}
+
+// --- Filtering ---
+
+static void CheckFiltering(MockDevice& device) {
+    AttachStateFilter(&device);
+    uint64_t calls = device.calls;
+    SetRenderState(device, 7, 1);
+    SetRenderState(device, 7, 1);
+    SetRenderState(device, 7, 1);
+    Check(device.calls == calls + 1, "repeated render states are dropped");
+    SetRenderState(device, 7, 0);
+    Check(device.calls == calls + 2 && device.renderStates[7] == 0,
+        "a new value reaches the device");
+
+    int texture = 0;
+    SetTexture(device, 0, &texture);
+    SetTexture(device, 0, &texture);
+    SetTextureStageState(device, 1, 4, 2);
+    SetTextureStageState(device, 1, 4, 2);
+    Check(device.calls == calls + 4, "repeated textures and stage states are "
+        "dropped");
+
+    // A failed call leaves the value unknown, so the retry goes through
+    device.failNext = true;
+    Check(SetRenderState(device, 8, 5) == MOCK_ERROR, "the failure is returned");
+    SetRenderState(device, 8, 5);
+    Check(device.renderStates.count(8) && device.renderStates[8] == 5,
+        "the retry after a failure reaches the device");
+
+    // Calls on another device are passed through untouched
+    MockDevice other;
+    other.vtable = g_deviceVtable;
+    SetRenderState(other, 7, 0);
+    SetRenderState(other, 7, 0);
+    Check(other.calls == 2, "another device is not filtered");
+
+    // While a block is recorded, calls are forwarded and not remembered
+    Slot<NoArgumentFn>(&device, BEGIN_STATE_BLOCK)(&device);
+    calls = device.calls;
+    SetRenderState(device, 9, 3);
+    SetRenderState(device, 9, 3);
+    Check(device.calls == calls + 2, "calls while recording are forwarded");
+    DWORD block = 0;
+    Slot<EndStateBlockFn>(&device, END_STATE_BLOCK)(&device, &block);
+    SetRenderState(device, 9, 3);
+    Check(device.renderStates.count(9) && device.renderStates[9] == 3,
+        "a recorded value is not taken as set");
+
+    // Applying a block changes states behind the filter's back
+    SetRenderState(device, 9, 4);
+    Slot<ApplyStateBlockFn>(&device, APPLY_STATE_BLOCK)(&device, block);
+    SetRenderState(device, 9, 4);
+    Check(device.renderStates[9] == 4, "states are forgotten after a block");
+}
+
+// --- Device Loss ---
+
+static void CheckLoss(MockDevice& device, MockDirectDraw& directDraw,
+    MockSurface& surface) {
+    AttachStateFilter(&device);
+    SetRenderState(device, 7, 1);
+    uint64_t losses = GetDeviceLosses();
+
+    // TestCooperativeLevel succeeding is no loss
+    TestCooperativeLevel(directDraw);
+    uint64_t calls = device.calls;
+    SetRenderState(device, 7, 1);
+    Check(device.calls == calls && GetDeviceLosses() == losses,
+        "no loss while the cooperative level is fine");
+
+    // Lost: the device comes back with defaults, and the filter must not
+    // drop the value the game sets again
+    directDraw.cooperativeLevel = MOCK_WRONG_MODE;
+    Check(TestCooperativeLevel(directDraw) == MOCK_WRONG_MODE,
+        "the loss is returned");
+    device.Lose();
+    directDraw.cooperativeLevel = S_OK;
+    SetRenderState(device, 7, 1);
+    Check(device.renderStates.count(7) && device.renderStates[7] == 1,
+        "state is set again after TestCooperativeLevel failed");
+    Check(GetDeviceLosses() == losses + 1, "the loss is counted");
+
+    device.Lose();
+    Slot<NoArgumentFn>(&directDraw, RESTORE_ALL_SURFACES)(&directDraw);
+    Check(directDraw.restores == 1, "RestoreAllSurfaces reaches DirectDraw");
+    SetRenderState(device, 7, 1);
+    Check(device.renderStates.count(7) && device.renderStates[7] == 1,
+        "state is set again after RestoreAllSurfaces");
+
+    device.Lose();
+    Slot<NoArgumentFn>(&surface, SURFACE_RESTORE)(&surface);
+    Check(surface.restores == 1, "Restore reaches the surface");
+    int texture = 0;
+    SetTexture(device, 0, &texture);
+    SetRenderState(device, 7, 1);
+    Check(device.renderStates.count(7) && device.textures.count(0),
+        "state is set again after a surface Restore");
+}
+
+// Random calls, failures, state blocks and losses: the device must always
+// hold what the game last set
+static void CheckRandom(MockDevice& device, MockDirectDraw& directDraw,
+    MockSurface& surface) {
+    AttachStateFilter(&device);
+    device.Lose();
+    Slot<NoArgumentFn>(&surface, SURFACE_RESTORE)(&surface);
+    std::map<DWORD, DWORD> expected;
+    std::map<std::pair<DWORD, DWORD>, DWORD> expectedStages;
+    std::mt19937 random(1234);
+    uint64_t calls = 0;
+    uint64_t forwarded = device.calls;
+    for (int i = 0; i < 100000; ++i) {
+        uint32_t action = random() % 1000;
+        if (action < 600) {
+            DWORD state = random() % 12;
+            DWORD value = random() % 3;
+            calls++;
+            if (random() % 50 == 0) device.failNext = true;
+            if (SUCCEEDED(SetRenderState(device, state, value))) {
+                expected[state] = value;
+            }
+            else {
+                expected.erase(state);
+            }
+        }
+        else if (action < 950) {
+            DWORD stage = random() % 2;
+            DWORD type = random() % 6;
+            DWORD value = random() % 3;
+            calls++;
+            if (SUCCEEDED(SetTextureStageState(device, stage, type, value))) {
+                expectedStages[{ stage, type }] = value;
+            }
+        }
+        else if (action < 990) {
+            // Lost; the game finds out, restores and sets its states again
+            device.Lose();
+            expected.clear();
+            expectedStages.clear();
+            directDraw.cooperativeLevel = MOCK_WRONG_MODE;
+            TestCooperativeLevel(directDraw);
+            directDraw.cooperativeLevel = S_OK;
+            Slot<NoArgumentFn>(&directDraw, RESTORE_ALL_SURFACES)(&directDraw);
+        }
+        else {
+            // A block that sets one state, applied straight away
+            DWORD state = random() % 12;
+            DWORD value = random() % 3;
+            Slot<NoArgumentFn>(&device, BEGIN_STATE_BLOCK)(&device);
+            SetRenderState(device, state, value);
+            DWORD block = 0;
+            Slot<EndStateBlockFn>(&device, END_STATE_BLOCK)(&device, &block);
+            Slot<ApplyStateBlockFn>(&device, APPLY_STATE_BLOCK)(&device, block);
+            expected[state] = value;
+        }
+    }
+    bool matches = true;
+    for (const auto& entry : expected) {
+        auto it = device.renderStates.find(entry.first);
+        matches = matches && it != device.renderStates.end() &&
+            it->second == entry.second;
+    }
+    for (const auto& entry : expectedStages) {
+        auto it = device.stageStates.find(entry.first);
+        matches = matches && it != device.stageStates.end() &&
+            it->second == entry.second;
+    }
+    Check(matches, "the device holds every state the game set");
+    forwarded = device.calls - forwarded;
+    Check(forwarded < calls, "some calls were filtered (" +
+        std::to_string(forwarded) + " of " + std::to_string(calls) +
+        " forwarded)");
+}
+
+int main() {
+    g_deviceVtable[SET_RENDER_STATE] = reinterpret_cast<void*>(MockSetRenderState);
+    g_deviceVtable[BEGIN_STATE_BLOCK] = reinterpret_cast<void*>(MockBeginStateBlock);
+    g_deviceVtable[END_STATE_BLOCK] = reinterpret_cast<void*>(MockEndStateBlock);
+    g_deviceVtable[SET_TEXTURE] = reinterpret_cast<void*>(MockSetTexture);
+    g_deviceVtable[SET_TEXTURE_STAGE_STATE] =
+        reinterpret_cast<void*>(MockSetTextureStageState);
+    g_deviceVtable[APPLY_STATE_BLOCK] = reinterpret_cast<void*>(MockApplyStateBlock);
+    g_directDrawVtable[RESTORE_ALL_SURFACES] =
+        reinterpret_cast<void*>(MockRestoreAllSurfaces);
+    g_directDrawVtable[TEST_COOPERATIVE_LEVEL] =
+        reinterpret_cast<void*>(MockTestCooperativeLevel);
+    g_surfaceVtable[SURFACE_RESTORE] = reinterpret_cast<void*>(MockSurfaceRestore);
+    g_surfaceVtable[RELEASE_DC] = reinterpret_cast<void*>(MockSurfaceReleaseDC);
+    std::vector<void*> deviceBefore(g_deviceVtable,
+        g_deviceVtable + DEVICE_METHOD_COUNT);
+    std::vector<void*> directDrawBefore(g_directDrawVtable,
+        g_directDrawVtable + DIRECTDRAW_METHOD_COUNT);
+    std::vector<void*> surfaceBefore(g_surfaceVtable,
+        g_surfaceVtable + SURFACE_METHOD_COUNT);
+
+    MockDevice device;
+    device.vtable = g_deviceVtable;
+    MockDirectDraw directDraw;
+    directDraw.vtable = g_directDrawVtable;
+    MockSurface surface;
+    surface.vtable = g_surfaceVtable;
+    Check(AttachLossDetection(&directDraw, &surface), "hook the loss calls");
+    Check(AttachStateFilter(&device), "hook the device");
+    Check(PatchedSlots(g_deviceVtable, deviceBefore) ==
+        std::vector<size_t>({ SET_RENDER_STATE, BEGIN_STATE_BLOCK, END_STATE_BLOCK,
+        SET_TEXTURE, SET_TEXTURE_STAGE_STATE, APPLY_STATE_BLOCK }),
+        "only the device's state calls are hooked");
+    Check(PatchedSlots(g_directDrawVtable, directDrawBefore) ==
+        std::vector<size_t>({ RESTORE_ALL_SURFACES, TEST_COOPERATIVE_LEVEL }),
+        "only DirectDraw's loss calls are hooked");
+    Check(PatchedSlots(g_surfaceVtable, surfaceBefore) ==
+        std::vector<size_t>({ SURFACE_RESTORE }), "only Restore is hooked on "
+        "the surface");
+    int dc = 0;
+    Slot<ReleaseDCFn>(&surface, RELEASE_DC)(&surface, &dc);
+    Check(surface.releasedDCs == 1, "ReleaseDC still reaches the surface");
+
+    CheckFiltering(device);
+    CheckLoss(device, directDraw, surface);
+    CheckRandom(device, directDraw, surface);
+
+    AttachStateFilter(nullptr);
+    uint64_t calls = device.calls;
+    SetRenderState(device, 1, 1);
+    SetRenderState(device, 1, 1);
+    Check(device.calls == calls + 2, "nothing is filtered once detached");
+
+    if (g_failures > 0) {
+        printf("%d checks failed.\n", g_failures);
+        return 1;
+    }
+    printf("All Direct3D hook checks passed.\n");
+    return 0;
+}
@@ -0,0 +1,204 @@
+// detourtest: checks the x86 instruction length decoder and the trampoline
+// builder behind the inline detours (CrtSimdEnabled=true) on prologues like
+// the ones in the game's executable.
+//
+// Build (Linux, from the repository root):
+//   g++ -std=c++17 -O2 -I"EE Tweaks Mod" -o detourtest tools/detourtest.cpp
+//       "EE Tweaks Mod/detour.cpp"
+//
+// Usage: detourtest
+//   Prints each failed check and exits with 1 if there was one.
+
+#include "pch.h"
+#include "detour.h"
+
+#include <cstdio>
+
+static int g_failures = 0;
+
+static void Check(bool condition, const std::string& what) {
+    if (!condition) {
+        printf("FAILED: %s\n", what.c_str());
+        g_failures++;
+    }
+}
+
+static std::string Hex(const std::vector<unsigned char>& bytes) {
+    std::stringstream ss;
+    for (unsigned char byte : bytes) {
+        ss << std::hex << std::setw(2) << std::setfill('0') << int(byte) << " ";
+    }
+    return ss.str();
+}
+
+static int32_t ReadRel32(const unsigned char* p) {
+    int32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+// --- Decoder ---
+
+struct DecodeCase {
+    std::vector<unsigned char> bytes;
+    size_t length;         // 0: must be refused
+    size_t relativeSize;
+    size_t relativeOffset;
+    bool isReturn;
+    bool isUnconditionalJump;
+};
+
+static const DecodeCase DECODE_CASES[] = {
+    { { 0x55 }, 1, 0, 0, false, false },                             // push ebp
+    { { 0x8B, 0xEC }, 2, 0, 0, false, false },                       // mov ebp, esp
+    { { 0x83, 0xEC, 0x10 }, 3, 0, 0, false, false },                 // sub esp, 10h
+    { { 0x81, 0xEC, 0x00, 0x01, 0x00, 0x00 }, 6, 0, 0, false, false }, // sub esp, 100h
+    { { 0x6A, 0xFF }, 2, 0, 0, false, false },                       // push -1
+    { { 0x68, 0x78, 0x56, 0x34, 0x12 }, 5, 0, 0, false, false },     // push imm32
+    { { 0x64, 0xA1, 0x00, 0x00, 0x00, 0x00 }, 6, 0, 0, false, false }, // mov eax, fs:[0]
+    { { 0x8B, 0x44, 0x24, 0x04 }, 4, 0, 0, false, false },           // mov eax, [esp+4]
+    { { 0x8B, 0x84, 0x24, 0x00, 0x01, 0x00, 0x00 }, 7, 0, 0, false, false },
+    { { 0x8B, 0x05, 0x00, 0x10, 0x40, 0x00 }, 6, 0, 0, false, false }, // mov eax, [disp32]
+    { { 0x8B, 0x04, 0x85, 0x00, 0x10, 0x40, 0x00 }, 7, 0, 0, false, false }, // [eax*4+disp32]
+    { { 0x8D, 0x4C, 0x24, 0x10 }, 4, 0, 0, false, false },           // lea ecx, [esp+10h]
+    { { 0xC7, 0x44, 0x24, 0x04, 0x01, 0x00, 0x00, 0x00 }, 8, 0, 0, false, false },
+    { { 0x66, 0x89, 0x45, 0xFC }, 4, 0, 0, false, false },           // mov [ebp-4], ax
+    { { 0x66, 0xC7, 0x45, 0xFC, 0x34, 0x12 }, 6, 0, 0, false, false }, // mov word [ebp-4], imm16
+    { { 0xF6, 0x45, 0x08, 0x01 }, 4, 0, 0, false, false },           // test byte [ebp+8], 1
+    { { 0xF7, 0xC1, 0x00, 0x00, 0x01, 0x00 }, 6, 0, 0, false, false }, // test ecx, imm32
+    { { 0xF7, 0xD8 }, 2, 0, 0, false, false },                       // neg eax
+    { { 0xFF, 0x15, 0x00, 0x20, 0x40, 0x00 }, 6, 0, 0, false, false }, // call [disp32]
+    { { 0x0F, 0xB6, 0x45, 0x08 }, 4, 0, 0, false, false },           // movzx eax, byte [ebp+8]
+    { { 0x0F, 0xAF, 0xC1 }, 3, 0, 0, false, false },                 // imul eax, ecx
+    { { 0x0F, 0x10, 0x45, 0xF0 }, 4, 0, 0, false, false },           // movups xmm0, [ebp-10h]
+    { { 0x66, 0x0F, 0x6F, 0x06 }, 4, 0, 0, false, false },           // movdqa xmm0, [esi]
+    { { 0xF3, 0x0F, 0x6F, 0x06 }, 4, 0, 0, false, false },           // movdqu xmm0, [esi]
+    { { 0xD9, 0x45, 0x08 }, 3, 0, 0, false, false },                 // fld dword [ebp+8]
+    { { 0xE8, 0x00, 0x10, 0x00, 0x00 }, 5, 4, 1, false, false },     // call rel32
+    { { 0xE9, 0x00, 0x10, 0x00, 0x00 }, 5, 4, 1, false, true },      // jmp rel32
+    { { 0xEB, 0x10 }, 2, 1, 1, false, true },                        // jmp rel8
+    { { 0x74, 0x05 }, 2, 1, 1, false, false },                       // je rel8
+    { { 0x0F, 0x84, 0x00, 0x01, 0x00, 0x00 }, 6, 4, 2, false, false }, // je rel32
+    { { 0xC3 }, 1, 0, 0, true, false },                              // ret
+    { { 0xC2, 0x08, 0x00 }, 3, 0, 0, true, false },                  // ret 8
+    { { 0xD6 }, 0, 0, 0, false, false },                             // salc: refused
+};
+
+static void CheckDecoder() {
+    for (const DecodeCase& test : DECODE_CASES) {
+        // Padding, so a wrong length cannot read past the buffer
+        std::vector<unsigned char> code = test.bytes;
+        code.resize(code.size() + 16, 0x90);
+        InstructionInfo info;
+        size_t length = DecodeInstruction(code.data(), info);
+        std::string name = "decode " + Hex(test.bytes);
+        Check(length == test.length, name + "length " + std::to_string(length) +
+            ", expected " + std::to_string(test.length));
+        if (test.length == 0 || length != test.length) {
+            continue;
+        }
+        Check(info.relativeSize == test.relativeSize, name + "relative size");
+        if (test.relativeSize != 0) {
+            Check(info.relativeOffset == test.relativeOffset,
+                name + "relative offset");
+        }
+        Check(info.isReturn == test.isReturn, name + "return flag");
+        Check(info.isUnconditionalJump == test.isUnconditionalJump,
+            name + "jump flag");
+    }
+}
+
+// --- Trampoline Builder ---
+
+const uintptr_t CODE_ADDRESS = 0x00401000;
+const uintptr_t TRAMPOLINE_ADDRESS = 0x10000000;
+
+// Follow the trampoline's instructions and return where each relative branch
+// goes and where its final jump leads back to
+static bool WalkTrampoline(const std::vector<unsigned char>& trampoline,
+    std::vector<uintptr_t>& targets) {
+    targets.clear();
+    size_t offset = 0;
+    while (offset < trampoline.size()) {
+        std::vector<unsigned char> padded(trampoline.begin() + offset,
+            trampoline.end());
+        padded.resize(padded.size() + 16, 0x90);
+        InstructionInfo info;
+        if (DecodeInstruction(padded.data(), info) == 0) {
+            return false;
+        }
+        if (info.relativeSize == 1) {
+            return false; // Short branches must all have been widened
+        }
+        if (info.relativeSize == 4) {
+            targets.push_back(TRAMPOLINE_ADDRESS + offset + info.length +
+                ReadRel32(&padded[info.relativeOffset]));
+        }
+        offset += info.length;
+    }
+    return offset == trampoline.size();
+}
+
+struct TrampolineCase {
+    const char* name;
+    std::vector<unsigned char> code;
+    bool builds;
+    size_t stolenLength;
+    std::vector<uintptr_t> targets; // Branch targets, then the jump back
+};
+
+static void CheckTrampolines() {
+    const TrampolineCase cases[] = {
+        { "frame prologue", { 0x55, 0x8B, 0xEC, 0x83, 0xEC, 0x10, 0x53 },
+            true, 6, { CODE_ADDRESS + 6 } },
+        { "SEH prologue", { 0x6A, 0xFF, 0x68, 0x78, 0x56, 0x34, 0x12, 0x64 },
+            true, 7, { CODE_ADDRESS + 7 } },
+        { "call first", { 0xE8, 0xFB, 0x0F, 0x00, 0x00, 0x55 },
+            true, 5, { CODE_ADDRESS + 5 + 0x0FFB, CODE_ADDRESS + 5 } },
+        { "je rel8 widened", { 0x85, 0xC0, 0x74, 0x20, 0x55, 0x8B, 0xEC },
+            true, 5, { CODE_ADDRESS + 4 + 0x20, CODE_ADDRESS + 5 } },
+        { "jne rel32 kept", { 0x0F, 0x85, 0x00, 0x01, 0x00, 0x00 },
+            true, 6, { CODE_ADDRESS + 6 + 0x100, CODE_ADDRESS + 6 } },
+        { "backward je", { 0x33, 0xC0, 0x74, 0xEC, 0x90, 0x90 },
+            true, 5, { CODE_ADDRESS + 4 - 0x14, CODE_ADDRESS + 5 } },
+        { "ret inside", { 0x33, 0xC0, 0xC3, 0x90, 0x90, 0x90 }, false, 0, {} },
+        { "jmp rel8 inside", { 0xEB, 0x10, 0x90, 0x90, 0x90, 0x90 }, false, 0, {} },
+        { "branch into stolen bytes", { 0x55, 0x8B, 0xEC, 0x75, 0xFC, 0x90 },
+            false, 0, {} },
+        { "loop", { 0xE2, 0x10, 0x90, 0x90, 0x90, 0x90 }, false, 0, {} },
+        { "undecodable", { 0x90, 0xD6, 0x90, 0x90, 0x90, 0x90 }, false, 0, {} },
+    };
+    for (const TrampolineCase& test : cases) {
+        std::string name = std::string("trampoline '") + test.name + "': ";
+        std::vector<unsigned char> code = test.code;
+        code.resize(code.size() + 16, 0x90);
+        std::vector<unsigned char> trampoline;
+        size_t stolen = 0;
+        bool built = BuildTrampoline(code.data(), CODE_ADDRESS,
+            TRAMPOLINE_ADDRESS, DETOUR_JUMP_SIZE, trampoline, stolen);
+        Check(built == test.builds, name + (built ? "built" : "refused"));
+        if (!built || !test.builds) {
+            continue;
+        }
+        Check(stolen == test.stolenLength, name + "stole " +
+            std::to_string(stolen) + " bytes");
+        std::vector<uintptr_t> targets;
+        Check(WalkTrampoline(trampoline, targets), name + "does not decode: " +
+            Hex(trampoline));
+        Check(targets == test.targets, name + "branches go elsewhere: " +
+            Hex(trampoline));
+        Check(trampoline.size() >= 5 && trampoline[trampoline.size() - 5] == 0xE9,
+            name + "does not end in a jmp rel32");
+    }
+}
+
+int main() {
+    CheckDecoder();
+    CheckTrampolines();
+    if (g_failures > 0) {
+        printf("%d checks failed.\n", g_failures);
+        return 1;
+    }
+    printf("All decoder and trampoline checks passed.\n");
+    return 0;
+}
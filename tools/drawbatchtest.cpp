@@ -0,0 +1,259 @@
+// drawbatchtest: checks the draw batcher behind Draw Batching
+// (DrawBatchingEnabled=true) against a mock device. Random frames of draws are
+// sent once straight to the device and once through the batcher, flushed the
+// way the hooks do; both call streams are expanded into the primitives the
+// device would draw, vertex by vertex, and must be the same.
+//
+// Build (Linux, from the repository root):
+//   g++ -std=c++17 -O2 -I"EE Tweaks Mod" -o drawbatchtest tools/drawbatchtest.cpp
+//       "EE Tweaks Mod/drawbatch.cpp" "EE Tweaks Mod/vbring.cpp"
+//
+// Usage: drawbatchtest
+//   Prints each failed check and exits with 1 if there was one.
+
+#include "pch.h"
+#include "drawbatch.h"
+#include "vbring.h"
+
+#include <cstdio>
+#include <random>
+
+static int g_failures = 0;
+
+static void Check(bool condition, const std::string& what) {
+    if (!condition) {
+        printf("FAILED: %s\n", what.c_str());
+        g_failures++;
+    }
+}
+
+// --- Mock Device ---
+
+// A draw call as the game makes it
+struct DrawCall {
+    uint32_t primitiveType;
+    uint32_t fvf;
+    uint32_t flags;
+    std::vector<uint8_t> vertices;
+    uint32_t vertexCount;
+    std::vector<uint16_t> indices;
+    bool indexed;
+};
+
+// Records every primitive drawn: its kind, format and flags, then the bytes
+// of its vertices in the order Direct3D uses them. Flat shading takes the
+// first vertex, so a primitive that starts elsewhere or winds the other way
+// does not match.
+struct MockDevice {
+    std::vector<std::string> primitives;
+    int calls = 0;
+
+    void Draw(uint32_t primitiveType, uint32_t fvf, uint32_t flags,
+        const void* vertices, uint32_t vertexCount, const uint16_t* indices,
+        uint32_t indexCount) {
+        calls++;
+        uint32_t stride = GetFvfVertexSize(fvf);
+        const uint8_t* bytes = static_cast<const uint8_t*>(vertices);
+        uint32_t count = indices != nullptr ? indexCount : vertexCount;
+        auto primitive = [&](char kind, std::initializer_list<uint32_t> at) {
+            std::string out = std::string(1, kind) + std::to_string(fvf) + "/" +
+                std::to_string(flags) + ":";
+            for (uint32_t i : at) {
+                uint32_t vertex = indices != nullptr ? indices[i] : i;
+                if (vertex >= vertexCount) {
+                    out += "<out of range>";
+                    continue;
+                }
+                out.append(reinterpret_cast<const char*>(bytes + vertex * stride),
+                    stride);
+            }
+            primitives.push_back(out);
+        };
+        switch (primitiveType) {
+        case PRIMITIVE_POINT_LIST:
+            for (uint32_t i = 0; i < count; ++i) primitive('p', { i });
+            break;
+        case PRIMITIVE_LINE_LIST:
+            for (uint32_t i = 0; i + 1 < count; i += 2) primitive('l', { i, i + 1 });
+            break;
+        case PRIMITIVE_LINE_STRIP:
+            for (uint32_t i = 0; i + 1 < count; ++i) primitive('l', { i, i + 1 });
+            break;
+        case PRIMITIVE_TRIANGLE_LIST:
+            for (uint32_t i = 0; i + 2 < count; i += 3) {
+                primitive('t', { i, i + 1, i + 2 });
+            }
+            break;
+        case PRIMITIVE_TRIANGLE_STRIP:
+            // Odd triangles are reversed to keep the winding; flat shading
+            // still takes vertex i
+            for (uint32_t i = 0; i + 2 < count; ++i) {
+                if (i % 2 == 0) primitive('t', { i, i + 1, i + 2 });
+                else primitive('t', { i, i + 2, i + 1 });
+            }
+            break;
+        case PRIMITIVE_TRIANGLE_FAN:
+            // Flat shaded from vertex i + 1
+            for (uint32_t i = 0; i + 2 < count; ++i) {
+                primitive('t', { i + 1, i + 2, 0 });
+            }
+            break;
+        }
+    }
+
+    void Draw(const DrawCall& call) {
+        Draw(call.primitiveType, call.fvf, call.flags, call.vertices.data(),
+            call.vertexCount, call.indexed ? call.indices.data() : nullptr,
+            static_cast<uint32_t>(call.indices.size()));
+    }
+};
+
+// Hands the held draws to the device, as FlushPendingDraws does
+static void Flush(DrawBatcher& batcher, MockDevice& device) {
+    if (!batcher.Pending()) {
+        return;
+    }
+    MergedDraw merged = batcher.Merged();
+    device.Draw(merged.primitiveType, merged.fvf, merged.flags, merged.vertices,
+        merged.vertexCount, merged.indices, merged.indexCount);
+    batcher.Clear();
+}
+
+// Adds a draw the way the draw hooks do. The caller's memory is overwritten
+// afterwards, as the game reuses it once the call returns.
+static void BatchDraw(DrawBatcher& batcher, MockDevice& device, DrawCall call) {
+    const uint16_t* indices = call.indexed ? call.indices.data() : nullptr;
+    uint32_t indexCount = static_cast<uint32_t>(call.indices.size());
+    BatchResult added = batcher.Add(call.primitiveType, call.fvf,
+        call.vertices.data(), call.vertexCount, indices, indexCount, call.flags);
+    if (added == BATCH_FLUSH_FIRST) {
+        Flush(batcher, device);
+        added = batcher.Add(call.primitiveType, call.fvf, call.vertices.data(),
+            call.vertexCount, indices, indexCount, call.flags);
+    }
+    if (added != BATCH_ADDED) {
+        Flush(batcher, device);
+        device.Draw(call);
+    }
+    std::fill(call.vertices.begin(), call.vertices.end(), 0xCD);
+    std::fill(call.indices.begin(), call.indices.end(), 0xFFFF);
+}
+
+// --- Random Frames ---
+
+const uint32_t FVF_LIT = 0x002 | 0x040;                // XYZ | DIFFUSE
+const uint32_t FVF_TRANSFORMED = 0x004 | 0x040 | 0x100; // XYZRHW | DIFFUSE | TEX1
+
+static DrawCall RandomDraw(std::mt19937& random) {
+    static const uint32_t types[] = { PRIMITIVE_POINT_LIST, PRIMITIVE_LINE_LIST,
+        PRIMITIVE_LINE_STRIP, PRIMITIVE_TRIANGLE_LIST, PRIMITIVE_TRIANGLE_STRIP,
+        PRIMITIVE_TRIANGLE_FAN };
+    DrawCall call;
+    // Mostly one kind of draw in a row, as terrain and units are drawn
+    call.primitiveType = random() % 4 == 0 ? types[random() % 6] :
+        PRIMITIVE_TRIANGLE_STRIP;
+    call.fvf = random() % 32 == 0 ? FVF_LIT : FVF_TRANSFORMED;
+    call.flags = random() % 32 == 0 ? 8 : 0; // D3DDP_DONOTUPDATEEXTENTS
+    // Now and then too short for a primitive or too large for one batch;
+    // lists often end in a partial primitive
+    call.vertexCount = random() % 64 == 0 ? 200 :
+        random() % 16 == 0 ? random() % 3 : 3 + random() % 10;
+    call.vertices.resize(call.vertexCount * GetFvfVertexSize(call.fvf));
+    for (uint8_t& byte : call.vertices) byte = static_cast<uint8_t>(random());
+    call.indexed = call.primitiveType != PRIMITIVE_POINT_LIST &&
+        call.vertexCount > 0 && random() % 3 == 0;
+    if (call.indexed) {
+        call.indices.resize(random() % 16 == 0 ? random() % 3 : 3 + random() % 14);
+        for (uint16_t& index : call.indices) {
+            index = static_cast<uint16_t>(random() % call.vertexCount);
+        }
+    }
+    return call;
+}
+
+static void CheckRandomFrames() {
+    std::mt19937 random(7);
+    DrawBatcher batcher(4096);
+    MockDevice direct;
+    MockDevice batched;
+    for (int frame = 0; frame < 500; ++frame) {
+        int draws = static_cast<int>(random() % 200);
+        for (int i = 0; i < draws; ++i) {
+            DrawCall call = RandomDraw(random);
+            direct.Draw(call);
+            BatchDraw(batcher, batched, call);
+            if (random() % 20 == 0) {
+                Flush(batcher, batched); // A state change
+            }
+        }
+        Flush(batcher, batched); // EndScene
+        if (batched.primitives != direct.primitives) {
+            size_t at = 0;
+            while (at < batched.primitives.size() && at < direct.primitives.size() &&
+                batched.primitives[at] == direct.primitives[at]) {
+                at++;
+            }
+            Check(false, "frame " + std::to_string(frame) + ": primitive " +
+                std::to_string(at) + " differs (" +
+                std::to_string(batched.primitives.size()) + " batched, " +
+                std::to_string(direct.primitives.size()) + " direct)");
+            return;
+        }
+        Check(batched.calls <= direct.calls, "frame " + std::to_string(frame) +
+            ": more calls after batching");
+        direct.primitives.clear();
+        batched.primitives.clear();
+    }
+    Check(batched.calls * 3 < direct.calls * 2, "batching cut the calls to " +
+        std::to_string(batched.calls) + " of " + std::to_string(direct.calls));
+}
+
+// --- Single Draws ---
+
+static void CheckSingleDraws() {
+    DrawBatcher batcher(4096);
+    // One draw is handed back exactly as it came
+    uint8_t vertices[16 * 5];
+    for (size_t i = 0; i < sizeof(vertices); ++i) vertices[i] = uint8_t(i);
+    const uint16_t indices[] = { 0, 2, 1, 3, 4 };
+    Check(batcher.Add(PRIMITIVE_TRIANGLE_STRIP, FVF_LIT, vertices, 5, indices, 5,
+        0) == BATCH_ADDED, "add an indexed strip");
+    MergedDraw merged = batcher.Merged();
+    Check(merged.primitiveType == PRIMITIVE_TRIANGLE_STRIP &&
+        merged.vertexCount == 5 && merged.indexCount == 5 &&
+        merged.indices != nullptr && merged.draws == 1,
+        "a single draw is kept as it came");
+    batcher.Clear();
+    Check(!batcher.Pending(), "nothing pending after clear");
+
+    // Fans and indexed points are drawn as they came
+    Check(batcher.Add(PRIMITIVE_TRIANGLE_FAN, FVF_LIT, vertices, 5, nullptr, 0,
+        0) == BATCH_NOT_BATCHABLE, "fans are not batched");
+    Check(batcher.Add(PRIMITIVE_POINT_LIST, FVF_LIT, vertices, 5, indices, 5,
+        0) == BATCH_NOT_BATCHABLE, "indexed points are not batched");
+    Check(batcher.Add(PRIMITIVE_TRIANGLE_LIST, 0, vertices, 5, nullptr, 0,
+        0) == BATCH_NOT_BATCHABLE, "an unknown vertex format is not batched");
+
+    // A different format ends the batch
+    Check(batcher.Add(PRIMITIVE_TRIANGLE_LIST, FVF_LIT, vertices, 3, nullptr, 0,
+        0) == BATCH_ADDED, "add a list");
+    Check(batcher.Add(PRIMITIVE_TRIANGLE_LIST, FVF_TRANSFORMED, vertices, 3,
+        nullptr, 0, 0) == BATCH_FLUSH_FIRST, "another format flushes first");
+    Check(batcher.Add(PRIMITIVE_LINE_STRIP, FVF_LIT, vertices, 3, nullptr, 0,
+        0) == BATCH_FLUSH_FIRST, "lines after triangles flush first");
+    Check(batcher.Add(PRIMITIVE_TRIANGLE_STRIP, FVF_LIT, vertices, 4, nullptr, 0,
+        0) == BATCH_ADDED, "a strip joins a list");
+    Check(batcher.Merged().draws == 2 && batcher.Merged().primitiveType ==
+        PRIMITIVE_TRIANGLE_LIST, "merged as a triangle list");
+}
+
+int main() {
+    CheckSingleDraws();
+    CheckRandomFrames();
+    if (g_failures > 0) {
+        printf("%d checks failed.\n", g_failures);
+        return 1;
+    }
+    printf("All draw batching checks passed.\n");
+    return 0;
+}
@@ -0,0 +1,92 @@
+// experimentreport: compares the variants of an experiment (ExperimentEnabled
+// =true) from the runs recorded in tweaks_experiment.csv.
+//
+// Build (Linux, from the repository root):
+//   g++ -std=c++17 -O2 -I"EE Tweaks Mod" -o experimentreport
+//       tools/experimentreport.cpp "EE Tweaks Mod/experiment.cpp"
+//
+// Usage: experimentreport [-b baseline_variant] tweaks_experiment.csv
+//   Prints the mean and 95% confidence interval of each metric per variant,
+//   then each variant's difference from the baseline (variant 1 by default).
+//   Differences whose interval excludes zero are marked with '*'. Lower is
+//   better for every metric.
+
+#include "pch.h"
+#include "experiment.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <set>
+
+int main(int argc, char** argv) {
+    int baseline = 1;
+    std::string path;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-b" && i + 1 < argc) baseline = atoi(argv[++i]);
+        else if (path.empty() && arg[0] != '-') path = arg;
+        else {
+            fprintf(stderr, "Usage: experimentreport [-b baseline_variant] "
+                "tweaks_experiment.csv\n");
+            return 2;
+        }
+    }
+    if (path.empty()) {
+        fprintf(stderr, "Usage: experimentreport [-b baseline_variant] "
+            "tweaks_experiment.csv\n");
+        return 2;
+    }
+
+    std::ifstream in(path);
+    if (!in.is_open()) {
+        fprintf(stderr, "Cannot open %s\n", path.c_str());
+        return 1;
+    }
+    std::vector<ExperimentRun> runs;
+    if (!ReadExperimentRuns(in, runs)) {
+        fprintf(stderr, "%s is not a valid results file\n", path.c_str());
+        return 1;
+    }
+    std::set<int> variants;
+    std::map<int, std::string> settings; // Of the latest run
+    for (const ExperimentRun& run : runs) {
+        variants.insert(run.variant);
+        settings[run.variant] = run.settings;
+    }
+    if (variants.empty()) {
+        fprintf(stderr, "No runs recorded yet\n");
+        return 1;
+    }
+
+    printf("%zu runs of %zu variants\n", runs.size(), variants.size());
+    for (int variant : variants) {
+        printf("  Variant %d: %s\n", variant, settings[variant].empty() ?
+            "(no changes)" : settings[variant].c_str());
+    }
+
+    for (int m = 0; m < METRIC_COUNT; ++m) {
+        ExperimentMetric metric = static_cast<ExperimentMetric>(m);
+        printf("\n%s\n", GetMetricName(metric));
+        printf("  %-8s %5s %10s  %-22s  %s\n", "variant", "runs", "mean",
+            "95% CI", "vs baseline (95% CI)");
+        for (int variant : variants) {
+            MetricSummary summary = SummarizeMetric(runs, variant, metric);
+            printf("  %-8d %5zu %10.3f  [%9.3f, %9.3f]", variant, summary.runs,
+                summary.mean, summary.ciLow, summary.ciHigh);
+            MetricComparison comparison;
+            if (variant == baseline) {
+                printf("  (baseline)");
+            }
+            else if (CompareMetric(runs, baseline, variant, metric, comparison)) {
+                printf("  %+9.3f [%+9.3f, %+9.3f]%s", comparison.difference,
+                    comparison.ciLow, comparison.ciHigh,
+                    comparison.significant ? " *" : "");
+            }
+            else {
+                printf("  (needs 2+ runs of both)");
+            }
+            printf("\n");
+        }
+    }
+    return 0;
+}
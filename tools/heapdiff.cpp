@@ -0,0 +1,108 @@
+// heapdiff: compares two heap snapshots written by the heap profiler
+// (HeapProfilerEnabled=true), for finding what grows over a long match.
+//
+// Build (Linux, from the repository root):
+//   g++ -std=c++17 -O2 -I"EE Tweaks Mod" -o heapdiff tools/heapdiff.cpp
+//       "EE Tweaks Mod/heapprof.cpp"
+//
+// Usage: heapdiff [-n rows] tweaks_heap_001.csv tweaks_heap_012.csv
+//   Prints the call sites whose live bytes changed the most between the two
+//   snapshots, largest growth first, with their allocated bytes in between.
+//   Values are estimates scaled up from the samples.
+
+#include "pch.h"
+#include "heapprof.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+static bool LoadSnapshot(const std::string& path,
+    std::map<std::string, HeapSnapshotRow>& rows) {
+    std::ifstream in(path);
+    if (!in.is_open()) {
+        fprintf(stderr, "Cannot open %s\n", path.c_str());
+        return false;
+    }
+    std::vector<HeapSnapshotRow> read;
+    if (!ReadHeapSnapshot(in, read)) {
+        fprintf(stderr, "%s is not a valid heap snapshot\n", path.c_str());
+        return false;
+    }
+    for (const HeapSnapshotRow& row : read) {
+        rows[row.site] = row;
+    }
+    return true;
+}
+
+static std::string FormatKB(double bytes) {
+    char text[32];
+    snprintf(text, sizeof(text), "%+.0f", bytes / 1024);
+    return text;
+}
+
+int main(int argc, char** argv) {
+    int maxRows = 30;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-n" && i + 1 < argc) maxRows = atoi(argv[++i]);
+        else if (arg[0] != '-') paths.push_back(arg);
+        else {
+            fprintf(stderr, "Usage: heapdiff [-n rows] before.csv after.csv\n");
+            return 2;
+        }
+    }
+    if (paths.size() != 2 || maxRows < 1) {
+        fprintf(stderr, "Usage: heapdiff [-n rows] before.csv after.csv\n");
+        return 2;
+    }
+
+    std::map<std::string, HeapSnapshotRow> before;
+    std::map<std::string, HeapSnapshotRow> after;
+    if (!LoadSnapshot(paths[0], before) || !LoadSnapshot(paths[1], after)) {
+        return 1;
+    }
+
+    struct Change {
+        std::string site;
+        double liveBefore;
+        double liveAfter;
+        double allocated; // Between the snapshots
+    };
+    std::vector<Change> changes;
+    Change total = { "(all)", 0, 0, 0 };
+    HeapSnapshotRow empty = { "", 0, 0, 0, 0 };
+    std::map<std::string, HeapSnapshotRow> sites = before;
+    sites.insert(after.begin(), after.end());
+    for (const auto& entry : sites) {
+        auto b = before.find(entry.first);
+        auto a = after.find(entry.first);
+        const HeapSnapshotRow& old = b != before.end() ? b->second : empty;
+        const HeapSnapshotRow& now = a != after.end() ? a->second : empty;
+        Change change = { entry.first, old.liveBytes, now.liveBytes,
+            now.allocatedBytes - old.allocatedBytes };
+        if (entry.first == "(all)") total = change;
+        else changes.push_back(change);
+    }
+    std::sort(changes.begin(), changes.end(),
+        [](const Change& x, const Change& y) {
+            return std::fabs(x.liveAfter - x.liveBefore) >
+                std::fabs(y.liveAfter - y.liveBefore);
+        });
+
+    printf("Live: %.0f KB -> %.0f KB (%s KB), %.0f KB allocated in between\n\n",
+        total.liveBefore / 1024, total.liveAfter / 1024,
+        FormatKB(total.liveAfter - total.liveBefore).c_str(),
+        total.allocated / 1024);
+    printf("   change KB    live KB  allocated KB  site\n");
+    for (size_t i = 0; i < changes.size() && i < static_cast<size_t>(maxRows);
+        ++i) {
+        const Change& change = changes[i];
+        printf("%12s %10.0f %13.0f  %s\n",
+            FormatKB(change.liveAfter - change.liveBefore).c_str(),
+            change.liveAfter / 1024, change.allocated / 1024,
+            change.site.c_str());
+    }
+    return 0;
+}
@@ -0,0 +1,256 @@
+// heapprofbench: measures what the heap profiler (HeapProfilerEnabled=true)
+// adds to each allocation and free, and checks its estimates against the
+// true totals. Threads allocate and free a game-like mix of sizes from four
+// made-up call sites, once straight through malloc and free and once through
+// the same sampling calls the hooks make.
+//
+// Build (Linux, from the repository root):
+//   g++ -std=c++17 -O2 -pthread -I"EE Tweaks Mod" -o heapprofbench
+//       tools/heapprofbench.cpp "EE Tweaks Mod/heapprof.cpp"
+//
+// Usage: heapprofbench [-t threads] [-n millions] [-k sampleKB]
+//   Runs -n million allocations (default 8) spread over -t threads (default
+//   4) at one sample per -k KB (default 256, as HeapProfilerSampleKB), then
+//   prints the best CPU time per allocation and free pair of three runs
+//   with and without the profiler, and the estimates per site of the last. Exits with 1 if an estimate is
+//   further off than its sample count allows.
+
+#include "pch.h"
+#include "heapprof.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+
+// --- Workload ---
+
+const size_t SITES = 4;
+const size_t LIVE_SLOTS = 4096; // Per thread; each allocation replaces one
+
+struct SiteMix {
+    const char* name;
+    uint32_t weight; // Per 10000 allocations
+    size_t minSize;
+    size_t maxSize;
+};
+
+// Mostly small objects, some buffers, rarely a large block
+static const SiteMix SITE_MIX[SITES] = {
+    { "small objects", 7000, 16, 128 },
+    { "strings", 2500, 256, 2048 },
+    { "buffers", 490, 4096, 32768 },
+    { "large blocks", 10, 65536, 524288 },
+};
+
+struct SiteTotals {
+    uint64_t allocations = 0;
+    uint64_t bytes = 0;
+    uint64_t liveBytes = 0;
+};
+
+struct Slot {
+    void* pointer;
+    size_t size;
+    size_t site;
+};
+
+struct ThreadResult {
+    double cpuSeconds = 0;
+    SiteTotals sites[SITES];
+    std::vector<Slot> slots; // Still allocated at the end
+};
+
+// CPU time, so threads waiting for a core do not count
+static double ThreadCpuSeconds() {
+    timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static uint64_t NextRandom(uint64_t& state) {
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 0x2545F4914F6CDD1Dull;
+}
+
+// The hooks' OnAllocation and OnFree, less the call counters. The site
+// stands in for the return address.
+static void* ProfiledAlloc(HeapProfiler& profiler, size_t size, size_t site) {
+    void* pointer = malloc(size);
+    if (pointer != nullptr && profiler.ShouldSample(size)) {
+        uintptr_t frames[HEAP_PROFILER_MAX_DEPTH] = { 0x401000 + site * 0x100,
+            0x402000 };
+        profiler.RecordAllocation(pointer, size, frames, 2);
+    }
+    return pointer;
+}
+
+static void ProfiledFree(HeapProfiler& profiler, void* pointer) {
+    if (pointer != nullptr && profiler.MaybeSampled(pointer)) {
+        profiler.RecordFree(pointer);
+    }
+    free(pointer);
+}
+
+static void RunThread(HeapProfiler* profiler, uint64_t allocations,
+    uint64_t seed, ThreadResult* result) {
+    std::vector<Slot>& slots = result->slots;
+    slots.assign(LIVE_SLOTS, Slot{ nullptr, 0, 0 });
+    uint64_t random = seed | 1;
+    double start = ThreadCpuSeconds();
+    for (uint64_t i = 0; i < allocations; ++i) {
+        uint64_t value = NextRandom(random);
+        uint32_t pick = static_cast<uint32_t>(value % 10000);
+        size_t site = 0;
+        while (site + 1 < SITES && pick >= SITE_MIX[site].weight) {
+            pick -= SITE_MIX[site].weight;
+            site++;
+        }
+        const SiteMix& mix = SITE_MIX[site];
+        size_t size = mix.minSize + (value >> 20) % (mix.maxSize - mix.minSize + 1);
+        Slot& slot = slots[(value >> 44) % LIVE_SLOTS];
+        if (profiler != nullptr) {
+            ProfiledFree(*profiler, slot.pointer);
+            slot.pointer = ProfiledAlloc(*profiler, size, site);
+        }
+        else {
+            free(slot.pointer);
+            slot.pointer = malloc(size);
+        }
+        slot.size = size;
+        slot.site = site;
+        result->sites[site].allocations++;
+        result->sites[site].bytes += size;
+    }
+    result->cpuSeconds = ThreadCpuSeconds() - start;
+
+    for (const Slot& slot : slots) {
+        if (slot.pointer != nullptr) {
+            result->sites[slot.site].liveBytes += slot.size;
+        }
+    }
+}
+
+// Run the workload; returns CPU nanoseconds per allocation and free pair.
+// What is still allocated at the end is freed after the snapshot is taken.
+static double RunWorkload(HeapProfiler* profiler, size_t threads,
+    uint64_t allocations, SiteTotals totals[SITES],
+    std::vector<HeapSiteStats>* snapshot) {
+    std::vector<ThreadResult> results(threads);
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < threads; ++i) {
+        workers.emplace_back(RunThread, profiler, allocations / threads,
+            0x9E3779B97F4A7C15ull * (i + 1), &results[i]);
+    }
+    for (std::thread& worker : workers) worker.join();
+    if (snapshot != nullptr) {
+        *snapshot = profiler->Snapshot();
+    }
+
+    double seconds = 0;
+    for (const ThreadResult& result : results) {
+        seconds += result.cpuSeconds;
+        for (size_t site = 0; site < SITES; ++site) {
+            totals[site].allocations += result.sites[site].allocations;
+            totals[site].bytes += result.sites[site].bytes;
+            totals[site].liveBytes += result.sites[site].liveBytes;
+        }
+        for (const Slot& slot : result.slots) {
+            if (profiler != nullptr) ProfiledFree(*profiler, slot.pointer);
+            else free(slot.pointer);
+        }
+    }
+    uint64_t pairs = allocations / threads * threads;
+    return pairs > 0 ? seconds * 1e9 / pairs : 0.0;
+}
+
+// --- Accuracy ---
+
+// Relative error of an estimate. With n samples the standard error is about
+// 1 / sqrt(n); more than five of those (plus 1%) counts as wrong.
+static bool CheckEstimate(const char* what, double estimate, uint64_t truth,
+    uint64_t samples) {
+    double error = truth > 0 ? (estimate - truth) / truth : 0.0;
+    double allowed = 5.0 / std::sqrt(static_cast<double>(
+        samples > 0 ? samples : 1)) + 0.01;
+    bool ok = std::fabs(error) <= allowed;
+    printf("    %-10s %14.0f est. %14llu true %+7.2f%% (allowed %.1f%%)%s\n",
+        what, estimate, static_cast<unsigned long long>(truth), error * 100.0,
+        allowed * 100.0, ok ? "" : "  FAILED");
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    size_t threads = 4;
+    uint64_t millions = 8;
+    uint64_t sampleKB = 256;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-t" && i + 1 < argc) threads = strtoul(argv[++i], nullptr, 10);
+        else if (arg == "-n" && i + 1 < argc) millions = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "-k" && i + 1 < argc) sampleKB = strtoull(argv[++i], nullptr, 10);
+        else {
+            threads = 0;
+            break;
+        }
+    }
+    if (threads == 0 || millions == 0 || sampleKB == 0) {
+        fprintf(stderr, "Usage: heapprofbench [-t threads] [-n millions] "
+            "[-k sampleKB]\n");
+        return 2;
+    }
+    uint64_t allocations = millions * 1000000;
+
+    // Taking turns, so a warming heap or a busy machine affects both alike
+    double directNs = 0;
+    double profiledNs = 0;
+    SiteTotals truth[SITES];
+    std::vector<HeapSiteStats> sites;
+    std::unique_ptr<HeapProfiler> profiler;
+    for (int run = 0; run < 3; ++run) {
+        SiteTotals direct[SITES];
+        double ns = RunWorkload(nullptr, threads, allocations, direct, nullptr);
+        if (run == 0 || ns < directNs) directNs = ns;
+        for (SiteTotals& totals : truth) totals = SiteTotals();
+        profiler.reset(new HeapProfiler(sampleKB * 1024, 1024, 1 << 20));
+        ns = RunWorkload(profiler.get(), threads, allocations, truth, &sites);
+        if (run == 0 || ns < profiledNs) profiledNs = ns;
+    }
+    printf("%zu threads, %llu allocations, one sample per %llu KB:\n", threads,
+        static_cast<unsigned long long>(allocations / threads * threads),
+        static_cast<unsigned long long>(sampleKB));
+    printf("  malloc + free:          %7.1f ns CPU per pair\n", directNs);
+    printf("  with the profiler:      %7.1f ns CPU per pair (%+.1f ns)\n", profiledNs,
+        profiledNs - directNs);
+    printf("  samples: %llu, dropped: %llu\n",
+        static_cast<unsigned long long>(profiler->Samples()),
+        static_cast<unsigned long long>(profiler->Dropped()));
+
+    // The snapshot's sites carry the made-up return addresses
+    bool passed = profiler->Dropped() == 0;
+    for (size_t site = 0; site < SITES; ++site) {
+        const HeapSiteStats* stats = nullptr;
+        for (size_t i = 1; i < sites.size(); ++i) {
+            if (sites[i].frames[0] == 0x401000 + site * 0x100) stats = &sites[i];
+        }
+        printf("  %s (%zu-%zu bytes):\n", SITE_MIX[site].name,
+            SITE_MIX[site].minSize, SITE_MIX[site].maxSize);
+        if (stats == nullptr) {
+            printf("    no samples  FAILED\n");
+            passed = false;
+            continue;
+        }
+        // Live bytes rest on the samples still live, a small part of all
+        uint64_t liveSamples = static_cast<uint64_t>(stats->samples *
+            static_cast<double>(truth[site].liveBytes) / truth[site].bytes);
+        passed = CheckEstimate("allocated", stats->allocatedBytes,
+            truth[site].bytes, stats->samples) && passed;
+        passed = CheckEstimate("count", stats->allocations,
+            truth[site].allocations, stats->samples) && passed;
+        passed = CheckEstimate("live", stats->liveBytes, truth[site].liveBytes,
+            liveSamples) && passed;
+    }
+    return passed ? 0 : 1;
+}
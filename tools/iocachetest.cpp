@@ -0,0 +1,220 @@
+// iocachetest: checks the archive read cache (ArchiveReadCacheEnabled=true)
+// against plain reads of a temporary file: reads across view boundaries,
+// seeks from each origin, reads at and past the end, and view eviction.
+//
+// Build (Linux, from the repository root):
+//   g++ -std=c++17 -O2 -I"EE Tweaks Mod" -o iocachetest tools/iocachetest.cpp
+//       "EE Tweaks Mod/iocache.cpp"
+//
+// Usage: iocachetest
+//   Prints each failed check and exits with 1 if there was one.
+
+#include "pch.h"
+#include "iocache.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+
+static int g_failures = 0;
+
+static void Check(bool condition, const std::string& what) {
+    if (!condition) {
+        printf("FAILED: %s\n", what.c_str());
+        g_failures++;
+    }
+}
+
+// Write a file of pseudo-random bytes and open it read-only
+static int CreateTestFile(const std::vector<unsigned char>& contents) {
+    char path[] = "/tmp/iocachetestXXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        return -1;
+    }
+    unlink(path);
+    if (write(fd, contents.data(), contents.size()) !=
+        static_cast<ssize_t>(contents.size())) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static std::vector<unsigned char> MakeContents(size_t size, uint32_t seed) {
+    std::vector<unsigned char> contents(size);
+    uint32_t state = seed;
+    for (unsigned char& byte : contents) {
+        state = state * 1664525 + 1013904223;
+        byte = static_cast<unsigned char>(state >> 24);
+    }
+    return contents;
+}
+
+// --- Reads And Seeks ---
+
+static void CheckReads() {
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    // Not a whole number of views, so the last one is short
+    size_t fileSize = page * 9 + page / 2 + 13;
+    std::vector<unsigned char> contents = MakeContents(fileSize, 1);
+    int fd = CreateTestFile(contents);
+    Check(fd >= 0, "create the test file");
+    if (fd < 0) {
+        return;
+    }
+
+    ArchiveReadCache cache(page * 2, 2);
+    Check(!cache.Attach(fd, 0), "an empty file is refused");
+    Check(cache.Attach(fd, fileSize), "attach");
+    Check(cache.IsAttached(fd), "attached");
+
+    // Sequential reads of odd sizes cross every view boundary
+    std::vector<unsigned char> out(fileSize);
+    uint64_t position = 0;
+    uint32_t chunk = static_cast<uint32_t>(page / 3);
+    while (position < fileSize) {
+        uint32_t bytesRead = 0;
+        Check(cache.Read(fd, out.data() + position, chunk, bytesRead),
+            "read at " + std::to_string(position));
+        if (bytesRead == 0) {
+            break;
+        }
+        position += bytesRead;
+    }
+    Check(position == fileSize, "sequential reads end at the file size");
+    Check(out == contents, "sequential reads match the file");
+    Check(cache.MappedViews() <= 2, "at most 2 views stay mapped, got " +
+        std::to_string(cache.MappedViews()));
+
+    // At the end a read succeeds with 0 bytes
+    uint32_t bytesRead = 1;
+    unsigned char byte = 0;
+    Check(cache.Read(fd, &byte, 1, bytesRead) && bytesRead == 0,
+        "a read at the end returns 0 bytes");
+
+    // Seeks from each origin, each followed by a read checked against the file
+    struct SeekCase {
+        int64_t distance;
+        SeekOrigin origin;
+        uint64_t expected;
+    };
+    const SeekCase seeks[] = {
+        { 0, SEEK_FROM_BEGIN, 0 },
+        { static_cast<int64_t>(page * 2 - 5), SEEK_FROM_BEGIN, page * 2 - 5 },
+        // Each read below moves on by page + 10 bytes
+        { static_cast<int64_t>(page), SEEK_FROM_CURRENT, page * 4 + 5 },
+        { -static_cast<int64_t>(page * 3), SEEK_FROM_CURRENT, page * 2 + 15 },
+        { -20, SEEK_FROM_END, fileSize - 20 },
+        { -static_cast<int64_t>(page * 7), SEEK_FROM_END, fileSize - page * 7 },
+    };
+    for (const SeekCase& test : seeks) {
+        uint64_t newPosition = 0;
+        std::string name = "seek " + std::to_string(test.distance) +
+            " from " + std::to_string(test.origin);
+        Check(cache.Seek(fd, test.distance, test.origin, newPosition) &&
+            newPosition == test.expected, name + ", got " +
+            std::to_string(newPosition));
+        std::vector<unsigned char> part(page + 10);
+        Check(cache.Read(fd, part.data(), static_cast<uint32_t>(part.size()),
+            bytesRead), name + ": read");
+        uint64_t expectedBytes = std::min<uint64_t>(part.size(),
+            fileSize - test.expected);
+        Check(bytesRead == expectedBytes &&
+            memcmp(part.data(), contents.data() + test.expected, bytesRead) == 0,
+            name + ": read matches the file");
+    }
+
+    // A seek before the start fails and leaves the position alone
+    uint64_t before = 0;
+    uint64_t after = 0;
+    cache.GetPosition(fd, before);
+    uint64_t newPosition = 0;
+    Check(!cache.Seek(fd, -1, SEEK_FROM_BEGIN, newPosition),
+        "a negative position is refused");
+    Check(!cache.Seek(fd, -static_cast<int64_t>(fileSize) - 1, SEEK_FROM_END,
+        newPosition), "a seek before the start from the end is refused");
+    cache.GetPosition(fd, after);
+    Check(before == after, "a refused seek keeps the position");
+
+    // Past the end is allowed, and reads there return 0 bytes
+    Check(cache.Seek(fd, 100, SEEK_FROM_END, newPosition) &&
+        newPosition == fileSize + 100, "a seek past the end");
+    Check(cache.Read(fd, &byte, 1, bytesRead) && bytesRead == 0,
+        "a read past the end returns 0 bytes");
+    Check(cache.MappedViews() <= 2, "at most 2 views after seeking");
+
+    cache.Detach(fd);
+    Check(!cache.IsAttached(fd), "detached");
+    Check(cache.MappedViews() == 0, "detach unmaps the views");
+    Check(!cache.Read(fd, &byte, 1, bytesRead), "no reads after detach");
+    Check(!cache.Seek(fd, 0, SEEK_FROM_BEGIN, newPosition),
+        "no seeks after detach");
+    Check(!cache.GetPosition(fd, newPosition), "no position after detach");
+    close(fd);
+}
+
+// --- Several Files ---
+
+static void CheckFiles() {
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    std::vector<unsigned char> first = MakeContents(page * 3, 2);
+    std::vector<unsigned char> second = MakeContents(page + 7, 3);
+    int firstFd = CreateTestFile(first);
+    int secondFd = CreateTestFile(second);
+    Check(firstFd >= 0 && secondFd >= 0, "create the test files");
+    if (firstFd < 0 || secondFd < 0) {
+        return;
+    }
+
+    // The view size is raised to the page size
+    ArchiveReadCache cache(1, 1);
+    Check(cache.Attach(firstFd, first.size()), "attach the first file");
+    Check(cache.Attach(secondFd, second.size()), "attach the second file");
+    Check(cache.AttachedFiles() == 2, "2 files attached");
+
+    // Interleaved reads keep separate positions and one view per file
+    std::vector<unsigned char> outFirst(first.size());
+    std::vector<unsigned char> outSecond(second.size());
+    uint64_t firstDone = 0;
+    uint64_t secondDone = 0;
+    for (int round = 0; round < 100; ++round) {
+        uint32_t bytesRead = 0;
+        if (firstDone < first.size() &&
+            cache.Read(firstFd, outFirst.data() + firstDone, 1000, bytesRead)) {
+            firstDone += bytesRead;
+        }
+        if (secondDone < second.size() &&
+            cache.Read(secondFd, outSecond.data() + secondDone, 1000, bytesRead)) {
+            secondDone += bytesRead;
+        }
+        Check(cache.MappedViews() <= 2, "one view per file");
+    }
+    Check(outFirst == first, "interleaved reads match the first file");
+    Check(outSecond == second, "interleaved reads match the second file");
+
+    // Attaching a reused handle starts again from the beginning
+    uint64_t position = 0;
+    Check(cache.Attach(firstFd, first.size()), "attach again");
+    Check(cache.GetPosition(firstFd, position) && position == 0,
+        "a reattached file starts at 0");
+    Check(cache.AttachedFiles() == 2, "reattaching does not add a file");
+
+    cache.Detach(secondFd);
+    Check(cache.AttachedFiles() == 1 && cache.IsAttached(firstFd),
+        "detach only the second file");
+    close(firstFd);
+    close(secondFd);
+}
+
+int main() {
+    CheckReads();
+    CheckFiles();
+    if (g_failures > 0) {
+        printf("%d checks failed.\n", g_failures);
+        return 1;
+    }
+    printf("All read cache checks passed.\n");
+    return 0;
+}
@@ -0,0 +1,184 @@
+// lockproftest: checks the lock profiler's (LockProfilerEnabled=true)
+// per-thread site tables, the merge over threads and the ranked report,
+// with threads recording while the report is collected.
+//
+// Build (Linux, from the repository root):
+//   g++ -std=c++17 -O2 -pthread -I"EE Tweaks Mod" -o lockproftest
+//       tools/lockproftest.cpp "EE Tweaks Mod/lockprof.cpp"
+// Add -fsanitize=thread to check for data races as well.
+//
+// Usage: lockproftest
+//   Prints each failed check and exits with 1 if there was one.
+
+#include "pch.h"
+#include "lockprof.h"
+
+#include <cstdio>
+
+static int g_failures = 0;
+
+static void Check(bool condition, const std::string& what) {
+    if (!condition) {
+        printf("FAILED: %s\n", what.c_str());
+        g_failures++;
+    }
+}
+
+static const LockSiteStats* FindSite(const std::vector<LockSiteStats>& sites,
+    uintptr_t lock, uintptr_t caller) {
+    for (const LockSiteStats& site : sites) {
+        if (site.lock == lock && site.caller == caller) return &site;
+    }
+    return nullptr;
+}
+
+// --- Site Table ---
+
+static void CheckTable() {
+    LockSiteTable table(16);
+    for (int i = 0; i < 10; ++i) {
+        table.Record(0x1000, 0x401000, LOCK_CRITICAL_SECTION, i % 5 == 0, 100);
+    }
+    table.Record(0x1000, 0x402000, LOCK_CRITICAL_SECTION, true, 700);
+    table.Record(0x2000, 0x401000, LOCK_WAIT, true, 50);
+    table.Record(0x2000, 0x401000, LOCK_WAIT, true, 30);
+
+    std::vector<LockSiteStats> sites;
+    table.AppendTo(sites);
+    Check(sites.size() == 3, "3 sites, got " + std::to_string(sites.size()));
+    const LockSiteStats* site = FindSite(sites, 0x1000, 0x401000);
+    Check(site != nullptr && site->acquisitions == 10 && site->contended == 2 &&
+        site->waitTicks == 200 && site->maxWaitTicks == 100,
+        "uncontended acquisitions add no wait time");
+    site = FindSite(sites, 0x2000, 0x401000);
+    Check(site != nullptr && site->kind == LOCK_WAIT && site->acquisitions == 2 &&
+        site->waitTicks == 80 && site->maxWaitTicks == 50,
+        "the same caller on another lock is its own site");
+
+    // 16 slots take 12 sites; the rest are dropped but known sites still count
+    for (uintptr_t lock = 0; lock < 20; ++lock) {
+        table.Record(0x10000 + lock * 8, 0x403000, LOCK_CRITICAL_SECTION, false, 0);
+    }
+    sites.clear();
+    table.AppendTo(sites);
+    Check(sites.size() == 12, "table stops at 3/4 full, got " +
+        std::to_string(sites.size()));
+    Check(table.Dropped() == 11, "11 dropped, got " +
+        std::to_string(table.Dropped()));
+    table.Record(0x1000, 0x401000, LOCK_CRITICAL_SECTION, false, 0);
+    sites.clear();
+    table.AppendTo(sites);
+    site = FindSite(sites, 0x1000, 0x401000);
+    Check(site != nullptr && site->acquisitions == 11, "known sites count when full");
+
+    // The capacity is rounded up to a power of two
+    LockSiteTable odd(5);
+    for (uintptr_t lock = 0; lock < 8; ++lock) {
+        odd.Record(0x100 + lock * 8, 0x401000, LOCK_CRITICAL_SECTION, false, 0);
+    }
+    Check(odd.Dropped() == 2, "5 becomes 8 slots holding 6 sites, dropped " +
+        std::to_string(odd.Dropped()));
+}
+
+// --- Profiler ---
+
+// Threads record the same sites and a few of their own while the main thread
+// collects; the final totals must add up exactly
+static void CheckThreads() {
+    const int threadCount = 6;
+    const int rounds = 20000;
+    LockProfiler profiler(256);
+    std::atomic<int> running{ threadCount };
+    std::vector<std::thread> threads;
+    for (int t = 0; t < threadCount; ++t) {
+        threads.emplace_back([&profiler, &running, t] {
+            LockSiteTable* table = profiler.ThreadTable();
+            if (table != profiler.ThreadTable()) {
+                table = nullptr; // Reported below as missing counts
+            }
+            for (int i = 0; table != nullptr && i < rounds; ++i) {
+                table->Record(0x1000, 0x401000, LOCK_CRITICAL_SECTION,
+                    i % 4 == 0, static_cast<uint64_t>(t + 1));
+                table->Record(0x2000 + t * 8, 0x402000, LOCK_WAIT, false, 0);
+            }
+            running--;
+        });
+    }
+    bool ordered = true;
+    while (running > 0) {
+        std::vector<LockSiteStats> sites = profiler.Collect();
+        for (size_t i = 1; i < sites.size(); ++i) {
+            if (sites[i - 1].waitTicks < sites[i].waitTicks) ordered = false;
+        }
+    }
+    for (std::thread& thread : threads) thread.join();
+
+    Check(profiler.Threads() == threadCount, "one table per thread, got " +
+        std::to_string(profiler.Threads()));
+    Check(ordered, "sites are ranked by wait time while threads record");
+    std::vector<LockSiteStats> sites = profiler.Collect();
+    Check(sites.size() == 1 + threadCount, "merged sites, got " +
+        std::to_string(sites.size()));
+    const LockSiteStats* shared = FindSite(sites, 0x1000, 0x401000);
+    uint64_t expectedWait = 0;
+    for (int t = 0; t < threadCount; ++t) expectedWait += (t + 1) * (rounds / 4);
+    Check(shared != nullptr &&
+        shared->acquisitions == static_cast<uint64_t>(threadCount) * rounds &&
+        shared->contended == static_cast<uint64_t>(threadCount) * rounds / 4 &&
+        shared->waitTicks == expectedWait &&
+        shared->maxWaitTicks == static_cast<uint64_t>(threadCount),
+        "the shared site adds up over threads");
+    Check(!sites.empty() && sites[0].lock == 0x1000,
+        "the only waited-on site ranks first");
+    Check(profiler.Dropped() == 0, "nothing dropped");
+}
+
+// --- Report ---
+
+static void CheckReport() {
+    std::vector<LockSiteStats> sites = {
+        { 0x1000, 0x401000, LOCK_CRITICAL_SECTION, 100, 10, 30000, 9000 },
+        { 0x1000, 0x402000, LOCK_CRITICAL_SECTION, 50, 5, 20000, 8000 },
+        { 0x2000, 0x403000, LOCK_WAIT, 10, 10, 40000, 4000 },
+        { 0x3000, 0x404000, LOCK_WAIT_MULTIPLE, 5, 0, 0, 0 },
+    };
+    std::stringstream out;
+    auto describe = [](uintptr_t caller) {
+        std::stringstream ss;
+        ss << "game.exe+0x" << std::hex << (caller - 0x400000);
+        return ss.str();
+    };
+    WriteLockReport(out, sites, 10.0, describe, 3);
+    std::string report = out.str();
+
+    Check(report.find("(4 sites)") != std::string::npos, "site count");
+    Check(report.find("(3 locks)") != std::string::npos, "lock count");
+    Check(report.find("game.exe+0x1000") != std::string::npos,
+        "callers are described");
+    Check(report.find("game.exe+0x4000") == std::string::npos,
+        "rows stop at the maximum");
+    // 0x1000 waits 50000 ticks = 5 ms in total over 2 call sites
+    Check(report.find("5.00") != std::string::npos &&
+        report.find("0x1000  2\n") != std::string::npos,
+        "the per-lock totals merge call sites:\n" + report);
+    Check(report.find("cs ") != std::string::npos &&
+        report.find("wait ") != std::string::npos &&
+        report.find("waitmulti") != std::string::npos, "kind names");
+    // In the per-lock part, 0x1000 (5 ms) ranks above 0x2000 (4 ms)
+    size_t locks = report.find("Locks by total wait time");
+    Check(locks != std::string::npos &&
+        report.find("0x1000  2", locks) < report.find("0x2000  1", locks),
+        "locks are ranked by total wait");
+}
+
+int main() {
+    CheckTable();
+    CheckThreads();
+    CheckReport();
+    if (g_failures > 0) {
+        printf("%d checks failed.\n", g_failures);
+        return 1;
+    }
+    printf("All lock profiler checks passed.\n");
+    return 0;
+}
@@ -0,0 +1,169 @@
+// powermodetest: checks the focus state machine behind Power Mode
+// (PowerModeEnabled=true): the grace delay on focus loss, immediate
+// minimize and refocus, deadline pacing, full speed during multiplayer
+// sessions, and the time kept per mode.
+//
+// Build (Linux, from the repository root):
+//   g++ -std=c++17 -O2 -I"EE Tweaks Mod" -o powermodetest tools/powermodetest.cpp
+//       "EE Tweaks Mod/powermode.cpp"
+//
+// Usage: powermodetest
+//   Prints each failed check and exits with 1 if there was one.
+
+#include "pch.h"
+#include "powermode.h"
+
+#include <cstdio>
+
+static int g_failures = 0;
+
+static void Check(bool condition, const std::string& what) {
+    if (!condition) {
+        printf("FAILED: %s\n", what.c_str());
+        g_failures++;
+    }
+}
+
+const uint64_t MS = 1000; // Microseconds
+
+// --- Transitions ---
+
+static void CheckTransitions() {
+    // 10 fps in the background, 2 minimized, after 1 s
+    FocusPowerController controller(10, 2, 1000, false);
+    uint64_t now = 5000 * MS;
+    Check(controller.OnLoopSleep(true, false, false, now, 0) == 0,
+        "the foreground keeps the game's sleep");
+    Check(controller.OnLoopSleep(true, false, false, now, 7) == 7,
+        "the foreground keeps a longer sleep too");
+    Check(controller.Mode() == POWER_FOREGROUND, "starts in the foreground");
+
+    // A quick alt-tab stays at full speed
+    Check(controller.OnLoopSleep(false, false, false, now += 10 * MS, 0) == 0,
+        "no throttling right after losing focus");
+    controller.OnLoopSleep(false, false, false, now += 900 * MS, 0);
+    Check(controller.Mode() == POWER_FOREGROUND, "still foreground at 910 ms");
+    controller.OnLoopSleep(true, false, false, now += 10 * MS, 0);
+    Check(controller.Transitions() == 0, "a quick alt-tab is no transition");
+
+    // The delay starts over after focus came back
+    controller.OnLoopSleep(false, false, false, now += 10 * MS, 0);
+    controller.OnLoopSleep(false, false, false, now += 500 * MS, 0);
+    Check(controller.Mode() == POWER_FOREGROUND,
+        "the delay starts over on each focus loss");
+    uint32_t sleep = controller.OnLoopSleep(false, false, false, now += 500 * MS, 0);
+    Check(controller.Mode() == POWER_BACKGROUND, "background after the delay");
+    Check(sleep == 100, "a 10 fps frame, got " + std::to_string(sleep));
+
+    // Minimizing and focus take effect at once
+    sleep = controller.OnLoopSleep(false, true, false, now += 1 * MS, 0);
+    Check(controller.Mode() == POWER_MINIMIZED && sleep == 500,
+        "minimized at once at 2 fps, got " + std::to_string(sleep));
+    sleep = controller.OnLoopSleep(true, false, false, now += 1 * MS, 0);
+    Check(controller.Mode() == POWER_FOREGROUND && sleep == 0,
+        "full speed at once on focus");
+    Check(controller.Transitions() == 3, "3 transitions, got " +
+        std::to_string(controller.Transitions()));
+
+    // Minimized without focus skips the delay as well
+    controller.OnLoopSleep(false, true, false, now += 1 * MS, 0);
+    Check(controller.Mode() == POWER_MINIMIZED, "minimized from the foreground");
+}
+
+// --- Pacing ---
+
+static void CheckPacing() {
+    FocusPowerController controller(10, 2, 0, false);
+    uint64_t now = 1000 * MS;
+    uint32_t sleep = controller.OnLoopSleep(false, false, false, now, 0);
+    Check(controller.Mode() == POWER_BACKGROUND && sleep == 100,
+        "no delay: background at once");
+
+    // A frame that took 30 ms sleeps the rest of the 100 ms
+    now += 100 * MS + 30 * MS;
+    sleep = controller.OnLoopSleep(false, false, false, now, 0);
+    Check(sleep == 70, "paced against the deadline, got " + std::to_string(sleep));
+
+    // Longer requests are kept
+    now += 70 * MS;
+    sleep = controller.OnLoopSleep(false, false, false, now, 250);
+    Check(sleep == 250, "a longer game sleep is kept, got " +
+        std::to_string(sleep));
+
+    // Far behind (a load): start over instead of catching up
+    now += 250 * MS + 2000 * MS;
+    sleep = controller.OnLoopSleep(false, false, false, now, 0);
+    Check(sleep == 100, "a stall starts the pacing over, got " +
+        std::to_string(sleep));
+
+    // Partial milliseconds round up, so the loop never runs faster
+    now += 100 * MS + 400;
+    sleep = controller.OnLoopSleep(false, false, false, now, 0);
+    Check(sleep == 100, "rounded up, got " + std::to_string(sleep));
+}
+
+// --- Multiplayer ---
+
+static void CheckMultiplayer() {
+    FocusPowerController controller(10, 2, 1000, false);
+    uint64_t now = 1000 * MS;
+    controller.OnLoopSleep(false, false, true, now, 0);
+    uint32_t sleep = controller.OnLoopSleep(false, false, true, now += 5000 * MS, 0);
+    Check(controller.Mode() == POWER_FOREGROUND && sleep == 0,
+        "a multiplayer session stays at full speed in the background");
+    sleep = controller.OnLoopSleep(false, true, true, now += 10 * MS, 0);
+    Check(controller.Mode() == POWER_FOREGROUND && sleep == 0,
+        "and minimized");
+
+    // After the session the delay applies as usual
+    controller.OnLoopSleep(false, false, false, now += 10 * MS, 0);
+    Check(controller.Mode() == POWER_FOREGROUND, "the delay after a session");
+    controller.OnLoopSleep(false, false, false, now += 1000 * MS, 0);
+    Check(controller.Mode() == POWER_BACKGROUND, "background after a session");
+
+    // A session that starts while throttled returns to full speed at once
+    sleep = controller.OnLoopSleep(false, false, true, now += 10 * MS, 0);
+    Check(controller.Mode() == POWER_FOREGROUND && sleep == 0,
+        "a session ends throttling at once");
+
+    FocusPowerController always(10, 2, 0, true);
+    sleep = always.OnLoopSleep(false, false, true, now, 0);
+    Check(always.Mode() == POWER_BACKGROUND && sleep == 100,
+        "throttleMultiplayer throttles sessions too");
+}
+
+// --- Time Per Mode ---
+
+static void CheckModeTimes() {
+    FocusPowerController controller(10, 2, 0, false);
+    Check(controller.SinceTransition(123) == 0, "no time before the first call");
+    uint64_t now = 1000 * MS;
+    controller.OnLoopSleep(true, false, false, now, 0);
+    controller.OnLoopSleep(false, false, false, now += 300 * MS, 0);
+    controller.OnLoopSleep(false, true, false, now += 200 * MS, 0);
+    controller.OnLoopSleep(true, false, false, now += 700 * MS, 0);
+    now += 50 * MS;
+    Check(controller.ModeMicros(POWER_FOREGROUND, now) == 350 * MS,
+        "foreground time, got " +
+        std::to_string(controller.ModeMicros(POWER_FOREGROUND, now)));
+    Check(controller.ModeMicros(POWER_BACKGROUND, now) == 200 * MS,
+        "background time");
+    Check(controller.ModeMicros(POWER_MINIMIZED, now) == 700 * MS,
+        "minimized time");
+    Check(controller.SinceTransition(now) == 50 * MS, "time in the current mode");
+    Check(std::string(PowerModeName(POWER_MINIMIZED)) == "minimized",
+        "mode names");
+}
+
+int main() {
+    CheckTransitions();
+    CheckPacing();
+    CheckMultiplayer();
+    CheckModeTimes();
+    if (g_failures > 0) {
+        printf("%d checks failed.\n", g_failures);
+        return 1;
+    }
+    printf("All power mode checks passed.\n");
+    return 0;
+}
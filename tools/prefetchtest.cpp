@@ -0,0 +1,289 @@
+// prefetchtest: checks the parts of Startup Prefetch (StartupPrefetchEnabled=
+// true) that need no game: the trace file round trip and its damaged forms,
+// how a synthetic startup trace becomes a read-ahead plan (merging, order,
+// chunks), and the coverage map the hit counts come from.
+//
+// Build (Linux, from the repository root):
+//   g++ -std=c++17 -O2 -I"EE Tweaks Mod" -o prefetchtest tools/prefetchtest.cpp
+//       "EE Tweaks Mod/prefetch.cpp"
+//
+// Usage: prefetchtest
+//   Prints each failed check and exits with 1 if there was one.
+
+#include "pch.h"
+#include "prefetch.h"
+
+#include <cstdio>
+#include <random>
+
+static int g_failures = 0;
+
+static void Check(bool condition, const std::string& what) {
+    if (!condition) {
+        printf("FAILED: %s\n", what.c_str());
+        g_failures++;
+    }
+}
+
+const uint64_t KB = 1024;
+
+static std::string RangeText(const PrefetchRange& range) {
+    return std::to_string(range.fileIndex) + ":" + std::to_string(range.offset) +
+        "+" + std::to_string(range.length);
+}
+
+// --- Trace ---
+
+static void CheckTraceRecording() {
+    FileAccessTrace trace;
+    Check(trace.AddFile("data\\terrain.drs") == 0, "the first file is 0");
+    Check(trace.AddFile("data\\sounds.drs") == 1, "the second file is 1");
+    Check(trace.AddFile("data\\terrain.drs") == 0, "a known file keeps its index");
+    Check(trace.FindFile("data\\sounds.drs") == 1 &&
+        trace.FindFile("data\\missing.drs") == -1, "find a file");
+
+    // Back-to-back reads of one file become one record
+    Check(trace.AddRead(0, 0, 4096, 10) && trace.AddRead(0, 4096, 100, 12),
+        "sequential reads");
+    Check(trace.Records().size() == 1 && trace.Records()[0].length == 4196 &&
+        trace.Records()[0].timeMs == 10, "a sequential read extends the record");
+    trace.AddRead(1, 4196, 50, 13);
+    trace.AddRead(0, 8192, 50, 14);
+    Check(trace.Records().size() == 3,
+        "another file or a gap starts a new record");
+    Check(!trace.AddRead(0, 0, 0, 15) && !trace.AddRead(2, 0, 10, 15),
+        "empty reads and unknown files are refused");
+    Check(trace.Records().size() == 3, "refused reads are not recorded");
+}
+
+static FileAccessTrace MakeTrace() {
+    FileAccessTrace trace;
+    trace.AddFile("data\\graphics.drs");
+    trace.AddFile("data\\interfac.drs");
+    trace.AddFile(std::string(300, 'x')); // A path longer than a varint byte
+    trace.AddRead(0, 0, 4096, 0);
+    trace.AddRead(1, 123456, 700, 3);
+    trace.AddRead(0, 5ull << 32, 65536, 3); // Past 4 GB
+    trace.AddRead(2, 10, 1, 2000);
+    trace.AddRead(0, 4096, 1, 2500);
+    trace.windowMs = 30000;
+    trace.readMicros = 1234567;
+    trace.baselineReadMicros = 7654321;
+    return trace;
+}
+
+static bool SameTrace(const FileAccessTrace& a, const FileAccessTrace& b) {
+    if (a.Files() != b.Files() || a.Records().size() != b.Records().size() ||
+        a.windowMs != b.windowMs || a.readMicros != b.readMicros ||
+        a.baselineReadMicros != b.baselineReadMicros) {
+        return false;
+    }
+    for (size_t i = 0; i < a.Records().size(); ++i) {
+        const TraceRecord& x = a.Records()[i];
+        const TraceRecord& y = b.Records()[i];
+        if (x.fileIndex != y.fileIndex || x.offset != y.offset ||
+            x.length != y.length || x.timeMs != y.timeMs) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void CheckTraceFile() {
+    FileAccessTrace trace = MakeTrace();
+    std::stringstream file;
+    Check(trace.WriteTo(file), "write the trace");
+    std::string bytes = file.str();
+    Check(bytes.size() < 512, "the trace is small, " +
+        std::to_string(bytes.size()) + " bytes");
+
+    FileAccessTrace loaded;
+    std::istringstream in(bytes);
+    Check(loaded.ReadFrom(in) && SameTrace(loaded, trace), "round trip");
+
+    // Every cut is refused and leaves the trace empty
+    for (size_t size = 0; size < bytes.size(); ++size) {
+        FileAccessTrace cut = MakeTrace();
+        std::istringstream cutIn(bytes.substr(0, size));
+        if (cut.ReadFrom(cutIn) || !cut.Files().empty() ||
+            !cut.Records().empty()) {
+            Check(false, "a trace cut at " + std::to_string(size) +
+                " bytes is refused");
+            break;
+        }
+    }
+
+    std::string badMagic = bytes;
+    badMagic[0] = 'X';
+    std::string badVersion = bytes;
+    badVersion[4] = 9;
+    FileAccessTrace bad;
+    std::istringstream magicIn(badMagic);
+    std::istringstream versionIn(badVersion);
+    Check(!bad.ReadFrom(magicIn), "another magic is refused");
+    Check(!bad.ReadFrom(versionIn), "another version is refused");
+
+    // Times are stored as deltas; out of order times are clamped, not wrapped
+    FileAccessTrace unordered;
+    unordered.AddFile("a");
+    unordered.AddRead(0, 0, 1, 100);
+    unordered.AddRead(0, 10, 1, 50);
+    unordered.AddRead(0, 20, 1, 120);
+    std::stringstream unorderedFile;
+    unordered.WriteTo(unorderedFile);
+    Check(loaded.ReadFrom(unorderedFile) && loaded.Records().size() == 3 &&
+        loaded.Records()[1].timeMs == 100 && loaded.Records()[2].timeMs == 120,
+        "an earlier time is read back as the one before it");
+}
+
+// --- Plan ---
+
+static void CheckPlan() {
+    FileAccessTrace trace;
+    trace.AddFile("data\\graphics.drs");
+    trace.AddFile("data\\sounds.drs");
+    trace.AddRead(0, 1024 * KB, 600 * KB, 40); // Needed last
+    trace.AddRead(1, 0, 10 * KB, 20);
+    trace.AddRead(0, 0, 4 * KB, 30);
+    trace.AddRead(0, 10 * KB, 4 * KB, 0);      // 6 KB gap: read through
+    trace.AddRead(1, 10 * KB + 200 * KB, 1 * KB, 50); // 200 KB gap: apart
+    trace.AddRead(0, 2 * KB, 1 * KB, 60);      // Inside the first range
+
+    std::vector<PrefetchRange> plan = BuildPrefetchPlan(trace, 256 * KB);
+    std::string text;
+    for (const PrefetchRange& range : plan) text += RangeText(range) + " ";
+    // File 0's first 14 KB (first needed at 0 ms), then file 1's first
+    // range (20 ms), file 0's large range (40 ms) in 256 KB chunks, and
+    // file 1's second range (50 ms)
+    std::vector<std::string> expected = { "0:0+14336", "1:0+10240",
+        "0:1048576+262144", "0:1310720+262144", "0:1572864+90112",
+        "1:215040+1024" };
+    std::string expectedText;
+    for (const std::string& range : expected) expectedText += range + " ";
+    Check(text == expectedText, "the plan is merged and ordered:\n  got      " +
+        text + "\n  expected " + expectedText);
+
+    // Without a chunk size the default 256 KB is used
+    std::vector<PrefetchRange> defaulted = BuildPrefetchPlan(trace, 0);
+    Check(defaulted.size() == plan.size(), "chunk size 0 means 256 KB");
+
+    FileAccessTrace empty;
+    Check(BuildPrefetchPlan(empty, 256 * KB).empty(), "an empty trace, no plan");
+}
+
+// Random traces: every traced byte is in the plan, chunks stay in size,
+// and nothing is read twice
+static void CheckRandomPlans() {
+    std::mt19937 random(5);
+    for (int round = 0; round < 200; ++round) {
+        FileAccessTrace trace;
+        int files = 1 + static_cast<int>(random() % 4);
+        for (int i = 0; i < files; ++i) trace.AddFile("file" + std::to_string(i));
+        uint32_t time = 0;
+        int reads = static_cast<int>(random() % 200);
+        for (int i = 0; i < reads; ++i) {
+            time += random() % 50;
+            trace.AddRead(static_cast<uint32_t>(random() % files),
+                random() % (16 * 1024 * KB), 1 + random() % (300 * KB), time);
+        }
+        uint32_t chunkSize = static_cast<uint32_t>(4 * KB + random() % (512 * KB));
+        std::vector<PrefetchRange> plan = BuildPrefetchPlan(trace, chunkSize);
+
+        std::string name = "round " + std::to_string(round);
+        PrefetchCoverage coverage;
+        uint64_t planned = 0;
+        bool inSize = true;
+        for (const PrefetchRange& range : plan) {
+            if (range.length == 0 || range.length > chunkSize) inSize = false;
+            coverage.Add(range.fileIndex, range.offset, range.length);
+            planned += range.length;
+        }
+        Check(inSize, name + ": chunks are at most the chunk size");
+        bool covered = true;
+        for (const TraceRecord& record : trace.Records()) {
+            if (!coverage.Contains(record.fileIndex, record.offset,
+                record.length)) {
+                covered = false;
+            }
+        }
+        Check(covered, name + ": every traced read is in the plan");
+
+        // Overlapping ranges would add up to more than the covered bytes
+        uint64_t distinct = 0;
+        std::map<uint32_t, std::vector<std::pair<uint64_t, uint64_t>>> byFile;
+        for (const PrefetchRange& range : plan) {
+            byFile[range.fileIndex].push_back({ range.offset,
+                range.offset + range.length });
+        }
+        bool disjoint = true;
+        for (auto& entry : byFile) {
+            std::sort(entry.second.begin(), entry.second.end());
+            for (size_t i = 0; i < entry.second.size(); ++i) {
+                distinct += entry.second[i].second - entry.second[i].first;
+                if (i > 0 && entry.second[i].first < entry.second[i - 1].second) {
+                    disjoint = false;
+                }
+            }
+        }
+        Check(disjoint && distinct == planned, name + ": nothing is read twice");
+    }
+}
+
+// --- Coverage ---
+
+static void CheckCoverage() {
+    PrefetchCoverage coverage;
+    Check(!coverage.Contains(0, 0, 1), "nothing is covered at first");
+    coverage.Add(0, 100, 100);  // [100, 200)
+    coverage.Add(0, 300, 100);  // [300, 400)
+    Check(coverage.Contains(0, 100, 100) && coverage.Contains(0, 150, 10),
+        "inside a range");
+    Check(!coverage.Contains(0, 150, 100), "across a gap");
+    Check(!coverage.Contains(0, 99, 2) && !coverage.Contains(0, 199, 2),
+        "over either end");
+    Check(!coverage.Contains(1, 150, 10), "another file");
+    coverage.Add(0, 200, 100);  // Touches both: [100, 400)
+    Check(coverage.Contains(0, 100, 300), "touching ranges merge");
+    coverage.Add(0, 50, 500);   // Swallows it: [50, 550)
+    Check(coverage.Contains(0, 50, 500) && !coverage.Contains(0, 49, 1),
+        "an enclosing range");
+    coverage.Add(0, 600, 0);
+    Check(!coverage.Contains(0, 600, 1), "an empty range adds nothing");
+
+    // Random ranges against a byte map
+    std::mt19937 random(9);
+    PrefetchCoverage randomCoverage;
+    std::vector<bool> bytes(4096, false);
+    for (int i = 0; i < 300; ++i) {
+        uint64_t offset = random() % 4000;
+        uint64_t length = 1 + random() % 60;
+        randomCoverage.Add(3, offset, length);
+        for (uint64_t b = offset; b < offset + length; ++b) bytes[b] = true;
+    }
+    int mismatches = 0;
+    for (int i = 0; i < 5000; ++i) {
+        uint64_t offset = random() % 4000;
+        uint64_t length = 1 + random() % 80;
+        bool expected = true;
+        for (uint64_t b = offset; b < offset + length; ++b) {
+            expected = expected && b < bytes.size() && bytes[b];
+        }
+        if (randomCoverage.Contains(3, offset, length) != expected) mismatches++;
+    }
+    Check(mismatches == 0, "random ranges match a byte map, " +
+        std::to_string(mismatches) + " mismatches");
+}
+
+int main() {
+    CheckTraceRecording();
+    CheckTraceFile();
+    CheckPlan();
+    CheckRandomPlans();
+    CheckCoverage();
+    if (g_failures > 0) {
+        printf("%d checks failed.\n", g_failures);
+        return 1;
+    }
+    printf("All startup prefetch checks passed.\n");
+    return 0;
+}
@@ -0,0 +1,142 @@
+// profiletest: checks the sampling profiler's (SamplingProfilerEnabled=true)
+// stack table, folded output and frame-pointer walk.
+//
+// Build (Linux, from the repository root):
+//   g++ -std=c++17 -O2 -I"EE Tweaks Mod" -o profiletest tools/profiletest.cpp
+//       "EE Tweaks Mod/profiler.cpp" "EE Tweaks Mod/modulemap.cpp"
+//
+// Usage: profiletest
+//   Prints each failed check and exits with 1 if there was one.
+
+#include "pch.h"
+#include "profiler.h"
+
+#include <cstdio>
+#include <set>
+
+static int g_failures = 0;
+
+static void Check(bool condition, const std::string& what) {
+    if (!condition) {
+        printf("FAILED: %s\n", what.c_str());
+        g_failures++;
+    }
+}
+
+// --- Stack Table ---
+
+static void CheckTable() {
+    StackSampleTable table;
+    Check(table.Initialize(16), "initialize");
+
+    const uintptr_t hot[] = { 0x401010, 0x402020, 0x403030 };
+    const uintptr_t cold[] = { 0x401010, 0x402024, 0x403030 };
+    for (int i = 0; i < 5; ++i) {
+        Check(table.Add(hot, 3), "add hot stack");
+    }
+    Check(table.Add(cold, 3), "add cold stack");
+    Check(table.Add(hot, 2), "add a shorter stack");
+    Check(!table.Add(hot, 0), "an empty stack is refused");
+    Check(table.UniqueStacks() == 3, "3 unique stacks, got " +
+        std::to_string(table.UniqueStacks()));
+    Check(table.TotalSamples() == 7, "7 samples, got " +
+        std::to_string(table.TotalSamples()));
+
+    // 16 slots take 12 stacks; the rest are dropped but still counted
+    for (uintptr_t leaf = 0; leaf < 20; ++leaf) {
+        uintptr_t frames[] = { 0x500000 + leaf * 4, 0x403030 };
+        table.Add(frames, 2);
+    }
+    Check(table.UniqueStacks() == 12, "table stops at 3/4 full, got " +
+        std::to_string(table.UniqueStacks()));
+    Check(table.DroppedSamples() == 11, "11 dropped, got " +
+        std::to_string(table.DroppedSamples()));
+    Check(table.Add(hot, 3), "known stacks still count when full");
+
+    // Deeper stacks are cut to the maximum depth
+    StackSampleTable deep;
+    deep.Initialize(16);
+    uintptr_t frames[PROFILER_MAX_DEPTH + 8];
+    for (size_t i = 0; i < PROFILER_MAX_DEPTH + 8; ++i) frames[i] = 0x1000 + i;
+    Check(deep.Add(frames, PROFILER_MAX_DEPTH + 8), "add a deep stack");
+    Check(deep.Add(frames, PROFILER_MAX_DEPTH), "the same stack, cut");
+    Check(deep.UniqueStacks() == 1, "deep stacks are cut to the same stack");
+}
+
+static void CheckFolded() {
+    StackSampleTable table;
+    table.Initialize(64);
+    const uintptr_t inGame[] = { 0x401010, 0x402020 };  // leaf first
+    const uintptr_t inMiles[] = { 0x10001234, 0x402020 };
+    const uintptr_t unknown[] = { 0x7000 };
+    for (int i = 0; i < 3; ++i) table.Add(inGame, 2);
+    table.Add(inMiles, 2);
+    table.Add(unknown, 1);
+
+    ModuleMap modules;
+    modules.SetModules({ { "mss32.dll", 0x10000000, 0x50000 },
+        { "game.exe", 0x400000, 0x100000 } });
+    std::stringstream out;
+    table.WriteFolded(out, modules);
+
+    std::set<std::string> lines;
+    std::string line;
+    while (std::getline(out, line)) lines.insert(line);
+    const std::set<std::string> expected = {
+        "game.exe+0x2020;game.exe+0x1010 3",
+        "game.exe+0x2020;mss32.dll+0x1234 1",
+        "0x7000 1",
+    };
+    Check(lines == expected, "folded output:\n" + out.str());
+}
+
+// --- Stack Walk ---
+
+static void CheckWalk() {
+    // A fake stack: frame pointers are addresses inside it
+    uintptr_t stack[32] = { 0 };
+    uintptr_t low = reinterpret_cast<uintptr_t>(&stack[0]);
+    uintptr_t high = reinterpret_cast<uintptr_t>(&stack[32]);
+    auto at = [&](size_t i) { return reinterpret_cast<uintptr_t>(&stack[i]); };
+    // Frames at 4 -> 10 -> 20; the outermost has a zero return address
+    stack[4] = at(10);  stack[5] = 0x402000;
+    stack[10] = at(20); stack[11] = 0x403000;
+    stack[20] = at(30); stack[21] = 0;
+
+    uintptr_t frames[8];
+    size_t depth = WalkFrameChain(0x401000, at(4), low, high, frames, 8);
+    Check(depth == 3 && frames[0] == 0x401000 && frames[1] == 0x402000 &&
+        frames[2] == 0x403000, "walk a 3-frame chain, got depth " +
+        std::to_string(depth));
+
+    Check(WalkFrameChain(0x401000, at(4), low, high, frames, 2) == 2,
+        "stop at the maximum depth");
+    Check(WalkFrameChain(0x401000, at(4), low, high, frames, 0) == 0,
+        "no room for frames");
+
+    // A frame pointer outside the stack or misaligned is not followed
+    Check(WalkFrameChain(0x401000, low - 64, low, high, frames, 8) == 1,
+        "frame pointer below the stack");
+    Check(WalkFrameChain(0x401000, at(31), low, high, frames, 8) == 1,
+        "frame runs past the stack top");
+    Check(WalkFrameChain(0x401000, at(4) + 1, low, high, frames, 8) == 1,
+        "misaligned frame pointer");
+
+    // A chain that loops back ends after the looping frame
+    stack[10] = at(4);
+    depth = WalkFrameChain(0x401000, at(4), low, high, frames, 8);
+    Check(depth == 3, "a looping chain stops, got depth " +
+        std::to_string(depth));
+}
+
+int main() {
+    CheckTable();
+    CheckFolded();
+    CheckWalk();
+    if (g_failures > 0) {
+        printf("%d checks failed.\n", g_failures);
+        return 1;
+    }
+    printf("All profiler checks passed.\n");
+    return 0;
+}
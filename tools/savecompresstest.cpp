@@ -0,0 +1,252 @@
+// savecompresstest: checks compressed saves (SaveCompressionEnabled=true)
+// against a plain copy kept in memory: reads and rewrites across sessions,
+// detection by the header, unfinished files, and compaction into a copy.
+//
+// Build (Linux, from the repository root):
+//   g++ -std=c++17 -O2 -I"EE Tweaks Mod" -o savecompresstest
+//       tools/savecompresstest.cpp "EE Tweaks Mod/savecompress.cpp"
+//       "EE Tweaks Mod/lz4block.cpp"
+//
+// Usage: savecompresstest
+//   Prints each failed check and exits with 1 if there was one.
+
+#include "pch.h"
+#include "savecompress.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+static int g_failures = 0;
+
+static void Check(bool condition, const std::string& what) {
+    if (!condition) {
+        printf("FAILED: %s\n", what.c_str());
+        g_failures++;
+    }
+}
+
+const uint32_t BLOCK_SIZE = 4096;
+
+static int CreateTestFile() {
+    char path[] = "/tmp/savecompresstestXXXXXX";
+    int fd = mkstemp(path);
+    if (fd >= 0) {
+        unlink(path);
+    }
+    return fd;
+}
+
+static uint64_t FileSize(int fd) {
+    struct stat info;
+    return fstat(fd, &info) == 0 ? static_cast<uint64_t>(info.st_size) : 0;
+}
+
+// Compressible like a save: runs of repeated values with some noise
+static std::vector<unsigned char> MakeContents(size_t size, uint32_t seed) {
+    std::vector<unsigned char> contents(size);
+    uint32_t state = seed;
+    unsigned char value = 0;
+    for (size_t i = 0; i < size; ++i) {
+        state = state * 1664525 + 1013904223;
+        if ((state >> 24) < 24) value = static_cast<unsigned char>(state >> 8);
+        contents[i] = (state >> 16) % 64 == 0 ?
+            static_cast<unsigned char>(state >> 4) : value;
+    }
+    return contents;
+}
+
+// Close, then compact the way the file hooks do: a copy replaces the file,
+// which stays valid until then
+static void CloseAndCompact(CompressedFile& file, int& fd,
+    const std::string& name) {
+    Check(file.Close(), "close " + name);
+    uint64_t before = FileSize(fd);
+    CompressedFile reopened(fd, BLOCK_SIZE);
+    Check(reopened.Open() && reopened.Size() == file.Size(),
+        name + ": the closed file opens before it is compacted");
+    if (!file.NeedsCompacting()) {
+        return;
+    }
+    int copy = CreateTestFile();
+    Check(file.CompactTo(copy), name + ": compact");
+    Check(FileSize(fd) == before, name + ": compacting leaves the file alone");
+    Check(FileSize(copy) < before, name + ": the copy is smaller");
+    close(fd);
+    fd = copy;
+}
+
+static bool WriteAt(CompressedFile& file, uint64_t offset,
+    const unsigned char* data, size_t size) {
+    uint64_t position = 0;
+    return file.Seek(static_cast<int64_t>(offset), SEEK_FROM_BEGIN, position) &&
+        file.Write(data, static_cast<uint32_t>(size));
+}
+
+static bool ReadAll(CompressedFile& file, std::vector<unsigned char>& out) {
+    uint64_t position = 0;
+    out.assign(static_cast<size_t>(file.Size()), 0);
+    uint32_t bytesRead = 0;
+    return file.Seek(0, SEEK_FROM_BEGIN, position) &&
+        file.Read(out.data(), static_cast<uint32_t>(out.size()), bytesRead) &&
+        bytesRead == out.size();
+}
+
+// Open the file again and compare it with the plain copy
+static void CheckContents(int fd, const std::vector<unsigned char>& expected,
+    const std::string& name) {
+    CompressedFile file(fd, BLOCK_SIZE);
+    Check(CompressedFile::IsCompressed(fd), name + ": detected");
+    Check(file.Open(), name + ": open");
+    std::vector<unsigned char> contents;
+    Check(file.Size() == expected.size(), name + ": size " +
+        std::to_string(file.Size()));
+    Check(ReadAll(file, contents) && contents == expected,
+        name + ": contents match");
+    Check(file.Close() && !file.Modified(), name + ": reading changes nothing");
+}
+
+// --- Detection ---
+
+static void CheckDetection() {
+    int fd = CreateTestFile();
+    std::vector<unsigned char> plain = MakeContents(10000, 1);
+    Check(write(fd, plain.data(), plain.size()) ==
+        static_cast<ssize_t>(plain.size()), "write a plain file");
+    Check(!CompressedFile::IsCompressed(fd), "a plain file is not compressed");
+
+    // The magic alone is not enough
+    Check(pwrite(fd, "EELZ", 4, 0) == 4, "write the magic");
+    Check(!CompressedFile::IsCompressed(fd),
+        "the magic without a valid header is plain");
+    close(fd);
+
+    fd = CreateTestFile();
+    Check(!CompressedFile::IsCompressed(fd), "an empty file is plain");
+    close(fd);
+}
+
+// A file cut off before its close has a header but no index
+static void CheckUnfinished() {
+    int fd = CreateTestFile();
+    std::vector<unsigned char> contents = MakeContents(BLOCK_SIZE * 5 + 100, 2);
+    {
+        CompressedFile file(fd, BLOCK_SIZE);
+        Check(file.Create(), "create");
+        Check(file.Write(contents.data(), static_cast<uint32_t>(contents.size())),
+            "write");
+        Check(file.Flush(), "flush");
+    }
+    Check(CompressedFile::IsCompressed(fd), "an unfinished file is detected");
+    CompressedFile reopened(fd, BLOCK_SIZE);
+    Check(!reopened.Open() && reopened.Corrupt(),
+        "an unfinished file is reported as damaged");
+
+    // Just the header
+    Check(ftruncate(fd, COMPRESSED_FILE_HEADER_SIZE) == 0, "truncate");
+    CompressedFile headerOnly(fd, BLOCK_SIZE);
+    Check(CompressedFile::IsCompressed(fd), "a bare header is detected");
+    Check(!headerOnly.Open() && headerOnly.Corrupt(),
+        "a bare header is reported as damaged");
+    close(fd);
+}
+
+// --- Rewrites ---
+
+static void CheckRewrites() {
+    int fd = CreateTestFile();
+    std::vector<unsigned char> expected = MakeContents(BLOCK_SIZE * 40 + 123, 3);
+    {
+        CompressedFile file(fd, BLOCK_SIZE);
+        Check(file.Create(), "create");
+        Check(file.Write(expected.data(), static_cast<uint32_t>(expected.size())),
+            "write");
+        Check(file.Close(), "close");
+    }
+    uint64_t firstSize = FileSize(fd);
+    Check(firstSize < expected.size() / 2, "the file is compressed, " +
+        std::to_string(firstSize) + " bytes");
+    CheckContents(fd, expected, "first session");
+
+    // The game patches its header at the end of a save: the same block is
+    // written again within the session and goes where it was
+    {
+        int patched = CreateTestFile();
+        CompressedFile file(patched, BLOCK_SIZE);
+        file.Create();
+        file.Write(expected.data(), static_cast<uint32_t>(expected.size()));
+        WriteAt(file, 8, expected.data() + 8, 16);
+        file.Flush();
+        uint64_t stored = file.StoredBytes();
+        for (int i = 0; i < 10; ++i) {
+            WriteAt(file, 8, expected.data() + 8, 16);
+            file.Flush();
+        }
+        Check(file.StoredBytes() == stored, "a rewritten block that fits is "
+            "not appended");
+        Check(file.Close(), "close after patching");
+        Check(FileSize(patched) == firstSize,
+            "rewrites of the same data take no space, " +
+            std::to_string(FileSize(patched)) + " bytes");
+        close(patched);
+    }
+
+    // Later sessions rewrite random ranges; the file never grows much past
+    // what the live data needs
+    uint32_t state = 7;
+    uint64_t largest = 0;
+    for (int session = 0; session < 30; ++session) {
+        CompressedFile file(fd, BLOCK_SIZE);
+        Check(file.Open(), "open session " + std::to_string(session));
+        for (int edit = 0; edit < 5; ++edit) {
+            state = state * 1664525 + 1013904223;
+            size_t offset = (state >> 8) % expected.size();
+            size_t size = std::min<size_t>((state >> 4) % (BLOCK_SIZE * 3) + 1,
+                expected.size() - offset);
+            std::vector<unsigned char> data = MakeContents(size, state);
+            memcpy(expected.data() + offset, data.data(), size);
+            Check(WriteAt(file, offset, data.data(), size), "rewrite");
+        }
+        CloseAndCompact(file, fd, "session " + std::to_string(session));
+        largest = std::max(largest, FileSize(fd));
+    }
+    CheckContents(fd, expected, "after rewrites");
+    // Compaction keeps the unused space under an eighth, plus one session
+    // of rewrites (5 x 3 blocks) and the indexes; sizes are taken after it
+    Check(largest < firstSize * 9 / 8 + BLOCK_SIZE * 15 + 4096,
+        "rewrites are compacted, largest " + std::to_string(largest) +
+        " bytes against " + std::to_string(firstSize));
+
+    // Shrinking and growing again leaves zeros, not the old bytes
+    {
+        CompressedFile file(fd, BLOCK_SIZE);
+        uint64_t position = 0;
+        Check(file.Open(), "open to truncate");
+        Check(file.Seek(BLOCK_SIZE * 3 + 10, SEEK_FROM_BEGIN, position) &&
+            file.Truncate(), "truncate");
+        unsigned char end = 0xAB;
+        Check(WriteAt(file, BLOCK_SIZE * 10, &end, 1), "write past the end");
+        CloseAndCompact(file, fd, "after truncating");
+    }
+    expected.resize(BLOCK_SIZE * 3 + 10);
+    expected.resize(BLOCK_SIZE * 10, 0);
+    expected.push_back(0xAB);
+    CheckContents(fd, expected, "truncated and grown");
+    Check(FileSize(fd) < firstSize / 4, "the truncated file is compacted, " +
+        std::to_string(FileSize(fd)) + " bytes");
+    close(fd);
+}
+
+int main() {
+    CheckDetection();
+    CheckUnfinished();
+    CheckRewrites();
+    if (g_failures > 0) {
+        printf("%d checks failed.\n", g_failures);
+        return 1;
+    }
+    printf("All save compression checks passed.\n");
+    return 0;
+}
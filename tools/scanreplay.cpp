@@ -0,0 +1,237 @@
+// scanreplay: runs the mod's scan and patch pipeline against module dumps
+// (tweaks_dump_*.eemd, written in-game with ModuleDumpEnabled=true) instead
+// of a live game process, and reports what was found and how long it took.
+//
+// Build (Linux, from the repository root):
+//   g++ -std=c++17 -O2 -pthread -I"EE Tweaks Mod" -o scanreplay
+//       tools/scanreplay.cpp "EE Tweaks Mod/memory.cpp"
+//       "EE Tweaks Mod/patches.cpp" "EE Tweaks Mod/config.cpp"
+//       "EE Tweaks Mod/logging.cpp" "EE Tweaks Mod/moduledump.cpp"
+//       "EE Tweaks Mod/lz4block.cpp" "EE Tweaks Mod/mapplanner.cpp"
+//       "EE Tweaks Mod/pipeline.cpp" "EE Tweaks Mod/counters.cpp"
+//
+// Usage: scanreplay [-c tweaks.config] [-n iterations] [-t] dump.eemd...
+//   -c  settings to patch with (default: every patch enabled)
+//   -n  run the pipeline this many times for timing (images are restored
+//       between runs)
+//   -t  scan on several threads, as when initialized from the entry point
+// The mod's own log lines go to stderr.
+
+#include "pch.h"
+#include "globals.h"
+#include "logging.h"
+#include "config.h"
+#include "memory.h"
+#include "patches.h"
+#include "moduledump.h"
+#include "pipeline.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <strings.h> // strcasecmp
+
+// Serves module lookups and patch reads/writes from dumps loaded into this
+// process. Addresses are host pointers into the loaded images.
+class DumpMemoryBackend : public MemoryBackend {
+public:
+    void AddModule(const ModuleDump& dump) {
+        m_modules.push_back(dump);
+        m_pristine.push_back(dump.image);
+    }
+
+    void Restore() {
+        for (size_t i = 0; i < m_modules.size(); ++i) {
+            m_modules[i].image = m_pristine[i];
+        }
+    }
+
+    const std::vector<ModuleDump>& Modules() const { return m_modules; }
+
+    // "module+0xRVA (0xoriginal address)" for a host address
+    std::string Describe(uintptr_t address) const {
+        for (const ModuleDump& module : m_modules) {
+            uintptr_t base = reinterpret_cast<uintptr_t>(module.image.data());
+            if (address >= base && address - base < module.image.size()) {
+                char text[512];
+                snprintf(text, sizeof(text), "%s+0x%llx (0x%llx)",
+                    module.name.c_str(),
+                    static_cast<unsigned long long>(address - base),
+                    static_cast<unsigned long long>(
+                        module.baseAddress + (address - base)));
+                return text;
+            }
+        }
+        return "?";
+    }
+
+    bool GetModule(const std::string& moduleName, uintptr_t& baseAddress,
+        size_t& moduleSize) override {
+        for (ModuleDump& module : m_modules) {
+            if (strcasecmp(module.name.c_str(), moduleName.c_str()) == 0) {
+                baseAddress = reinterpret_cast<uintptr_t>(module.image.data());
+                moduleSize = module.image.size();
+                return true;
+            }
+        }
+        Log("Error: Could not get handle for module '" + moduleName +
+            "' (no dump loaded).");
+        return false;
+    }
+
+    bool Read(uintptr_t address, void* buffer, size_t size) override {
+        unsigned char* bytes = Locate(address, size);
+        if (bytes == nullptr) {
+            return false;
+        }
+        memcpy(buffer, bytes, size);
+        return true;
+    }
+
+    bool Write(uintptr_t address, const void* data, size_t size,
+        bool) override {
+        unsigned char* bytes = Locate(address, size);
+        if (bytes == nullptr) {
+            Log("Error: Write outside the loaded module dumps.");
+            return false;
+        }
+        memcpy(bytes, data, size);
+        return true;
+    }
+
+private:
+    unsigned char* Locate(uintptr_t address, size_t size) {
+        for (ModuleDump& module : m_modules) {
+            uintptr_t base = reinterpret_cast<uintptr_t>(module.image.data());
+            if (address >= base && address - base <= module.image.size() &&
+                size <= module.image.size() - (address - base)) {
+                return module.image.data() + (address - base);
+            }
+        }
+        return nullptr;
+    }
+
+    std::vector<ModuleDump> m_modules;
+    std::vector<std::vector<unsigned char>> m_pristine;
+};
+
+struct StageTimes {
+    double scanMs = 0;
+    double standardMs = 0;
+    double customMs = 0;
+};
+
+static double MillisecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+// One line per enabled patch, as printed after the runs
+static std::vector<std::string> DescribeReport(const DumpMemoryBackend& memory,
+    const PatchPipelineReport& report) {
+    std::vector<std::string> lines;
+    for (const PatchPipelineReport::Entry& entry : report.entries) {
+        if (entry.isCustom) {
+            lines.push_back(entry.name + ": " +
+                (entry.applied ? "applied" : "not applied"));
+        }
+        else if (!entry.moduleFound) {
+            lines.push_back(entry.name + ": module '" + entry.module +
+                "' not in dumps");
+        }
+        else {
+            lines.push_back(entry.name + ": " +
+                (entry.address ? "found at " + memory.Describe(entry.address) :
+                    std::string("pattern not found")) +
+                (entry.applied ? ", applied" : ", not applied"));
+        }
+    }
+    return lines;
+}
+
+static void PrintUsage() {
+    fprintf(stderr, "Usage: scanreplay [-c tweaks.config] [-n iterations] [-t] "
+        "dump.eemd...\n");
+}
+
+int main(int argc, char** argv) {
+    std::string configPath;
+    int iterations = 1;
+    std::vector<std::string> dumpPaths;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-c" && i + 1 < argc) {
+            configPath = argv[++i];
+        }
+        else if (arg == "-n" && i + 1 < argc) {
+            iterations = atoi(argv[++i]);
+            if (iterations < 1) iterations = 1;
+        }
+        else if (arg == "-t") {
+            g_initFromEntryPoint = true; // Enables threaded scanning
+        }
+        else if (!arg.empty() && arg[0] == '-') {
+            PrintUsage();
+            return 2;
+        }
+        else {
+            dumpPaths.push_back(arg);
+        }
+    }
+    if (dumpPaths.empty()) {
+        PrintUsage();
+        return 2;
+    }
+
+    g_loggingEnabled = false; // Log() still reaches stderr
+    if (!configPath.empty() && !ReadConfigFile(configPath)) {
+        fprintf(stderr, "Could not read %s\n", configPath.c_str());
+        return 1;
+    }
+
+    DumpMemoryBackend memory;
+    for (const std::string& path : dumpPaths) {
+        auto start = std::chrono::steady_clock::now();
+        std::ifstream file(path, std::ios::binary);
+        ModuleDump dump;
+        if (!file.is_open() || !ReadModuleDump(file, dump)) {
+            fprintf(stderr, "Could not load dump %s\n", path.c_str());
+            return 1;
+        }
+        printf("Loaded %s: %s, %zu KB, base 0x%llx%s (%.1f ms)\n", path.c_str(),
+            dump.name.c_str(), dump.image.size() / 1024,
+            static_cast<unsigned long long>(dump.baseAddress),
+            dump.isGameExecutable ? ", game executable" : "",
+            MillisecondsSince(start));
+        if (dump.isGameExecutable) {
+            g_executableName = dump.name;
+        }
+        memory.AddModule(dump);
+    }
+    SetMemoryBackend(&memory);
+
+    // Steps 4 to 7 of ApplyTweaks, minus the parts that need the live process
+    // (CRT detours, map memory planning)
+    StageTimes times;
+    PatchPipelineReport report;
+    for (int i = 0; i < iterations; ++i) {
+        memory.Restore();
+        report = PatchPipelineReport();
+        RunPatchPipeline(configPath.empty(), report);
+        times.scanMs += report.scanMs;
+        times.standardMs += report.standardMs;
+        times.customMs += report.customMs;
+    }
+
+    printf("\n");
+    for (const std::string& line : DescribeReport(memory, report)) {
+        printf("  %s\n", line.c_str());
+    }
+    printf("\nApplied %d standard and %d custom patches.\n",
+        report.standardApplied, report.customApplied);
+    printf("Average over %d run(s): scan %.3f ms, standard patches %.3f ms, "
+        "custom patches %.3f ms\n", iterations, times.scanMs / iterations,
+        times.standardMs / iterations, times.customMs / iterations);
+
+    SetMemoryBackend(nullptr);
+    return 0;
+}
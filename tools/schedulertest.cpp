@@ -0,0 +1,239 @@
+// schedulertest: stress-tests the job scheduler (JobSchedulerEnabled=true):
+// jobs submitted from many threads and from inside jobs all run exactly
+// once, WaitIdle and Stop wait for them, and the frame scheduler keeps
+// main-thread jobs back while handing the rest to the workers.
+//
+// Build (Linux, from the repository root):
+//   g++ -std=c++17 -O2 -pthread -I"EE Tweaks Mod" -o schedulertest
+//       tools/schedulertest.cpp "EE Tweaks Mod/scheduler.cpp"
+// Add -fsanitize=thread to check for data races as well.
+//
+// Usage: schedulertest [rounds]
+//   Prints each failed check and exits with 1 if there was one.
+
+#include "pch.h"
+#include "scheduler.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+static int g_failures = 0;
+
+static void Check(bool condition, const std::string& what) {
+    if (!condition) {
+        printf("FAILED: %s\n", what.c_str());
+        g_failures++;
+    }
+}
+
+// Each job marks its own slot, so lost and repeated jobs both show
+struct RunCounts {
+    explicit RunCounts(size_t count) : runs(count) {}
+    void Mark(size_t index) { runs[index]++; }
+    size_t Wrong() const {
+        size_t wrong = 0;
+        for (const std::atomic<int>& run : runs) {
+            if (run != 1) wrong++;
+        }
+        return wrong;
+    }
+    std::vector<std::atomic<int>> runs;
+};
+
+// --- Job Scheduler ---
+
+static void CheckStartStop() {
+    JobScheduler scheduler;
+    Check(!scheduler.Submit([] {}), "no submits before start");
+    Check(!scheduler.Start(0), "no workers is refused");
+    Check(scheduler.Start(3) && scheduler.WorkerCount() == 3, "start 3 workers");
+    Check(!scheduler.Start(2), "a running scheduler is not restarted");
+    Check(!scheduler.Submit(Job()), "an empty job is refused");
+
+    // Stop runs what is still queued
+    const size_t count = 500;
+    RunCounts counts(count);
+    for (size_t i = 0; i < count; ++i) {
+        scheduler.Submit([&counts, i] {
+            std::this_thread::sleep_for(std::chrono::microseconds(i % 7));
+            counts.Mark(i);
+        });
+    }
+    scheduler.Stop();
+    Check(counts.Wrong() == 0, std::to_string(counts.Wrong()) +
+        " jobs not run exactly once by Stop");
+    Check(!scheduler.Running() && !scheduler.Submit([] {}),
+        "no submits after stop");
+
+    // Started again after a stop
+    Check(scheduler.Start(2), "start again");
+    std::atomic<int> ran{ 0 };
+    scheduler.Submit([&ran] { ran++; });
+    scheduler.WaitIdle();
+    Check(ran == 1, "runs jobs after a restart");
+}
+
+// Threads submit jobs that submit more jobs, two levels deep
+static void CheckNestedSubmits(size_t workers) {
+    const size_t submitters = 4;
+    const size_t perSubmitter = 200;
+    const size_t children = 3;
+    const size_t total = submitters * perSubmitter * (1 + children);
+    RunCounts counts(total);
+
+    JobScheduler scheduler;
+    Check(scheduler.Start(workers), "start");
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < submitters; ++t) {
+        threads.emplace_back([&, t] {
+            for (size_t i = 0; i < perSubmitter; ++i) {
+                size_t parent = (t * perSubmitter + i) * (1 + children);
+                bool submitted = scheduler.Submit([&, parent] {
+                    for (size_t c = 1; c <= children; ++c) {
+                        size_t child = parent + c;
+                        scheduler.Submit([&counts, child] { counts.Mark(child); });
+                    }
+                    counts.Mark(parent);
+                });
+                if (!submitted) counts.Mark(parent);
+            }
+        });
+    }
+    for (std::thread& thread : threads) thread.join();
+    scheduler.WaitIdle();
+
+    std::string name = std::to_string(workers) + " workers: ";
+    Check(counts.Wrong() == 0, name + std::to_string(counts.Wrong()) +
+        " jobs not run exactly once");
+    Check(scheduler.Executed() == total, name + "executed " +
+        std::to_string(scheduler.Executed()) + " of " + std::to_string(total));
+    if (workers == 1) {
+        Check(scheduler.Stolen() == 0, name + "nothing to steal from");
+    }
+    scheduler.Stop();
+}
+
+// One slow worker's queue is emptied by the others
+static void CheckStealing() {
+    JobScheduler scheduler;
+    scheduler.Start(4);
+    std::atomic<int> ran{ 0 };
+    scheduler.Submit([&] {
+        // Submitted from a worker, so all of them land in its own queue
+        for (int i = 0; i < 400; ++i) {
+            scheduler.Submit([&ran] {
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+                ran++;
+            });
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    });
+    scheduler.WaitIdle();
+    Check(ran == 400, "all local jobs ran, got " + std::to_string(ran));
+    Check(scheduler.Stolen() > 0, "idle workers steal from a busy one");
+    scheduler.Stop();
+}
+
+// --- Frame Scheduler ---
+
+static void CheckFrames() {
+    FrameScheduler frames;
+    std::atomic<int> callbacks{ 0 };
+    frames.AddFrameCallback([&callbacks] { callbacks++; });
+
+    // No budget: posted jobs wait, callbacks still run
+    std::atomic<int> ran{ 0 };
+    std::thread::id mainThread = std::this_thread::get_id();
+    std::atomic<int> offMainThread{ 0 };
+    for (int i = 0; i < 10; ++i) {
+        frames.Post([&] {
+            ran++;
+            if (std::this_thread::get_id() != mainThread) offMainThread++;
+        }, true);
+    }
+    frames.RunFrame(0, nullptr);
+    Check(callbacks == 1 && ran == 0, "a frame without budget runs callbacks only");
+    Check(frames.Pending() == 10 && frames.OverBudget() == 1,
+        "the jobs wait and the frame is over budget");
+
+    // Main-thread jobs are never handed to workers
+    JobScheduler workers;
+    workers.Start(2);
+    frames.RunFrame(0, &workers);
+    Check(frames.Pending() == 10 && frames.Spilled() == 0,
+        "main-thread jobs stay");
+    frames.RunFrame(1000000, &workers);
+    Check(ran == 10 && offMainThread == 0 && frames.Pending() == 0,
+        "main-thread jobs run on the calling thread");
+
+    // Jobs that may run anywhere go to the workers once the budget is gone
+    for (int i = 0; i < 20; ++i) {
+        frames.Post([&ran] { ran++; }, false);
+    }
+    frames.RunFrame(0, &workers);
+    workers.WaitIdle();
+    Check(ran == 30 && frames.Spilled() == 20 && frames.Pending() == 0,
+        "spilled jobs run on the workers");
+    workers.Stop();
+}
+
+// Threads post while frames run; every job runs exactly once
+static void CheckFrameStress() {
+    const size_t posters = 4;
+    const size_t perPoster = 2000;
+    RunCounts counts(posters * perPoster);
+    std::atomic<size_t> mainOnlyElsewhere{ 0 };
+    std::thread::id mainThread = std::this_thread::get_id();
+
+    FrameScheduler frames;
+    JobScheduler workers;
+    workers.Start(3);
+    std::atomic<size_t> finished{ 0 };
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < posters; ++t) {
+        threads.emplace_back([&, t] {
+            for (size_t i = 0; i < perPoster; ++i) {
+                size_t index = t * perPoster + i;
+                bool mainOnly = index % 3 == 0;
+                frames.Post([&, index, mainOnly] {
+                    if (mainOnly && std::this_thread::get_id() != mainThread) {
+                        mainOnlyElsewhere++;
+                    }
+                    counts.Mark(index);
+                }, mainOnly);
+            }
+            finished++;
+        });
+    }
+    // Small budgets, so some frames spill and some run everything
+    for (int frame = 0; finished < posters; ++frame) {
+        frames.RunFrame((frame % 4) * 50, &workers);
+    }
+    for (std::thread& thread : threads) thread.join();
+    while (frames.Pending() > 0) {
+        frames.RunFrame(1000000, &workers);
+    }
+    workers.WaitIdle();
+    Check(counts.Wrong() == 0, std::to_string(counts.Wrong()) +
+        " posted jobs not run exactly once");
+    Check(mainOnlyElsewhere == 0, std::to_string(mainOnlyElsewhere) +
+        " main-thread jobs ran on a worker");
+    workers.Stop();
+}
+
+int main(int argc, char* argv[]) {
+    int rounds = argc > 1 ? atoi(argv[1]) : 20;
+    CheckStartStop();
+    CheckStealing();
+    CheckFrames();
+    for (int round = 0; round < rounds && g_failures == 0; ++round) {
+        CheckNestedSubmits(1 + round % 4);
+        CheckFrameStress();
+    }
+    if (g_failures > 0) {
+        printf("%d checks failed.\n", g_failures);
+        return 1;
+    }
+    printf("All scheduler checks passed.\n");
+    return 0;
+}
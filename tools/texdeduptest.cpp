@@ -0,0 +1,136 @@
+// texdeduptest: checks the content hash and the sharing table behind texture
+// dedup (TextureDedupEnabled=true): the SSE2 and scalar hashes agree, split
+// updates hash like one, and the table counts references and saved bytes.
+//
+// Build (Linux, from the repository root):
+//   g++ -std=c++17 -O2 -I"EE Tweaks Mod" -o texdeduptest tools/texdeduptest.cpp
+//       "EE Tweaks Mod/texdedup.cpp"
+//
+// Usage: texdeduptest
+//   Prints each failed check and exits with 1 if there was one.
+
+#include "pch.h"
+#include "texdedup.h"
+
+#include <cstdio>
+#include <set>
+
+static int g_failures = 0;
+
+static void Check(bool condition, const std::string& what) {
+    if (!condition) {
+        printf("FAILED: %s\n", what.c_str());
+        g_failures++;
+    }
+}
+
+static std::vector<unsigned char> MakeContents(size_t size, uint32_t seed) {
+    std::vector<unsigned char> contents(size);
+    uint32_t state = seed;
+    for (unsigned char& byte : contents) {
+        state = state * 1664525 + 1013904223;
+        byte = static_cast<unsigned char>(state >> 24);
+    }
+    return contents;
+}
+
+static uint64_t Hash(const std::vector<unsigned char>& data, bool useSse2) {
+    ContentHasher hasher(useSse2);
+    hasher.Update(data.data(), data.size());
+    return hasher.Finish();
+}
+
+// --- Content Hash ---
+
+static void CheckHash() {
+    // Sizes around the 64-byte stripe and the 16-stripe scramble
+    const size_t sizes[] = { 0, 1, 63, 64, 65, 1023, 1024, 1025, 4096 + 17,
+        64 * 64 * 4 };
+    std::set<uint64_t> seen;
+    for (size_t size : sizes) {
+        std::vector<unsigned char> data = MakeContents(size, 7);
+        std::string name = "size " + std::to_string(size);
+        uint64_t scalar = Hash(data, false);
+        if (ContentHasher::Sse2Available()) {
+            Check(Hash(data, true) == scalar, name + ": SSE2 and scalar agree");
+        }
+        seen.insert(scalar);
+
+        // Rows of odd lengths, as HashSurface feeds them
+        for (size_t row : { size_t(1), size_t(3), size_t(60), size_t(100) }) {
+            ContentHasher hasher(true);
+            for (size_t offset = 0; offset < size; offset += row) {
+                hasher.Update(data.data() + offset, std::min(row, size - offset));
+            }
+            Check(hasher.Finish() == scalar, name + ": updates of " +
+                std::to_string(row) + " bytes hash like one");
+        }
+    }
+    // Zero padding of the last stripe must not hide the length
+    Check(seen.size() == sizeof(sizes) / sizeof(sizes[0]),
+        "different sizes hash differently");
+
+    // Any single changed bit changes the hash
+    std::vector<unsigned char> data = MakeContents(2048, 9);
+    uint64_t original = Hash(data, false);
+    int unchanged = 0;
+    for (size_t bit = 0; bit < data.size() * 8; bit += 37) {
+        data[bit / 8] ^= static_cast<unsigned char>(1 << (bit % 8));
+        if (Hash(data, false) == original) unchanged++;
+        data[bit / 8] ^= static_cast<unsigned char>(1 << (bit % 8));
+    }
+    Check(unchanged == 0, std::to_string(unchanged) +
+        " changed bits left the hash alone");
+    Check(Hash(data, false) == original, "hash is repeatable");
+}
+
+// --- Dedup Table ---
+
+static void CheckTable() {
+    TextureDedupTable table;
+    const TextureKey grass = { 1, 10 };
+    const TextureKey water = { 2, 10 };
+    const TextureKey grassOtherFormat = { 1, 11 };
+
+    Check(table.Share(grass, 0x1000, 4096) == 0x1000, "new content keeps its surface");
+    Check(table.Share(grass, 0x2000, 4096) == 0x1000,
+        "same content gets the first surface");
+    Check(table.Share(grass, 0x3000, 4096) == 0x1000, "and a third");
+    Check(table.Share(water, 0x4000, 1024) == 0x4000, "other content is new");
+    Check(table.Share(grassOtherFormat, 0x5000, 8192) == 0x5000,
+        "other layout is new");
+    Check(table.References(grass) == 3, "3 references to grass, got " +
+        std::to_string(table.References(grass)));
+    Check(table.UniqueTextures() == 3, "3 distinct textures");
+    Check(table.SavedBytes() == 8192, "2 shared copies saved, got " +
+        std::to_string(table.SavedBytes()));
+
+    // Release goes by the shared surface, not the one the texture started with
+    Check(!table.Release(grass, 0x2000), "release with the wrong surface");
+    Check(table.References(grass) == 3, "a wrong release changes nothing");
+    Check(!table.Release(grass, 0x1000), "release a shared copy");
+    Check(table.SavedBytes() == 4096, "saved bytes drop with the copy");
+    Check(!table.Release(grass, 0x1000), "release another");
+    Check(table.SavedBytes() == 0, "nothing saved with one user");
+    Check(table.Release(grass, 0x1000), "the last release");
+    Check(table.References(grass) == 0 && table.UniqueTextures() == 2,
+        "the entry is gone");
+    Check(!table.Release(grass, 0x1000), "release of an unknown key");
+    Check(table.PeakSavedBytes() == 8192, "the peak stays, got " +
+        std::to_string(table.PeakSavedBytes()));
+
+    // Content registered again after its last release starts over
+    Check(table.Share(grass, 0x6000, 4096) == 0x6000, "grass again is new");
+    Check(table.SavedBytes() == 0, "still nothing saved");
+}
+
+int main() {
+    CheckHash();
+    CheckTable();
+    if (g_failures > 0) {
+        printf("%d checks failed.\n", g_failures);
+        return 1;
+    }
+    printf("All texture dedup checks passed.\n");
+    return 0;
+}
@@ -0,0 +1,198 @@
+// threadmontest: checks the Thread Monitor (ThreadMonitorEnabled=true): the
+// /proc/self/task sampler against threads this test starts, names and
+// busy time, then the usage tracker, thread naming and reports on made-up
+// samples.
+//
+// Build (Linux, from the repository root):
+//   g++ -std=c++17 -O2 -pthread -I"EE Tweaks Mod" -o threadmontest
+//       tools/threadmontest.cpp "EE Tweaks Mod/threadmon.cpp"
+//       "EE Tweaks Mod/modulemap.cpp"
+//
+// Usage: threadmontest
+//   Prints each failed check and exits with 1 if there was one.
+
+#include "pch.h"
+#include "threadmon.h"
+
+#include <cstdio>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static int g_failures = 0;
+
+static void Check(bool condition, const std::string& what) {
+    if (!condition) {
+        printf("FAILED: %s\n", what.c_str());
+        g_failures++;
+    }
+}
+
+static const ThreadSample* FindThread(const std::vector<ThreadSample>& threads,
+    uint32_t id) {
+    for (const ThreadSample& thread : threads) {
+        if (thread.id == id) {
+            return &thread;
+        }
+    }
+    return nullptr;
+}
+
+// --- Sampler ---
+
+struct TestThread {
+    std::atomic<uint32_t> id{ 0 };
+    std::atomic<bool> stop{ false };
+    std::thread thread;
+};
+
+// Name the thread, publish its id, then spin or sleep until stopped
+static void RunTestThread(TestThread* self, const char* name, bool busy) {
+    pthread_setname_np(pthread_self(), name);
+    self->id = static_cast<uint32_t>(syscall(SYS_gettid));
+    volatile uint64_t work = 0;
+    while (!self->stop) {
+        if (busy) {
+            for (int i = 0; i < 100000; ++i) work = work + i;
+        }
+        else {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+    }
+}
+
+static void CheckSampler() {
+    // A name with spaces and parentheses, as the stat line puts it in
+    // parentheses too
+    TestThread busy;
+    TestThread idle;
+    busy.thread = std::thread(RunTestThread, &busy, "sp (in) x", true);
+    idle.thread = std::thread(RunTestThread, &idle, "idler", false);
+    while (busy.id == 0 || idle.id == 0) {
+        std::this_thread::yield();
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(400));
+
+    std::vector<ThreadSample> threads;
+    Check(SampleProcessThreads(threads), "sample the threads");
+    Check(threads.size() >= 3, "at least 3 threads, got " +
+        std::to_string(threads.size()));
+    uint32_t mainId = static_cast<uint32_t>(getpid());
+    Check(FindThread(threads, mainId) != nullptr, "the main thread is listed");
+    const ThreadSample* spinner = FindThread(threads, busy.id);
+    const ThreadSample* sleeper = FindThread(threads, idle.id);
+    Check(spinner != nullptr && sleeper != nullptr, "both threads are listed");
+    if (spinner != nullptr && sleeper != nullptr) {
+        Check(spinner->name == "sp (in) x", "the name keeps its parentheses, got '" +
+            spinner->name + "'");
+        Check(sleeper->name == "idler", "the idle thread's name");
+        Check(spinner->startAddress == 0, "no start address on Linux");
+        // 400 ms of spinning, allowing for a loaded machine and tick rounding
+        Check(spinner->cpuMicros >= 100000, "the busy thread used CPU, got " +
+            std::to_string(spinner->cpuMicros) + " us");
+        Check(sleeper->cpuMicros < spinner->cpuMicros / 4,
+            "the idle thread used little CPU, got " +
+            std::to_string(sleeper->cpuMicros) + " us");
+    }
+
+    // Later samples only go up, and an ended thread is gone
+    uint64_t before = spinner != nullptr ? spinner->cpuMicros : 0;
+    uint32_t idleId = idle.id;
+    idle.stop = true;
+    idle.thread.join();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    Check(SampleProcessThreads(threads), "sample again");
+    spinner = FindThread(threads, busy.id);
+    Check(spinner != nullptr && spinner->cpuMicros >= before,
+        "CPU time never goes down");
+    Check(FindThread(threads, idleId) == nullptr, "an ended thread is gone");
+    busy.stop = true;
+    busy.thread.join();
+}
+
+// --- Tracker ---
+
+static void CheckTracker() {
+    ThreadUsageTracker tracker;
+    int identified = 0;
+    auto identify = [&identified](const ThreadSample& thread) {
+        identified++;
+        return "t" + std::to_string(thread.id);
+    };
+    const uint64_t S = 1000000;
+
+    // The first sample is a baseline: CPU used before it does not count
+    tracker.Update(10 * S, { { 1, 0x401000, "", 5 * S, 0 },
+        { 2, 0x10001000, "", 1 * S, 0 } }, identify);
+    Check(!tracker.HasInterval(), "no interval after one sample");
+    Check(tracker.Threads().size() == 2 && tracker.Threads()[0].cpuMicros == 0,
+        "a baseline on the first sample");
+
+    // 1 s later: thread 1 used a full core, thread 2 a quarter, 3 is new
+    tracker.Update(11 * S, { { 1, 0x401000, "", 6 * S, 0 },
+        { 2, 0x10001000, "", 1 * S + S / 4, 0 },
+        { 3, 0x402000, "", S / 2, 0 } }, identify);
+    const std::vector<ThreadUsage>& usage = tracker.Threads();
+    Check(tracker.HasInterval() && tracker.IntervalMicros() == S, "a 1 s interval");
+    Check(usage.size() == 3 && identified == 3, "3 threads, each named once");
+    Check(usage[0].utilization == 1.0 && usage[1].utilization == 0.25,
+        "utilization per thread");
+    Check(usage[2].cpuMicros == S / 2 && usage[2].firstSeenMicros == 10 * S,
+        "a new thread's CPU time all counts, from the last sample");
+    Check(tracker.ProcessUtilization() == 1.75, "process utilization");
+
+    // Thread 2 ends, and id 3 comes back with less CPU time: a new thread
+    tracker.Update(12 * S, { { 1, 0x401000, "", 6 * S + S / 2, 0 },
+        { 3, 0x402000, "", S / 10, 0 } }, identify);
+    Check(usage.size() == 4 && identified == 4, "a reused id is a new thread");
+    Check(!usage[1].alive && usage[1].utilization == 0.0, "thread 2 ended");
+    Check(!usage[2].alive && usage[3].alive && usage[3].id == 3,
+        "the old thread 3 ended and the new one is alive");
+    Check(usage[0].peakUtilization == 1.0 && usage[0].utilization == 0.5,
+        "peak and last utilization");
+    Check(tracker.MonitoredMicros() == 2 * S, "2 s monitored");
+
+    std::stringstream series;
+    WriteThreadSeriesHeader(series);
+    WriteThreadSeriesRows(series, tracker);
+    Check(series.str() == "seconds,thread,label,cpu_percent,megacycles\n"
+        "2.0,1,t1,50.0,0.00\n2.0,3,t3,10.0,0.00\n",
+        "series rows for the running threads:\n" + series.str());
+
+    std::vector<std::string> summary = SummarizeThreads(tracker, 2);
+    Check(summary.size() == 2 && summary[0].find("t1, thread 1: 1.5 s CPU") == 0 &&
+        summary[1].find("t3, thread 3: 0.5 s CPU") == 0 &&
+        summary[1].find(", ended)") != std::string::npos,
+        "the busiest threads first:\n" + (summary.empty() ? "" : summary[0]));
+}
+
+// --- Naming ---
+
+static void CheckNaming() {
+    ModuleMap modules;
+    modules.SetModules({ { "EE-AOC.exe", 0x400000, 0x200000 },
+        { "MSS32.DLL", 0x10000000, 0x50000 },
+        { "other.dll", 0x20000000, 0x10000 } });
+    Check(IdentifyThread({ 7, 0x401234, "", 0, 0 }, 7, modules) ==
+        "main (EE-AOC.exe+0x1234)", "the main thread");
+    Check(IdentifyThread({ 8, 0x10000010, "", 0, 0 }, 7, modules) ==
+        "Miles (MSS32.DLL+0x10)", "roles ignore case");
+    Check(IdentifyThread({ 9, 0x20000020, "", 0, 0 }, 7, modules) ==
+        "other.dll+0x20", "no role");
+    Check(IdentifyThread({ 10, 0, "worker", 0, 0 }, 7, modules) == "worker",
+        "the system name without a start address");
+    Check(IdentifyThread({ 11, 0, "", 0, 0 }, 7, modules) == "unknown",
+        "nothing known");
+}
+
+int main() {
+    CheckSampler();
+    CheckTracker();
+    CheckNaming();
+    if (g_failures > 0) {
+        printf("%d checks failed.\n", g_failures);
+        return 1;
+    }
+    printf("All thread monitor checks passed.\n");
+    return 0;
+}
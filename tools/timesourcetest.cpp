@@ -0,0 +1,130 @@
+// timesourcetest: checks the millisecond clock behind the redirected game
+// timers (HighResolutionTimersEnabled=true) against a fake counter:
+// conversion, wraparound, drift and corrections in both directions.
+//
+// Build (Linux, from the repository root):
+//   g++ -std=c++17 -O2 -I"EE Tweaks Mod" -o timesourcetest
+//       tools/timesourcetest.cpp "EE Tweaks Mod/timesource.cpp"
+//
+// Usage: timesourcetest
+//   Prints each failed check and exits with 1 if there was one.
+
+#include "pch.h"
+#include "timesource.h"
+
+#include <cstdio>
+
+static int g_failures = 0;
+
+static void Check(bool condition, const std::string& what) {
+    if (!condition) {
+        printf("FAILED: %s\n", what.c_str());
+        g_failures++;
+    }
+}
+
+// --- Conversion ---
+
+static void CheckConversion() {
+    // Typical counter rates: ACPI PM timer, HPET-derived 10 MHz, TSC-derived
+    const uint64_t frequencies[] = { 3579545, 10000000, 2900000000ULL };
+    for (uint64_t frequency : frequencies) {
+        std::string name = std::to_string(frequency) + " Hz: ";
+        MillisecondClock clock;
+        uint64_t base = frequency * 1000; // Counters do not start at 0
+        clock.Initialize(base, frequency, 5000);
+        // Reads go forward in time: the clock never returns less than before
+        uint64_t oneMs = (frequency + 999) / 1000;
+        Check(clock.Now(base) == 5000, name + "starts at the real clock");
+        Check(clock.Now(base + oneMs - 1) == 5000, name + "just under 1 ms later");
+        Check(clock.Now(base + oneMs) == 5001, name + "1 ms later");
+        Check(clock.Now(base + frequency * 3600) == 5000 + 3600000,
+            name + "an hour later, got " +
+            std::to_string(clock.Now(base + frequency * 3600)));
+        // A week of counts at this rate must not overflow the conversion
+        uint64_t week = frequency * 7 * 24 * 3600;
+        Check(clock.Now(base + week) == static_cast<uint32_t>(
+            5000 + 7ULL * 24 * 3600 * 1000), name + "a week later");
+    }
+
+    MillisecondClock clock;
+    clock.Initialize(1000, 1000, 0);
+    Check(clock.Now(500) == 0, "a counter before the base reads as the start");
+}
+
+static void CheckWraparound() {
+    // 10 ms before the 32-bit wrap, as after 49.7 days of uptime
+    MillisecondClock clock;
+    clock.Initialize(0, 1000, 0xFFFFFFF6u);
+    Check(clock.Now(5) == 0xFFFFFFFBu, "before the wrap");
+    Check(clock.Now(10) == 0, "at the wrap");
+    Check(clock.Now(25) == 15, "after the wrap");
+    Check(clock.Drift(25, 10) == 5, "drift across the wrap (ahead)");
+    MillisecondClock behind;
+    behind.Initialize(0, 1000, 0xFFFFFFF6u);
+    Check(behind.Drift(5, 3) == -8, "drift across the wrap (behind)");
+}
+
+// --- Corrections ---
+
+static void CheckCorrections() {
+    MillisecondClock clock;
+    clock.Initialize(0, 1000, 100000);
+
+    // Small differences are left alone
+    Check(clock.Correct(1000, 101010, 20) == -10, "10 ms behind is measured");
+    Check(clock.Now(1000) == 101000, "10 ms behind is not corrected");
+    Check(clock.Correct(1000, 100990, 20) == 10, "10 ms ahead is measured");
+    Check(clock.Now(1000) == 101000, "10 ms ahead is not corrected");
+
+    // Behind: pulled forward to the real clock
+    Check(clock.Correct(2000, 102050, 20) == -50, "50 ms behind");
+    Check(clock.Now(2000) == 102050, "moved forward to the real clock");
+    Check(clock.Now(2100) == 102150, "then runs on from there");
+
+    // Ahead: held until the counter catches up, never going backwards
+    Check(clock.Correct(3000, 102950, 20) == 100, "100 ms ahead");
+    uint32_t held = clock.Now(3000);
+    Check(held == 103050, "the clock keeps the value already handed out, got " +
+        std::to_string(held));
+    Check(clock.Now(3050) == 103050, "held while the counter catches up");
+    Check(clock.Now(3099) == 103050, "still held");
+    Check(clock.Now(3101) == 103051, "runs again once caught up");
+    Check(clock.Drift(3101, 103051) == 0, "back in step with the real clock");
+
+    // A real clock that jumped far ahead (e.g. after a long suspend)
+    Check(clock.Correct(4000, 200000, 20) < -20, "a large jump is measured");
+    Check(clock.Now(4000) == 200000, "and followed");
+
+    // Values never decrease across a sequence of corrections either way
+    MillisecondClock sequence;
+    sequence.Initialize(0, 1000, 0);
+    uint32_t last = 0;
+    bool monotonic = true;
+    for (uint64_t counter = 0; counter < 20000; counter += 7) {
+        // The real clock alternates between 60 ms behind and 60 ms ahead
+        uint32_t real = static_cast<uint32_t>(counter) +
+            ((counter / 1000) % 2 ? 60 : -60);
+        if (counter % 500 < 7) {
+            sequence.Correct(counter, real, 20);
+        }
+        uint32_t now = sequence.Now(counter);
+        if (static_cast<int32_t>(now - last) < 0) {
+            monotonic = false;
+        }
+        last = now;
+    }
+    Check(monotonic, "the clock never goes backwards");
+}
+
+int main() {
+    CheckConversion();
+    CheckWraparound();
+    CheckCorrections();
+    if (g_failures > 0) {
+        printf("%d checks failed.\n", g_failures);
+        return 1;
+    }
+    printf("All timer clock checks passed.\n");
+    return 0;
+}
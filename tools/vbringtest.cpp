@@ -0,0 +1,151 @@
+// vbringtest: checks the vertex ring allocator and the vertex format sizes
+// behind Managed Vertex Buffers (ManagedVertexBuffersEnabled=true). Ranges
+// handed out since the last discard must never overlap, and every wrap must
+// ask for a discard.
+//
+// Build (Linux, from the repository root):
+//   g++ -std=c++17 -O2 -I"EE Tweaks Mod" -o vbringtest tools/vbringtest.cpp
+//       "EE Tweaks Mod/vbring.cpp"
+//
+// Usage: vbringtest
+//   Prints each failed check and exits with 1 if there was one.
+
+#include "pch.h"
+#include "vbring.h"
+
+#include <cstdio>
+#include <random>
+
+static int g_failures = 0;
+
+static void Check(bool condition, const std::string& what) {
+    if (!condition) {
+        printf("FAILED: %s\n", what.c_str());
+        g_failures++;
+    }
+}
+
+// --- Vertex Formats ---
+
+static void CheckFormats() {
+    struct FormatCase {
+        uint32_t fvf;
+        uint32_t size;
+    };
+    const FormatCase cases[] = {
+        { 0x002, 12 },               // XYZ
+        { 0x004, 16 },               // XYZRHW
+        { 0x112, 32 },               // XYZ | NORMAL | TEX1
+        { 0x044, 20 },               // XYZRHW | DIFFUSE
+        { 0x1C4, 32 },               // XYZRHW | DIFFUSE | SPECULAR | TEX1
+        { 0x252, 44 },               // XYZ | NORMAL | DIFFUSE | TEX2
+        { 0x00C, 28 },               // XYZB4
+        { 0x102 | (1 << 16), 24 },   // XYZ | TEX1, 3 floats
+        { 0x102 | (3 << 16), 16 },   // XYZ | TEX1, 1 float
+        { 0x202 | (2 << 18), 36 },   // XYZ | TEX2, second set 4 floats
+        { 0x802, 12 + 8 * 8 },       // XYZ | TEX8
+        { 0x000, 0 },                // No position
+        { 0x902, 0 },                // 9 texture sets
+    };
+    for (const FormatCase& test : cases) {
+        std::stringstream ss;
+        ss << "format 0x" << std::hex << test.fvf;
+        Check(GetFvfVertexSize(test.fvf) == test.size, ss.str() + ": size " +
+            std::to_string(GetFvfVertexSize(test.fvf)) + ", expected " +
+            std::to_string(test.size));
+    }
+}
+
+// --- Ring Allocator ---
+
+static void CheckRing() {
+    VertexRing ring;
+    ring.Reset(100);
+    uint32_t epoch = ring.Epoch();
+    uint32_t offset = 0;
+    bool discard = false;
+
+    Check(!ring.Allocate(0, offset, discard), "an empty range is refused");
+    Check(!ring.Allocate(101, offset, discard), "a range over capacity is refused");
+    Check(ring.Allocate(40, offset, discard) && offset == 0 && discard,
+        "the first range discards");
+    Check(ring.Allocate(40, offset, discard) && offset == 40 && !discard,
+        "the next range follows without a discard");
+    Check(ring.IsCurrent(epoch), "no wrap yet");
+    Check(ring.Allocate(20, offset, discard) && offset == 80 && !discard,
+        "a range that ends the ring exactly fits");
+    Check(ring.Allocate(1, offset, discard) && offset == 0 && discard,
+        "a full ring wraps with a discard");
+    Check(!ring.IsCurrent(epoch) && ring.Wraps() == 1, "the wrap is counted");
+    Check(ring.Allocate(100, offset, discard) && offset == 0 && discard,
+        "a range of the whole ring wraps again");
+    Check(ring.Wraps() == 2, "2 wraps");
+
+    uint32_t before = ring.Epoch();
+    ring.Reset(50);
+    Check(ring.Epoch() != before && ring.Wraps() == 0 && ring.Capacity() == 50,
+        "reset starts a new epoch");
+    Check(ring.Allocate(10, offset, discard) && offset == 0 && discard,
+        "the first range after a reset discards");
+}
+
+// Random ranges: while the epoch stays the same, no two ranges overlap, as
+// the GPU may still be reading the earlier ones
+static void CheckRandomRing() {
+    std::mt19937 random(42);
+    const uint32_t capacities[] = { 1, 7, 1000, 65535 };
+    for (uint32_t capacity : capacities) {
+        std::string name = "capacity " + std::to_string(capacity) + ": ";
+        VertexRing ring;
+        ring.Reset(capacity);
+        std::vector<std::pair<uint32_t, uint32_t>> live; // offset, count
+        uint32_t epoch = ring.Epoch();
+        uint64_t discards = 0;
+        bool ok = true;
+        for (int i = 0; i < 20000 && ok; ++i) {
+            uint32_t count = 1 + random() % (capacity < 300 ? capacity : 300);
+            uint32_t offset = 0;
+            bool discard = false;
+            if (!ring.Allocate(count, offset, discard)) {
+                Check(false, name + "a range that fits is refused");
+                break;
+            }
+            if (discard) {
+                discards++;
+                live.clear();
+                epoch = ring.Epoch();
+            }
+            else if (!ring.IsCurrent(epoch)) {
+                Check(false, name + "the epoch changed without a discard");
+                ok = false;
+            }
+            if (offset + count > capacity) {
+                Check(false, name + "range past the end");
+                ok = false;
+            }
+            for (const auto& range : live) {
+                if (offset < range.first + range.second &&
+                    range.first < offset + count) {
+                    Check(false, name + "range overlaps one still in use");
+                    ok = false;
+                    break;
+                }
+            }
+            live.push_back({ offset, count });
+        }
+        Check(discards == ring.Wraps() + 1, name + "one discard per wrap, plus "
+            "the first range");
+    }
+}
+
+int main() {
+    CheckFormats();
+    CheckRing();
+    CheckRandomRing();
+    if (g_failures > 0) {
+        printf("%d checks failed.\n", g_failures);
+        return 1;
+    }
+    printf("All vertex ring checks passed.\n");
+    return 0;
+}
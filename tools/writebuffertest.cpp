@@ -0,0 +1,224 @@
+// writebuffertest: checks the write coalescer behind Write Coalescing
+// (WriteCoalescingEnabled=true). Random sequences of small and large writes,
+// seeks back over written data, position queries and reads go once straight
+// to one file and once through the coalescer to another, handled the way the
+// file hooks do; both files must hold the same bytes after the close.
+//
+// Build (Linux, from the repository root):
+//   g++ -std=c++17 -O2 -pthread -I"EE Tweaks Mod" -o writebuffertest
+//       tools/writebuffertest.cpp "EE Tweaks Mod/writebuffer.cpp"
+//
+// Usage: writebuffertest
+//   Prints each failed check and exits with 1 if there was one.
+
+#include "pch.h"
+#include "writebuffer.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <random>
+#include <unistd.h>
+#include <sys/stat.h>
+
+static int g_failures = 0;
+
+static void Check(bool condition, const std::string& what) {
+    if (!condition) {
+        printf("FAILED: %s\n", what.c_str());
+        g_failures++;
+    }
+}
+
+const size_t BUFFER_SIZE = 16 * 1024;
+
+static int CreateTestFile() {
+    char path[] = "/tmp/writebuffertestXXXXXX";
+    int fd = mkstemp(path);
+    if (fd >= 0) {
+        unlink(path);
+    }
+    return fd;
+}
+
+static std::vector<unsigned char> ReadFileContents(int fd) {
+    struct stat info;
+    std::vector<unsigned char> contents;
+    if (fstat(fd, &info) != 0) {
+        return contents;
+    }
+    contents.resize(static_cast<size_t>(info.st_size));
+    if (!contents.empty() &&
+        pread(fd, contents.data(), contents.size(), 0) !=
+        static_cast<ssize_t>(contents.size())) {
+        contents.clear();
+    }
+    return contents;
+}
+
+// --- Hooked File ---
+// What the file hooks do around a coalesced handle
+
+struct CoalescedFile {
+    WriteCoalescer& coalescer;
+    int fd;
+
+    bool Write(const unsigned char* data, uint32_t size) {
+        bool success = false;
+        return coalescer.Write(fd, data, size, success) && success;
+    }
+
+    // A FILE_CURRENT seek by 0 is answered without a flush
+    bool Tell(uint64_t& position) {
+        return coalescer.GetPosition(fd, position);
+    }
+
+    bool Seek(off_t offset, int origin) {
+        if (!coalescer.Flush(fd)) {
+            return false;
+        }
+        bool moved = lseek(fd, offset, origin) >= 0;
+        coalescer.Reposition(fd);
+        return moved;
+    }
+
+    bool Read(unsigned char* buffer, size_t size, ssize_t& count) {
+        if (!coalescer.Flush(fd)) {
+            return false;
+        }
+        count = read(fd, buffer, size);
+        return count >= 0;
+    }
+
+    bool Close() {
+        return coalescer.Detach(fd);
+    }
+};
+
+static bool WriteDirect(int fd, const unsigned char* data, size_t size) {
+    return write(fd, data, size) == static_cast<ssize_t>(size);
+}
+
+// --- Random Sessions ---
+
+static void CheckRandomSessions() {
+    std::mt19937 random(11);
+    WriteCoalescer coalescer(BUFFER_SIZE);
+    uint64_t gameWrites = 0;
+    for (int session = 0; session < 200; ++session) {
+        std::string name = "session " + std::to_string(session);
+        int direct = CreateTestFile();
+        int coalesced = CreateTestFile();
+        coalescer.Attach(coalesced);
+        CoalescedFile file = { coalescer, coalesced };
+        bool ok = true;
+
+        int operations = 50 + static_cast<int>(random() % 500);
+        for (int i = 0; i < operations && ok; ++i) {
+            uint32_t kind = random() % 100;
+            if (kind < 80) {
+                // Mostly tiny writes, now and then one as large as the buffer
+                size_t size = random() % 50 == 0 ? BUFFER_SIZE + random() % 5000 :
+                    random() % 10 == 0 ? random() % 3000 : 1 + random() % 16;
+                std::vector<unsigned char> data(size);
+                for (unsigned char& byte : data) {
+                    byte = static_cast<unsigned char>(random());
+                }
+                ok = WriteDirect(direct, data.data(), size) &&
+                    file.Write(data.data(), static_cast<uint32_t>(size));
+                gameWrites++;
+                Check(ok, name + ": write " + std::to_string(i));
+            }
+            else if (kind < 88) {
+                // Back over written data (the game patches its header), or
+                // past the end
+                off_t end = lseek(direct, 0, SEEK_END);
+                off_t offset = random() % 8 == 0 ? end + random() % 100 :
+                    static_cast<off_t>(random() % (end + 1));
+                ok = lseek(direct, offset, SEEK_SET) == offset &&
+                    file.Seek(offset, SEEK_SET);
+                Check(ok, name + ": seek " + std::to_string(i));
+            }
+            else if (kind < 92) {
+                ok = lseek(direct, 0, SEEK_END) >= 0 && file.Seek(0, SEEK_END);
+                Check(ok, name + ": seek to the end " + std::to_string(i));
+            }
+            else if (kind < 97) {
+                uint64_t position = 0;
+                Check(file.Tell(position) &&
+                    position == static_cast<uint64_t>(lseek(direct, 0, SEEK_CUR)),
+                    name + ": position " + std::to_string(position) +
+                    " at operation " + std::to_string(i));
+            }
+            else {
+                // A read sees what was written, even the buffered part
+                unsigned char expected[256];
+                unsigned char got[256];
+                ssize_t expectedCount = read(direct, expected, sizeof(expected));
+                ssize_t count = 0;
+                ok = file.Read(got, sizeof(got), count);
+                Check(ok && count == expectedCount &&
+                    memcmp(expected, got, count > 0 ? count : 0) == 0,
+                    name + ": read " + std::to_string(i));
+            }
+        }
+        Check(file.Close(), name + ": close flushes");
+        Check(!coalescer.IsAttached(coalesced), name + ": detached on close");
+        std::vector<unsigned char> expected = ReadFileContents(direct);
+        Check(!expected.empty() && ReadFileContents(coalesced) == expected,
+            name + ": the files are the same, " +
+            std::to_string(expected.size()) + " bytes");
+        close(direct);
+        close(coalesced);
+    }
+    Check(coalescer.AttachedFiles() == 0, "no files left attached");
+    Check(coalescer.NativeWrites() * 4 < gameWrites, "coalescing cut the "
+        "writes to " + std::to_string(coalescer.NativeWrites()) + " of " +
+        std::to_string(gameWrites));
+}
+
+// --- Failures ---
+
+static void CheckFailures() {
+    // Writes to a read-only descriptor fail once they reach the file
+    int fd = CreateTestFile();
+    int readOnly = open(("/proc/self/fd/" + std::to_string(fd)).c_str(),
+        O_RDONLY);
+    Check(readOnly >= 0, "open read-only");
+    WriteCoalescer coalescer(BUFFER_SIZE);
+    coalescer.Attach(readOnly);
+    unsigned char data[100] = { 0 };
+    bool success = false;
+    Check(coalescer.Write(readOnly, data, sizeof(data), success) && success,
+        "a buffered write succeeds");
+    Check(!coalescer.Flush(readOnly), "the failure shows up at the flush");
+    Check(coalescer.Write(readOnly, data, sizeof(data), success) && success,
+        "buffering goes on after a failure");
+    Check(!coalescer.Detach(readOnly), "and at the close");
+    std::vector<unsigned char> large(BUFFER_SIZE * 2);
+    coalescer.Attach(readOnly);
+    Check(coalescer.Write(readOnly, large.data(),
+        static_cast<uint32_t>(large.size()), success) && !success,
+        "a large write fails at once");
+    coalescer.Detach(readOnly);
+    close(readOnly);
+    close(fd);
+
+    // Not attached: left to the caller
+    Check(!coalescer.Write(12345, data, sizeof(data), success),
+        "a write to a file that is not attached is not taken");
+    uint64_t position = 0;
+    Check(!coalescer.GetPosition(12345, position) && coalescer.Flush(12345),
+        "nothing to flush for a file that is not attached");
+}
+
+int main() {
+    CheckRandomSessions();
+    CheckFailures();
+    if (g_failures > 0) {
+        printf("%d checks failed.\n", g_failures);
+        return 1;
+    }
+    printf("All write coalescing checks passed.\n");
+    return 0;
+}